@@ -10,6 +10,11 @@
 #include <common_macros.h>
 #include <app_priv.h>
 #include <app_reset.h>
+#include <esp_diagnostics_system_metrics.h>
+#if CONFIG_DIAG_ENABLE_TASK_METRICS && !CONFIG_ESP_INSIGHTS_ENABLED
+#include <esp_diagnostics_metrics.h>
+#include <esp_rmaker_work_queue.h>
+#endif
 
 #if CHIP_DEVICE_CONFIG_ENABLE_THREAD
 #include <platform/ESP32/OpenthreadLauncher.h>
@@ -19,6 +24,9 @@
 #include <app/server/Server.h>
 
 #include "pid_controller.h"
+#if CONFIG_APP_OTA_DELTA_IMAGES
+#include "app_ota_image_processor.h"
+#endif
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <cmath>
@@ -91,6 +99,33 @@ static void temp_control_task(void *arg)
     }
 }
 
+#if CONFIG_DIAG_ENABLE_TASK_METRICS && !CONFIG_ESP_INSIGHTS_ENABLED
+// Without Insights nothing stores the metrics, the task metrics log the CPU load of every report
+static esp_err_t app_metrics_write_cb(const char *group, void *data, size_t len, void *cb_arg)
+{
+    return ESP_OK;
+}
+
+// Insights starts the task metrics with its system metrics, without it the app starts them itself
+static esp_err_t app_task_metrics_init(void)
+{
+    esp_diag_metrics_config_t metrics_config = {
+        .write_cb = app_metrics_write_cb,
+    };
+    esp_err_t err = esp_rmaker_work_queue_init();
+    if (err == ESP_OK) {
+        err = esp_rmaker_work_queue_start();
+    }
+    if (err == ESP_OK) {
+        err = esp_diag_metrics_init(&metrics_config);
+    }
+    if (err == ESP_OK) {
+        err = esp_diag_task_metrics_init();
+    }
+    return err;
+}
+#endif
+
 void app_main() {
     esp_err_t err;
 
@@ -102,6 +137,11 @@ void app_main() {
     }
     ESP_ERROR_CHECK(err);
 
+#if CONFIG_APP_OTA_DELTA_IMAGES
+    // The OTA requestor is started with Matter, its image processor has to be set before
+    ESP_ERROR_CHECK(app_ota_image_processor_init());
+#endif
+
     err = esp_matter::start(app_event_cb);
     ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "Failed to start Matter, err:%d", err));
 
@@ -204,6 +244,16 @@ void app_main() {
 
     // Matter console
     esp_matter_console_init();
+#if CONFIG_DIAG_ENABLE_TASK_METRICS
+    // "task-top" shows CPU share of CHIP, wifi, temp_ctrl and other tasks
+    esp_diag_task_metrics_register_cmd();
+#if !CONFIG_ESP_INSIGHTS_ENABLED
+    err = app_task_metrics_init();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to start task metrics, err:%d", err);
+    }
+#endif
+#endif
     esp_matter_console_start();
 
 #if CONFIG_ENABLE_OTA_REQUESTOR
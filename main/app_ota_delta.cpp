@@ -0,0 +1,393 @@
+#include "app_ota_delta.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_app_format.h"
+#include "esp_delta_ota.h"
+#include "esp_encrypted_img.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "sdkconfig.h"
+#if CONFIG_APP_OTA_PIPELINE
+#include "app_ota_pipe.h"
+#endif
+
+static const char *TAG = "app_ota_delta";
+
+// Patch header of esp_delta_ota (see esp_delta_ota_patch_gen.py): magic, SHA-256 of the base app, reserved.
+// With --new_digest, the first reserved word is the size of the header, which ends with the SHA-256 of the
+// new app, 0 in older headers.
+#define PATCH_HEADER_SIZE           64
+#define PATCH_MAGIC                 0xfccdde10
+#define PATCH_DIGEST_OFFSET         4
+#define PATCH_DIGEST_SIZE           32
+#define PATCH_HEADER_SIZE_OFFSET    (PATCH_DIGEST_OFFSET + PATCH_DIGEST_SIZE)
+#define PATCH_NEW_DIGEST_OFFSET     PATCH_HEADER_SIZE
+#define PATCH_HEADER_MAX_SIZE       (PATCH_NEW_DIGEST_OFFSET + PATCH_DIGEST_SIZE)
+
+#if CONFIG_APP_OTA_PIPELINE
+// Stages of the pipeline, at the priority of the CHIP task which receives the image, the flash stage
+// above so that the next erase starts as soon as a block is patched. RSA of the decrypt stage needs the
+// larger stack.
+#define DECRYPT_TASK_STACK  6144
+#define PATCH_TASK_STACK    4096
+#define FLASH_TASK_STACK    3072
+#define DECRYPT_TASK_PRIO   1
+#define PATCH_TASK_PRIO     1
+#define FLASH_TASK_PRIO     2
+#endif
+
+typedef enum {
+    APP_OTA_DETECT,     // first bytes of the image not received yet
+    APP_OTA_FULL,
+    APP_OTA_PATCH,
+} app_ota_mode_t;
+
+typedef enum {
+    APP_OTA_STAGE_DECRYPT,
+    APP_OTA_STAGE_PATCH,
+    APP_OTA_STAGE_FLASH,
+} app_ota_stage_t;
+
+struct app_ota_delta {
+    esp_ota_handle_t ota;
+    esp_decrypt_handle_t decrypt;
+    app_ota_mode_t mode;
+    esp_delta_ota_handle_t patch;
+    uint8_t header[PATCH_HEADER_MAX_SIZE];
+    size_t header_len;
+    esp_image_header_t image_header;    // held back until the chip id is checked
+    size_t image_header_len;
+#if CONFIG_APP_OTA_PIPELINE
+    // receive -> decrypt_pipe -> patch_pipe -> flash_pipe, without decrypt_pipe for plain images
+    app_ota_pipe_handle_t decrypt_pipe;
+    app_ota_pipe_handle_t patch_pipe;
+    app_ota_pipe_handle_t flash_pipe;
+#endif
+};
+
+// Source of the patch, read_cb of esp_delta_ota has no user data. There is one update at a time.
+static const esp_partition_t *s_running_partition;
+static esp_decrypt_cfg_t s_decrypt_cfg;
+
+static esp_err_t flash_write(void *ctx, const uint8_t *data, size_t size)
+{
+    return esp_ota_write(((app_ota_delta_handle_t)ctx)->ota, data, size);
+}
+
+static esp_err_t to_flash_write(app_ota_delta_handle_t handle, const uint8_t *data, size_t size)
+{
+#if CONFIG_APP_OTA_PIPELINE
+    return app_ota_pipe_write(handle->flash_pipe, data, size);
+#else
+    return flash_write(handle, data, size);
+#endif
+}
+
+static esp_err_t ota_write(app_ota_delta_handle_t handle, const uint8_t *data, size_t size)
+{
+    if (handle->image_header_len < sizeof(esp_image_header_t)) {
+        size_t len = MIN(size, sizeof(esp_image_header_t) - handle->image_header_len);
+        memcpy((uint8_t *)&handle->image_header + handle->image_header_len, data, len);
+        handle->image_header_len += len;
+        data += len;
+        size -= len;
+        if (handle->image_header_len < sizeof(esp_image_header_t)) {
+            return ESP_OK;
+        }
+        if (handle->image_header.chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+            ESP_LOGE(TAG, "Mismatch chip id, expected %d, found %d", CONFIG_IDF_FIRMWARE_CHIP_ID,
+                     handle->image_header.chip_id);
+            return ESP_ERR_INVALID_VERSION;
+        }
+        esp_err_t err = to_flash_write(handle, (const uint8_t *)&handle->image_header, sizeof(esp_image_header_t));
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return size ? to_flash_write(handle, data, size) : ESP_OK;
+}
+
+static esp_err_t patch_write_cb(const uint8_t *buf_p, size_t size, void *user_data)
+{
+    return ota_write((app_ota_delta_handle_t)user_data, buf_p, size);
+}
+
+static esp_err_t patch_read_cb(uint8_t *buf_p, size_t size, int src_offset)
+{
+    return esp_partition_read(s_running_partition, src_offset, buf_p, size);
+}
+
+static uint32_t patch_header_size_field(app_ota_delta_handle_t handle)
+{
+    uint32_t header_size;
+    memcpy(&header_size, handle->header + PATCH_HEADER_SIZE_OFFSET, sizeof(header_size));
+    return header_size;
+}
+
+// Size of the patch header, known once its first PATCH_HEADER_SIZE bytes are received
+static size_t patch_header_size(app_ota_delta_handle_t handle)
+{
+    if (handle->header_len < PATCH_HEADER_SIZE) {
+        return PATCH_HEADER_SIZE;
+    }
+    return patch_header_size_field(handle) == PATCH_HEADER_MAX_SIZE ? PATCH_HEADER_MAX_SIZE : PATCH_HEADER_SIZE;
+}
+
+static esp_err_t patch_begin(app_ota_delta_handle_t handle)
+{
+    uint32_t magic;
+    uint8_t sha_256[PATCH_DIGEST_SIZE];
+
+    memcpy(&magic, handle->header, sizeof(magic));
+    if (magic != PATCH_MAGIC) {
+        ESP_LOGE(TAG, "Neither an app image nor a delta patch");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    uint32_t header_size = patch_header_size_field(handle);
+    if (header_size != 0 && header_size != PATCH_HEADER_MAX_SIZE) {
+        ESP_LOGE(TAG, "Unsupported delta patch header size %u", (unsigned)header_size);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    s_running_partition = esp_ota_get_running_partition();
+    esp_err_t err = esp_partition_get_sha256(s_running_partition, sha_256);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (memcmp(sha_256, handle->header + PATCH_DIGEST_OFFSET, PATCH_DIGEST_SIZE) != 0) {
+        ESP_LOGE(TAG, "Delta patch is not for the running firmware");
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    esp_delta_ota_cfg_t cfg = {};
+    cfg.user_data = handle;
+    cfg.read_cb = patch_read_cb;
+    cfg.write_cb_with_user_data = patch_write_cb;
+    // the new app is checked against its SHA-256 while it is patched
+    cfg.expected_sha256 = header_size ? handle->header + PATCH_NEW_DIGEST_OFFSET : NULL;
+    handle->patch = esp_delta_ota_init(&cfg);
+    if (handle->patch == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    handle->mode = APP_OTA_PATCH;
+    ESP_LOGI(TAG, "Applying delta patch to %s", s_running_partition->label);
+    return ESP_OK;
+}
+
+// Plain image: a full app image or a delta patch
+static esp_err_t image_write(void *ctx, const uint8_t *data, size_t size)
+{
+    app_ota_delta_handle_t handle = (app_ota_delta_handle_t)ctx;
+
+    if (handle->mode == APP_OTA_DETECT) {
+        // the size of the patch header is known once its first bytes are in
+        while (size > 0 && handle->header_len < patch_header_size(handle)) {
+            size_t len = MIN(size, patch_header_size(handle) - handle->header_len);
+            memcpy(handle->header + handle->header_len, data, len);
+            handle->header_len += len;
+            data += len;
+            size -= len;
+        }
+
+        esp_err_t err;
+        if (handle->header[0] == ESP_IMAGE_HEADER_MAGIC) {
+            handle->mode = APP_OTA_FULL;
+            err = ota_write(handle, handle->header, handle->header_len);
+        } else if (handle->header_len < patch_header_size(handle)) {
+            return ESP_OK;
+        } else {
+            err = patch_begin(handle);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    if (size == 0) {
+        return ESP_OK;
+    }
+    if (handle->mode == APP_OTA_FULL) {
+        return ota_write(handle, data, size);
+    }
+    return esp_delta_ota_feed_patch(handle->patch, data, size);
+}
+
+static esp_err_t to_image_write(app_ota_delta_handle_t handle, const uint8_t *data, size_t size)
+{
+#if CONFIG_APP_OTA_PIPELINE
+    return app_ota_pipe_write(handle->patch_pipe, data, size);
+#else
+    return image_write(handle, data, size);
+#endif
+}
+
+static esp_err_t decrypt_write(void *ctx, const uint8_t *data, size_t size)
+{
+    app_ota_delta_handle_t handle = (app_ota_delta_handle_t)ctx;
+    pre_enc_decrypt_arg_t args = {};
+
+    args.data_in = (const char *)data;
+    args.data_in_len = size;
+    esp_err_t err = esp_encrypted_img_decrypt_data(handle->decrypt, &args);
+    if (err == ESP_ERR_NOT_FINISHED) {
+        err = ESP_OK;
+    }
+    if (err == ESP_OK && args.data_out_len > 0) {
+        err = to_image_write(handle, (const uint8_t *)args.data_out, args.data_out_len);
+    }
+    free(args.data_out);
+    return err;
+}
+
+// Waits for the data written to the stage to be processed
+static esp_err_t sync_stage(app_ota_delta_handle_t handle, app_ota_stage_t stage)
+{
+#if CONFIG_APP_OTA_PIPELINE
+    app_ota_pipe_handle_t pipes[] = {handle->decrypt_pipe, handle->patch_pipe, handle->flash_pipe};
+    return pipes[stage] ? app_ota_pipe_sync(pipes[stage]) : ESP_OK;
+#else
+    (void)handle;
+    (void)stage;
+    return ESP_OK;
+#endif
+}
+
+// Stops the stages before the OTA is ended or aborted, they drop what they have not processed
+static void stop_stages(app_ota_delta_handle_t handle)
+{
+#if CONFIG_APP_OTA_PIPELINE
+    app_ota_pipe_handle_t *pipes[] = {&handle->decrypt_pipe, &handle->patch_pipe, &handle->flash_pipe};
+    // upstream first, a stage may be writing to the next one
+    for (int i = APP_OTA_STAGE_DECRYPT; i <= APP_OTA_STAGE_FLASH; i++) {
+        if (*pipes[i]) {
+            app_ota_pipe_delete(*pipes[i]);
+            *pipes[i] = NULL;
+        }
+    }
+#else
+    (void)handle;
+#endif
+}
+
+static void release(app_ota_delta_handle_t handle)
+{
+    if (handle->decrypt) {
+        esp_encrypted_img_decrypt_abort(handle->decrypt);
+    }
+    if (handle->patch) {
+        esp_delta_ota_deinit(handle->patch);
+    }
+    free(handle);
+}
+
+void app_ota_delta_set_decrypt_key(const char *rsa_priv_key, size_t rsa_priv_key_len)
+{
+    s_decrypt_cfg.rsa_priv_key = rsa_priv_key;
+    s_decrypt_cfg.rsa_priv_key_len = rsa_priv_key_len;
+}
+
+esp_err_t app_ota_delta_begin(const esp_partition_t *update_partition, app_ota_delta_handle_t *out_handle)
+{
+    app_ota_delta_handle_t handle = (app_ota_delta_handle_t)calloc(1, sizeof(struct app_ota_delta));
+    if (handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &handle->ota);
+    if (err != ESP_OK) {
+        free(handle);
+        return err;
+    }
+    if (s_decrypt_cfg.rsa_priv_key) {
+        handle->decrypt = esp_encrypted_img_decrypt_start(&s_decrypt_cfg);
+        if (handle->decrypt == NULL) {
+            err = ESP_ERR_NO_MEM;
+        }
+    }
+#if CONFIG_APP_OTA_PIPELINE
+    if (err == ESP_OK) {
+        err = app_ota_pipe_create("ota_flash", FLASH_TASK_STACK, FLASH_TASK_PRIO, flash_write, handle, &handle->flash_pipe);
+    }
+    if (err == ESP_OK) {
+        err = app_ota_pipe_create("ota_patch", PATCH_TASK_STACK, PATCH_TASK_PRIO, image_write, handle, &handle->patch_pipe);
+    }
+    if (err == ESP_OK && handle->decrypt) {
+        err = app_ota_pipe_create("ota_decrypt", DECRYPT_TASK_STACK, DECRYPT_TASK_PRIO, decrypt_write, handle,
+                                  &handle->decrypt_pipe);
+    }
+#endif
+    if (err != ESP_OK) {
+        stop_stages(handle);
+        esp_ota_abort(handle->ota);
+        release(handle);
+        return err;
+    }
+    *out_handle = handle;
+    return ESP_OK;
+}
+
+esp_err_t app_ota_delta_write(app_ota_delta_handle_t handle, const uint8_t *data, size_t size)
+{
+    if (handle->decrypt) {
+#if CONFIG_APP_OTA_PIPELINE
+        return app_ota_pipe_write(handle->decrypt_pipe, data, size);
+#else
+        return decrypt_write(handle, data, size);
+#endif
+    }
+    return to_image_write(handle, data, size);
+}
+
+bool app_ota_delta_is_patch(app_ota_delta_handle_t handle)
+{
+    // the patch stage tells once it has the first bytes of the image
+    sync_stage(handle, APP_OTA_STAGE_DECRYPT);
+    sync_stage(handle, APP_OTA_STAGE_PATCH);
+    return handle->mode == APP_OTA_PATCH;
+}
+
+esp_err_t app_ota_delta_end(app_ota_delta_handle_t handle)
+{
+    // every stage completes before the next is synced, finishing a stage writes to the next
+    esp_err_t err = sync_stage(handle, APP_OTA_STAGE_DECRYPT);
+
+    if (handle->decrypt) {
+        if (err == ESP_OK && !esp_encrypted_img_is_complete_data_received(handle->decrypt)) {
+            ESP_LOGE(TAG, "Encrypted image truncated");
+            err = ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        if (err == ESP_OK) {
+            // checks the authentication tag and frees the handle
+            err = esp_encrypted_img_decrypt_end(handle->decrypt);
+            handle->decrypt = NULL;
+        }
+    }
+    if (err == ESP_OK) {
+        err = sync_stage(handle, APP_OTA_STAGE_PATCH);
+    }
+    if (err == ESP_OK && handle->patch) {
+        err = esp_delta_ota_finalize(handle->patch);
+    }
+    if (err == ESP_OK && handle->image_header_len < sizeof(esp_image_header_t)) {
+        ESP_LOGE(TAG, "Image too short");
+        err = ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    if (err == ESP_OK) {
+        err = sync_stage(handle, APP_OTA_STAGE_FLASH);
+    }
+    stop_stages(handle);
+    if (err == ESP_OK) {
+        // validates the image, hash included
+        err = esp_ota_end(handle->ota);
+    } else {
+        esp_ota_abort(handle->ota);
+    }
+    release(handle);
+    return err;
+}
+
+void app_ota_delta_abort(app_ota_delta_handle_t handle)
+{
+    stop_stages(handle);
+    esp_ota_abort(handle->ota);
+    release(handle);
+}
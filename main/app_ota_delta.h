@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Writes an OTA image to the update partition. The image is either a full app image or an esp_delta_ota
+// patch of the running app (64 bytes patch header, then a detools patch), told apart by its first bytes.
+// Patches are applied while they are received, reading the running partition as the source, and checked
+// against the SHA-256 of the new app when their header carries it.
+// With CONFIG_APP_OTA_PIPELINE, decryption, patching and flash writes run on tasks of their own, writes
+// return once the data is queued and errors of the stages are returned by the next writes or by end.
+typedef struct app_ota_delta *app_ota_delta_handle_t;
+
+// Images begun after this call are esp_encrypted_img images, decrypted with the RSA key (PEM). The key is
+// not copied.
+void app_ota_delta_set_decrypt_key(const char *rsa_priv_key, size_t rsa_priv_key_len);
+
+esp_err_t app_ota_delta_begin(const esp_partition_t *update_partition, app_ota_delta_handle_t *out_handle);
+esp_err_t app_ota_delta_write(app_ota_delta_handle_t handle, const uint8_t *data, size_t size);
+// Waits for the data written to be decrypted and patched
+bool app_ota_delta_is_patch(app_ota_delta_handle_t handle);
+// Completes and validates the image, frees the handle
+esp_err_t app_ota_delta_end(app_ota_delta_handle_t handle);
+// Drops the image, frees the handle
+void app_ota_delta_abort(app_ota_delta_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
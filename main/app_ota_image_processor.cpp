@@ -0,0 +1,273 @@
+#include "sdkconfig.h"
+
+#if CONFIG_APP_OTA_DELTA_IMAGES
+
+#include "app_ota_image_processor.h"
+
+#include <app/clusters/ota-requestor/BDXDownloader.h>
+#include <app/clusters/ota-requestor/OTARequestorInterface.h>
+#include <cinttypes>
+#include <esp_log.h>
+#include <esp_matter_ota.h>
+#include <esp_ota_ops.h>
+#include <esp_system.h>
+#include <lib/support/CHIPMem.h>
+#include <lib/support/CodeUtils.h>
+#include <lib/support/Span.h>
+
+using namespace chip;
+
+// Downloader of esp_matter_ota.cpp. esp_matter_ota_requestor_start() hands it to the default image
+// processor only and esp_matter has no API to get it, this one has to be given it as well. It is not a
+// public symbol of esp_matter: with an esp_matter which no longer has it, or has it static, the link fails
+// on this reference rather than the app running without delta images.
+extern BDXDownloader gDownloader;
+
+static const char *TAG = "app_ota_processor";
+
+static AppOTAImageProcessor s_image_processor;
+
+namespace {
+
+void PostOTAStateChangeEvent(DeviceLayer::OtaState newState)
+{
+    DeviceLayer::ChipDeviceEvent otaChange;
+    otaChange.Type                     = DeviceLayer::DeviceEventType::kOtaStateChanged;
+    otaChange.OtaStateChanged.newState = newState;
+    CHIP_ERROR error                   = DeviceLayer::PlatformMgr().PostEvent(&otaChange);
+    if (error != CHIP_NO_ERROR) {
+        ESP_LOGE(TAG, "Error while posting OtaChange event %" CHIP_ERROR_FORMAT, error.Format());
+    }
+}
+
+void HandleRestart(System::Layer *, void *)
+{
+    esp_restart();
+}
+
+} // namespace
+
+CHIP_ERROR AppOTAImageProcessor::PrepareDownload()
+{
+    DeviceLayer::PlatformMgr().ScheduleWork(HandlePrepareDownload, reinterpret_cast<intptr_t>(this));
+    return CHIP_NO_ERROR;
+}
+
+CHIP_ERROR AppOTAImageProcessor::Finalize()
+{
+    DeviceLayer::PlatformMgr().ScheduleWork(HandleFinalize, reinterpret_cast<intptr_t>(this));
+    return CHIP_NO_ERROR;
+}
+
+CHIP_ERROR AppOTAImageProcessor::Apply()
+{
+    DeviceLayer::PlatformMgr().ScheduleWork(HandleApply, reinterpret_cast<intptr_t>(this));
+    return CHIP_NO_ERROR;
+}
+
+CHIP_ERROR AppOTAImageProcessor::Abort()
+{
+    DeviceLayer::PlatformMgr().ScheduleWork(HandleAbort, reinterpret_cast<intptr_t>(this));
+    return CHIP_NO_ERROR;
+}
+
+CHIP_ERROR AppOTAImageProcessor::ProcessBlock(ByteSpan &block)
+{
+    CHIP_ERROR err = SetBlock(block);
+    if (err != CHIP_NO_ERROR) {
+        ESP_LOGE(TAG, "Cannot set block data: %" CHIP_ERROR_FORMAT, err.Format());
+        return err;
+    }
+    DeviceLayer::PlatformMgr().ScheduleWork(HandleProcessBlock, reinterpret_cast<intptr_t>(this));
+    return CHIP_NO_ERROR;
+}
+
+bool AppOTAImageProcessor::IsFirstImageRun()
+{
+    OTARequestorInterface *requestor = GetRequestorInstance();
+    if (requestor == nullptr) {
+        return false;
+    }
+    return requestor->GetCurrentUpdateState() == OTARequestorInterface::OTAUpdateStateEnum::kApplying;
+}
+
+CHIP_ERROR AppOTAImageProcessor::ConfirmCurrentImage()
+{
+    OTARequestorInterface *requestor = GetRequestorInstance();
+    if (requestor == nullptr) {
+        return CHIP_ERROR_INTERNAL;
+    }
+    uint32_t currentVersion;
+    ReturnErrorOnFailure(DeviceLayer::ConfigurationMgr().GetSoftwareVersion(currentVersion));
+    if (currentVersion != requestor->GetTargetVersion()) {
+        return CHIP_ERROR_INCORRECT_STATE;
+    }
+    return CHIP_NO_ERROR;
+}
+
+void AppOTAImageProcessor::HandlePrepareDownload(intptr_t context)
+{
+    auto *imageProcessor = reinterpret_cast<AppOTAImageProcessor *>(context);
+    if (imageProcessor->mDownloader == nullptr) {
+        ESP_LOGE(TAG, "mDownloader is null");
+        return;
+    }
+    imageProcessor->mOTAUpdatePartition = esp_ota_get_next_update_partition(NULL);
+    if (imageProcessor->mOTAUpdatePartition == NULL) {
+        ESP_LOGE(TAG, "OTA partition not found");
+        imageProcessor->mDownloader->OnPreparedForDownload(CHIP_ERROR_INTERNAL);
+        return;
+    }
+    esp_err_t err = app_ota_delta_begin(imageProcessor->mOTAUpdatePartition, &imageProcessor->mOTAUpdate);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to begin OTA (%s)", esp_err_to_name(err));
+        imageProcessor->mDownloader->OnPreparedForDownload(CHIP_ERROR_INTERNAL);
+        return;
+    }
+    imageProcessor->mHeaderParser.Init();
+    imageProcessor->mDownloader->OnPreparedForDownload(CHIP_NO_ERROR);
+    PostOTAStateChangeEvent(DeviceLayer::kOtaDownloadInProgress);
+}
+
+void AppOTAImageProcessor::HandleFinalize(intptr_t context)
+{
+    auto *imageProcessor = reinterpret_cast<AppOTAImageProcessor *>(context);
+    if (imageProcessor->mOTAUpdate == nullptr) {
+        return;
+    }
+    bool patch = app_ota_delta_is_patch(imageProcessor->mOTAUpdate);
+    esp_err_t err = app_ota_delta_end(imageProcessor->mOTAUpdate);
+    imageProcessor->mOTAUpdate = nullptr;
+    imageProcessor->ReleaseBlock();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "OTA image %s failed (%s)", patch ? "patching" : "validation", esp_err_to_name(err));
+        PostOTAStateChangeEvent(DeviceLayer::kOtaDownloadFailed);
+        return;
+    }
+    ESP_LOGI(TAG, "OTA image %s to offset 0x%" PRIx32, patch ? "patched" : "downloaded",
+             imageProcessor->mOTAUpdatePartition->address);
+    PostOTAStateChangeEvent(DeviceLayer::kOtaDownloadComplete);
+}
+
+void AppOTAImageProcessor::HandleAbort(intptr_t context)
+{
+    auto *imageProcessor = reinterpret_cast<AppOTAImageProcessor *>(context);
+    if (imageProcessor->mOTAUpdate != nullptr) {
+        app_ota_delta_abort(imageProcessor->mOTAUpdate);
+        imageProcessor->mOTAUpdate = nullptr;
+    }
+    imageProcessor->ReleaseBlock();
+    PostOTAStateChangeEvent(DeviceLayer::kOtaDownloadAborted);
+}
+
+void AppOTAImageProcessor::HandleProcessBlock(intptr_t context)
+{
+    auto *imageProcessor = reinterpret_cast<AppOTAImageProcessor *>(context);
+    if (imageProcessor->mDownloader == nullptr) {
+        ESP_LOGE(TAG, "mDownloader is null");
+        return;
+    }
+    if (imageProcessor->mOTAUpdate == nullptr) {
+        imageProcessor->mDownloader->EndDownload(CHIP_ERROR_INCORRECT_STATE);
+        return;
+    }
+
+    ByteSpan block = ByteSpan(imageProcessor->mBlock.data(), imageProcessor->mBlock.size());
+    CHIP_ERROR error = imageProcessor->ProcessHeader(block);
+    if (error != CHIP_NO_ERROR) {
+        ESP_LOGE(TAG, "Failed to process OTA image header");
+        imageProcessor->mDownloader->EndDownload(error);
+        PostOTAStateChangeEvent(DeviceLayer::kOtaDownloadFailed);
+        return;
+    }
+
+    // The payload after the Matter OTA image header, a full app image or a delta patch
+    esp_err_t err = app_ota_delta_write(imageProcessor->mOTAUpdate, block.data(), block.size());
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write OTA image (%s)", esp_err_to_name(err));
+        imageProcessor->mDownloader->EndDownload(CHIP_ERROR_WRITE_FAILED);
+        PostOTAStateChangeEvent(DeviceLayer::kOtaDownloadFailed);
+        return;
+    }
+    imageProcessor->mParams.downloadedBytes += block.size();
+    imageProcessor->mDownloader->FetchNextData();
+}
+
+void AppOTAImageProcessor::HandleApply(intptr_t context)
+{
+    auto *imageProcessor = reinterpret_cast<AppOTAImageProcessor *>(context);
+    PostOTAStateChangeEvent(DeviceLayer::kOtaApplyInProgress);
+    esp_err_t err = esp_ota_set_boot_partition(imageProcessor->mOTAUpdatePartition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed (%s)!", esp_err_to_name(err));
+        PostOTAStateChangeEvent(DeviceLayer::kOtaApplyFailed);
+        return;
+    }
+    ESP_LOGI(TAG, "Applying, Boot partition set offset:0x%" PRIx32, imageProcessor->mOTAUpdatePartition->address);
+    PostOTAStateChangeEvent(DeviceLayer::kOtaApplyComplete);
+
+#ifdef CONFIG_OTA_AUTO_REBOOT_ON_APPLY
+    // HandleApply is called after the delayed action time of the provider, the restart can be scheduled
+    DeviceLayer::SystemLayer().StartTimer(System::Clock::Milliseconds32(CONFIG_OTA_AUTO_REBOOT_DELAY_MS), HandleRestart,
+                                          nullptr);
+#else
+    ESP_LOGI(TAG, "Please reboot the device manually to apply the new image");
+#endif
+}
+
+CHIP_ERROR AppOTAImageProcessor::SetBlock(ByteSpan &block)
+{
+    if (!IsSpanUsable(block)) {
+        return CHIP_NO_ERROR;
+    }
+    if (mBlock.size() < block.size()) {
+        if (!mBlock.empty()) {
+            ReleaseBlock();
+        }
+        uint8_t *block_ptr = static_cast<uint8_t *>(Platform::MemoryAlloc(block.size()));
+        if (block_ptr == nullptr) {
+            return CHIP_ERROR_NO_MEMORY;
+        }
+        mBlock = MutableByteSpan(block_ptr, block.size());
+    }
+    return CopySpanToMutableSpan(block, mBlock);
+}
+
+CHIP_ERROR AppOTAImageProcessor::ReleaseBlock()
+{
+    if (mBlock.data() != nullptr) {
+        Platform::MemoryFree(mBlock.data());
+    }
+    mBlock = MutableByteSpan();
+    return CHIP_NO_ERROR;
+}
+
+CHIP_ERROR AppOTAImageProcessor::ProcessHeader(ByteSpan &block)
+{
+    if (mHeaderParser.IsInitialized()) {
+        OTAImageHeader header;
+        CHIP_ERROR error = mHeaderParser.AccumulateAndDecode(block, header);
+
+        // Needs more data to decode the header
+        VerifyOrReturnError(error != CHIP_ERROR_BUFFER_TOO_SMALL, CHIP_NO_ERROR);
+        ReturnErrorOnFailure(error);
+
+        mParams.totalFileBytes = header.mPayloadSize;
+        mHeaderParser.Clear();
+    }
+    return CHIP_NO_ERROR;
+}
+
+esp_err_t app_ota_image_processor_init(void)
+{
+    static esp_matter_ota_requestor_impl_t impl = {};
+    impl.image_processor = &s_image_processor;
+
+    // Fields left zero keep the defaults of esp_matter, the driver and the user consent among them
+    esp_matter_ota_config_t config = {};
+    config.impl = &impl;
+    s_image_processor.SetOTADownloader(&gDownloader);
+    return esp_matter_ota_requestor_set_config(config);
+}
+
+#endif // CONFIG_APP_OTA_DELTA_IMAGES
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <app/clusters/ota-requestor/OTADownloader.h>
+#include <lib/core/OTAImageHeader.h>
+#include <platform/CHIPDeviceLayer.h>
+#include <platform/OTAImageProcessor.h>
+
+#include "app_ota_delta.h"
+
+// Image processor of the Matter OTA requestor, as the one of the ESP32 platform, but the payload of the
+// image is written with app_ota_delta: a full app image or a delta patch of the running app, encrypted
+// with esp_encrypted_img once app_ota_delta_set_decrypt_key() is called.
+class AppOTAImageProcessor : public chip::OTAImageProcessorInterface
+{
+public:
+    //////////// OTAImageProcessorInterface Implementation ///////////////
+    CHIP_ERROR PrepareDownload() override;
+    CHIP_ERROR Finalize() override;
+    CHIP_ERROR Apply() override;
+    CHIP_ERROR Abort() override;
+    CHIP_ERROR ProcessBlock(chip::ByteSpan &block) override;
+    bool IsFirstImageRun() override;
+    CHIP_ERROR ConfirmCurrentImage() override;
+
+    void SetOTADownloader(chip::OTADownloader *downloader) { mDownloader = downloader; }
+
+private:
+    static void HandlePrepareDownload(intptr_t context);
+    static void HandleFinalize(intptr_t context);
+    static void HandleAbort(intptr_t context);
+    static void HandleProcessBlock(intptr_t context);
+    static void HandleApply(intptr_t context);
+
+    CHIP_ERROR SetBlock(chip::ByteSpan &block);
+    CHIP_ERROR ReleaseBlock();
+    CHIP_ERROR ProcessHeader(chip::ByteSpan &block);
+
+    chip::OTADownloader *mDownloader = nullptr;
+    chip::MutableByteSpan mBlock;
+    const esp_partition_t *mOTAUpdatePartition = nullptr;
+    app_ota_delta_handle_t mOTAUpdate = nullptr;
+    chip::OTAImageHeaderParser mHeaderParser;
+};
+
+// Sets the image processor of the Matter OTA requestor, before esp_matter::start().
+esp_err_t app_ota_image_processor_init(void);
@@ -0,0 +1,160 @@
+#include "sdkconfig.h"
+
+#if CONFIG_APP_OTA_PIPELINE
+
+#include "app_ota_pipe.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#define PIPE_BLOCK_SIZE CONFIG_APP_OTA_PIPELINE_BLOCK_SIZE
+#define PIPE_BUFFERS    CONFIG_APP_OTA_PIPELINE_BUFFERS
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} pipe_buf_t;
+
+struct app_ota_pipe {
+    app_ota_pipe_cb_t cb;
+    void *ctx;
+    QueueHandle_t full;         // buffers to process, NULL asks the task to acknowledge on done
+    QueueHandle_t free;         // buffers processed
+    QueueHandle_t done;
+    pipe_buf_t bufs[PIPE_BUFFERS];
+    pipe_buf_t *fill;           // buffer being filled by the writer
+    volatile esp_err_t err;     // first error of cb
+    volatile bool stop;
+};
+
+static void pipe_task(void *arg)
+{
+    app_ota_pipe_handle_t pipe = (app_ota_pipe_handle_t)arg;
+    pipe_buf_t *buf;
+    uint8_t ack = 0;
+
+    for (;;) {
+        xQueueReceive(pipe->full, &buf, portMAX_DELAY);
+        if (buf == NULL) {
+            if (pipe->stop) {
+                break;
+            }
+            xQueueSend(pipe->done, &ack, portMAX_DELAY);
+            continue;
+        }
+        if (pipe->err == ESP_OK) {
+            esp_err_t err = pipe->cb(pipe->ctx, buf->data, buf->len);
+            if (err != ESP_OK) {
+                pipe->err = err;
+            }
+        }
+        buf->len = 0;
+        xQueueSend(pipe->free, &buf, portMAX_DELAY);
+    }
+    xQueueSend(pipe->done, &ack, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+static void pipe_free(app_ota_pipe_handle_t pipe)
+{
+    for (int i = 0; i < PIPE_BUFFERS; i++) {
+        free(pipe->bufs[i].data);
+    }
+    if (pipe->full) {
+        vQueueDelete(pipe->full);
+    }
+    if (pipe->free) {
+        vQueueDelete(pipe->free);
+    }
+    if (pipe->done) {
+        vQueueDelete(pipe->done);
+    }
+    free(pipe);
+}
+
+esp_err_t app_ota_pipe_create(const char *name, uint32_t stack_size, unsigned priority, app_ota_pipe_cb_t cb, void *ctx,
+                              app_ota_pipe_handle_t *out_pipe)
+{
+    app_ota_pipe_handle_t pipe = (app_ota_pipe_handle_t)calloc(1, sizeof(struct app_ota_pipe));
+    if (pipe == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    pipe->cb = cb;
+    pipe->ctx = ctx;
+    // one more slot than buffers for the NULL of sync and delete
+    pipe->full = xQueueCreate(PIPE_BUFFERS + 1, sizeof(pipe_buf_t *));
+    pipe->free = xQueueCreate(PIPE_BUFFERS, sizeof(pipe_buf_t *));
+    pipe->done = xQueueCreate(1, sizeof(uint8_t));
+    if (pipe->full == NULL || pipe->free == NULL || pipe->done == NULL) {
+        pipe_free(pipe);
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < PIPE_BUFFERS; i++) {
+        pipe_buf_t *buf = &pipe->bufs[i];
+        buf->data = (uint8_t *)malloc(PIPE_BLOCK_SIZE);
+        if (buf->data == NULL) {
+            pipe_free(pipe);
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(pipe->free, &buf, 0);
+    }
+    if (xTaskCreate(pipe_task, name, stack_size, pipe, priority, NULL) != pdPASS) {
+        pipe_free(pipe);
+        return ESP_ERR_NO_MEM;
+    }
+    *out_pipe = pipe;
+    return ESP_OK;
+}
+
+esp_err_t app_ota_pipe_write(app_ota_pipe_handle_t pipe, const uint8_t *data, size_t size)
+{
+    while (size > 0 && pipe->err == ESP_OK) {
+        if (pipe->fill == NULL) {
+            xQueueReceive(pipe->free, &pipe->fill, portMAX_DELAY);
+        }
+        size_t len = MIN(size, PIPE_BLOCK_SIZE - pipe->fill->len);
+        memcpy(pipe->fill->data + pipe->fill->len, data, len);
+        pipe->fill->len += len;
+        data += len;
+        size -= len;
+        if (pipe->fill->len == PIPE_BLOCK_SIZE) {
+            xQueueSend(pipe->full, &pipe->fill, portMAX_DELAY);
+            pipe->fill = NULL;
+        }
+    }
+    return pipe->err;
+}
+
+esp_err_t app_ota_pipe_sync(app_ota_pipe_handle_t pipe)
+{
+    pipe_buf_t *buf = NULL;
+    uint8_t ack;
+
+    if (pipe->fill != NULL && pipe->fill->len > 0) {
+        xQueueSend(pipe->full, &pipe->fill, portMAX_DELAY);
+        pipe->fill = NULL;
+    }
+    xQueueSend(pipe->full, &buf, portMAX_DELAY);
+    xQueueReceive(pipe->done, &ack, portMAX_DELAY);
+    return pipe->err;
+}
+
+void app_ota_pipe_delete(app_ota_pipe_handle_t pipe)
+{
+    pipe_buf_t *buf = NULL;
+    uint8_t ack;
+
+    if (pipe->err == ESP_OK) {
+        pipe->err = ESP_ERR_INVALID_STATE;
+    }
+    pipe->stop = true;
+    xQueueSend(pipe->full, &buf, portMAX_DELAY);
+    xQueueReceive(pipe->done, &ack, portMAX_DELAY);
+    pipe_free(pipe);
+}
+
+#endif // CONFIG_APP_OTA_PIPELINE
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stage of the OTA pipeline: a task that hands the data written to the stage to its callback, in blocks
+// of CONFIG_APP_OTA_PIPELINE_BLOCK_SIZE. The writer fills one of CONFIG_APP_OTA_PIPELINE_BUFFERS buffers
+// while the task processes the others, and only waits when they are all full.
+typedef struct app_ota_pipe *app_ota_pipe_handle_t;
+
+typedef esp_err_t (*app_ota_pipe_cb_t)(void *ctx, const uint8_t *data, size_t size);
+
+esp_err_t app_ota_pipe_create(const char *name, uint32_t stack_size, unsigned priority, app_ota_pipe_cb_t cb, void *ctx,
+                              app_ota_pipe_handle_t *out_pipe);
+// Returns the first error of the callback, data written after it is dropped
+esp_err_t app_ota_pipe_write(app_ota_pipe_handle_t pipe, const uint8_t *data, size_t size);
+// Hands the partly filled buffer to the task and waits until all the data written is processed
+esp_err_t app_ota_pipe_sync(app_ota_pipe_handle_t pipe);
+// Drops the data not processed yet and deletes the task
+void app_ota_pipe_delete(app_ota_pipe_handle_t pipe);
+
+#ifdef __cplusplus
+}
+#endif
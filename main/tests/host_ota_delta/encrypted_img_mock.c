@@ -0,0 +1,154 @@
+/* esp_encrypted_img of the host build, with OpenSSL. Same image format as esp_enc_img_gen.py, but the
+ * 32 bytes GCM key is in the clear at the start of the field of its RSA encryption, the RSA private key
+ * given to esp_encrypted_img_decrypt_start() is not used. The decryption can be slowed down to the rate
+ * of the device.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include "esp_encrypted_img.h"
+#include "encrypted_img_mock.h"
+
+#define MAGIC               0x0788b6cf
+#define GCM_KEY_SIZE        32
+#define ENC_GCM_KEY_SIZE    384
+#define IV_SIZE             16
+#define AUTH_SIZE           16
+#define HEADER_SIZE         512
+#define KEY_OFFSET          4
+#define IV_OFFSET           (KEY_OFFSET + ENC_GCM_KEY_SIZE)
+#define BIN_SIZE_OFFSET     (IV_OFFSET + IV_SIZE)
+#define AUTH_OFFSET         (BIN_SIZE_OFFSET + 4)
+
+typedef struct {
+    uint8_t header[HEADER_SIZE];
+    size_t header_len;
+    uint32_t bin_size;
+    uint32_t bin_read;
+    EVP_CIPHER_CTX *gcm;
+} decrypt_t;
+
+static double s_byte_ns;
+
+static void decrypt_cost(size_t bytes)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t end = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec + (uint64_t)(bytes * s_byte_ns);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+    } while ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec < end);
+}
+
+void encrypted_img_mock_set_rate(double mbps)
+{
+    s_byte_ns = mbps > 0 ? 1000.0 / mbps : 0;
+}
+
+uint8_t *encrypted_img_mock_encrypt(const uint8_t *image, size_t size, size_t *out_size)
+{
+    uint8_t *out = calloc(1, HEADER_SIZE + size);
+    uint32_t magic = MAGIC, bin_size = size;
+    EVP_CIPHER_CTX *gcm = EVP_CIPHER_CTX_new();
+    int len;
+
+    memcpy(out, &magic, sizeof(magic));
+    RAND_bytes(out + KEY_OFFSET, GCM_KEY_SIZE);
+    RAND_bytes(out + IV_OFFSET, IV_SIZE);
+    memcpy(out + BIN_SIZE_OFFSET, &bin_size, sizeof(bin_size));
+    EVP_EncryptInit_ex(gcm, EVP_aes_256_gcm(), NULL, NULL, NULL);
+    EVP_CIPHER_CTX_ctrl(gcm, EVP_CTRL_GCM_SET_IVLEN, IV_SIZE, NULL);
+    EVP_EncryptInit_ex(gcm, NULL, NULL, out + KEY_OFFSET, out + IV_OFFSET);
+    EVP_EncryptUpdate(gcm, out + HEADER_SIZE, &len, image, size);
+    EVP_EncryptFinal_ex(gcm, out + HEADER_SIZE + len, &len);
+    EVP_CIPHER_CTX_ctrl(gcm, EVP_CTRL_GCM_GET_TAG, AUTH_SIZE, out + AUTH_OFFSET);
+    EVP_CIPHER_CTX_free(gcm);
+    *out_size = HEADER_SIZE + size;
+    return out;
+}
+
+esp_decrypt_handle_t esp_encrypted_img_decrypt_start(const esp_decrypt_cfg_t *cfg)
+{
+    if (cfg == NULL || cfg->rsa_priv_key == NULL) {
+        return NULL;
+    }
+    return calloc(1, sizeof(decrypt_t));
+}
+
+esp_err_t esp_encrypted_img_decrypt_data(esp_decrypt_handle_t ctx, pre_enc_decrypt_arg_t *args)
+{
+    decrypt_t *handle = ctx;
+    const uint8_t *data = (const uint8_t *)args->data_in;
+    size_t size = args->data_in_len;
+    uint32_t magic;
+    int len;
+
+    args->data_out = NULL;
+    args->data_out_len = 0;
+    if (handle->header_len < HEADER_SIZE) {
+        size_t copy = size < HEADER_SIZE - handle->header_len ? size : HEADER_SIZE - handle->header_len;
+        memcpy(handle->header + handle->header_len, data, copy);
+        handle->header_len += copy;
+        data += copy;
+        size -= copy;
+        if (handle->header_len < HEADER_SIZE) {
+            return ESP_ERR_NOT_FINISHED;
+        }
+        memcpy(&magic, handle->header, sizeof(magic));
+        if (magic != MAGIC) {
+            return ESP_FAIL;
+        }
+        memcpy(&handle->bin_size, handle->header + BIN_SIZE_OFFSET, sizeof(handle->bin_size));
+        handle->gcm = EVP_CIPHER_CTX_new();
+        EVP_DecryptInit_ex(handle->gcm, EVP_aes_256_gcm(), NULL, NULL, NULL);
+        EVP_CIPHER_CTX_ctrl(handle->gcm, EVP_CTRL_GCM_SET_IVLEN, IV_SIZE, NULL);
+        EVP_DecryptInit_ex(handle->gcm, NULL, NULL, handle->header + KEY_OFFSET, handle->header + IV_OFFSET);
+    }
+    if (size > handle->bin_size - handle->bin_read) {
+        size = handle->bin_size - handle->bin_read;
+    }
+    if (size > 0) {
+        decrypt_cost(size);
+        args->data_out = malloc(size);
+        EVP_DecryptUpdate(handle->gcm, (uint8_t *)args->data_out, &len, data, size);
+        args->data_out_len = len;
+        handle->bin_read += size;
+    }
+    return handle->bin_read == handle->bin_size ? ESP_OK : ESP_ERR_NOT_FINISHED;
+}
+
+bool esp_encrypted_img_is_complete_data_received(esp_decrypt_handle_t ctx)
+{
+    decrypt_t *handle = ctx;
+    return handle->gcm && handle->bin_read == handle->bin_size;
+}
+
+esp_err_t esp_encrypted_img_decrypt_abort(esp_decrypt_handle_t ctx)
+{
+    decrypt_t *handle = ctx;
+    EVP_CIPHER_CTX_free(handle->gcm);
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t esp_encrypted_img_decrypt_end(esp_decrypt_handle_t ctx)
+{
+    decrypt_t *handle = ctx;
+    uint8_t out[16];
+    int len;
+    esp_err_t err = ESP_FAIL;
+
+    if (esp_encrypted_img_is_complete_data_received(ctx)) {
+        EVP_CIPHER_CTX_ctrl(handle->gcm, EVP_CTRL_GCM_SET_TAG, AUTH_SIZE, handle->header + AUTH_OFFSET);
+        if (EVP_DecryptFinal_ex(handle->gcm, out, &len) == 1) {
+            err = ESP_OK;
+        }
+    }
+    esp_encrypted_img_decrypt_abort(ctx);
+    return err;
+}
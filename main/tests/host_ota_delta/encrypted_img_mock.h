@@ -0,0 +1,10 @@
+/* Host only functions of encrypted_img_mock.c */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Encrypts the image in the esp_encrypted_img format, the GCM key is in the clear in place of its RSA encryption */
+uint8_t *encrypted_img_mock_encrypt(const uint8_t *image, size_t size, size_t *out_size);
+/* Busy wait of the decryption, in MB/s of encrypted data, 0 for none */
+void encrypted_img_mock_set_rate(double mbps);
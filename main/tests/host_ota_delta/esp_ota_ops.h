@@ -0,0 +1,27 @@
+/* Minimal esp_ota_ops.h for the host build, the OTA writes go to the update partition in memory (ota_mock.c) */
+#pragma once
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_ERR_OTA_BASE                0x1500
+#define ESP_ERR_OTA_VALIDATE_FAILED     (ESP_ERR_OTA_BASE + 0x03)
+
+#define OTA_SIZE_UNKNOWN                0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES      0xfffffffe
+
+typedef uint32_t esp_ota_handle_t;
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+const esp_partition_t *esp_ota_get_running_partition(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,22 @@
+/* Minimal esp_partition.h for the host build, partitions are in memory (ota_mock.c) */
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    uint8_t *data;      /* host only, content of the partition */
+} esp_partition_t;
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_get_sha256(const esp_partition_t *partition, uint8_t *sha_256);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,14 @@
+/* Minimal FreeRTOS.h for the host build, tasks are threads and queues are in freertos_mock.c */
+#pragma once
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdPASS          1
+#define pdFAIL          0
+#define pdTRUE          1
+#define pdFALSE         0
+#define portMAX_DELAY   ((TickType_t)0xffffffff)
@@ -0,0 +1,21 @@
+/* Minimal task.h for the host build */
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/* The stack size and the priority are ignored */
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_size, void *arg, UBaseType_t priority,
+                       TaskHandle_t *out_task);
+/* Only deletes the calling task */
+void vTaskDelete(TaskHandle_t task);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,113 @@
+/* FreeRTOS tasks and queues of the host build, on POSIX threads */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+struct queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *items;
+};
+
+typedef struct {
+    TaskFunction_t task;
+    void *arg;
+} task_start_t;
+
+static void *task_start(void *arg)
+{
+    task_start_t start = *(task_start_t *)arg;
+    free(arg);
+    start.task(start.arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_size, void *arg, UBaseType_t priority,
+                       TaskHandle_t *out_task)
+{
+    (void)name;
+    (void)stack_size;
+    (void)priority;
+    pthread_t thread;
+    task_start_t *start = malloc(sizeof(task_start_t));
+
+    start->task = task;
+    start->arg = arg;
+    if (pthread_create(&thread, NULL, task_start, start) != 0) {
+        free(start);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (out_task) {
+        *out_task = (TaskHandle_t)thread;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+    pthread_exit(NULL);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct queue));
+
+    queue->items = malloc(length * item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->changed, NULL);
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (wait == 0) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    memcpy(queue->items + ((queue->head + queue->count) % queue->length) * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (wait == 0) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+        pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->changed);
+    free(queue->items);
+    free(queue);
+}
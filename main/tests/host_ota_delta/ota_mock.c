@@ -0,0 +1,153 @@
+/* esp_partition and esp_ota_ops of the host build. The running partition holds the base image, the
+ * update partition gets the OTA writes. esp_ota_end() checks the image magic only, the test compares
+ * the written image. OTA writes can take the time of the flash: sector erases as esp_ota_write() does
+ * with OTA_WITH_SEQUENTIAL_WRITES, and page programs, either as busy waits (cache disabled during the
+ * flash operation on a single core chip) or as sleeps (flash auto suspend).
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/sha.h>
+#include "esp_ota_ops.h"
+#include "ota_mock.h"
+
+static esp_partition_t s_running = {0x20000, 0x1E0000, "ota_0", NULL};
+static esp_partition_t s_update = {0x200000, 0x1E0000, "ota_1", NULL};
+static size_t s_running_image_size;
+static size_t s_written;
+static size_t s_erased;
+static bool s_open;
+static struct {
+    unsigned erase_us;
+    unsigned page_us;
+    bool busy;
+} s_flash;
+
+#define SECTOR_SIZE 4096
+#define PAGE_SIZE   256
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void flash_wait(uint64_t ns)
+{
+    if (ns == 0) {
+        return;
+    }
+    if (s_flash.busy) {
+        uint64_t end = now_ns() + ns;
+        while (now_ns() < end) {
+        }
+    } else {
+        struct timespec ts = {(time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL)};
+        nanosleep(&ts, NULL);
+    }
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (src_offset + size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, partition->data + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_get_sha256(const esp_partition_t *partition, uint8_t *sha_256)
+{
+    SHA256(partition->data, partition == &s_running ? s_running_image_size : s_written, sha_256);
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &s_running;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    (void)image_size;
+    if (partition != &s_update || s_open) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(s_update.data, 0xff, s_update.size);
+    s_written = 0;
+    s_erased = 0;
+    s_open = true;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    if (handle != 1 || !s_open) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_written == 0 && size > 0 && ((const uint8_t *)data)[0] != 0xE9) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    if (s_written + size > s_update.size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    while (s_erased < s_written + size) {
+        flash_wait(s_flash.erase_us * 1000ULL);
+        s_erased += SECTOR_SIZE;
+    }
+    flash_wait((uint64_t)s_flash.page_us * 1000ULL * size / PAGE_SIZE);
+    memcpy(s_update.data + s_written, data, size);
+    s_written += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    if (handle != 1 || !s_open) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_open = false;
+    return s_written ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    if (handle != 1 || !s_open) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_open = false;
+    return ESP_OK;
+}
+
+const esp_partition_t *ota_mock_init(const uint8_t *running_image, size_t size)
+{
+    s_running.data = malloc(s_running.size);
+    s_update.data = malloc(s_update.size);
+    memset(s_running.data, 0xff, s_running.size);
+    memcpy(s_running.data, running_image, size);
+    s_running_image_size = size;
+    return &s_update;
+}
+
+const uint8_t *ota_mock_written(size_t *size)
+{
+    *size = s_written;
+    return s_update.data;
+}
+
+void ota_mock_set_flash_timing(unsigned erase_us, unsigned page_us, bool busy)
+{
+    s_flash.erase_us = erase_us;
+    s_flash.page_us = page_us;
+    s_flash.busy = busy;
+}
+
+bool ota_mock_is_open(void)
+{
+    return s_open;
+}
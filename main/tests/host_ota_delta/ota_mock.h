@@ -0,0 +1,13 @@
+/* Host only functions of ota_mock.c */
+#pragma once
+
+#include "esp_partition.h"
+
+/* Loads the running partition with the image, returns the update partition */
+const esp_partition_t *ota_mock_init(const uint8_t *running_image, size_t size);
+/* Image written to the update partition by the last update */
+const uint8_t *ota_mock_written(size_t *size);
+/* An update is begun and neither ended nor aborted */
+bool ota_mock_is_open(void);
+/* Time of a 4 KB sector erase and of a 256 bytes page program, busy waits or sleeps */
+void ota_mock_set_flash_timing(unsigned erase_us, unsigned page_us, bool busy);
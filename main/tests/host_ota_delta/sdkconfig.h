@@ -0,0 +1,2 @@
+/* sdkconfig.h of the host build, the options are set in the Makefile */
+#pragma once
@@ -36,6 +36,7 @@
 /* Patch types. */
 #define PATCH_TYPE_SEQUENTIAL                               0
 #define PATCH_TYPE_IN_PLACE                                 1
+#define PATCH_TYPE_HDIFFPATCH                               2
 
 /* Compressions. */
 #define COMPRESSION_NONE                                    0
@@ -47,6 +48,9 @@
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define DIV_CEIL(n, d) (((n) + (d) - 1) / (d))
 
+/* Default work buffer size, on the stack. */
+#define WORK_BUF_SIZE                                       128
+
 /*
  * Utility functions.
  */
@@ -1212,16 +1216,69 @@ static int process_size(struct detools_apply_patch_t *self_p,
     return (res);
 }
 
+#if DETOOLS_CONFIG_DIFF_ADD_SWAR == 1 && defined(__GNUC__)
+typedef uint32_t __attribute__((__may_alias__)) diff_add_word_t;
+#endif
+
+/**
+ * Add from-data to diff data, byte by byte modulo 256. Words are
+ * added with the carry out of the top bit of every byte masked, so
+ * that it does not ripple into the next byte.
+ */
+static void diff_add(uint8_t *to_p, const uint8_t *from_p, size_t size)
+{
+    size_t i;
+#if DETOOLS_CONFIG_DIFF_ADD_SWAR == 1 && defined(__GNUC__)
+    uint32_t to;
+    uint32_t from;
+#endif
+
+    i = 0;
+
+#if DETOOLS_CONFIG_DIFF_ADD_SWAR == 1 && defined(__GNUC__)
+    if ((((uintptr_t)to_p ^ (uintptr_t)from_p) & 3) == 0) {
+        while ((i < size) && (((uintptr_t)&to_p[i] & 3) != 0)) {
+            to_p[i] = (uint8_t)(to_p[i] + from_p[i]);
+            i++;
+        }
+
+        for (; i + 4 <= size; i += 4) {
+            to = *(diff_add_word_t *)&to_p[i];
+            from = *(const diff_add_word_t *)&from_p[i];
+            *(diff_add_word_t *)&to_p[i] = (((to & 0x7f7f7f7fu)
+                                             + (from & 0x7f7f7f7fu))
+                                            ^ ((to ^ from) & 0x80808080u));
+        }
+    }
+#endif
+
+    for (; i < size; i++) {
+        to_p[i] = (uint8_t)(to_p[i] + from_p[i]);
+    }
+}
+
 static int process_data(struct detools_apply_patch_t *self_p,
                         enum detools_apply_patch_state_t next_state)
 {
     int res;
-    size_t i;
-    uint8_t to[128];
+    uint32_t to[WORK_BUF_SIZE / 4];
+    uint8_t *to_p;
     size_t to_size;
-    uint8_t from[128];
+    uint32_t from[WORK_BUF_SIZE / 4];
+    uint8_t *from_p;
+    size_t buf_size;
+
+    if (self_p->work_buf_p != NULL) {
+        buf_size = self_p->work_buf_size;
+        to_p = self_p->work_buf_p;
+        from_p = &self_p->work_buf_p[buf_size];
+    } else {
+        buf_size = sizeof(to);
+        to_p = (uint8_t *)&to[0];
+        from_p = (uint8_t *)&from[0];
+    }
 
-    to_size = MIN(sizeof(to), self_p->chunk_size);
+    to_size = MIN(buf_size, self_p->chunk_size);
 
     if (to_size == 0) {
         self_p->state = next_state;
@@ -1230,7 +1287,7 @@ static int process_data(struct detools_apply_patch_t *self_p,
     }
 
     res = patch_reader_decompress(&self_p->patch_reader,
-                                  &to[0],
+                                  to_p,
                                   &to_size);
 
     if (res != 0) {
@@ -1238,7 +1295,7 @@ static int process_data(struct detools_apply_patch_t *self_p,
     }
 
     if (next_state == detools_apply_patch_state_extra_size_t) {
-        res = self_p->from_read(self_p->arg_p, &from[0], to_size);
+        res = self_p->from_read(self_p->arg_p, from_p, to_size);
 
         if (res != 0) {
             return (-DETOOLS_IO_FAILED);
@@ -1246,15 +1303,13 @@ static int process_data(struct detools_apply_patch_t *self_p,
 
         self_p->from_offset += to_size;
 
-        for (i = 0; i < to_size; i++) {
-            to[i] = (uint8_t)(to[i] + from[i]);
-        }
+        diff_add(to_p, from_p, to_size);
     }
 
     self_p->to_offset += to_size;
     self_p->chunk_size -= to_size;
 
-    res = self_p->to_write(self_p->arg_p, &to[0], to_size);
+    res = self_p->to_write(self_p->arg_p, to_p, to_size);
 
     if (res != 0) {
         return (-DETOOLS_IO_FAILED);
@@ -1410,6 +1465,29 @@ int detools_apply_patch_init(struct detools_apply_patch_t *self_p,
     self_p->state = detools_apply_patch_state_init_t;
     self_p->init_state = detools_apply_patch_init_state_fixed_header_t;
     self_p->patch_reader.destroy = NULL;
+    self_p->work_buf_p = NULL;
+    self_p->work_buf_size = 0;
+
+    return (0);
+}
+
+int detools_apply_patch_set_work_buffer(struct detools_apply_patch_t *self_p,
+                                        uint8_t *buf_p,
+                                        size_t size)
+{
+    if (buf_p != NULL) {
+        if (size < 8) {
+            return (-DETOOLS_OUT_OF_MEMORY);
+        }
+
+        /* Word aligned halves. */
+        size = (size / 2) & ~(size_t)3;
+    } else {
+        size = 0;
+    }
+
+    self_p->work_buf_p = buf_p;
+    self_p->work_buf_size = size;
 
     return (0);
 }
@@ -1895,7 +1973,6 @@ static int in_place_process_data(struct detools_apply_patch_in_place_t *self_p,
                                  enum detools_apply_patch_state_t next_state)
 {
     int res;
-    size_t i;
     uint8_t to[128];
     size_t to_size;
     uint8_t from[128];
@@ -1928,9 +2005,7 @@ static int in_place_process_data(struct detools_apply_patch_in_place_t *self_p,
 
         self_p->segment.from_offset += (int)to_size;
 
-        for (i = 0; i < to_size; i++) {
-            to[i] = (uint8_t)(to[i] + from[i]);
-        }
+        diff_add(&to[0], &from[0], to_size);
     }
 
     res = in_place_mem_write(self_p,
@@ -2112,6 +2187,219 @@ int detools_apply_patch_in_place_finalize(
                                         self_p->to_size));
 }
 
+/*
+ * Hdiffpatch patch type functionality. Only the diff is decompressed,
+ * it is applied by HPatch.
+ */
+
+static int hdiffpatch_reader_process_init(
+    struct detools_hdiffpatch_reader_t *self_p)
+{
+    int patch_type;
+    uint8_t byte;
+
+    if (chunk_get(&self_p->chunk, &byte) != 0) {
+        return (1);
+    }
+
+    patch_type = ((byte >> 4) & 0x7);
+    self_p->compression = (byte & 0xf);
+
+    if (patch_type != PATCH_TYPE_HDIFFPATCH) {
+        return (-DETOOLS_BAD_PATCH_TYPE);
+    }
+
+    self_p->state = detools_hdiffpatch_reader_state_to_size_t;
+    self_p->size.state = detools_unpack_usize_state_first_t;
+
+    return (0);
+}
+
+static int hdiffpatch_reader_process_to_size(
+    struct detools_hdiffpatch_reader_t *self_p)
+{
+    int res;
+    int to_size;
+
+    res = chunk_unpack_header_size(&self_p->chunk, &self_p->size, &to_size);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    if (to_size < 0) {
+        return (-DETOOLS_CORRUPT_PATCH);
+    }
+
+    self_p->to_size = (size_t)to_size;
+    self_p->state = detools_hdiffpatch_reader_state_diff_size_t;
+
+    return (0);
+}
+
+static int hdiffpatch_reader_process_diff_size(
+    struct detools_hdiffpatch_reader_t *self_p)
+{
+    int res;
+    int diff_size;
+
+    res = chunk_unpack_header_size(&self_p->chunk, &self_p->size, &diff_size);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    if (diff_size <= 0) {
+        return (-DETOOLS_CORRUPT_PATCH);
+    }
+
+    /* The compressed size of an uncompressed diff is its size. */
+    res = patch_reader_init(&self_p->patch_reader,
+                            &self_p->chunk,
+                            (size_t)diff_size,
+                            self_p->compression);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    self_p->diff_size = (size_t)diff_size;
+    self_p->state = detools_hdiffpatch_reader_state_diff_data_t;
+
+    return (0);
+}
+
+static int hdiffpatch_reader_process_diff_data(
+    struct detools_hdiffpatch_reader_t *self_p)
+{
+    int res;
+    uint8_t buf[128];
+    size_t size;
+
+    size = MIN(sizeof(buf), self_p->diff_size - self_p->diff_offset);
+    res = patch_reader_decompress(&self_p->patch_reader, &buf[0], &size);
+
+    if (res != 0) {
+        return (res);
+    }
+
+    res = self_p->diff_write(self_p->arg_p, &buf[0], size);
+
+    if (res != 0) {
+        return (-DETOOLS_IO_FAILED);
+    }
+
+    self_p->diff_offset += size;
+
+    if (self_p->diff_offset == self_p->diff_size) {
+        self_p->state = detools_hdiffpatch_reader_state_done_t;
+    }
+
+    return (0);
+}
+
+static int hdiffpatch_reader_process_once(
+    struct detools_hdiffpatch_reader_t *self_p)
+{
+    int res;
+
+    switch (self_p->state) {
+
+    case detools_hdiffpatch_reader_state_init_t:
+        res = hdiffpatch_reader_process_init(self_p);
+        break;
+
+    case detools_hdiffpatch_reader_state_to_size_t:
+        res = hdiffpatch_reader_process_to_size(self_p);
+        break;
+
+    case detools_hdiffpatch_reader_state_diff_size_t:
+        res = hdiffpatch_reader_process_diff_size(self_p);
+        break;
+
+    case detools_hdiffpatch_reader_state_diff_data_t:
+        res = hdiffpatch_reader_process_diff_data(self_p);
+        break;
+
+    case detools_hdiffpatch_reader_state_done_t:
+        return (-DETOOLS_ALREADY_DONE);
+
+    case detools_hdiffpatch_reader_state_failed_t:
+        res = -DETOOLS_ALREADY_FAILED;
+        break;
+
+    default:
+        res = -DETOOLS_INTERNAL_ERROR;
+        break;
+    }
+
+    if (res < 0) {
+        self_p->state = detools_hdiffpatch_reader_state_failed_t;
+    }
+
+    return (res);
+}
+
+int detools_hdiffpatch_reader_init(struct detools_hdiffpatch_reader_t *self_p,
+                                   detools_write_t diff_write,
+                                   void *arg_p)
+{
+    self_p->diff_write = diff_write;
+    self_p->arg_p = arg_p;
+    self_p->state = detools_hdiffpatch_reader_state_init_t;
+    self_p->to_size = 0;
+    self_p->diff_size = 0;
+    self_p->diff_offset = 0;
+    self_p->patch_reader.destroy = NULL;
+
+    return (0);
+}
+
+int detools_hdiffpatch_reader_process(struct detools_hdiffpatch_reader_t *self_p,
+                                      const uint8_t *patch_p,
+                                      size_t size)
+{
+    int res;
+
+    res = 0;
+    self_p->chunk.buf_p = patch_p;
+    self_p->chunk.size = size;
+    self_p->chunk.offset = 0;
+
+    while (chunk_available(&self_p->chunk) && (res >= 0)) {
+        res = hdiffpatch_reader_process_once(self_p);
+    }
+
+    if ((res == 1) || (res == -DETOOLS_ALREADY_DONE)) {
+        res = 0;
+    }
+
+    return (res);
+}
+
+size_t detools_hdiffpatch_reader_get_diff_size(
+    struct detools_hdiffpatch_reader_t *self_p)
+{
+    return (self_p->diff_size);
+}
+
+int detools_hdiffpatch_reader_finalize(
+    struct detools_hdiffpatch_reader_t *self_p)
+{
+    int res;
+
+    self_p->chunk.size = 0;
+    self_p->chunk.offset = 0;
+
+    do {
+        res = hdiffpatch_reader_process_once(self_p);
+    } while (res == 0);
+
+    return (apply_patch_common_finalize(res,
+                                        &self_p->patch_reader,
+                                        self_p->to_size));
+}
+
 /*
  * Callback functionality.
  */
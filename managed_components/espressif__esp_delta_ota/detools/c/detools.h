@@ -55,6 +55,11 @@
 #    define DETOOLS_CONFIG_COMPRESSION_HEATSHRINK  1
 #endif
 
+/* Add diff data to from-data a 32-bit word at a time. */
+#ifndef DETOOLS_CONFIG_DIFF_ADD_SWAR
+#    define DETOOLS_CONFIG_DIFF_ADD_SWAR           1
+#endif
+
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
@@ -349,6 +354,8 @@ struct detools_apply_patch_t {
     struct detools_apply_patch_patch_reader_t patch_reader;
     struct detools_apply_patch_chunk_t chunk;
     struct detools_apply_patch_size_t size;
+    uint8_t *work_buf_p;
+    size_t work_buf_size;
 };
 
 /**
@@ -381,6 +388,33 @@ struct detools_apply_patch_in_place_t {
     struct detools_apply_patch_size_t size;
 };
 
+enum detools_hdiffpatch_reader_state_t {
+    detools_hdiffpatch_reader_state_init_t = 0,
+    detools_hdiffpatch_reader_state_to_size_t,
+    detools_hdiffpatch_reader_state_diff_size_t,
+    detools_hdiffpatch_reader_state_diff_data_t,
+    detools_hdiffpatch_reader_state_done_t,
+    detools_hdiffpatch_reader_state_failed_t
+};
+
+/**
+ * The hdiffpatch patch reader data structure. Decompresses the
+ * HDiffPatch compressed diff of a hdiffpatch patch, which is then
+ * applied by HPatch.
+ */
+struct detools_hdiffpatch_reader_t {
+    detools_write_t diff_write;
+    void *arg_p;
+    enum detools_hdiffpatch_reader_state_t state;
+    int compression;
+    size_t to_size;
+    size_t diff_size;
+    size_t diff_offset;
+    struct detools_apply_patch_patch_reader_t patch_reader;
+    struct detools_apply_patch_chunk_t chunk;
+    struct detools_apply_patch_size_t size;
+};
+
 /**
  * Initialize given apply patch object.
  *
@@ -402,6 +436,25 @@ int detools_apply_patch_init(struct detools_apply_patch_t *self_p,
                              detools_write_t to_write,
                              void *arg_p);
 
+/**
+ * Use given buffer to apply patch data instead of two 128 bytes
+ * buffers on the stack. Half of the buffer is used for diff data and
+ * half for from-data, so a larger buffer means fewer and larger
+ * from_read() and to_write() calls. Call after
+ * `detools_apply_patch_init()`, the buffer is kept by
+ * `detools_apply_patch_restore()`.
+ *
+ * @param[in,out] self_p Initialized apply patch object.
+ * @param[in] buf_p Work buffer, valid until the patching is
+ *                  finalized. NULL to use the stack buffers.
+ * @param[in] size Work buffer size in bytes, at least 8.
+ *
+ * @return zero(0) or negative error code.
+ */
+int detools_apply_patch_set_work_buffer(struct detools_apply_patch_t *self_p,
+                                        uint8_t *buf_p,
+                                        size_t size);
+
 /**
  * Dump given apply patch object state. Call
  * `detools_apply_patch_restore()` to restore an apply patch object to
@@ -532,6 +585,59 @@ int detools_apply_patch_in_place_process(
 int detools_apply_patch_in_place_finalize(
     struct detools_apply_patch_in_place_t *self_p);
 
+/**
+ * Initialize given hdiffpatch patch reader.
+ *
+ * @param[out] self_p Hdiffpatch patch reader to initialize.
+ * @param[in] diff_write Callback to write the decompressed diff.
+ * @param[in] arg_p Argument passed to the callback.
+ *
+ * @return zero(0) or negative error code.
+ */
+int detools_hdiffpatch_reader_init(struct detools_hdiffpatch_reader_t *self_p,
+                                   detools_write_t diff_write,
+                                   void *arg_p);
+
+/**
+ * Call this function repeatedly until all patch data has been
+ * processed or an error occurres. Call
+ * detools_hdiffpatch_reader_finalize() to finalize the reading, even
+ * if an error occurred.
+ *
+ * @param[in,out] self_p Initialized hdiffpatch patch reader.
+ * @param[in] patch_p Next chunk of the patch.
+ * @param[in] size Patch buffer size.
+ *
+ * @return zero(0) or negative error code.
+ */
+int detools_hdiffpatch_reader_process(struct detools_hdiffpatch_reader_t *self_p,
+                                      const uint8_t *patch_p,
+                                      size_t size);
+
+/**
+ * Get the size of the diff, known once the patch header has been
+ * processed.
+ *
+ * @param[in] self_p Hdiffpatch patch reader.
+ *
+ * @return Size of the diff in bytes, or zero(0) if not yet known.
+ */
+size_t detools_hdiffpatch_reader_get_diff_size(
+    struct detools_hdiffpatch_reader_t *self_p);
+
+/**
+ * Call once after all data has been processed to finalize the
+ * reading. The value returned from this function should be ignored
+ * if an error occurred in detools_hdiffpatch_reader_process().
+ *
+ * @param[in,out] self_p Initialized hdiffpatch patch reader.
+ *
+ * @return Size of to-data in bytes if the whole diff was written, or
+ *         negative error code.
+ */
+int detools_hdiffpatch_reader_finalize(
+    struct detools_hdiffpatch_reader_t *self_p);
+
 /**
  * Apply given patch using read, write and seek callbacks.
  *
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <sys/param.h>
 
 #include "freertos/FreeRTOS.h"
@@ -36,6 +37,8 @@
 #define BUFFSIZE 1024
 #define PATCH_HEADER_SIZE 64
 #define DIGEST_SIZE 32
+// size of the header in the first reserved word, 0 for 64 bytes, 96 with the SHA256 of the new firmware
+#define PATCH_HEADER_SIZE_OFFSET (4 + DIGEST_SIZE)
 static uint32_t esp_delta_ota_magic = 0xfccdde10;
 
 static const char *TAG = "https_delta_ota_example";
@@ -187,8 +190,33 @@ static void ota_example_task(void *pvParameter)
         ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
         goto error;
     }
+    // Read size equal to patch header to verify the header
+    int data_read = esp_http_client_read(client, ota_write_data, PATCH_HEADER_SIZE);
+    if (data_read != PATCH_HEADER_SIZE) {
+        ESP_LOGE(TAG, "Patch Header not received");
+        goto error;
+    }
+    if (!verify_patch_header(ota_write_data)) {
+        ESP_LOGE(TAG, "Patch Header verification failed");
+        goto error;
+    }
+    uint32_t header_size;
+    static uint8_t new_digest[DIGEST_SIZE];
+    memcpy(&header_size, ota_write_data + PATCH_HEADER_SIZE_OFFSET, sizeof(header_size));
+    if (header_size == PATCH_HEADER_SIZE + DIGEST_SIZE) {
+        // SHA256 of the new firmware, checked by esp_delta_ota_finalize()
+        if (esp_http_client_read(client, (char *)new_digest, DIGEST_SIZE) != DIGEST_SIZE) {
+            ESP_LOGE(TAG, "Patch Header not received");
+            goto error;
+        }
+    } else if (header_size != 0) {
+        ESP_LOGE(TAG, "Unsupported patch header size %" PRIu32, header_size);
+        goto error;
+    }
+
     esp_delta_ota_cfg_t cfg = {
         .read_cb = &read_cb,
+        .expected_sha256 = header_size ? new_digest : NULL,
     };
 
 #if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0))
@@ -205,19 +233,8 @@ static void ota_example_task(void *pvParameter)
         goto error;
     }
 
-    // Read size equal to patch header to verify the header
-    int data_read = esp_http_client_read(client, ota_write_data, PATCH_HEADER_SIZE);
-    if (data_read != PATCH_HEADER_SIZE) {
-        ESP_LOGE(TAG, "Patch Header not received");
-        goto error;
-    }
-    if (!verify_patch_header(ota_write_data)) {
-        ESP_LOGE(TAG, "Patch Header verification failed");
-        goto error;
-    }
-
     while (1) {
-        int data_read = esp_http_client_read(client, ota_write_data, BUFFSIZE);
+        data_read = esp_http_client_read(client, ota_write_data, BUFFSIZE);
         if (data_read < 0) {
             ESP_LOGE(TAG, "Error: SSL data read error");
             goto error;
@@ -27,6 +27,11 @@ MAGIC_SIZE = 4 # This is the size of the magic byte
 DIGEST_SIZE = 32 # This is the SHA256 of the base binary    
 HEADER_SIZE = 64
 RESERVED_HEADER = HEADER_SIZE - (MAGIC_SIZE + DIGEST_SIZE) # This is the reserved header size
+# With --new_digest, the first reserved word holds the size of the header, which is followed by the SHA256
+# of the new binary, checked while the patch is applied. 0 (older patches) is a 64 bytes header.
+HEADER_SIZE_OFFSET = MAGIC_SIZE + DIGEST_SIZE
+HEADER_SIZE_FIELD = 4
+HEADER_WITH_DIGEST_SIZE = HEADER_SIZE + DIGEST_SIZE
 
 def calculate_sha256(file_path: str) -> str:
     """Calculate the SHA-256 hash of a file."""
@@ -40,7 +45,8 @@ def calculate_sha256(file_path: str) -> str:
     # Return the hex representation of the hash
     return sha256_hash.hexdigest()
 
-def create_patch(chip: str, base_binary: str, new_binary: str, patch_file_name: str) -> None:
+def create_patch(chip: str, base_binary: str, new_binary: str, patch_file_name: str, new_digest: bool = False,
+                 hdiffpatch: bool = False) -> None:
     command = ['--chip', chip, 'image_info', base_binary]
     output = sys.stdout
     sys.stdout = tempfile.TemporaryFile(mode='w+')
@@ -62,12 +68,22 @@ def create_patch(chip: str, base_binary: str, new_binary: str, patch_file_name:
     patch_file_without_header = "patch_file_temp.bin"
     try:
         with open(base_binary, 'rb') as b_binary, open(new_binary, 'rb') as n_binary, open(patch_file_without_header, 'wb') as p_binary:
-            detools.create_patch(b_binary, n_binary, p_binary, compression='heatshrink') # b_binary is the base binary, n_binary is the new binary, p_binary is the patch file without header
+            # b_binary is the base binary, n_binary is the new binary, p_binary is the patch file without header
+            if hdiffpatch:
+                detools.create_patch(b_binary, n_binary, p_binary, compression='heatshrink',
+                                     algorithm='hdiffpatch', patch_type='hdiffpatch')
+            else:
+                detools.create_patch(b_binary, n_binary, p_binary, compression='heatshrink')
 
         with open(patch_file_without_header, "rb") as p_binary, open(patch_file_name, "wb") as patch_file:
             patch_file.write(esp_delta_ota_magic.to_bytes(MAGIC_SIZE, 'little'))
             patch_file.write(bytes.fromhex(x[1]))
-            patch_file.write(bytearray(RESERVED_HEADER))
+            if new_digest:
+                patch_file.write(HEADER_WITH_DIGEST_SIZE.to_bytes(HEADER_SIZE_FIELD, 'little'))
+                patch_file.write(bytearray(RESERVED_HEADER - HEADER_SIZE_FIELD))
+                patch_file.write(bytes.fromhex(calculate_sha256(new_binary)))
+            else:
+                patch_file.write(bytearray(RESERVED_HEADER))
             patch_file.write(p_binary.read())    
     except Exception as e:
         print(f"Error during patch creation: {e}")
@@ -84,7 +100,13 @@ def create_patch(chip: str, base_binary: str, new_binary: str, patch_file_name:
 def verify_patch(base_binary: str, patch_to_verify: str, new_binary: str) -> None:
 
     with open(patch_to_verify, "rb") as original_file:
-        original_file.seek(HEADER_SIZE)
+        header = original_file.read(HEADER_SIZE)
+        header_size = int.from_bytes(header[HEADER_SIZE_OFFSET:HEADER_SIZE_OFFSET + HEADER_SIZE_FIELD], 'little')
+        if header_size > HEADER_SIZE:
+            new_digest = original_file.read(DIGEST_SIZE).hex()
+            if new_digest != calculate_sha256(new_binary):
+                print("SHA256 of the new binary differs from the one in the patch header")
+        original_file.seek(max(header_size, HEADER_SIZE))
         patch_content = original_file.read()
 
     temp_file_name = None
@@ -123,8 +145,14 @@ def main() -> None:
         parser.add_argument('--base_binary', help="Path of Base Binary for creating the patch", required=True)
         parser.add_argument('--new_binary', help="Path of New Binary for which patch has to be created", required=True)
         parser.add_argument('--patch_file_name', help="Patch file path", default="patch.bin")
+        parser.add_argument('--new_digest', action='store_true',
+                            help="Add the SHA256 of the new binary to the patch header (96 bytes header), "
+                                 "for devices which check the patched image against it")
+        parser.add_argument('--hdiffpatch', action='store_true',
+                            help="Create a hdiffpatch patch, for devices built with CONFIG_ESP_DELTA_OTA_HDIFFPATCH")
         args = parser.parse_args(sys.argv[2:])
-        create_patch(args.chip, args.base_binary, args.new_binary, args.patch_file_name)
+        create_patch(args.chip, args.base_binary, args.new_binary, args.patch_file_name, args.new_digest,
+                     args.hdiffpatch)
     elif command == 'verify_patch':
         parser.add_argument('--base_binary', help="Path of Base Binary for verifying the patch", required=True)
         parser.add_argument('--patch_file_name', help="Patch file path", required=True)
@@ -35,10 +35,45 @@ typedef struct esp_delta_ota_cfg {
         merged_stream_write_cb_with_user_ctx_t write_cb_with_user_data;     /*!< Write Callback with user data */
         merged_stream_write_cb_t write_cb DEPRECATED_ATTRIBUTE;             /*!< Write Callback */
     };
+    const char *checkpoint_id;    /*!< Identifies the update in its checkpoints, e.g. the version of the new firmware. NULL disables checkpoints */
+    const uint8_t *expected_sha256; /*!< SHA-256 of the patched data, e.g. from a patch header of esp_delta_ota_patch_gen.py --new_digest,
+                                         checked by esp_delta_ota_finalize(). The 32 bytes are copied. NULL disables the check */
 } esp_delta_ota_cfg_t;
 
 #undef DEPRECATED_ATTRIBUTE
 
+typedef void *esp_delta_ota_in_place_handle_t;
+
+// Callbacks for the memory patched in place, e.g. an app partition, at offsets from its start
+typedef esp_err_t (*mem_read_cb_t)(uint8_t *buf_p, size_t size, size_t offset, void *user_data);
+typedef esp_err_t (*mem_write_cb_t)(const uint8_t *buf_p, size_t size, size_t offset, void *user_data);
+typedef esp_err_t (*mem_erase_cb_t)(size_t offset, size_t size, void *user_data);
+
+typedef struct esp_delta_ota_in_place_cfg {
+    void *user_data;              /*!< User Data */
+    mem_read_cb_t read_cb;        /*!< Reads the memory */
+    mem_write_cb_t write_cb;      /*!< Writes erased memory */
+    mem_erase_cb_t erase_cb;      /*!< Erases the memory, in multiples of the 4 KB flash sectors */
+    size_t patch_size;            /*!< Size of the in-place detools patch */
+    const char *update_id;        /*!< Identifies the update in the steps saved in NVS, e.g. the version of the new firmware. NULL disables resuming */
+} esp_delta_ota_in_place_cfg_t;
+
+/**
+ * @brief Statistics of the source read cache
+ */
+typedef struct esp_delta_ota_read_cache_stats {
+    uint32_t hits;                /*!< Cache lines read from the cache */
+    uint32_t misses;              /*!< Cache lines read from the source with read_cb */
+} esp_delta_ota_read_cache_stats_t;
+
+/**
+ * @brief Offsets to continue an update from its checkpoint
+ */
+typedef struct esp_delta_ota_checkpoint {
+    size_t patch_offset;          /*!< Offset in the patch to feed it from */
+    size_t to_offset;             /*!< Size of the patched data written with write_cb before the checkpoint */
+} esp_delta_ota_checkpoint_t;
+
 /**
  * @brief Initializes the delta OTA process
  *
@@ -48,26 +83,88 @@ typedef struct esp_delta_ota_cfg {
  */
 esp_delta_ota_handle_t esp_delta_ota_init(esp_delta_ota_cfg_t *cfg);
 
+/**
+ * @brief Initializes the delta OTA process from the last checkpoint of an interrupted update
+ *
+ * Checkpoints are saved in NVS every CONFIG_ESP_DELTA_OTA_CHECKPOINT_INTERVAL bytes of patch and with
+ * esp_delta_ota_checkpoint(), for updates with a checkpoint_id. They are erased when the update is
+ * finalized and when an update starts over with esp_delta_ota_init().
+ *
+ * The patch is then fed from checkpoint->patch_offset and write_cb is called with the patched data
+ * from checkpoint->to_offset. If there is no checkpoint of cfg->checkpoint_id, the update starts
+ * from the beginning and both offsets are 0.
+ *
+ * @note NVS must be initialized.
+ *
+ * @param[in]  cfg          pointer to esp_delta_ota_cfg_t structure, with the checkpoint_id of the update.
+ * @param[out] checkpoint   offsets in the patch and in the patched data to continue from
+ * @return - NULL   On failure
+ *         - esp_delta_ota_handle_t handle
+ */
+esp_delta_ota_handle_t esp_delta_ota_resume(esp_delta_ota_cfg_t *cfg, esp_delta_ota_checkpoint_t *checkpoint);
+
 /**
  * @brief This function performs the patch applying operation on the source data.
  *
+ * With CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE, the patched data is passed to write_cb in whole buffers,
+ * the rest of it by esp_delta_ota_checkpoint() and esp_delta_ota_finalize().
+ *
+ * With CONFIG_ESP_DELTA_OTA_HDIFFPATCH, hdiffpatch patches are told by their header: their diff is
+ * decompressed into the heap and applied by esp_delta_ota_finalize(), no data is written before.
+ *
  * @param[in] handle    esp_delta_ota_handle_t handle
  * @param[in] buf       pointer to patch buffer
  * @param[in] size      size of patch buffer.
  * @return - ESP_OK
  *         - ESP_ERR_INVALID_ARG
+ *         - ESP_ERR_INVALID_SIZE   if the diff of an hdiffpatch patch is larger than
+ *                                  CONFIG_ESP_DELTA_OTA_HDIFFPATCH_MAX_DIFF_SIZE or than its header tells
+ *         - ESP_ERR_NO_MEM         if the diff of an hdiffpatch patch cannot be allocated
  *         - ESP_FAIL
  */
 esp_err_t esp_delta_ota_feed_patch(esp_delta_ota_handle_t handle, const uint8_t *buf, int size);
 
+/**
+ * @brief Saves a checkpoint of the update in NVS, to continue it with esp_delta_ota_resume()
+ *
+ * The patched data buffered is first passed to write_cb. The patched data passed to write_cb so far
+ * must be kept across the interruption, e.g. written to flash.
+ *
+ * @param[in] handle    esp_delta_ota_handle_t handle
+ * @return - ESP_OK
+ *         - ESP_ERR_INVALID_ARG
+ *         - ESP_ERR_INVALID_STATE  if the update has no checkpoint_id
+ *         - ESP_ERR_NOT_SUPPORTED  for hdiffpatch patches
+ *         - Errors of NVS
+ */
+esp_err_t esp_delta_ota_checkpoint(esp_delta_ota_handle_t handle);
+
 /**
  * @brief This function finishes the patch applying operation.
  *
+ * With an expected_sha256, the SHA-256 of the data passed to write_cb is computed while the patch is
+ * applied and compared to it, so the patched data needs not be read back to be checked.
+ * Hdiffpatch patches are applied by this function, with the work buffer as the cache of HPatch.
+ *
  * @param[in] handle    esp_delta_ota_handle_t
- * @return int
+ * @return - ESP_OK
+ *         - ESP_ERR_INVALID_ARG
+ *         - ESP_ERR_INVALID_CRC    if the SHA-256 of the patched data is not the expected one
+ *         - ESP_ERR_INVALID_SIZE   if the diff of an hdiffpatch patch is larger than its header tells
+ *         - ESP_FAIL
  */
 esp_err_t esp_delta_ota_finalize(esp_delta_ota_handle_t handle);
 
+/**
+ * @brief Get the statistics of the source read cache
+ * @param[in]  handle    esp_delta_ota_handle_t
+ * @param[out] stats     pointer to the statistics
+ * @return - ESP_OK
+ *         - ESP_ERR_INVALID_ARG
+ *         - ESP_ERR_NOT_SUPPORTED  if CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE is 0
+ */
+esp_err_t esp_delta_ota_get_read_cache_stats(esp_delta_ota_handle_t handle, esp_delta_ota_read_cache_stats_t *stats);
+
 /**
  * @brief Clean-up delta ota process
  *
@@ -75,6 +172,62 @@ esp_err_t esp_delta_ota_finalize(esp_delta_ota_handle_t handle);
  */
 esp_err_t esp_delta_ota_deinit(esp_delta_ota_handle_t handle);
 
+/**
+ * @brief Initializes an in-place update, which patches the memory holding the base image
+ *
+ * The patch is an in-place detools patch (detools create_patch_in_place) for a memory of its memory
+ * size, whose segment size must be a multiple of 4 KB. The base image is first shifted up in the memory,
+ * then the new image is written from offset 0, one segment at a time. The memory must not be the flash
+ * of the running app, the update is applied by another app (e.g. a factory app) or the bootloader.
+ *
+ * With an update_id, each segment completed is a step saved in NVS. After an interruption, the update
+ * is initialized again with the same update_id and the whole patch fed again: the completed steps are
+ * skipped and the memory is written from the first step that was not. Once all steps are completed
+ * the update stays completed until esp_delta_ota_in_place_finalize(), feeding its patch again with the
+ * same update_id leaves the memory as is. The steps are erased by esp_delta_ota_in_place_finalize(), the
+ * patch must not be fed again after it, e.g. the new image is booted or the update recorded as applied
+ * first. Without update_id, an interrupted update cannot be recovered.
+ *
+ * @note NVS must be initialized if update_id is set.
+ *
+ * @param[in] cfg   pointer to esp_delta_ota_in_place_cfg_t structure.
+ * @return - NULL   On failure
+ *         - esp_delta_ota_in_place_handle_t handle
+ */
+esp_delta_ota_in_place_handle_t esp_delta_ota_in_place_init(esp_delta_ota_in_place_cfg_t *cfg);
+
+/**
+ * @brief Applies the next bytes of the in-place patch
+ *
+ * @param[in] handle    esp_delta_ota_in_place_handle_t handle
+ * @param[in] buf       pointer to patch buffer
+ * @param[in] size      size of patch buffer.
+ * @return - ESP_OK
+ *         - ESP_ERR_INVALID_ARG
+ *         - ESP_FAIL
+ */
+esp_err_t esp_delta_ota_in_place_feed_patch(esp_delta_ota_in_place_handle_t handle, const uint8_t *buf, size_t size);
+
+/**
+ * @brief Finishes the in-place patching
+ *
+ * With an update_id, the steps saved in NVS are erased, the update is not known as completed anymore.
+ *
+ * @param[in]  handle   esp_delta_ota_in_place_handle_t
+ * @param[out] to_size  size of the new image at the start of the memory, may be NULL
+ * @return - ESP_OK
+ *         - ESP_ERR_INVALID_ARG
+ *         - ESP_FAIL
+ */
+esp_err_t esp_delta_ota_in_place_finalize(esp_delta_ota_in_place_handle_t handle, size_t *to_size);
+
+/**
+ * @brief Clean-up the in-place update, the steps saved are kept
+ *
+ * @param[in] handle    esp_delta_ota_in_place_handle_t
+ */
+esp_err_t esp_delta_ota_in_place_deinit(esp_delta_ota_in_place_handle_t handle);
+
 #ifdef __cplusplus
 }
 #endif
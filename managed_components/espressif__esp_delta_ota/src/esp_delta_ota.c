@@ -6,17 +6,97 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <sys/param.h>
 
 #include "esp_err.h"
 #include "esp_log.h"
+#include "nvs.h"
+#include "mbedtls/sha256.h"
 
 #include "esp_delta_ota.h"
 #include "detools.h"
+#if CONFIG_ESP_DELTA_OTA_HDIFFPATCH
+#include "patch.h"
+#endif
 
 static const char *TAG = "esp_delta_ota";
 
+#if (ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0))
+// mbedtls 2.x, the functions without _ret return nothing
+#define mbedtls_sha256_starts   mbedtls_sha256_starts_ret
+#define mbedtls_sha256_update   mbedtls_sha256_update_ret
+#define mbedtls_sha256_finish   mbedtls_sha256_finish_ret
+#endif
+
+#if CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE
+#define READ_CACHE_LINE_SIZE    CONFIG_ESP_DELTA_OTA_READ_CACHE_LINE_SIZE
+#define READ_CACHE_LINES        (CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE / READ_CACHE_LINE_SIZE)
+
+_Static_assert((READ_CACHE_LINE_SIZE & (READ_CACHE_LINE_SIZE - 1)) == 0, "Read cache line size must be a power of two");
+_Static_assert(READ_CACHE_LINES > 0, "Read cache size must be at least one line");
+
+typedef struct {
+    int offset;                 // source offset of the line, -1 if the line is empty
+    uint32_t used;              // last use, for replacement of the least recently used lines
+} read_cache_line_t;
+
+typedef struct {
+    uint8_t *data;              // READ_CACHE_LINES lines, consecutive lines are read in one go
+    read_cache_line_t lines[READ_CACHE_LINES];
+    uint32_t clock;
+    esp_delta_ota_read_cache_stats_t stats;
+} read_cache_t;
+#endif
+
+#define CHECKPOINT_NVS_NAMESPACE    "delta_ota"
+#define CHECKPOINT_NVS_KEY          "checkpoint"
+#define CHECKPOINT_MAGIC            0xde17a0c4
+
+#define SHA256_SIZE                 32
+
+#if CONFIG_ESP_DELTA_OTA_HDIFFPATCH
+#define PATCH_TYPE_HDIFFPATCH       2           // 3 bits after the first of the detools patch header
+#define HPATCH_MIN_CACHE_SIZE       2048
+
+_Static_assert(CONFIG_ESP_DELTA_OTA_WORK_BUF_SIZE >= HPATCH_MIN_CACHE_SIZE, "HPatch needs a work buffer of at least 2 KB");
+#endif
+
+#define IN_PLACE_NVS_KEY            "in_place"
+#define IN_PLACE_MAGIC              0xde17a0c3
+#define IN_PLACE_DONE               INT_MAX     // step saved once all steps are completed
+#define IN_PLACE_ERASE_SIZE         4096
+
+/* Steps blob in NVS: header then id of the update */
+typedef struct {
+    uint32_t magic;
+    int32_t step;                       // last step completed
+    uint16_t id_len;
+    uint16_t reserved;
+} in_place_steps_hdr_t;
+
+/* Checkpoint blob in NVS: header, id of the update, the dumped detools state, then the sha256_sw_t state
+ * of updates with an expected_sha256, in a single key so that a checkpoint is replaced as a whole or not
+ * at all */
+typedef struct {
+    uint32_t magic;
+    uint16_t id_len;
+    uint16_t state_size;
+    uint16_t sha256_size;
+    uint16_t reserved;
+} checkpoint_hdr_t;
+
+/* SHA-256 in software, for updates with checkpoints. The whole state of the hash is in the struct, so it
+ * is saved in the checkpoint as is; the mbedtls context may keep it in the SHA peripheral instead. */
+typedef struct {
+    uint32_t state[8];
+    uint64_t len;                       // bytes hashed
+    uint8_t block[64];                  // first len % 64 bytes of the current block
+} sha256_sw_t;
+
 typedef struct esp_delta_ota_ctx {
     void *user_data;
     src_read_cb_t read_cb;
@@ -25,15 +105,134 @@ typedef struct esp_delta_ota_ctx {
         merged_stream_write_cb_t write_cb;
     };
     struct detools_apply_patch_t *apply_patch;
+    uint8_t *work_buf;
+#if CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE
+    read_cache_t read_cache;
+#endif
     int src_offset;
+    const char *checkpoint_id;
+    size_t checkpoint_patch_offset;     // patch offset of the last checkpoint
+    uint8_t *state;                     // detools state dumped to or restored from
+    size_t state_size;
+    size_t state_pos;
+    bool check_sha256;
+    uint8_t expected_sha256[SHA256_SIZE];
+    mbedtls_sha256_context sha256;      // of the data written with write_cb, without checkpoint_id
+    sha256_sw_t sha256_sw;              // of the data written with write_cb, with checkpoint_id
+#if CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE
+    uint8_t *write_buf;                 // patched data not passed to write_cb yet
+    size_t write_len;
+    size_t write_offset;                // patched data offset of write_buf
+#endif
+#if CONFIG_ESP_DELTA_OTA_HDIFFPATCH
+    struct detools_hdiffpatch_reader_t *hdiffpatch;    // hdiffpatch patches, NULL for sequential ones
+    uint8_t *diff;                      // HDiffPatch compressed diff, applied by esp_delta_ota_finalize()
+    size_t diff_size;                   // allocated for the diff, from the patch header
+    size_t diff_len;
+    esp_err_t diff_err;                 // error of hdiffpatch_diff_write_cb(), returned by esp_delta_ota_feed_patch()
+    size_t to_offset;                   // patched data written by HPatch
+#endif
 } esp_delta_ota_ctx;
 
-static int esp_delta_ota_write_cb(void *arg_p, const uint8_t *buf_p, size_t size)
+typedef struct esp_delta_ota_in_place_ctx {
+    void *user_data;
+    mem_read_cb_t read_cb;
+    mem_write_cb_t write_cb;
+    mem_erase_cb_t erase_cb;
+    const char *update_id;
+    int step;                           // last step completed, as saved in NVS
+    struct detools_apply_patch_in_place_t *apply_patch;
+} esp_delta_ota_in_place_ctx;
+
+static const uint32_t s_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define SHA256_ROTR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_sw_block(sha256_sw_t *sha, const uint8_t *block)
 {
-    if (size <= 0) {
-        return ESP_ERR_INVALID_ARG;
+    uint32_t w[64], v[8];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+               (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
     }
-    esp_delta_ota_ctx *handle = (esp_delta_ota_ctx *)arg_p;
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = SHA256_ROTR(w[i - 15], 7) ^ SHA256_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = SHA256_ROTR(w[i - 2], 17) ^ SHA256_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(v, sha->state, sizeof(v));
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = SHA256_ROTR(v[4], 6) ^ SHA256_ROTR(v[4], 11) ^ SHA256_ROTR(v[4], 25);
+        uint32_t t1 = v[7] + s1 + ((v[4] & v[5]) ^ (~v[4] & v[6])) + s_sha256_k[i] + w[i];
+        uint32_t s0 = SHA256_ROTR(v[0], 2) ^ SHA256_ROTR(v[0], 13) ^ SHA256_ROTR(v[0], 22);
+        uint32_t t2 = s0 + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v + 1, v, 7 * sizeof(v[0]));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++) {
+        sha->state[i] += v[i];
+    }
+}
+
+static void sha256_sw_starts(sha256_sw_t *sha)
+{
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(sha->state, init, sizeof(init));
+    sha->len = 0;
+}
+
+static void sha256_sw_update(sha256_sw_t *sha, const uint8_t *buf, size_t size)
+{
+    size_t used = sha->len % sizeof(sha->block);
+    sha->len += size;
+    if (used) {
+        size_t n = MIN(size, sizeof(sha->block) - used);
+        memcpy(sha->block + used, buf, n);
+        buf += n;
+        size -= n;
+        if (used + n < sizeof(sha->block)) {
+            return;
+        }
+        sha256_sw_block(sha, sha->block);
+    }
+    for (; size >= sizeof(sha->block); buf += sizeof(sha->block), size -= sizeof(sha->block)) {
+        sha256_sw_block(sha, buf);
+    }
+    memcpy(sha->block, buf, size);
+}
+
+static void sha256_sw_finish(sha256_sw_t *sha, uint8_t out[SHA256_SIZE])
+{
+    uint64_t bits = sha->len * 8;
+    uint8_t pad[sizeof(sha->block) + 8] = { 0x80 };
+    size_t used = sha->len % sizeof(sha->block);
+    size_t pad_len = (used < 56 ? 56 : 120) - used;
+    for (int i = 0; i < 8; i++) {
+        pad[pad_len + i] = bits >> (56 - 8 * i);
+    }
+    sha256_sw_update(sha, pad, pad_len + 8);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = sha->state[i] >> 24;
+        out[4 * i + 1] = sha->state[i] >> 16;
+        out[4 * i + 2] = sha->state[i] >> 8;
+        out[4 * i + 3] = sha->state[i];
+    }
+}
+
+static esp_err_t write_out(esp_delta_ota_ctx *handle, const uint8_t *buf_p, size_t size)
+{
     esp_err_t err = ESP_OK;
     if (!handle->user_data) {
         err = handle->write_cb(buf_p, size);
@@ -48,6 +247,167 @@ static int esp_delta_ota_write_cb(void *arg_p, const uint8_t *buf_p, size_t size
             return ESP_FAIL;
         }
     }
+    if (!handle->check_sha256) {
+        return ESP_OK;
+    }
+    if (handle->checkpoint_id) {
+        sha256_sw_update(&handle->sha256_sw, buf_p, size);
+    } else if (mbedtls_sha256_update(&handle->sha256, buf_p, size) != 0) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/* Passes the buffered patched data to write_cb */
+static esp_err_t write_flush(esp_delta_ota_ctx *handle)
+{
+#if CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE
+    if (handle->write_len > 0) {
+        esp_err_t err = write_out(handle, handle->write_buf, handle->write_len);
+        if (err != ESP_OK) {
+            return err;
+        }
+        handle->write_offset += handle->write_len;
+        handle->write_len = 0;
+    }
+#else
+    (void)handle;
+#endif
+    return ESP_OK;
+}
+
+static int esp_delta_ota_write_cb(void *arg_p, const uint8_t *buf_p, size_t size)
+{
+    if (size <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_delta_ota_ctx *handle = (esp_delta_ota_ctx *)arg_p;
+#if CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE
+    while (size > 0) {
+        // the buffer is flushed at multiples of its size in the patched data, resumed updates included,
+        // so that write_cb is passed whole flash sectors
+        size_t end = CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE - handle->write_offset % CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE;
+        size_t len = MIN(size, end - handle->write_len);
+        memcpy(handle->write_buf + handle->write_len, buf_p, len);
+        handle->write_len += len;
+        buf_p += len;
+        size -= len;
+        if (handle->write_len == end && write_flush(handle) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+#else
+    return write_out(handle, buf_p, size);
+#endif
+}
+
+#if CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE
+static esp_err_t read_cache_init(read_cache_t *cache)
+{
+    cache->data = malloc(READ_CACHE_LINES * READ_CACHE_LINE_SIZE);
+    if (!cache->data) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < READ_CACHE_LINES; i++) {
+        cache->lines[i].offset = -1;
+        cache->lines[i].used = 0;
+    }
+    cache->clock = 0;
+    return ESP_OK;
+}
+
+static int read_cache_lookup(const read_cache_t *cache, int offset)
+{
+    for (int i = 0; i < READ_CACHE_LINES; i++) {
+        if (cache->lines[i].offset == offset) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Returns the first of count consecutive lines least recently used, -1 if count is more than the cache holds */
+static int read_cache_victim(const read_cache_t *cache, int count)
+{
+    int victim = -1;
+    uint32_t victim_used = UINT32_MAX;
+    for (int i = 0; i + count <= READ_CACHE_LINES; i++) {
+        uint32_t used = 0;
+        for (int j = i; j < i + count; j++) {
+            used = MAX(used, cache->lines[j].used);
+        }
+        if (used < victim_used) {
+            victim = i;
+            victim_used = used;
+        }
+    }
+    return victim;
+}
+
+static esp_err_t read_cache_read(esp_delta_ota_ctx *handle, uint8_t *buf_p, size_t size, int offset)
+{
+    read_cache_t *cache = &handle->read_cache;
+    int end = offset + size;
+    while (offset < end) {
+        int line_offset = offset & ~(READ_CACHE_LINE_SIZE - 1);
+        int i = read_cache_lookup(cache, line_offset);
+        if (i >= 0) {
+            int len = MIN(line_offset + READ_CACHE_LINE_SIZE, end) - offset;
+            memcpy(buf_p, cache->data + i * READ_CACHE_LINE_SIZE + (offset - line_offset), len);
+            cache->lines[i].used = ++cache->clock;
+            cache->stats.hits++;
+            buf_p += len;
+            offset += len;
+            continue;
+        }
+
+        /* Read ahead the missing lines up to the end of the read or the next cached line */
+        int run_end = line_offset + READ_CACHE_LINE_SIZE;
+        while (run_end < end && read_cache_lookup(cache, run_end) < 0) {
+            run_end += READ_CACHE_LINE_SIZE;
+        }
+        int count = (run_end - line_offset) / READ_CACHE_LINE_SIZE;
+        int len = MIN(run_end, end) - offset;
+        i = read_cache_victim(cache, count);
+        if (i >= 0) {
+            for (int j = i; j < i + count; j++) {
+                cache->lines[j].offset = -1;
+                cache->lines[j].used = 0;
+            }
+        }
+        if (i >= 0 && handle->read_cb(cache->data + i * READ_CACHE_LINE_SIZE, count * READ_CACHE_LINE_SIZE, line_offset) == ESP_OK) {
+            for (int j = i; j < i + count; j++) {
+                cache->lines[j].offset = line_offset + (j - i) * READ_CACHE_LINE_SIZE;
+                cache->lines[j].used = ++cache->clock;
+            }
+            cache->stats.misses += count;
+            memcpy(buf_p, cache->data + i * READ_CACHE_LINE_SIZE + (offset - line_offset), len);
+        } else {
+            // larger than the cache or lines past the end of the source, read the data as is
+            esp_err_t err = handle->read_cb(buf_p, len, offset);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        buf_p += len;
+        offset += len;
+    }
+    return ESP_OK;
+}
+#endif /* CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE */
+
+static esp_err_t src_read(esp_delta_ota_ctx *handle, uint8_t *buf_p, size_t size, int offset)
+{
+#if CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE
+    esp_err_t err = read_cache_read(handle, buf_p, size, offset);
+#else
+    esp_err_t err = handle->read_cb(buf_p, size, offset);
+#endif
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error in read_cb(): %s", esp_err_to_name(err));
+        return ESP_FAIL;
+    }
     return ESP_OK;
 }
 
@@ -57,9 +417,7 @@ static int esp_delta_ota_read_cb(void *arg_p, uint8_t *buf_p, size_t size)
         return -ESP_ERR_INVALID_ARG;
     }
     esp_delta_ota_ctx *handle = (esp_delta_ota_ctx *)arg_p;
-    esp_err_t err = handle->read_cb(buf_p, size, handle->src_offset);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error in read_cb(): %s", esp_err_to_name(err));
+    if (src_read(handle, buf_p, size, handle->src_offset) != ESP_OK) {
         return ESP_FAIL;
     }
     handle->src_offset += size;
@@ -73,7 +431,236 @@ static int esp_delta_ota_seek_cb(void *arg_p, int offset)
     return ESP_OK;
 }
 
-esp_delta_ota_handle_t esp_delta_ota_init(esp_delta_ota_cfg_t *cfg)
+static int esp_delta_ota_state_write_cb(void *arg_p, const void *buf_p, size_t size)
+{
+    esp_delta_ota_ctx *handle = (esp_delta_ota_ctx *)arg_p;
+    if (handle->state_pos + size > handle->state_size) {
+        return -ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(handle->state + handle->state_pos, buf_p, size);
+    handle->state_pos += size;
+    return ESP_OK;
+}
+
+static int esp_delta_ota_state_read_cb(void *arg_p, void *buf_p, size_t size)
+{
+    esp_delta_ota_ctx *handle = (esp_delta_ota_ctx *)arg_p;
+    if (handle->state_pos + size > handle->state_size) {
+        return -ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(buf_p, handle->state + handle->state_pos, size);
+    handle->state_pos += size;
+    return ESP_OK;
+}
+
+#if CONFIG_ESP_DELTA_OTA_HDIFFPATCH
+static int hdiffpatch_diff_write_cb(void *arg_p, const uint8_t *buf_p, size_t size)
+{
+    esp_delta_ota_ctx *handle = (esp_delta_ota_ctx *)arg_p;
+    if (!handle->diff) {
+        size_t diff_size = detools_hdiffpatch_reader_get_diff_size(handle->hdiffpatch);
+        if (diff_size == 0 || diff_size > CONFIG_ESP_DELTA_OTA_HDIFFPATCH_MAX_DIFF_SIZE) {
+            ESP_LOGE(TAG, "Diff of %u bytes, at most %d are supported", (unsigned)diff_size,
+                     CONFIG_ESP_DELTA_OTA_HDIFFPATCH_MAX_DIFF_SIZE);
+            handle->diff_err = ESP_ERR_INVALID_SIZE;
+            return -DETOOLS_CORRUPT_PATCH;
+        }
+        handle->diff = malloc(diff_size);
+        if (!handle->diff) {
+            ESP_LOGE(TAG, "Unable to allocate %u bytes for the diff", (unsigned)diff_size);
+            handle->diff_err = ESP_ERR_NO_MEM;
+            return -DETOOLS_OUT_OF_MEMORY;
+        }
+        handle->diff_size = diff_size;
+    }
+    // the reader should write no more than the diff size of the patch header, the patch is not trusted
+    if (size > handle->diff_size - handle->diff_len) {
+        ESP_LOGE(TAG, "Diff larger than the %u bytes of the patch header", (unsigned)handle->diff_size);
+        handle->diff_err = ESP_ERR_INVALID_SIZE;
+        return -DETOOLS_CORRUPT_PATCH;
+    }
+    memcpy(handle->diff + handle->diff_len, buf_p, size);
+    handle->diff_len += size;
+    return 0;
+}
+
+static hpatch_BOOL hdiffpatch_old_read(const hpatch_TStreamInput *stream, hpatch_StreamPos_t pos,
+                                       unsigned char *out_data, unsigned char *out_data_end)
+{
+    esp_delta_ota_ctx *handle = (esp_delta_ota_ctx *)stream->streamImport;
+    if (out_data == out_data_end) {
+        return hpatch_TRUE;
+    }
+    return src_read(handle, out_data, out_data_end - out_data, (int)pos) == ESP_OK;
+}
+
+static hpatch_BOOL hdiffpatch_new_write(const hpatch_TStreamOutput *stream, hpatch_StreamPos_t pos,
+                                        const unsigned char *data, const unsigned char *data_end)
+{
+    esp_delta_ota_ctx *handle = (esp_delta_ota_ctx *)stream->streamImport;
+    // HPatch writes the new data in order, as write_cb takes it
+    if (pos != handle->to_offset) {
+        return hpatch_FALSE;
+    }
+    if (data == data_end) {
+        return hpatch_TRUE;
+    }
+    if (esp_delta_ota_write_cb(handle, data, data_end - data) != ESP_OK) {
+        return hpatch_FALSE;
+    }
+    handle->to_offset += data_end - data;
+    return hpatch_TRUE;
+}
+
+/* Applies the diff of the hdiffpatch patch fed, the work buffer is the cache of HPatch */
+static esp_err_t hdiffpatch_apply(esp_delta_ota_ctx *ctx)
+{
+    int to_size = detools_hdiffpatch_reader_finalize(ctx->hdiffpatch);
+    if (to_size < 0) {
+        ESP_LOGE(TAG, "Error while finishing the patching: %s", detools_error_as_string(to_size));
+        return ctx->diff_err != ESP_OK ? ctx->diff_err : ESP_FAIL;
+    }
+    if (ctx->diff_len != ctx->diff_size) {
+        ESP_LOGE(TAG, "Diff of %u bytes, %u in the patch header", (unsigned)ctx->diff_len, (unsigned)ctx->diff_size);
+        return ESP_FAIL;
+    }
+    hpatch_TStreamInput diff;
+    hpatch_compressedDiffInfo info;
+    mem_as_hStreamInput(&diff, ctx->diff, ctx->diff + ctx->diff_len);
+    // the diff of detools has no compressed parts, HPatch is built without decompressor
+    if (!getCompressedDiffInfo(&info, &diff) || info.newDataSize != (hpatch_StreamPos_t)to_size
+            || info.compressedCount != 0) {
+        ESP_LOGE(TAG, "Corrupt HDiffPatch diff");
+        return ESP_FAIL;
+    }
+    hpatch_TStreamInput old_data = {
+        .streamImport = ctx,
+        .streamSize = info.oldDataSize,
+        .read = hdiffpatch_old_read,
+    };
+    hpatch_TStreamOutput new_data = {
+        .streamImport = ctx,
+        .streamSize = info.newDataSize,
+        .write = hdiffpatch_new_write,
+    };
+    if (!patch_decompress_with_cache(&new_data, &old_data, &diff, NULL, ctx->work_buf,
+                                     ctx->work_buf + CONFIG_ESP_DELTA_OTA_WORK_BUF_SIZE)
+            || ctx->to_offset != (size_t)to_size) {
+        ESP_LOGE(TAG, "Error while applying the HDiffPatch diff");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+#endif /* CONFIG_ESP_DELTA_OTA_HDIFFPATCH */
+
+/* Erases the checkpoint or the in-place steps, ESP_OK if there are none */
+static esp_err_t nvs_key_erase(const char *key)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CHECKPOINT_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_erase_key(nvs, key);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = ESP_OK;
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+static esp_err_t checkpoint_save(esp_delta_ota_ctx *ctx)
+{
+    checkpoint_hdr_t hdr = {
+        .magic = CHECKPOINT_MAGIC,
+        .id_len = strlen(ctx->checkpoint_id),
+        .sha256_size = ctx->check_sha256 ? sizeof(sha256_sw_t) : 0,
+    };
+    size_t size = sizeof(hdr) + hdr.id_len + sizeof(struct detools_apply_patch_t) + hdr.sha256_size;
+    uint8_t *blob = malloc(size);
+    if (!blob) {
+        return ESP_ERR_NO_MEM;
+    }
+    ctx->state = blob + sizeof(hdr) + hdr.id_len;
+    ctx->state_size = sizeof(struct detools_apply_patch_t);
+    ctx->state_pos = 0;
+    esp_err_t err = ESP_FAIL;
+    if (detools_apply_patch_dump(ctx->apply_patch, esp_delta_ota_state_write_cb) == 0) {
+        hdr.state_size = ctx->state_pos;
+        memcpy(blob, &hdr, sizeof(hdr));
+        memcpy(blob + sizeof(hdr), ctx->checkpoint_id, hdr.id_len);
+        memcpy(ctx->state + hdr.state_size, &ctx->sha256_sw, hdr.sha256_size);
+        nvs_handle_t nvs;
+        err = nvs_open(CHECKPOINT_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+        if (err == ESP_OK) {
+            err = nvs_set_blob(nvs, CHECKPOINT_NVS_KEY, blob, sizeof(hdr) + hdr.id_len + hdr.state_size + hdr.sha256_size);
+            if (err == ESP_OK) {
+                err = nvs_commit(nvs);
+            }
+            nvs_close(nvs);
+        }
+    }
+    ctx->state = NULL;
+    free(blob);
+    if (err == ESP_OK) {
+        ctx->checkpoint_patch_offset = detools_apply_patch_get_patch_offset(ctx->apply_patch);
+    }
+    return err;
+}
+
+/* Restores the checkpoint of the update of ctx->checkpoint_id, ESP_ERR_NOT_FOUND if there is none */
+static esp_err_t checkpoint_restore(esp_delta_ota_ctx *ctx)
+{
+    nvs_handle_t nvs;
+    size_t size = 0;
+    esp_err_t err = nvs_open(CHECKPOINT_NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_ERR_NOT_FOUND;
+    } else if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_get_blob(nvs, CHECKPOINT_NVS_KEY, NULL, &size);
+    uint8_t *blob = NULL;
+    if (err == ESP_OK) {
+        blob = malloc(size);
+        err = blob ? nvs_get_blob(nvs, CHECKPOINT_NVS_KEY, blob, &size) : ESP_ERR_NO_MEM;
+    }
+    nvs_close(nvs);
+    if (err != ESP_OK) {
+        free(blob);
+        return err == ESP_ERR_NVS_NOT_FOUND ? ESP_ERR_NOT_FOUND : err;
+    }
+
+    checkpoint_hdr_t hdr;
+    size_t id_len = strlen(ctx->checkpoint_id);
+    size_t sha256_size = ctx->check_sha256 ? sizeof(sha256_sw_t) : 0;
+    memcpy(&hdr, blob, MIN(size, sizeof(hdr)));
+    if (size < sizeof(hdr) || hdr.magic != CHECKPOINT_MAGIC
+            || size != sizeof(hdr) + hdr.id_len + hdr.state_size + hdr.sha256_size
+            || hdr.state_size < sizeof(struct detools_apply_patch_t) || hdr.sha256_size != sha256_size
+            || hdr.id_len != id_len || memcmp(blob + sizeof(hdr), ctx->checkpoint_id, id_len) != 0) {
+        // checkpoint of another update, or of a build with another layout of the detools state
+        free(blob);
+        return ESP_ERR_NOT_FOUND;
+    }
+    ctx->state = blob + sizeof(hdr) + hdr.id_len;
+    ctx->state_size = hdr.state_size;
+    ctx->state_pos = 0;
+    int ret = detools_apply_patch_restore(ctx->apply_patch, esp_delta_ota_state_read_cb);
+    memcpy(&ctx->sha256_sw, ctx->state + hdr.state_size, sha256_size);
+    ctx->state = NULL;
+    free(blob);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Error while restoring the checkpoint: %s", detools_error_as_string(ret));
+        return ESP_FAIL;
+    }
+    ctx->checkpoint_patch_offset = detools_apply_patch_get_patch_offset(ctx->apply_patch);
+    return ESP_OK;
+}
+
+static esp_delta_ota_ctx *esp_delta_ota_create(esp_delta_ota_cfg_t *cfg)
 {
     esp_delta_ota_ctx *ctx = calloc(1, sizeof(esp_delta_ota_ctx));
     if (!ctx) {
@@ -90,15 +677,111 @@ esp_delta_ota_handle_t esp_delta_ota_init(esp_delta_ota_cfg_t *cfg)
         ctx = NULL;
         return NULL;
     }
+    ctx->work_buf = malloc(CONFIG_ESP_DELTA_OTA_WORK_BUF_SIZE);
+    if (!ctx->work_buf) {
+        ESP_LOGE(TAG, "Unable to allocate memory");
+        free(ctx->apply_patch);
+        free(ctx);
+        return NULL;
+    }
+#if CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE
+    ctx->write_buf = malloc(CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE);
+    if (!ctx->write_buf) {
+        ESP_LOGE(TAG, "Unable to allocate memory");
+        free(ctx->work_buf);
+        free(ctx->apply_patch);
+        free(ctx);
+        return NULL;
+    }
+#endif
+#if CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE
+    if (read_cache_init(&ctx->read_cache) != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to allocate memory");
+#if CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE
+        free(ctx->write_buf);
+#endif
+        free(ctx->work_buf);
+        free(ctx->apply_patch);
+        free(ctx);
+        return NULL;
+    }
+#endif
     int ret = detools_apply_patch_init(ctx->apply_patch, &esp_delta_ota_read_cb, &esp_delta_ota_seek_cb, 0, &esp_delta_ota_write_cb, ctx);
+    if (ret == 0) {
+        ret = detools_apply_patch_set_work_buffer(ctx->apply_patch, ctx->work_buf, CONFIG_ESP_DELTA_OTA_WORK_BUF_SIZE);
+    }
     if (ret < 0) {
         ESP_LOGE(TAG, "Error while initializing delta_ota: %s", detools_error_as_string(ret));
+#if CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE
+        free(ctx->read_cache.data);
+#endif
+#if CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE
+        free(ctx->write_buf);
+#endif
+        free(ctx->work_buf);
         free(ctx->apply_patch);
         ctx->apply_patch = NULL;
         free(ctx);
         ctx = NULL;
         return NULL;
     }
+    ctx->checkpoint_id = cfg->checkpoint_id;
+    if (cfg->expected_sha256) {
+        ctx->check_sha256 = true;
+        memcpy(ctx->expected_sha256, cfg->expected_sha256, SHA256_SIZE);
+        if (ctx->checkpoint_id) {
+            sha256_sw_starts(&ctx->sha256_sw);
+        } else {
+            mbedtls_sha256_init(&ctx->sha256);
+            mbedtls_sha256_starts(&ctx->sha256, 0);
+        }
+    }
+    return ctx;
+}
+
+esp_delta_ota_handle_t esp_delta_ota_init(esp_delta_ota_cfg_t *cfg)
+{
+    esp_delta_ota_ctx *ctx = esp_delta_ota_create(cfg);
+    if (ctx && ctx->checkpoint_id) {
+        // the update starts over, a checkpoint of an earlier attempt no longer matches the written data
+        esp_err_t err = nvs_key_erase(CHECKPOINT_NVS_KEY);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error while erasing the checkpoint: %s", esp_err_to_name(err));
+            esp_delta_ota_deinit(ctx);
+            return NULL;
+        }
+    }
+    return (esp_delta_ota_handle_t)ctx;
+}
+
+esp_delta_ota_handle_t esp_delta_ota_resume(esp_delta_ota_cfg_t *cfg, esp_delta_ota_checkpoint_t *checkpoint)
+{
+    if (cfg == NULL || cfg->checkpoint_id == NULL || checkpoint == NULL) {
+        return NULL;
+    }
+    esp_delta_ota_ctx *ctx = esp_delta_ota_create(cfg);
+    if (!ctx) {
+        return NULL;
+    }
+    esp_err_t err = checkpoint_restore(ctx);
+    if (err == ESP_ERR_NOT_FOUND) {
+        ESP_LOGI(TAG, "No checkpoint of %s, starting from the beginning", ctx->checkpoint_id);
+        esp_delta_ota_deinit(ctx);
+        checkpoint->patch_offset = 0;
+        checkpoint->to_offset = 0;
+        return esp_delta_ota_init(cfg);
+    }
+    if (err != ESP_OK) {
+        esp_delta_ota_deinit(ctx);
+        return NULL;
+    }
+    checkpoint->patch_offset = detools_apply_patch_get_patch_offset(ctx->apply_patch);
+    checkpoint->to_offset = detools_apply_patch_get_to_offset(ctx->apply_patch);
+#if CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE
+    ctx->write_offset = checkpoint->to_offset;
+#endif
+    ESP_LOGI(TAG, "Resuming %s at patch offset %u, patched data offset %u", ctx->checkpoint_id,
+             (unsigned)checkpoint->patch_offset, (unsigned)checkpoint->to_offset);
     return (esp_delta_ota_handle_t)ctx;
 }
 
@@ -109,14 +792,73 @@ esp_err_t esp_delta_ota_feed_patch(esp_delta_ota_handle_t handle, const uint8_t
     }
     esp_delta_ota_ctx *ctx = (esp_delta_ota_ctx *)handle;
 
+#if CONFIG_ESP_DELTA_OTA_HDIFFPATCH
+    // the engine is told by the patch type of the patch header, hdiffpatch patches have no checkpoints
+    // and are never resumed
+    if (!ctx->hdiffpatch && size > 0 && detools_apply_patch_get_patch_offset(ctx->apply_patch) == 0
+            && ((buf[0] >> 4) & 0x7) == PATCH_TYPE_HDIFFPATCH) {
+        ctx->hdiffpatch = calloc(1, sizeof(struct detools_hdiffpatch_reader_t));
+        if (!ctx->hdiffpatch) {
+            ESP_LOGE(TAG, "Unable to allocate memory");
+            return ESP_FAIL;
+        }
+        detools_hdiffpatch_reader_init(ctx->hdiffpatch, hdiffpatch_diff_write_cb, ctx);
+    }
+    if (ctx->hdiffpatch) {
+        int ret = detools_hdiffpatch_reader_process(ctx->hdiffpatch, buf, size);
+        if (ret != 0) {
+            ESP_LOGE(TAG, "Error while reading the patch: %s", detools_error_as_string(ret));
+            return ctx->diff_err != ESP_OK ? ctx->diff_err : ESP_FAIL;
+        }
+        return ESP_OK;
+    }
+#endif
     int err = detools_apply_patch_process(ctx->apply_patch, (const uint8_t *)buf, size);
     if (err != 0) {
         ESP_LOGE(TAG, "Error while applying patch: %s", detools_error_as_string(err));
         return ESP_FAIL;
     }
+#if CONFIG_ESP_DELTA_OTA_CHECKPOINT_INTERVAL
+    if (ctx->checkpoint_id && detools_apply_patch_get_patch_offset(ctx->apply_patch) - ctx->checkpoint_patch_offset >= CONFIG_ESP_DELTA_OTA_CHECKPOINT_INTERVAL) {
+        // the checkpoint is resumed at the end of the data passed to write_cb
+        if (write_flush(ctx) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        esp_err_t ret = checkpoint_save(ctx);
+        if (ret != ESP_OK) {
+            // the update goes on, an interruption restarts it from the previous checkpoint
+            ESP_LOGW(TAG, "Error while saving the checkpoint: %s", esp_err_to_name(ret));
+        }
+    }
+#endif
     return ESP_OK;
 }
 
+esp_err_t esp_delta_ota_checkpoint(esp_delta_ota_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_delta_ota_ctx *ctx = (esp_delta_ota_ctx *)handle;
+    if (ctx->checkpoint_id == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+#if CONFIG_ESP_DELTA_OTA_HDIFFPATCH
+    if (ctx->hdiffpatch) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+#endif
+    esp_err_t err = write_flush(ctx);
+    if (err != ESP_OK) {
+        return ESP_FAIL;
+    }
+    err = checkpoint_save(ctx);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error while saving the checkpoint: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
 esp_err_t esp_delta_ota_finalize(esp_delta_ota_handle_t handle)
 {
     if (handle == NULL) {
@@ -124,12 +866,61 @@ esp_err_t esp_delta_ota_finalize(esp_delta_ota_handle_t handle)
     }
     esp_delta_ota_ctx *ctx = (esp_delta_ota_ctx *)handle;
 
-    int err = detools_apply_patch_finalize(ctx->apply_patch);
-    if (err < 0) {
-        ESP_LOGE(TAG, "Error while finishing the patching: %s", detools_error_as_string(err));
+#if CONFIG_ESP_DELTA_OTA_HDIFFPATCH
+    if (ctx->hdiffpatch) {
+        esp_err_t err = hdiffpatch_apply(ctx);
+        if (err != ESP_OK) {
+            return err;
+        }
+    } else
+#endif
+    {
+        int err = detools_apply_patch_finalize(ctx->apply_patch);
+        if (err < 0) {
+            ESP_LOGE(TAG, "Error while finishing the patching: %s", detools_error_as_string(err));
+            return ESP_FAIL;
+        }
+    }
+    if (write_flush(ctx) != ESP_OK) {
         return ESP_FAIL;
     }
+    if (ctx->checkpoint_id) {
+        esp_err_t ret = nvs_key_erase(CHECKPOINT_NVS_KEY);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Error while erasing the checkpoint: %s", esp_err_to_name(ret));
+        }
+    }
+#if CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE
+    ESP_LOGD(TAG, "Source read cache: %" PRIu32 " hits, %" PRIu32 " misses",
+             ctx->read_cache.stats.hits, ctx->read_cache.stats.misses);
+#endif
+    if (ctx->check_sha256) {
+        uint8_t sha256[SHA256_SIZE];
+        if (ctx->checkpoint_id) {
+            sha256_sw_finish(&ctx->sha256_sw, sha256);
+        } else if (mbedtls_sha256_finish(&ctx->sha256, sha256) != 0) {
+            return ESP_FAIL;
+        }
+        if (memcmp(sha256, ctx->expected_sha256, SHA256_SIZE) != 0) {
+            ESP_LOGE(TAG, "SHA-256 of the patched data differs from the expected one");
+            return ESP_ERR_INVALID_CRC;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_delta_ota_get_read_cache_stats(esp_delta_ota_handle_t handle, esp_delta_ota_read_cache_stats_t *stats)
+{
+    if (handle == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE
+    esp_delta_ota_ctx *ctx = (esp_delta_ota_ctx *)handle;
+    *stats = ctx->read_cache.stats;
     return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
 }
 
 esp_err_t esp_delta_ota_deinit(esp_delta_ota_handle_t handle)
@@ -141,7 +932,245 @@ esp_err_t esp_delta_ota_deinit(esp_delta_ota_handle_t handle)
 
     free(ctx->apply_patch);
     ctx->apply_patch = NULL;
+    free(ctx->work_buf);
+    ctx->work_buf = NULL;
+#if CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE
+    free(ctx->write_buf);
+    ctx->write_buf = NULL;
+#endif
+#if CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE
+    free(ctx->read_cache.data);
+    ctx->read_cache.data = NULL;
+#endif
+#if CONFIG_ESP_DELTA_OTA_HDIFFPATCH
+    free(ctx->hdiffpatch);
+    ctx->hdiffpatch = NULL;
+    free(ctx->diff);
+    ctx->diff = NULL;
+#endif
+    if (ctx->check_sha256 && !ctx->checkpoint_id) {
+        mbedtls_sha256_free(&ctx->sha256);
+    }
     free(ctx);
     ctx = NULL;
     return ESP_OK;
 }
+
+static int in_place_mem_read_cb(void *arg_p, void *dst_p, uintptr_t src, size_t size)
+{
+    esp_delta_ota_in_place_ctx *ctx = (esp_delta_ota_in_place_ctx *)arg_p;
+    esp_err_t err = ctx->read_cb(dst_p, size, src, ctx->user_data);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error in read_cb(): %s", esp_err_to_name(err));
+        return -DETOOLS_IO_FAILED;
+    }
+    return 0;
+}
+
+static int in_place_mem_write_cb(void *arg_p, uintptr_t dst, void *src_p, size_t size)
+{
+    esp_delta_ota_in_place_ctx *ctx = (esp_delta_ota_in_place_ctx *)arg_p;
+    esp_err_t err = ctx->write_cb(src_p, size, dst, ctx->user_data);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error in write_cb(): %s", esp_err_to_name(err));
+        return -DETOOLS_IO_FAILED;
+    }
+    return 0;
+}
+
+static int in_place_mem_erase_cb(void *arg_p, uintptr_t addr, size_t size)
+{
+    esp_delta_ota_in_place_ctx *ctx = (esp_delta_ota_in_place_ctx *)arg_p;
+    if (addr % IN_PLACE_ERASE_SIZE != 0) {
+        ESP_LOGE(TAG, "Segment size of the patch is not a multiple of %d", IN_PLACE_ERASE_SIZE);
+        return -DETOOLS_IO_FAILED;
+    }
+    // the last segment of the new image is erased up to its end only, the rest of its sector is free
+    esp_err_t err = ctx->erase_cb(addr, (size + IN_PLACE_ERASE_SIZE - 1) & ~(IN_PLACE_ERASE_SIZE - 1), ctx->user_data);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error in erase_cb(): %s", esp_err_to_name(err));
+        return -DETOOLS_IO_FAILED;
+    }
+    return 0;
+}
+
+/* Reads the last step completed of the update of ctx->update_id, 0 if there is none */
+static esp_err_t in_place_steps_load(esp_delta_ota_in_place_ctx *ctx)
+{
+    nvs_handle_t nvs;
+    in_place_steps_hdr_t hdr;
+    size_t id_len = strlen(ctx->update_id);
+    size_t size = 0;
+
+    ctx->step = 0;
+    esp_err_t err = nvs_open(CHECKPOINT_NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    } else if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_get_blob(nvs, IN_PLACE_NVS_KEY, NULL, &size);
+    uint8_t *blob = NULL;
+    if (err == ESP_OK) {
+        blob = malloc(size);
+        err = blob ? nvs_get_blob(nvs, IN_PLACE_NVS_KEY, blob, &size) : ESP_ERR_NO_MEM;
+    }
+    nvs_close(nvs);
+    if (err == ESP_OK && size == sizeof(hdr) + id_len) {
+        memcpy(&hdr, blob, sizeof(hdr));
+        if (hdr.magic == IN_PLACE_MAGIC && hdr.id_len == id_len && memcmp(blob + sizeof(hdr), ctx->update_id, id_len) == 0) {
+            ctx->step = hdr.step;
+        }
+    }
+    free(blob);
+    return err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+}
+
+static esp_err_t in_place_steps_save(esp_delta_ota_in_place_ctx *ctx, int step)
+{
+    in_place_steps_hdr_t hdr = {
+        .magic = IN_PLACE_MAGIC,
+        .step = step,
+        .id_len = strlen(ctx->update_id),
+    };
+    uint8_t *blob = malloc(sizeof(hdr) + hdr.id_len);
+    if (!blob) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(blob, &hdr, sizeof(hdr));
+    memcpy(blob + sizeof(hdr), ctx->update_id, hdr.id_len);
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CHECKPOINT_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, IN_PLACE_NVS_KEY, blob, sizeof(hdr) + hdr.id_len);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    free(blob);
+    if (err == ESP_OK) {
+        ctx->step = step;
+    }
+    return err;
+}
+
+static int in_place_step_set_cb(void *arg_p, int step)
+{
+    esp_delta_ota_in_place_ctx *ctx = (esp_delta_ota_in_place_ctx *)arg_p;
+    // detools sets step 0 once all steps are completed, to start over on the next update. The update is
+    // rather kept completed until it is finalized, so that it is not applied a second time on the new image
+    // if it is fed again after a reset before esp_delta_ota_in_place_finalize().
+    esp_err_t err = in_place_steps_save(ctx, step == 0 ? IN_PLACE_DONE : step);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error while saving the step: %s", esp_err_to_name(err));
+        return -1;
+    }
+    return 0;
+}
+
+static int in_place_step_get_cb(void *arg_p, int *step_p)
+{
+    *step_p = ((esp_delta_ota_in_place_ctx *)arg_p)->step;
+    return 0;
+}
+
+esp_delta_ota_in_place_handle_t esp_delta_ota_in_place_init(esp_delta_ota_in_place_cfg_t *cfg)
+{
+    if (cfg == NULL || !cfg->read_cb || !cfg->write_cb || !cfg->erase_cb) {
+        return NULL;
+    }
+    esp_delta_ota_in_place_ctx *ctx = calloc(1, sizeof(esp_delta_ota_in_place_ctx));
+    if (!ctx) {
+        ESP_LOGE(TAG, "Unable to allocate memory");
+        return NULL;
+    }
+    ctx->user_data = cfg->user_data;
+    ctx->read_cb = cfg->read_cb;
+    ctx->write_cb = cfg->write_cb;
+    ctx->erase_cb = cfg->erase_cb;
+    ctx->update_id = cfg->update_id;
+    ctx->apply_patch = calloc(1, sizeof(struct detools_apply_patch_in_place_t));
+    if (!ctx->apply_patch) {
+        ESP_LOGE(TAG, "Unable to allocate memory");
+        free(ctx);
+        return NULL;
+    }
+    if (ctx->update_id) {
+        esp_err_t err = in_place_steps_load(ctx);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error while reading the steps: %s", esp_err_to_name(err));
+            esp_delta_ota_in_place_deinit(ctx);
+            return NULL;
+        }
+        if (ctx->step == IN_PLACE_DONE) {
+            ESP_LOGI(TAG, "In-place update %s already completed", ctx->update_id);
+        } else if (ctx->step > 0) {
+            ESP_LOGI(TAG, "Resuming in-place update %s after step %d", ctx->update_id, ctx->step);
+        }
+    }
+    int ret = detools_apply_patch_in_place_init(ctx->apply_patch, in_place_mem_read_cb, in_place_mem_write_cb,
+                                                in_place_mem_erase_cb,
+                                                ctx->update_id ? in_place_step_set_cb : NULL,
+                                                ctx->update_id ? in_place_step_get_cb : NULL,
+                                                cfg->patch_size, ctx);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Error while initializing delta_ota: %s", detools_error_as_string(ret));
+        esp_delta_ota_in_place_deinit(ctx);
+        return NULL;
+    }
+    return (esp_delta_ota_in_place_handle_t)ctx;
+}
+
+esp_err_t esp_delta_ota_in_place_feed_patch(esp_delta_ota_in_place_handle_t handle, const uint8_t *buf, size_t size)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_delta_ota_in_place_ctx *ctx = (esp_delta_ota_in_place_ctx *)handle;
+
+    int err = detools_apply_patch_in_place_process(ctx->apply_patch, buf, size);
+    if (err != 0) {
+        ESP_LOGE(TAG, "Error while applying patch: %s", detools_error_as_string(err));
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_delta_ota_in_place_finalize(esp_delta_ota_in_place_handle_t handle, size_t *to_size)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_delta_ota_in_place_ctx *ctx = (esp_delta_ota_in_place_ctx *)handle;
+
+    int ret = detools_apply_patch_in_place_finalize(ctx->apply_patch);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Error while finishing the patching: %s", detools_error_as_string(ret));
+        return ESP_FAIL;
+    }
+    if (to_size) {
+        *to_size = ret;
+    }
+    if (ctx->update_id) {
+        // the update is applied, the steps kept it completed until now and are not needed anymore
+        esp_err_t err = nvs_key_erase(IN_PLACE_NVS_KEY);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Error while erasing the steps: %s", esp_err_to_name(err));
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_delta_ota_in_place_deinit(esp_delta_ota_in_place_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_delta_ota_in_place_ctx *ctx = (esp_delta_ota_in_place_ctx *)handle;
+
+    free(ctx->apply_patch);
+    ctx->apply_patch = NULL;
+    free(ctx);
+    return ESP_OK;
+}
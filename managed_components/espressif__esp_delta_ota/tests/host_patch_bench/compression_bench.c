@@ -0,0 +1,374 @@
+/*
+ * SPDX-License-Identifier: Apache 2.0 License
+ *
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ */
+
+/* Host benchmark of the compressions of detools patches.
+ * Applies patches of the same pair of builds, one per compression and patch type (sequential patches
+ * applied by detools, hdiffpatch patches by HPatch), with src/esp_delta_ota.c as the firmware does and
+ * prints for each the patch size, the rate of patched data, the peak heap allocated by the update and the
+ * stack it uses. The patch type and compression of a patch are read from its header.
+ * Without arguments, the micropython patches of detools, else: from.bin to.bin patch...
+ * The heap is counted by replacing malloc() and friends of glibc, so the allocations of liblzma are in.
+ * The update runs on a thread whose stack is painted beforehand, the depth reached is the first byte
+ * that changed, less that of a thread doing nothing.
+ * Also checks that hdiffpatch patches whose header tells a diff larger than the max diff size are rejected.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_delta_ota.h"
+
+#define FILES_DIR           "../../detools/tests/files/micropython/"
+#define FROM_FILE           FILES_DIR "esp8266-20180511-v1.9.4.bin"
+#define TO_FILE             FILES_DIR "esp8266-20190125-v1.10.bin"
+#define PATCH_PREFIX        FILES_DIR "esp8266-20180511-v1.9.4--20190125-v1.10"
+#define PATCH_CHUNK_SIZE    1024
+#define MIN_BENCH_NS        500000000ULL
+#define THREAD_STACK_SIZE   (1024 * 1024)
+#define STACK_PAINT         0xa5
+
+static const char *const s_default_patches[] = {
+    PATCH_PREFIX "-none.patch",
+    PATCH_PREFIX "-crle.patch",
+    PATCH_PREFIX "-heatshrink.patch",
+    PATCH_PREFIX ".patch",
+};
+
+/* Patch types and compressions of the detools patch header, 3 and 4 low bits of its first byte */
+static const char *const s_patch_types[] = {"sequential", "in-place", "hdiffpatch"};
+static const char *const s_compressions[] = {"none", "lzma", "crle", "?", "heatshrink"};
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} file_t;
+
+static struct {
+    const file_t *from;
+    uint8_t *to;
+    size_t to_size;
+    size_t to_offset;
+    unsigned long call_ns;
+} s_io;
+
+typedef struct {
+    const file_t *patch;
+    esp_err_t err;
+    uint64_t iter;
+    uint64_t elapsed_ns;
+} bench_t;
+
+/* Heap in use, of all threads */
+static long s_heap_used;
+static long s_heap_peak;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static void *heap_add(void *ptr)
+{
+    if (ptr) {
+        long used = __atomic_add_fetch(&s_heap_used, (long)malloc_usable_size(ptr), __ATOMIC_RELAXED);
+        long peak = __atomic_load_n(&s_heap_peak, __ATOMIC_RELAXED);
+        while (used > peak && !__atomic_compare_exchange_n(&s_heap_peak, &peak, used, true, __ATOMIC_RELAXED,
+                                                            __ATOMIC_RELAXED)) {
+        }
+    }
+    return ptr;
+}
+
+static void heap_sub(void *ptr)
+{
+    if (ptr) {
+        __atomic_sub_fetch(&s_heap_used, (long)malloc_usable_size(ptr), __ATOMIC_RELAXED);
+    }
+}
+
+void *malloc(size_t size)
+{
+    return heap_add(__libc_malloc(size));
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    return heap_add(__libc_calloc(nmemb, size));
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    long old = ptr ? (long)malloc_usable_size(ptr) : 0;
+    void *res = __libc_realloc(ptr, size);
+    if (res || size == 0) {
+        __atomic_sub_fetch(&s_heap_used, old, __ATOMIC_RELAXED);
+        heap_add(res);
+    }
+    return res;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    return heap_add(__libc_memalign(alignment, size));
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *ptr = memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void free(void *ptr)
+{
+    heap_sub(ptr);
+    __libc_free(ptr);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void call_cost(void)
+{
+    if (s_io.call_ns) {
+        uint64_t end = now_ns() + s_io.call_ns;
+        while (now_ns() < end) {
+        }
+    }
+}
+
+static esp_err_t read_cb(uint8_t *buf_p, size_t size, int src_offset)
+{
+    if (src_offset < 0 || src_offset + size > s_io.from->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    call_cost();
+    memcpy(buf_p, s_io.from->data + src_offset, size);
+    return ESP_OK;
+}
+
+static esp_err_t write_cb(const uint8_t *buf_p, size_t size, void *user_data)
+{
+    (void)user_data;
+    if (s_io.to_offset + size > s_io.to_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    call_cost();
+    memcpy(s_io.to + s_io.to_offset, buf_p, size);
+    s_io.to_offset += size;
+    return ESP_OK;
+}
+
+static int file_load(const char *name, file_t *file)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f) {
+        perror(name);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    file->size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    file->data = malloc(file->size);
+    if (!file->data || fread(file->data, 1, file->size, f) != file->size) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Applies the patch the way the https_delta_ota example does */
+static esp_err_t update(const file_t *patch)
+{
+    esp_delta_ota_cfg_t cfg = {
+        .read_cb = read_cb,
+        .write_cb_with_user_data = write_cb,
+    };
+    esp_err_t err = ESP_OK;
+
+    s_io.to_offset = 0;
+    esp_delta_ota_handle_t handle = esp_delta_ota_init(&cfg);
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t offset = 0; err == ESP_OK && offset < patch->size; offset += PATCH_CHUNK_SIZE) {
+        size_t len = patch->size - offset < PATCH_CHUNK_SIZE ? patch->size - offset : PATCH_CHUNK_SIZE;
+        err = esp_delta_ota_feed_patch(handle, patch->data + offset, len);
+    }
+    if (err == ESP_OK) {
+        err = esp_delta_ota_finalize(handle);
+    }
+    esp_delta_ota_deinit(handle);
+    return err;
+}
+
+/* Size of the patch header, as pack_size() of detools */
+static size_t pack_size(uint8_t *buf, size_t value)
+{
+    size_t len = 0;
+    uint8_t byte = value & 0x3f;
+    value >>= 6;
+    while (value > 0) {
+        buf[len++] = byte | 0x80;
+        byte = value & 0x7f;
+        value >>= 7;
+    }
+    buf[len++] = byte;
+    return len;
+}
+
+/* Hdiffpatch patch of compression none with a diff of diff_size bytes in its header, of which the first
+ * data_len bytes follow */
+static esp_err_t hdiffpatch_header_check(size_t diff_size, size_t data_len)
+{
+    static uint8_t patch[64];
+    size_t len = 0;
+    patch[len++] = 2 << 4;
+    len += pack_size(patch + len, s_io.to_size);
+    len += pack_size(patch + len, diff_size);
+    memset(patch + len, 0, data_len);
+    len += data_len;
+    file_t file = {.data = patch, .size = len};
+    return update(&file);
+}
+
+static void *bench_thread(void *arg)
+{
+    bench_t *bench = (bench_t *)arg;
+    uint64_t start = now_ns();
+
+    do {
+        bench->err = update(bench->patch);
+        bench->iter++;
+        bench->elapsed_ns = now_ns() - start;
+    } while (bench->err == ESP_OK && bench->elapsed_ns < MIN_BENCH_NS);
+    return NULL;
+}
+
+static void *idle_thread(void *arg)
+{
+    return arg;
+}
+
+/* Runs fn on a painted stack, returns the depth of the stack it reached */
+static size_t run_on_stack(void *(*fn)(void *), void *arg)
+{
+    static uint8_t stack[THREAD_STACK_SIZE] __attribute__((aligned(64)));
+    pthread_attr_t attr;
+    pthread_t thread;
+    size_t untouched = 0;
+
+    memset(stack, STACK_PAINT, sizeof(stack));
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, sizeof(stack));
+    if (pthread_create(&thread, &attr, fn, arg) != 0) {
+        pthread_attr_destroy(&attr);
+        return 0;
+    }
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    while (untouched < sizeof(stack) && stack[untouched] == STACK_PAINT) {
+        untouched++;
+    }
+    return sizeof(stack) - untouched;
+}
+
+int main(int argc, char *argv[])
+{
+    file_t from, to;
+    const char *const *patches = s_default_patches;
+    size_t num_patches = sizeof(s_default_patches) / sizeof(s_default_patches[0]);
+    const char *from_file = FROM_FILE, *to_file = TO_FILE;
+    int ret = 0;
+
+    if (argc > 3) {
+        from_file = argv[1];
+        to_file = argv[2];
+        patches = (const char *const *)&argv[3];
+        num_patches = argc - 3;
+    }
+    const char *call_us = getenv("CALL_US");
+    s_io.call_ns = call_us ? strtoul(call_us, NULL, 0) * 1000 : 0;
+    if (file_load(from_file, &from) != 0 || file_load(to_file, &to) != 0) {
+        return 1;
+    }
+    s_io.from = &from;
+    s_io.to_size = to.size;
+    s_io.to = malloc(to.size);
+    size_t idle_stack = run_on_stack(idle_thread, NULL);
+
+    printf("%s -> %s, %zu bytes, work buf %d, read cache %d, %lu us per call\n", from_file, to_file, to.size,
+           CONFIG_ESP_DELTA_OTA_WORK_BUF_SIZE, CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE, s_io.call_ns / 1000);
+    printf("%-22s %10s %8s %10s %12s %10s\n", "patch", "patch KB", "% new", "MB/s", "peak heap B",
+           "stack B");
+    for (size_t p = 0; p < num_patches; p++) {
+        file_t patch;
+        if (file_load(patches[p], &patch) != 0 || patch.size == 0) {
+            ret = 1;
+            continue;
+        }
+        unsigned patch_type = (patch.data[0] >> 4) & 0x7;
+        unsigned compression = patch.data[0] & 0xf;
+        char name[32];
+        snprintf(name, sizeof(name), "%s %s",
+                 patch_type < sizeof(s_patch_types) / sizeof(s_patch_types[0]) ? s_patch_types[patch_type] : "?",
+                 compression < sizeof(s_compressions) / sizeof(s_compressions[0]) ? s_compressions[compression] : "?");
+        bench_t bench = {.patch = &patch};
+
+        long heap_base = __atomic_load_n(&s_heap_used, __ATOMIC_RELAXED);
+        s_heap_peak = heap_base;
+        size_t stack = run_on_stack(bench_thread, &bench);
+        long heap_peak = s_heap_peak - heap_base;
+        if (patch_type == 0 && compression == 0 && bench.err != ESP_OK) {
+            // the patch reader of none needs the size of the patch, esp_delta_ota has it not
+            printf("%-22s %10.1f %8.1f not applied by esp_delta_ota, patch size unknown\n", name,
+                   patch.size / 1024.0, 100.0 * patch.size / to.size);
+        } else if (bench.err != ESP_OK || s_io.to_offset != to.size || memcmp(s_io.to, to.data, to.size)) {
+            printf("%-22s failed: %s\n", name, bench.err != ESP_OK ? esp_err_to_name(bench.err) : "patched data differs");
+            ret = 1;
+        } else {
+            printf("%-22s %10.1f %8.1f %10.1f %12ld %10zu\n", name, patch.size / 1024.0, 100.0 * patch.size / to.size,
+                   (double)to.size * bench.iter * 1000.0 / bench.elapsed_ns, heap_peak, stack - idle_stack);
+        }
+        free(patch.data);
+    }
+    esp_err_t err = hdiffpatch_header_check(CONFIG_ESP_DELTA_OTA_HDIFFPATCH_MAX_DIFF_SIZE + 1, 16);
+    if (err != ESP_ERR_INVALID_SIZE) {
+        printf("hdiffpatch diff larger than %d bytes not rejected: %s\n", CONFIG_ESP_DELTA_OTA_HDIFFPATCH_MAX_DIFF_SIZE,
+               esp_err_to_name(err));
+        ret = 1;
+    }
+    err = hdiffpatch_header_check(8, 16);
+    if (err == ESP_OK) {
+        printf("hdiffpatch diff longer than its header not rejected\n");
+        ret = 1;
+    }
+    free(s_io.to);
+    free(to.data);
+    free(from.data);
+    printf("%s\n", ret ? "FAIL" : "PASS");
+    return ret;
+}
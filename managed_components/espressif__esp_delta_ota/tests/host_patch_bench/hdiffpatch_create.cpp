@@ -0,0 +1,111 @@
+/*
+ * SPDX-License-Identifier: Apache 2.0 License
+ *
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ */
+
+/* Creates the hdiffpatch patches of detools (create_patch -a hdiffpatch -t hdiffpatch) without its Python
+ * package: the header of detools, then the HDiffPatch compressed diff of the vendored HDiffPatch, which
+ * detools compresses as a whole. Compressions none and lzma (FORMAT_ALONE as detools, preset 6), the
+ * heatshrink encoder of detools is in its Python package only.
+ * Usage: hdiffpatch_create from.bin to.bin patch none|lzma
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <lzma.h>
+#include "HDiff/diff.h"
+
+#define PATCH_TYPE_HDIFFPATCH   2
+#define COMPRESSION_NONE        0
+#define COMPRESSION_LZMA        1
+#define MATCH_SCORE             6       // default of detools
+
+static bool file_load(const char *name, std::vector<unsigned char> &data)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f) {
+        perror(name);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    data.resize((size_t)ftell(f));
+    fseek(f, 0, SEEK_SET);
+    bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok;
+}
+
+/* Size of the patch header, pack_size() of detools */
+static void pack_size(std::vector<unsigned char> &out, size_t value)
+{
+    unsigned char byte = value & 0x3f;
+    value >>= 6;
+    while (value > 0) {
+        out.push_back(byte | 0x80);
+        byte = value & 0x7f;
+        value >>= 7;
+    }
+    out.push_back(byte);
+}
+
+static bool lzma_compress(const std::vector<unsigned char> &in, std::vector<unsigned char> &out)
+{
+    lzma_options_lzma options;
+    lzma_stream strm = LZMA_STREAM_INIT;
+    if (lzma_lzma_preset(&options, 6) || lzma_alone_encoder(&strm, &options) != LZMA_OK) {
+        return false;
+    }
+    size_t start = out.size();
+    out.resize(start + in.size() + in.size() / 2 + 4096);
+    strm.next_in = in.data();
+    strm.avail_in = in.size();
+    strm.next_out = out.data() + start;
+    strm.avail_out = out.size() - start;
+    lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+    out.resize(out.size() - strm.avail_out);
+    lzma_end(&strm);
+    return ret == LZMA_STREAM_END;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<unsigned char> from, to, diff, patch;
+
+    if (argc != 5 || (strcmp(argv[4], "none") != 0 && strcmp(argv[4], "lzma") != 0)) {
+        fprintf(stderr, "usage: %s from.bin to.bin patch none|lzma\n", argv[0]);
+        return 1;
+    }
+    if (!file_load(argv[1], from) || !file_load(argv[2], to)) {
+        return 1;
+    }
+    create_compressed_diff(to.data(), to.data() + to.size(), from.data(), from.data() + from.size(), diff, NULL,
+                           MATCH_SCORE, PATCH_TYPE_HDIFFPATCH);
+    if (!check_compressed_diff(to.data(), to.data() + to.size(), from.data(), from.data() + from.size(),
+                               diff.data(), diff.data() + diff.size(), NULL)) {
+        fprintf(stderr, "HDiffPatch diff does not patch %s into %s\n", argv[1], argv[2]);
+        return 1;
+    }
+
+    bool lzma = strcmp(argv[4], "lzma") == 0;
+    patch.push_back(PATCH_TYPE_HDIFFPATCH << 4 | (lzma ? COMPRESSION_LZMA : COMPRESSION_NONE));
+    pack_size(patch, to.size());
+    pack_size(patch, diff.size());
+    if (lzma) {
+        if (!lzma_compress(diff, patch)) {
+            fprintf(stderr, "lzma compression failed\n");
+            return 1;
+        }
+    } else {
+        patch.insert(patch.end(), diff.begin(), diff.end());
+    }
+
+    FILE *f = fopen(argv[3], "wb");
+    if (!f || fwrite(patch.data(), 1, patch.size(), f) != patch.size() || fclose(f) != 0) {
+        perror(argv[3]);
+        return 1;
+    }
+    printf("%s: %zu bytes, diff %zu bytes\n", argv[3], patch.size(), diff.size());
+    return 0;
+}
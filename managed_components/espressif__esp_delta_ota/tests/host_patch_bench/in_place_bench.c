@@ -0,0 +1,236 @@
+/*
+ * SPDX-License-Identifier: Apache 2.0 License
+ *
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ */
+
+/* Host benchmark of in-place delta updates that lose power.
+ * Applies the in-place micropython patch of detools (2 MB memory, 64 KB segments) with
+ * src/esp_delta_ota.c to a NOR flash model holding the base image: writes only clear bits of erased
+ * bytes, erases are of 4 KB sectors. Power is lost every given number of flash operations of a
+ * session, halfway through the write or erase it happens in. Each session initializes the update again
+ * with the same update_id and feeds the whole patch, the steps completed are saved in the in memory NVS
+ * of nvs.c. Checks the new image, that the steps are erased once the update is finalized, that feeding the
+ * patch once more after a reset before they are erased leaves it as is and that the steps of another
+ * update are not resumed, and prints the flash operations of the update.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_delta_ota.h"
+#include "nvs.h"
+
+#define FILES_DIR           "../../detools/tests/files/micropython/"
+#define FROM_FILE           FILES_DIR "esp8266-20180511-v1.9.4.bin"
+#define TO_FILE             FILES_DIR "esp8266-20190125-v1.10.bin"
+#define PATCH_FILE          FILES_DIR "esp8266-20180511-v1.9.4--20190125-v1.10-in-place.patch"
+#define MEMORY_SIZE         (2 * 1024 * 1024)
+#define SECTOR_SIZE         4096
+#define PATCH_CHUNK_SIZE    1024
+#define MAX_SESSIONS        1000
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} file_t;
+
+static struct {
+    uint8_t memory[MEMORY_SIZE];
+    unsigned long ops;          // flash operations of the session
+    unsigned long cut_ops;      // operation of the session power is lost at, 0 never
+    unsigned long erases;       // sectors
+    unsigned long written;      // bytes
+} s_flash;
+
+/* Whether power is lost during this operation */
+static bool flash_op(void)
+{
+    return ++s_flash.ops == s_flash.cut_ops;
+}
+
+static esp_err_t mem_read(uint8_t *buf_p, size_t size, size_t offset, void *user_data)
+{
+    (void)user_data;
+    if (offset + size > MEMORY_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (flash_op()) {
+        return ESP_FAIL;
+    }
+    memcpy(buf_p, s_flash.memory + offset, size);
+    return ESP_OK;
+}
+
+static esp_err_t mem_write(const uint8_t *buf_p, size_t size, size_t offset, void *user_data)
+{
+    (void)user_data;
+    if (offset + size > MEMORY_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    bool cut = flash_op();
+    size_t len = cut ? size / 2 : size;
+    for (size_t i = 0; i < len; i++) {
+        if (s_flash.memory[offset + i] != 0xff) {
+            printf("write at 0x%zx not erased\n", offset + i);
+            return ESP_ERR_INVALID_STATE;
+        }
+        s_flash.memory[offset + i] &= buf_p[i];
+    }
+    s_flash.written += len;
+    return cut ? ESP_FAIL : ESP_OK;
+}
+
+static esp_err_t mem_erase(size_t offset, size_t size, void *user_data)
+{
+    (void)user_data;
+    if (offset % SECTOR_SIZE || size % SECTOR_SIZE || offset + size > MEMORY_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bool cut = flash_op();
+    size_t len = cut ? (size / SECTOR_SIZE / 2) * SECTOR_SIZE : size;
+    memset(s_flash.memory + offset, 0xff, len);
+    if (cut) {
+        // the sector being erased when power is lost is left with neither its data nor erased
+        memset(s_flash.memory + offset + len, 0x5a, SECTOR_SIZE / 2);
+    }
+    s_flash.erases += len / SECTOR_SIZE;
+    return cut ? ESP_FAIL : ESP_OK;
+}
+
+static int file_load(const char *name, file_t *file)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f) {
+        perror(name);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    file->size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    file->data = malloc(file->size);
+    if (!file->data || fread(file->data, 1, file->size, f) != file->size) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Runs a session of the update, returns 1 if the update is complete, 0 if power was lost, -1 on error */
+static int session(const char *id, const file_t *patch, size_t *to_size)
+{
+    esp_delta_ota_in_place_cfg_t cfg = {
+        .read_cb = mem_read,
+        .write_cb = mem_write,
+        .erase_cb = mem_erase,
+        .patch_size = patch->size,
+        .update_id = id,
+    };
+    esp_err_t err = ESP_OK;
+
+    s_flash.ops = 0;
+    esp_delta_ota_in_place_handle_t handle = esp_delta_ota_in_place_init(&cfg);
+    if (!handle) {
+        return -1;
+    }
+    for (size_t offset = 0; err == ESP_OK && offset < patch->size; offset += PATCH_CHUNK_SIZE) {
+        size_t len = patch->size - offset < PATCH_CHUNK_SIZE ? patch->size - offset : PATCH_CHUNK_SIZE;
+        err = esp_delta_ota_in_place_feed_patch(handle, patch->data + offset, len);
+    }
+    if (err == ESP_OK) {
+        err = esp_delta_ota_in_place_finalize(handle, to_size);
+    }
+    esp_delta_ota_in_place_deinit(handle);
+    if (err == ESP_OK) {
+        return 1;
+    }
+    return s_flash.cut_ops && s_flash.ops >= s_flash.cut_ops ? 0 : -1;
+}
+
+static bool steps_saved(void)
+{
+    nvs_handle_t nvs;
+    size_t size = 0;
+    if (nvs_open("delta_ota", NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    bool saved = nvs_get_blob(nvs, "in_place", NULL, &size) == ESP_OK;
+    nvs_close(nvs);
+    return saved;
+}
+
+static void memory_load(const file_t *from)
+{
+    memset(s_flash.memory, 0xff, MEMORY_SIZE);
+    memcpy(s_flash.memory, from->data, from->size);
+}
+
+int main(int argc, char *argv[])
+{
+    file_t from, to, patch;
+    unsigned long cut_ops = argc > 1 ? strtoul(argv[1], NULL, 0) : 3000;
+    size_t to_size = 0;
+    unsigned writes;
+    int sessions = 0, res = 0;
+
+    if (file_load(FROM_FILE, &from) != 0 || file_load(TO_FILE, &to) != 0 || file_load(PATCH_FILE, &patch) != 0) {
+        return 1;
+    }
+
+    /* Steps of another update are not resumed */
+    memory_load(&from);
+    s_flash.cut_ops = cut_ops;
+    session("update-1", &patch, &to_size);
+    memory_load(&from);
+    s_flash.cut_ops = 0;
+    s_flash.erases = s_flash.written = 0;
+    writes = nvs_mock_writes();
+    if (session("update-2", &patch, &to_size) != 1 || to_size != to.size || memcmp(s_flash.memory, to.data, to.size)) {
+        printf("FAIL: update without power loss\n");
+        return 1;
+    }
+    printf("no power loss     %lu sectors erased, %lu bytes written, %u NVS writes\n", s_flash.erases,
+           s_flash.written, nvs_mock_writes() - writes);
+
+    memory_load(&from);
+    s_flash.cut_ops = cut_ops;
+    s_flash.erases = s_flash.written = 0;
+    writes = nvs_mock_writes();
+    while (res == 0 && sessions < MAX_SESSIONS) {
+        res = session("update-3", &patch, &to_size);
+        sessions++;
+    }
+    if (res != 1 || to_size != to.size || memcmp(s_flash.memory, to.data, to.size)) {
+        printf("FAIL: %s\n", res == 1 ? "patched data differs" : "update not complete");
+        return 1;
+    }
+    printf("power lost every %lu flash operations\n", cut_ops);
+    printf("update            %d sessions, %lu sectors erased, %lu bytes written, %u NVS writes\n", sessions,
+           s_flash.erases, s_flash.written, nvs_mock_writes() - writes);
+
+    if (steps_saved()) {
+        printf("FAIL: steps kept once the update is finalized\n");
+        return 1;
+    }
+
+    /* Reset once all steps are completed, before the steps are erased by the finalize: the completed
+     * update is not applied again on the new image */
+    memory_load(&from);
+    s_flash.cut_ops = 0;
+    nvs_mock_erase_fail(true);
+    res = session("update-4", &patch, &to_size);
+    nvs_mock_erase_fail(false);
+    if (res != 1 || !steps_saved()) {
+        printf("FAIL: update with steps not erased\n");
+        return 1;
+    }
+    s_flash.erases = s_flash.written = 0;
+    if (session("update-4", &patch, &to_size) != 1 || s_flash.erases || s_flash.written ||
+            memcmp(s_flash.memory, to.data, to.size) || steps_saved()) {
+        printf("FAIL: completed update applied again\n");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
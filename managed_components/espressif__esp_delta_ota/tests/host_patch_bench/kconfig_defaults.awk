@@ -0,0 +1,86 @@
+# Writes the CONFIG_ macros of the defaults of a Kconfig file as sdkconfig.h does, for the host builds to be
+# configured as the firmware is by default. Only the bool and int options of this component are handled:
+# the first default without a condition is taken, an option which depends on a single bool option left
+# undefined is left undefined too, other dependencies and conditional defaults are not evaluated.
+# A type, default or range line which is not part of a config entry is an error, it would otherwise be
+# taken by the entry before it and leave its own option undefined.
+# Usage: awk -f kconfig_defaults.awk Kconfig > sdkconfig.h
+
+function fail(msg) {
+    printf("%s:%d: %s\n", FILENAME, FNR, msg) > "/dev/stderr"
+    failed = 1
+    exit 1
+}
+
+function entry_end() {
+    if (name != "" && type == "") {
+        fail("config " name " has no type")
+    }
+    if (name != "" && value != "" && !(type == "bool" && value == "n") && !(depends in undefined)) {
+        printf("#define CONFIG_%s %s\n", name, type == "bool" ? 1 : value)
+    } else if (name != "") {
+        undefined[name] = 1
+    }
+    name = type = value = depends = ""
+    in_help = 0
+}
+
+BEGIN {
+    print "/* Generated from the Kconfig defaults by kconfig_defaults.awk */"
+}
+
+# help text runs until the indentation drops back to the one of the entry
+in_help {
+    if ($0 ~ /^[ \t]*$/ || match($0, /^[ \t]*/) && RLENGTH > help_indent) {
+        next
+    }
+    in_help = 0
+}
+
+/^[ \t]*$/ || /^[ \t]*#/ {
+    next
+}
+
+$1 == "config" || $1 == "menuconfig" {
+    entry_end()
+    name = $2
+    attrs = 1
+    next
+}
+
+$1 == "menu" || $1 == "endmenu" || $1 == "if" || $1 == "endif" || $1 == "choice" || $1 == "endchoice" {
+    entry_end()
+    attrs = 0
+    next
+}
+
+$1 == "bool" || $1 == "int" || $1 == "default" || $1 == "range" || $1 == "depends" || $1 == "help" {
+    if (!attrs || name == "") {
+        fail("\"" $1 "\" outside of a config entry")
+    }
+    if ($1 == "bool" || $1 == "int") {
+        if (type != "") {
+            fail("config " name " has a second type")
+        }
+        type = $1
+    } else if ($1 == "default" && value == "" && NF == 2) {
+        value = $2
+    } else if ($1 == "depends" && NF == 3) {
+        depends = $3
+    } else if ($1 == "help") {
+        match($0, /^[ \t]*/)
+        help_indent = RLENGTH
+        in_help = 1
+    }
+    next
+}
+
+{
+    fail("unknown Kconfig line: " $0)
+}
+
+END {
+    if (!failed) {
+        entry_end()
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * SPDX-License-Identifier: Apache 2.0 License
+ *
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ */
+
+/* Minimal mbedtls/sha256.h for the host build, on the SHA-256 of OpenSSL libcrypto. The context is a
+ * plain struct holding the whole hash state, as the one of mbedtls */
+#pragma once
+
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/sha.h>
+
+typedef SHA256_CTX mbedtls_sha256_context;
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    (void)ctx;
+}
+
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    (void)ctx;
+}
+
+static inline int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+    return is224 || !SHA256_Init(ctx) ? -1 : 0;
+}
+
+static inline int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    return SHA256_Update(ctx, input, ilen) ? 0 : -1;
+}
+
+static inline int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    return SHA256_Final(output, ctx) ? 0 : -1;
+}
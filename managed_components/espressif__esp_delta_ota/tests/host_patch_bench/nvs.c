@@ -0,0 +1,130 @@
+/*
+ * SPDX-License-Identifier: Apache 2.0 License
+ *
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ */
+
+/* In memory NVS for the host build, a few blobs of a single namespace */
+
+#include <stdlib.h>
+#include <string.h>
+#include "nvs.h"
+
+#define NVS_MOCK_KEYS       4
+#define NVS_MOCK_KEY_LEN    16
+
+static struct {
+    char namespace_name[NVS_MOCK_KEY_LEN];
+    struct {
+        char key[NVS_MOCK_KEY_LEN];
+        void *value;
+        size_t length;
+    } keys[NVS_MOCK_KEYS];
+    unsigned writes;
+    bool erase_fail;
+} s_nvs;
+
+static int nvs_mock_find(const char *key)
+{
+    for (int i = 0; i < NVS_MOCK_KEYS; i++) {
+        if (s_nvs.keys[i].value && strcmp(s_nvs.keys[i].key, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (strlen(namespace_name) >= NVS_MOCK_KEY_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_nvs.namespace_name[0] == '\0') {
+        if (open_mode == NVS_READONLY) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        strcpy(s_nvs.namespace_name, namespace_name);
+    } else if (strcmp(s_nvs.namespace_name, namespace_name) != 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    (void)handle;
+    int i = nvs_mock_find(key);
+    for (int j = 0; i < 0 && j < NVS_MOCK_KEYS; j++) {
+        if (!s_nvs.keys[j].value) {
+            i = j;
+        }
+    }
+    if (i < 0 || strlen(key) >= NVS_MOCK_KEY_LEN) {
+        return ESP_ERR_NO_MEM;
+    }
+    void *copy = malloc(length ? length : 1);
+    if (!copy) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, length);
+    free(s_nvs.keys[i].value);
+    strcpy(s_nvs.keys[i].key, key);
+    s_nvs.keys[i].value = copy;
+    s_nvs.keys[i].length = length;
+    s_nvs.writes++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    (void)handle;
+    int i = nvs_mock_find(key);
+    if (i < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value) {
+        if (*length < s_nvs.keys[i].length) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(out_value, s_nvs.keys[i].value, s_nvs.keys[i].length);
+    }
+    *length = s_nvs.keys[i].length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    (void)handle;
+    if (s_nvs.erase_fail) {
+        return ESP_FAIL;
+    }
+    int i = nvs_mock_find(key);
+    if (i < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    free(s_nvs.keys[i].value);
+    s_nvs.keys[i].value = NULL;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+unsigned nvs_mock_writes(void)
+{
+    return s_nvs.writes;
+}
+
+void nvs_mock_erase_fail(bool fail)
+{
+    s_nvs.erase_fail = fail;
+}
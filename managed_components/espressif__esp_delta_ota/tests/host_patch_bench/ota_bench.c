@@ -0,0 +1,191 @@
+/*
+ * SPDX-License-Identifier: Apache 2.0 License
+ *
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ */
+
+/* Host benchmark of a delta OTA update through esp_delta_ota.
+ * Applies the heatshrink micropython patch of detools with src/esp_delta_ota.c, built with the source
+ * read cache of CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE. The source is in a partition of whole 64 KB blocks,
+ * erased past its end. Source reads and OTA writes cost a busy wait per call, and source reads also per
+ * byte at the given flash read rate, so the time of the update is the one of the patching plus the
+ * modelled flash accesses. OTA writes are modelled as esp_ota_write(): each call programs the 256 bytes
+ * pages it touches, a page shared by two calls is programmed twice, and a sector is erased when the
+ * writes reach it, each at the given cost (0 by default).
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/param.h>
+#include "esp_delta_ota.h"
+
+#define FILES_DIR           "../../detools/tests/files/micropython/"
+#define FROM_FILE           FILES_DIR "esp8266-20180511-v1.9.4.bin"
+#define TO_FILE             FILES_DIR "esp8266-20190125-v1.10.bin"
+#define PATCH_FILE          FILES_DIR "esp8266-20180511-v1.9.4--20190125-v1.10-heatshrink.patch"
+#define PATCH_CHUNK_SIZE    1024
+#define PARTITION_ALIGN     0x10000
+#define FLASH_PAGE_SIZE     256
+#define FLASH_SECTOR_SIZE   4096
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} file_t;
+
+static struct {
+    file_t from;
+    size_t partition_size;
+    uint8_t *to;
+    size_t to_size;
+    size_t to_offset;
+    unsigned long reads;
+    unsigned long read_bytes;
+    unsigned long writes;
+    unsigned long pages;
+    unsigned long partial_pages;
+    unsigned long erases;
+    uint64_t call_ns;
+    double byte_ns;
+    uint64_t page_ns;
+    uint64_t erase_ns;
+} s_io;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void busy_wait(uint64_t ns)
+{
+    uint64_t end = now_ns() + ns;
+    while (now_ns() < end) {
+    }
+}
+
+static void flash_cost(size_t bytes)
+{
+    busy_wait(s_io.call_ns + (uint64_t)(bytes * s_io.byte_ns));
+}
+
+static esp_err_t read_cb(uint8_t *buf_p, size_t size, int src_offset)
+{
+    if (src_offset < 0 || src_offset + size > s_io.partition_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    flash_cost(size);
+    memcpy(buf_p, s_io.from.data + src_offset, size);
+    s_io.reads++;
+    s_io.read_bytes += size;
+    return ESP_OK;
+}
+
+static esp_err_t write_cb(const uint8_t *buf_p, size_t size, void *user_data)
+{
+    (void)user_data;
+    if (s_io.to_offset + size > s_io.to_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    flash_cost(0);
+    size_t end = s_io.to_offset + size;
+    // the sectors reached by the write are erased first
+    size_t erased = (s_io.to_offset + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+    size_t erases = (end + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE - erased;
+    size_t first_page = s_io.to_offset / FLASH_PAGE_SIZE;
+    size_t pages = (end + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE - first_page;
+    busy_wait(erases * s_io.erase_ns + pages * s_io.page_ns);
+    s_io.erases += erases;
+    s_io.pages += pages;
+    // pages the write does not cover whole, programmed again by the next or previous write
+    size_t partial = (s_io.to_offset % FLASH_PAGE_SIZE != 0) + (end % FLASH_PAGE_SIZE != 0);
+    s_io.partial_pages += MIN(partial, pages);
+    memcpy(s_io.to + s_io.to_offset, buf_p, size);
+    s_io.to_offset += size;
+    s_io.writes++;
+    return ESP_OK;
+}
+
+static int file_load(const char *name, file_t *file)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f) {
+        perror(name);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    file->size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    file->data = malloc(file->size);
+    if (!file->data || fread(file->data, 1, file->size, f) != file->size) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    file_t to, patch;
+    esp_delta_ota_cfg_t cfg = {
+        .user_data = &s_io,
+        .read_cb = read_cb,
+        .write_cb_with_user_data = write_cb,
+    };
+    esp_delta_ota_read_cache_stats_t stats = { 0 };
+    esp_err_t err = ESP_OK;
+
+    s_io.call_ns = (argc > 1 ? strtoul(argv[1], NULL, 0) : 20) * 1000;
+    s_io.byte_ns = 1000.0 / (argc > 2 ? strtod(argv[2], NULL) : 20.0);
+    s_io.page_ns = (argc > 3 ? strtoul(argv[3], NULL, 0) : 0) * 1000;
+    s_io.erase_ns = (argc > 4 ? strtoul(argv[4], NULL, 0) : 0) * 1000;
+    if (file_load(FROM_FILE, &s_io.from) != 0 || file_load(TO_FILE, &to) != 0 || file_load(PATCH_FILE, &patch) != 0) {
+        return 1;
+    }
+    s_io.partition_size = (s_io.from.size + PARTITION_ALIGN - 1) & ~(PARTITION_ALIGN - 1);
+    s_io.from.data = realloc(s_io.from.data, s_io.partition_size);
+    memset(s_io.from.data + s_io.from.size, 0xff, s_io.partition_size - s_io.from.size);
+    s_io.to_size = to.size;
+    s_io.to = malloc(to.size);
+
+    uint64_t start = now_ns();
+    esp_delta_ota_handle_t handle = esp_delta_ota_init(&cfg);
+    if (!handle) {
+        return 1;
+    }
+    for (size_t offset = 0; err == ESP_OK && offset < patch.size; offset += PATCH_CHUNK_SIZE) {
+        size_t len = patch.size - offset < PATCH_CHUNK_SIZE ? patch.size - offset : PATCH_CHUNK_SIZE;
+        err = esp_delta_ota_feed_patch(handle, patch.data + offset, len);
+    }
+    if (err == ESP_OK) {
+        err = esp_delta_ota_finalize(handle);
+    }
+    uint64_t elapsed = now_ns() - start;
+    bool cached = esp_delta_ota_get_read_cache_stats(handle, &stats) == ESP_OK;
+    esp_delta_ota_deinit(handle);
+
+    if (err != ESP_OK || s_io.to_offset != to.size || memcmp(s_io.to, to.data, to.size)) {
+        printf("FAIL: patched data differs\n");
+        return 1;
+    }
+    printf("read cache %d bytes, %d bytes lines, write buffer %d bytes, %lu us per call, %.0f MB/s flash reads, "
+           "%lu us per page program, %lu us per sector erase\n",
+           CONFIG_ESP_DELTA_OTA_READ_CACHE_SIZE, CONFIG_ESP_DELTA_OTA_READ_CACHE_LINE_SIZE,
+           CONFIG_ESP_DELTA_OTA_WRITE_BUF_SIZE, (unsigned long)(s_io.call_ns / 1000), 1000.0 / s_io.byte_ns,
+           (unsigned long)(s_io.page_ns / 1000), (unsigned long)(s_io.erase_ns / 1000));
+    printf("update            %.0f ms, %zu bytes patched\n", elapsed / 1e6, to.size);
+    printf("source reads      %lu calls, %lu bytes\n", s_io.reads, s_io.read_bytes);
+    printf("OTA writes        %lu calls, %lu page programs (%lu partial), %lu sector erases\n", s_io.writes,
+           s_io.pages, s_io.partial_pages, s_io.erases);
+    if (cached) {
+        printf("cache             %lu hits, %lu misses\n", (unsigned long)stats.hits, (unsigned long)stats.misses);
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * SPDX-License-Identifier: Apache 2.0 License
+ *
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ */
+
+/* Host benchmark of patch application with detools.
+ * Applies the micropython patches of detools, fed in chunks of the size of the HTTP reads of the
+ * https_delta_ota example, with the work buffer sizes below, and prints the rate of patched data and
+ * the number of from_read() and to_write() calls. Source is read from and patched data is written to
+ * memory, a busy wait per call can be added to model the cost of flash reads and OTA writes.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "detools.h"
+
+#define FILES_DIR           "../../detools/tests/files/micropython/"
+#define FROM_FILE           FILES_DIR "esp8266-20180511-v1.9.4.bin"
+#define TO_FILE             FILES_DIR "esp8266-20190125-v1.10.bin"
+#define PATCH_PREFIX        FILES_DIR "esp8266-20180511-v1.9.4--20190125-v1.10"
+#define PATCH_CHUNK_SIZE    1024
+#define MIN_BENCH_NS        500000000ULL
+
+typedef struct {
+    const char *name;
+    const char *file;
+} patch_t;
+
+static const patch_t s_patches[] = {
+    {"none", PATCH_PREFIX "-none.patch"},
+    {"crle", PATCH_PREFIX "-crle.patch"},
+    {"heatshrink", PATCH_PREFIX "-heatshrink.patch"},
+    {"lzma", PATCH_PREFIX ".patch"},
+};
+
+/* 0 is the default buffers of detools, on the stack */
+static const size_t s_work_buf_sizes[] = {0, 1024, 4096, 16384};
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} file_t;
+
+static struct {
+    const file_t *from;
+    size_t from_offset;
+    uint8_t *to;
+    size_t to_size;
+    size_t to_offset;
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long call_ns;
+} s_io;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void call_cost(void)
+{
+    if (s_io.call_ns) {
+        uint64_t end = now_ns() + s_io.call_ns;
+        while (now_ns() < end) {
+        }
+    }
+}
+
+static int from_read(void *arg_p, uint8_t *buf_p, size_t size)
+{
+    (void)arg_p;
+    if (s_io.from_offset + size > s_io.from->size) {
+        return -1;
+    }
+    call_cost();
+    memcpy(buf_p, s_io.from->data + s_io.from_offset, size);
+    s_io.from_offset += size;
+    s_io.reads++;
+    return 0;
+}
+
+static int from_seek(void *arg_p, int offset)
+{
+    (void)arg_p;
+    s_io.from_offset += offset;
+    return 0;
+}
+
+static int to_write(void *arg_p, const uint8_t *buf_p, size_t size)
+{
+    (void)arg_p;
+    if (s_io.to_offset + size > s_io.to_size) {
+        return -1;
+    }
+    call_cost();
+    memcpy(s_io.to + s_io.to_offset, buf_p, size);
+    s_io.to_offset += size;
+    s_io.writes++;
+    return 0;
+}
+
+static int file_load(const char *name, file_t *file)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f) {
+        perror(name);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    file->size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    file->data = malloc(file->size);
+    if (!file->data || fread(file->data, 1, file->size, f) != file->size) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Applies the patch the way esp_delta_ota does, returns the size of the patched data */
+static int apply(const file_t *patch, uint8_t *work_buf, size_t work_buf_size)
+{
+    static struct detools_apply_patch_t apply_patch;
+    int res;
+
+    s_io.from_offset = 0;
+    s_io.to_offset = 0;
+    res = detools_apply_patch_init(&apply_patch, from_read, from_seek, patch->size, to_write, NULL);
+    if (res == 0 && work_buf_size) {
+        res = detools_apply_patch_set_work_buffer(&apply_patch, work_buf, work_buf_size);
+    }
+    for (size_t offset = 0; res == 0 && offset < patch->size; offset += PATCH_CHUNK_SIZE) {
+        size_t len = patch->size - offset < PATCH_CHUNK_SIZE ? patch->size - offset : PATCH_CHUNK_SIZE;
+        res = detools_apply_patch_process(&apply_patch, patch->data + offset, len);
+    }
+    if (res != 0) {
+        (void)detools_apply_patch_finalize(&apply_patch);
+        return res;
+    }
+    return detools_apply_patch_finalize(&apply_patch);
+}
+
+int main(int argc, char *argv[])
+{
+    file_t from, to, patch;
+    static uint8_t work_buf[16384];
+    int ret = 0;
+
+    if (argc > 1) {
+        s_io.call_ns = strtoul(argv[1], NULL, 0) * 1000;
+    }
+    if (file_load(FROM_FILE, &from) != 0 || file_load(TO_FILE, &to) != 0) {
+        return 1;
+    }
+    s_io.from = &from;
+    s_io.to_size = to.size;
+    s_io.to = malloc(to.size);
+
+    printf("diff add %s, %lu us per call\n", DETOOLS_CONFIG_DIFF_ADD_SWAR ? "word-wise" : "byte-wise",
+           s_io.call_ns / 1000);
+    printf("%-12s %8s %10s %10s %10s\n", "patch", "work buf", "MB/s", "reads", "writes");
+    for (size_t p = 0; p < sizeof(s_patches) / sizeof(s_patches[0]); p++) {
+        if (file_load(s_patches[p].file, &patch) != 0) {
+            ret = 1;
+            continue;
+        }
+        for (size_t w = 0; w < sizeof(s_work_buf_sizes) / sizeof(s_work_buf_sizes[0]); w++) {
+            size_t work_buf_size = s_work_buf_sizes[w];
+            int res = apply(&patch, work_buf, work_buf_size);
+            if (res != (int)to.size || memcmp(s_io.to, to.data, to.size)) {
+                printf("%-12s %8zu failed: %s\n", s_patches[p].name, work_buf_size,
+                       res < 0 ? detools_error_as_string(res) : "patched data differs");
+                ret = 1;
+                continue;
+            }
+            uint64_t iter = 0, start = now_ns(), elapsed;
+            s_io.reads = 0;
+            s_io.writes = 0;
+            do {
+                apply(&patch, work_buf, work_buf_size);
+                iter++;
+                elapsed = now_ns() - start;
+            } while (elapsed < MIN_BENCH_NS);
+            printf("%-12s %8zu %10.1f %10lu %10lu\n", s_patches[p].name, work_buf_size,
+                   (double)to.size * iter * 1000.0 / elapsed, s_io.reads / iter, s_io.writes / iter);
+        }
+        free(patch.data);
+    }
+    free(s_io.to);
+    free(to.data);
+    free(from.data);
+    printf("%s\n", ret ? "FAIL" : "PASS");
+    return ret;
+}
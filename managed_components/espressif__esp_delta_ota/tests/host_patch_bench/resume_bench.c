@@ -0,0 +1,183 @@
+/*
+ * SPDX-License-Identifier: Apache 2.0 License
+ *
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ */
+
+/* Host benchmark of delta OTA updates over a link that drops.
+ * Applies the heatshrink micropython patch of detools with src/esp_delta_ota.c, the link drops every
+ * time the given number of patch bytes is received in a session. Each session continues the update
+ * with esp_delta_ota_resume() from the last checkpoint, saved in the in memory NVS of nvs.c, and the
+ * patched data past the checkpoint is lost (erased). Checks the patched data, its SHA-256 computed by
+ * esp_delta_ota across the sessions, and prints the patch bytes transferred to complete the update.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <openssl/sha.h>
+#include "esp_delta_ota.h"
+#include "nvs.h"
+
+#define FILES_DIR           "../../detools/tests/files/micropython/"
+#define FROM_FILE           FILES_DIR "esp8266-20180511-v1.9.4.bin"
+#define TO_FILE             FILES_DIR "esp8266-20190125-v1.10.bin"
+#define PATCH_FILE          FILES_DIR "esp8266-20180511-v1.9.4--20190125-v1.10-heatshrink.patch"
+#define PATCH_CHUNK_SIZE    1024
+#define MAX_SESSIONS        100
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} file_t;
+
+static struct {
+    file_t from;
+    uint8_t *to;
+    size_t to_size;
+    size_t to_offset;
+    uint8_t to_sha256[SHA256_DIGEST_LENGTH];
+} s_io;
+
+static esp_err_t read_cb(uint8_t *buf_p, size_t size, int src_offset)
+{
+    if (src_offset < 0 || src_offset + size > s_io.from.size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(buf_p, s_io.from.data + src_offset, size);
+    return ESP_OK;
+}
+
+static esp_err_t write_cb(const uint8_t *buf_p, size_t size, void *user_data)
+{
+    (void)user_data;
+    if (s_io.to_offset + size > s_io.to_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(s_io.to + s_io.to_offset, buf_p, size);
+    s_io.to_offset += size;
+    return ESP_OK;
+}
+
+static int file_load(const char *name, file_t *file)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f) {
+        perror(name);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    file->size = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    file->data = malloc(file->size);
+    if (!file->data || fread(file->data, 1, file->size, f) != file->size) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+static size_t checkpoint_size(void)
+{
+    nvs_handle_t nvs;
+    size_t size = 0;
+    if (nvs_open("delta_ota", NVS_READONLY, &nvs) == ESP_OK) {
+        nvs_get_blob(nvs, "checkpoint", NULL, &size);
+        nvs_close(nvs);
+    }
+    return size;
+}
+
+/* Runs a session of the update, returns 1 if the update is complete, 0 if the link dropped, -1 on error */
+static int session(const char *id, const file_t *patch, size_t drop, size_t *patch_offset, size_t *transferred)
+{
+    esp_delta_ota_cfg_t cfg = {
+        .read_cb = read_cb,
+        .write_cb_with_user_data = write_cb,
+        .checkpoint_id = id,
+        .expected_sha256 = s_io.to_sha256,
+    };
+    esp_delta_ota_checkpoint_t checkpoint;
+    esp_err_t err = ESP_OK;
+    size_t received = 0;
+
+    esp_delta_ota_handle_t handle = esp_delta_ota_resume(&cfg, &checkpoint);
+    if (!handle) {
+        return -1;
+    }
+    // patched data past the checkpoint was lost with the interruption
+    s_io.to_offset = checkpoint.to_offset;
+    memset(s_io.to + s_io.to_offset, 0xff, s_io.to_size - s_io.to_offset);
+    *patch_offset = checkpoint.patch_offset;
+
+    for (size_t offset = checkpoint.patch_offset; err == ESP_OK && offset < patch->size; offset += PATCH_CHUNK_SIZE) {
+        if (received >= drop) {
+            esp_delta_ota_deinit(handle);
+            *transferred += received;
+            return 0;
+        }
+        size_t len = patch->size - offset < PATCH_CHUNK_SIZE ? patch->size - offset : PATCH_CHUNK_SIZE;
+        err = esp_delta_ota_feed_patch(handle, patch->data + offset, len);
+        received += len;
+    }
+    if (err == ESP_OK) {
+        err = esp_delta_ota_finalize(handle);
+    }
+    esp_delta_ota_deinit(handle);
+    *transferred += received;
+    return err == ESP_OK ? 1 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    file_t to, patch;
+    size_t drop = (argc > 1 ? strtoul(argv[1], NULL, 0) : 40) * 1024;
+    size_t patch_offset, transferred = 0, ckpt_size = 0;
+    unsigned writes;
+    int sessions = 0, res = 0;
+
+    if (file_load(FROM_FILE, &s_io.from) != 0 || file_load(TO_FILE, &to) != 0 || file_load(PATCH_FILE, &patch) != 0) {
+        return 1;
+    }
+    s_io.to_size = to.size;
+    s_io.to = malloc(to.size);
+    SHA256(to.data, to.size, s_io.to_sha256);
+
+    /* A checkpoint of another update is not resumed */
+    session("v1.9.4-other", &patch, drop, &patch_offset, &transferred);
+    if (session("v1.10", &patch, 0, &patch_offset, &transferred) != 0 || patch_offset != 0) {
+        printf("FAIL: resumed the checkpoint of another update\n");
+        return 1;
+    }
+
+    transferred = 0;
+    writes = nvs_mock_writes();
+    while (res == 0 && sessions < MAX_SESSIONS) {
+        res = session("v1.10", &patch, drop, &patch_offset, &transferred);
+        sessions++;
+        ckpt_size = MAX(ckpt_size, checkpoint_size());
+    }
+    if (res != 1 || memcmp(s_io.to, to.data, to.size)) {
+        printf("FAIL: %s\n", res == 1 ? "patched data differs" : "update not complete");
+        return 1;
+    }
+    if (checkpoint_size() != 0) {
+        printf("FAIL: checkpoint kept after the update\n");
+        return 1;
+    }
+    printf("link drops every %zu KB, checkpoint every %d KB\n", drop / 1024, CONFIG_ESP_DELTA_OTA_CHECKPOINT_INTERVAL / 1024);
+    printf("update            %d sessions, %zu of %zu patch bytes transferred (%.2fx)\n", sessions, transferred,
+           patch.size, (double)transferred / patch.size);
+    printf("checkpoints       %u NVS writes of %zu bytes\n", nvs_mock_writes() - writes, ckpt_size);
+
+    /* The patched data of an update is checked against the expected SHA-256 */
+    s_io.to_sha256[0] ^= 1;
+    if (session("v1.10", &patch, patch.size, &patch_offset, &transferred) != -1) {
+        printf("FAIL: patched data not checked against its SHA-256\n");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -32,6 +32,59 @@ typedef enum {
     ESP_DIAG_DATA_STORE_EVENT_NON_CRITICAL_DATA_LOW_MEM,
 } esp_diag_data_store_events_t;
 
+/**
+ * @brief Maximum number of spans returned by a span read.
+ *
+ * Data in the store is kept in a ring buffer, so a read can be split in at most two
+ * contiguous regions: head (from read offset till end of buffer) and wrap (from start of buffer).
+ */
+#define ESP_DIAG_DATA_STORE_MAX_SPANS   2
+
+/**
+ * @brief Contiguous region of data inside the diagnostics data store
+ */
+typedef struct {
+    const uint8_t *ptr;     /*!< Pointer to the data inside the store, NULL if span is empty */
+    size_t len;             /*!< Length of the data */
+} esp_diag_data_store_span_t;
+
+/**
+ * @brief View of the data of a span read, for access to the records in place
+ *
+ * Records are read straight from the store, only the record that straddles the wrap point
+ * of the ring buffer is copied, into the seam buffer provided by the reader.
+ */
+typedef struct {
+    esp_diag_data_store_span_t spans[ESP_DIAG_DATA_STORE_MAX_SPANS];  /*!< Spans of the read */
+    size_t size;            /*!< Total length of the spans */
+    uint8_t *seam;          /*!< Buffer for the data straddling the spans */
+    size_t seam_size;       /*!< Size of the seam buffer, should fit the longest record */
+} esp_diag_data_store_view_t;
+
+/**
+ * @brief Record for vectored writes
+ */
+typedef struct {
+    const char *dg;         /*!< Data group of the record, used only for non_critical data */
+    void *data;             /*!< Buffer holding the record */
+    size_t len;             /*!< Length of the record */
+} esp_diag_data_store_iov_t;
+
+/**
+ * @brief Usage of the diagnostics data store
+ *
+ * Written counters count every byte ever put in the store and wrap around, so a write rate
+ * is the difference of two readings divided by the time between them.
+ */
+typedef struct {
+    size_t critical_size;           /*!< Size of the critical data store */
+    size_t critical_filled;         /*!< Critical data currently in the store */
+    uint32_t critical_written;      /*!< Total critical data written */
+    size_t non_critical_size;       /*!< Size of the non_critical data store */
+    size_t non_critical_filled;     /*!< Non_critical data currently in the store */
+    uint32_t non_critical_written;  /*!< Total non_critical data written */
+} esp_diag_data_store_usage_t;
+
 /**
  * @brief Write critical data to the diagnostics data store
  *
@@ -53,6 +106,32 @@ esp_err_t esp_diag_data_store_critical_write(void *data, size_t len);
  */
 esp_err_t esp_diag_data_store_non_critical_write(const char *dg, void *data, size_t len);
 
+/**
+ * @brief Write several critical records to the diagnostics data store at once
+ *
+ * Space for all the records is reserved at once, so either all the records are written or none.
+ * Low memory event is posted at most once for the whole batch.
+ *
+ * @param[in] iov Array of records
+ * @param[in] iovcnt Number of records
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t esp_diag_data_store_critical_writev(const esp_diag_data_store_iov_t *iov, size_t iovcnt);
+
+/**
+ * @brief Write several non_critical records to the diagnostics data store at once
+ *
+ * Space for all the records is reserved at once, so either all the records are written or none.
+ * Low memory event is posted at most once for the whole batch.
+ *
+ * @param[in] iov Array of records, data group of every record must be set
+ * @param[in] iovcnt Number of records
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t esp_diag_data_store_non_critical_writev(const esp_diag_data_store_iov_t *iov, size_t iovcnt);
+
 /**
  * @brief Read critical data from the diagnostics data store
  *
@@ -95,6 +174,90 @@ esp_err_t esp_diag_data_store_critical_release(size_t size);
  */
 esp_err_t esp_diag_data_store_non_critical_release(size_t size);
 
+/**
+ * @brief Get critical data from the diagnostics data store without copying it
+ *
+ * Fills \p spans with pointers into the store. Pointed data stays valid until
+ * esp_diag_data_store_critical_release_spans() is called. Only one span read can be
+ * outstanding at a time.
+ *
+ * @param[out] spans Array of ESP_DIAG_DATA_STORE_MAX_SPANS spans, unused spans have zero length
+ * @param[in]  size  Maximum number of bytes to get
+ *
+ * @return Total number of bytes in the spans or -1 on error
+ */
+int esp_diag_data_store_critical_read_spans(esp_diag_data_store_span_t *spans, size_t size);
+
+/**
+ * @brief Finish a critical span read and release the size bytes of critical data
+ *
+ * @param[in] size Number of bytes to free, can be zero to keep the data in store.
+ *
+ * If size is more than the data in store, nothing is freed and the spans stay held.
+ * If the data was discarded since the read, nothing is freed and ESP_ERR_INVALID_STATE is returned.
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t esp_diag_data_store_critical_release_spans(size_t size);
+
+/**
+ * @brief Get non_critical data from the diagnostics data store without copying it
+ *
+ * Fills \p spans with pointers into the store. Pointed data is not overwritten until
+ * esp_diag_data_store_non_critical_release_spans() is called. Only one span read can be
+ * outstanding at a time.
+ *
+ * @param[out] spans Array of ESP_DIAG_DATA_STORE_MAX_SPANS spans, unused spans have zero length
+ * @param[in]  size  Maximum number of bytes to get
+ *
+ * @return Total number of bytes in the spans or -1 on error
+ */
+int esp_diag_data_store_non_critical_read_spans(esp_diag_data_store_span_t *spans, size_t size);
+
+/**
+ * @brief Finish a non_critical span read and release the size bytes of non_critical data
+ *
+ * @param[in] size Number of bytes to free, can be zero to keep the data in store.
+ *
+ * If size is more than the data in store, nothing is freed and the spans stay held.
+ * If the data was discarded since the read, nothing is freed and ESP_ERR_INVALID_STATE is returned.
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t esp_diag_data_store_non_critical_release_spans(size_t size);
+
+/**
+ * @brief Initialize a view of the spans returned by a span read
+ *
+ * Typical drain of the store is a span read, records encoded in place through the view and
+ * release of the spans with the number of bytes consumed.
+ *
+ * @param[out] view      View to initialize
+ * @param[in]  spans     Array of ESP_DIAG_DATA_STORE_MAX_SPANS spans
+ * @param[in]  size      Total length of the spans, as returned by the span read
+ * @param[in]  seam      Buffer for the data straddling the spans
+ * @param[in]  seam_size Size of the seam buffer
+ */
+void esp_diag_data_store_view_init(esp_diag_data_store_view_t *view, const esp_diag_data_store_span_t *spans,
+                                   size_t size, uint8_t *seam, size_t seam_size);
+
+/**
+ * @brief Get contiguous data at an offset of the view
+ *
+ * Data is returned in place, unless it straddles the spans, then it is copied into the seam buffer.
+ * Data in the seam buffer is valid until the next call.
+ *
+ * @param[in]  view   View of the data
+ * @param[in]  offset Offset of the data from the start of the view
+ * @param[in]  len    Number of bytes needed
+ * @param[out] avail  Number of bytes at the returned pointer, less than len at the end of the view
+ *                    or if the seam buffer is smaller
+ *
+ * @return Pointer to the data, NULL if offset is past the end of the view
+ */
+const uint8_t *esp_diag_data_store_view_get(const esp_diag_data_store_view_t *view, size_t offset, size_t len,
+                                            size_t *avail);
+
 /**
  * @brief Initializes the diagnostics data store
  *
@@ -114,9 +277,20 @@ void esp_diag_data_store_deinit(void);
  */
 uint32_t esp_diag_data_store_get_crc(void);
 
+/**
+ * @brief Get size, fill level and number of bytes written of the diagnostics data store
+ *
+ * @param[out] usage Usage of critical and non_critical data store
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t esp_diag_data_store_get_usage(esp_diag_data_store_usage_t *usage);
+
 /**
  * @brief Discard values from diagnostics data store. This API should be called after esp_diag_data_store_init();
  *
+ * Span reads in progress are ended, the data they point to is discarded too.
+ *
  * @return ESP_OK on success, appropriate error on failure.
  */
 esp_err_t esp_diag_data_discard_data(void);
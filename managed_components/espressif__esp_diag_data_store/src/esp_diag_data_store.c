@@ -20,27 +20,40 @@ typedef void (*deinit_cb_t) (void);
 typedef esp_err_t (*write_cb_t) (void *data, size_t len);
 /* Callback type to write non_critical data */
 typedef esp_err_t (*nc_write_cb_t) (const char *dg, void *data, size_t len);
+/* Callback type to write several records at once */
+typedef esp_err_t (*writev_cb_t) (const esp_diag_data_store_iov_t *iov, size_t iovcnt);
 /* Callback type to read data */
 typedef int (*read_cb_t) (uint8_t *buf, size_t size);
 /* Callback type to release the data */
 typedef esp_err_t (*release_cb_t) (size_t size);
+/* Callback type to get the data in place */
+typedef int (*read_spans_cb_t) (esp_diag_data_store_span_t *spans, size_t size);
 /* Callback type to get CRC of data store configuration.
 This crc will be used to discard data from data store if its value is changed */
 typedef uint32_t (*crc_cb_t) ();
 /* Callback type to discard data from data store. */
 typedef esp_err_t (*discard_data_cb_t) ();
+/* Callback type to get usage of data store */
+typedef esp_err_t (*get_usage_cb_t) (esp_diag_data_store_usage_t *usage);
 
 typedef struct {
     init_cb_t init;
     deinit_cb_t deinit;
     write_cb_t critical_write;
     nc_write_cb_t non_critical_write;
+    writev_cb_t critical_writev;
+    writev_cb_t non_critical_writev;
     read_cb_t critical_read;
     read_cb_t non_critical_read;
     release_cb_t critical_release;
     release_cb_t non_critical_release;
+    read_spans_cb_t critical_read_spans;
+    read_spans_cb_t non_critical_read_spans;
+    release_cb_t critical_release_spans;
+    release_cb_t non_critical_release_spans;
     crc_cb_t data_store_crc;
     discard_data_cb_t discard_data;
+    get_usage_cb_t get_usage;
 } data_store_cbs_t;
 
 typedef struct {
@@ -63,12 +76,19 @@ static void set_diag_store_cbs(void)
     s_priv_data.cbs.deinit = rtc_store_deinit;
     s_priv_data.cbs.critical_write = rtc_store_critical_data_write;
     s_priv_data.cbs.non_critical_write = rtc_store_non_critical_data_write;
+    s_priv_data.cbs.critical_writev = rtc_store_critical_data_writev;
+    s_priv_data.cbs.non_critical_writev = rtc_store_non_critical_data_writev;
     s_priv_data.cbs.critical_read = rtc_store_critical_data_read;
     s_priv_data.cbs.non_critical_read = rtc_store_non_critical_data_read;
     s_priv_data.cbs.critical_release = rtc_store_critical_data_release;
     s_priv_data.cbs.non_critical_release = rtc_store_non_critical_data_release;
+    s_priv_data.cbs.critical_read_spans = rtc_store_critical_data_read_spans;
+    s_priv_data.cbs.non_critical_read_spans = rtc_store_non_critical_data_read_spans;
+    s_priv_data.cbs.critical_release_spans = rtc_store_critical_data_release_spans;
+    s_priv_data.cbs.non_critical_release_spans = rtc_store_non_critical_data_release_spans;
     s_priv_data.cbs.data_store_crc = rtc_store_get_crc;
     s_priv_data.cbs.discard_data = rtc_store_discard_data;
+    s_priv_data.cbs.get_usage = rtc_store_get_usage;
 }
 
 static void unset_diag_store_cbs(void)
@@ -77,12 +97,19 @@ static void unset_diag_store_cbs(void)
     s_priv_data.cbs.deinit = NULL;
     s_priv_data.cbs.critical_write = NULL;
     s_priv_data.cbs.non_critical_write = NULL;
+    s_priv_data.cbs.critical_writev = NULL;
+    s_priv_data.cbs.non_critical_writev = NULL;
     s_priv_data.cbs.critical_read = NULL;
     s_priv_data.cbs.non_critical_read = NULL;
     s_priv_data.cbs.critical_release = NULL;
     s_priv_data.cbs.non_critical_release = NULL;
+    s_priv_data.cbs.critical_read_spans = NULL;
+    s_priv_data.cbs.non_critical_read_spans = NULL;
+    s_priv_data.cbs.critical_release_spans = NULL;
+    s_priv_data.cbs.non_critical_release_spans = NULL;
     s_priv_data.cbs.data_store_crc = NULL;
     s_priv_data.cbs.discard_data = NULL;
+    s_priv_data.cbs.get_usage = NULL;
 }
 
 esp_err_t esp_diag_data_store_critical_write(void *data, size_t len)
@@ -97,6 +124,18 @@ esp_err_t esp_diag_data_store_non_critical_write(const char *dg, void *data, siz
     return s_priv_data.cbs.non_critical_write(dg, data, len);
 }
 
+esp_err_t esp_diag_data_store_critical_writev(const esp_diag_data_store_iov_t *iov, size_t iovcnt)
+{
+    CHECK_STORE_INIT(ESP_ERR_INVALID_STATE);
+    return s_priv_data.cbs.critical_writev(iov, iovcnt);
+}
+
+esp_err_t esp_diag_data_store_non_critical_writev(const esp_diag_data_store_iov_t *iov, size_t iovcnt)
+{
+    CHECK_STORE_INIT(ESP_ERR_INVALID_STATE);
+    return s_priv_data.cbs.non_critical_writev(iov, iovcnt);
+}
+
 int esp_diag_data_store_critical_read(uint8_t *buf, size_t size)
 {
     CHECK_STORE_INIT(-1);
@@ -121,6 +160,73 @@ esp_err_t esp_diag_data_store_non_critical_release(size_t size)
     return s_priv_data.cbs.non_critical_release(size);
 }
 
+int esp_diag_data_store_critical_read_spans(esp_diag_data_store_span_t *spans, size_t size)
+{
+    CHECK_STORE_INIT(-1);
+    return s_priv_data.cbs.critical_read_spans(spans, size);
+}
+
+esp_err_t esp_diag_data_store_critical_release_spans(size_t size)
+{
+    CHECK_STORE_INIT(ESP_ERR_INVALID_STATE);
+    return s_priv_data.cbs.critical_release_spans(size);
+}
+
+int esp_diag_data_store_non_critical_read_spans(esp_diag_data_store_span_t *spans, size_t size)
+{
+    CHECK_STORE_INIT(-1);
+    return s_priv_data.cbs.non_critical_read_spans(spans, size);
+}
+
+esp_err_t esp_diag_data_store_non_critical_release_spans(size_t size)
+{
+    CHECK_STORE_INIT(ESP_ERR_INVALID_STATE);
+    return s_priv_data.cbs.non_critical_release_spans(size);
+}
+
+void esp_diag_data_store_view_init(esp_diag_data_store_view_t *view, const esp_diag_data_store_span_t *spans,
+                                   size_t size, uint8_t *seam, size_t seam_size)
+{
+    memcpy(view->spans, spans, sizeof(view->spans));
+    view->size = size;
+    view->seam = seam;
+    view->seam_size = seam ? seam_size : 0;
+}
+
+const uint8_t *esp_diag_data_store_view_get(const esp_diag_data_store_view_t *view, size_t offset, size_t len,
+                                            size_t *avail)
+{
+    const esp_diag_data_store_span_t *head = &view->spans[0];
+    if (offset >= view->size) {
+        *avail = 0;
+        return NULL;
+    }
+    if (len > view->size - offset) {
+        len = view->size - offset;
+    }
+    if (offset >= head->len) {
+        *avail = len;
+        return view->spans[1].ptr + (offset - head->len);
+    }
+    size_t in_head = head->len - offset;
+    if (len <= in_head) {
+        *avail = len;
+        return head->ptr + offset;
+    }
+    // straddles the wrap point
+    if (len > view->seam_size) {
+        len = view->seam_size;
+    }
+    if (len <= in_head) {
+        *avail = in_head;
+        return head->ptr + offset;
+    }
+    memcpy(view->seam, head->ptr + offset, in_head);
+    memcpy(view->seam + in_head, view->spans[1].ptr, len - in_head);
+    *avail = len;
+    return view->seam;
+}
+
 esp_err_t esp_diag_data_store_init(void)
 {
     set_diag_store_cbs();
@@ -150,4 +256,9 @@ esp_err_t esp_diag_data_discard_data(void)
 {
     CHECK_STORE_INIT(ESP_ERR_INVALID_STATE);
     return s_priv_data.cbs.discard_data();
-}
\ No newline at end of file
+}
+esp_err_t esp_diag_data_store_get_usage(esp_diag_data_store_usage_t *usage)
+{
+    CHECK_STORE_INIT(ESP_ERR_INVALID_STATE);
+    return s_priv_data.cbs.get_usage(usage);
+}
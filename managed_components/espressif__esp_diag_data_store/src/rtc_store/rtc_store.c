@@ -16,6 +16,9 @@
 
 #include <esp_diag_data_store.h>
 #include "rtc_store.h"
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+#include "rtc_store_overflow.h"
+#endif
 #include <esp_crc.h>
 #include <inttypes.h>
 
@@ -56,7 +59,8 @@
 
 /* When buffer is filled beyond configured capacity then we post an event.
  * In case of failure in sending data over the network, new critical data is dropped and
- * non-critical data is overwritten.
+ * non-critical data is overwritten. With CONFIG_RTC_STORE_FLASH_OVERFLOW, data that does not
+ * fit is spilled to flash instead and drained back as the RTC buffers are released.
  */
 
 /* When current free size of buffer drops below (100 - reporting_watermark)% then we post an event */
@@ -87,6 +91,12 @@ typedef struct {
     SemaphoreHandle_t lock;     // critical lock
     data_store_t *store;        // pointer to rtc data store
     size_t wrap_cnt;            // keep track of no. of times wrapping happened
+    bool spans_held;            // reader holds pointers into the buffer, do not overwrite
+    uint32_t written;           // total bytes written to the buffer, wraps around
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    bool spilling;              // LOW_MEM is posted for the current spill, cleared once drained
+    uint32_t discard_cnt;       // incremented on discard, a drain in progress stops on change
+#endif
 } rbuf_data_t;
 
 typedef struct {
@@ -184,6 +194,7 @@ static void rtc_store_write_complete(rbuf_data_t *rbuf_data, size_t len)
 #endif
 
     info->filled += len;
+    rbuf_data->written += len;
 
 #if RTC_STORE_DBG_PRINTS
     ESP_LOGI(TAG, "after write_complete, filled %" PRIu16 ", size %u, read_offset %" PRIu16 ", len %u",
@@ -227,6 +238,16 @@ static size_t rtc_store_write(rbuf_data_t *rbuf_data, void *data, size_t len)
     return rtc_store_write_at_offset(rbuf_data, data, len, 0);
 }
 
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+/* Called with the lock held when data is spilled, true only for the first spill since last drain */
+static inline bool rtc_store_spill_start(rbuf_data_t *rbuf_data)
+{
+    bool first = !rbuf_data->spilling;
+    rbuf_data->spilling = true;
+    return first;
+}
+#endif
+
 esp_err_t rtc_store_critical_data_write(void *data, size_t len)
 {
     esp_err_t ret = ESP_OK;
@@ -241,19 +262,35 @@ esp_err_t rtc_store_critical_data_write(void *data, size_t len)
 
     size_t len_real = len + 1; // 1 byte to store meta_index
     if (len_real > DIAG_CRITICAL_BUF_SIZE) {
-        printf("rtc_store_critical_data_write: len too large %d, size %d\n",
-                len_real, DIAG_CRITICAL_BUF_SIZE);
+        printf("rtc_store_critical_data_write: len too large %u, size %u\n",
+                (unsigned) len_real, (unsigned) DIAG_CRITICAL_BUF_SIZE);
         return ESP_FAIL;
     }
     xSemaphoreTake(s_priv_data.critical.lock, portMAX_DELAY);
 
     size_t curr_free = data_store_get_free(s_priv_data.critical.store);
     // size_t free_at_end = data_store_get_free_at_end(s_priv_data.critical.store);
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    // Keep the order, once spilled new data also goes to flash till it is drained
+    if (curr_free < len_real || rtc_store_overflow_pending(RTC_STORE_OVERFLOW_CRITICAL)) {
+        bool post_low_mem = rtc_store_spill_start(&s_priv_data.critical);
+        xSemaphoreGive(s_priv_data.critical.lock);
+        ret = rtc_store_overflow_write(RTC_STORE_OVERFLOW_CRITICAL, s_rtc_store.meta_hdr_idx, NULL, 0, data, len);
+        if (ret != ESP_OK) {
+            esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_CRITICAL_DATA_WRITE_FAIL, data, len_real, 0);
+            ret = ESP_ERR_NO_MEM;
+        }
+        if (post_low_mem) {
+            esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_CRITICAL_DATA_LOW_MEM, NULL, 0, 0);
+        }
+        return ret;
+    }
+#endif
     // If no space available... Raise write fail event
     if (curr_free < len_real) {
         esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_CRITICAL_DATA_WRITE_FAIL, data, len_real, 0);
 #if RTC_STORE_DBG_PRINTS
-        printf("%s, curr_free %d, req_free %d\n", TAG, curr_free, len_real);
+        printf("%s, curr_free %u, req_free %u\n", TAG, (unsigned) curr_free, (unsigned) len_real);
 #endif
         ret = ESP_ERR_NO_MEM;
     } else { // we have enough space of (len + 1)
@@ -270,6 +307,83 @@ esp_err_t rtc_store_critical_data_write(void *data, size_t len)
     return ret;
 }
 
+esp_err_t rtc_store_critical_data_writev(const esp_diag_data_store_iov_t *iov, size_t iovcnt)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (!iov || !iovcnt) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_priv_data.init) {
+        printf("rtc_store init not done! skipping critical_data_writev...\n");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t req_free = 0;
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (!iov[i].data || !iov[i].len) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        req_free += iov[i].len + 1; // 1 byte to store meta_index
+    }
+    if (req_free > DIAG_CRITICAL_BUF_SIZE) {
+        printf("rtc_store_critical_data_writev: len too large %u, size %u\n",
+                (unsigned) req_free, (unsigned) DIAG_CRITICAL_BUF_SIZE);
+        return ESP_FAIL;
+    }
+    xSemaphoreTake(s_priv_data.critical.lock, portMAX_DELAY);
+
+    size_t curr_free = data_store_get_free(s_priv_data.critical.store);
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    // Batch does not fit as a whole, spill it record by record to keep the order
+    if (curr_free < req_free || rtc_store_overflow_pending(RTC_STORE_OVERFLOW_CRITICAL)) {
+        bool post_low_mem = rtc_store_spill_start(&s_priv_data.critical);
+        xSemaphoreGive(s_priv_data.critical.lock);
+        for (size_t i = 0; i < iovcnt; i++) {
+            if (rtc_store_overflow_write(RTC_STORE_OVERFLOW_CRITICAL, s_rtc_store.meta_hdr_idx,
+                                         NULL, 0, iov[i].data, iov[i].len) != ESP_OK) {
+                esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_CRITICAL_DATA_WRITE_FAIL,
+                               iov[i].data, iov[i].len + 1, 0);
+                ret = ESP_ERR_NO_MEM;
+            }
+        }
+        if (post_low_mem) {
+            esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_CRITICAL_DATA_LOW_MEM, NULL, 0, 0);
+        }
+        return ret;
+    }
+#endif
+    if (curr_free < req_free) {
+        xSemaphoreGive(s_priv_data.critical.lock);
+        // Every record is dropped, keep the write fail count in line with single writes
+        for (size_t i = 0; i < iovcnt; i++) {
+            esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_CRITICAL_DATA_WRITE_FAIL,
+                           iov[i].data, iov[i].len + 1, 0);
+        }
+#if RTC_STORE_DBG_PRINTS
+        printf("%s, curr_free %u, req_free %u\n", TAG, (unsigned) curr_free, (unsigned) req_free);
+#endif
+        esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_CRITICAL_DATA_LOW_MEM, NULL, 0, 0);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Write all the records past the write pointer and commit them at once
+    size_t offset = 0;
+    for (size_t i = 0; i < iovcnt; i++) {
+        rtc_store_write_at_offset(&s_priv_data.critical, &s_rtc_store.meta_hdr_idx, 1, offset);
+        rtc_store_write_at_offset(&s_priv_data.critical, iov[i].data, iov[i].len, offset + 1);
+        offset += iov[i].len + 1;
+    }
+    rtc_store_write_complete(&s_priv_data.critical, offset);
+    curr_free = data_store_get_free(s_priv_data.critical.store);
+    xSemaphoreGive(s_priv_data.critical.lock);
+
+    if (curr_free < DIAG_CRITICAL_DATA_REPORTING_WATERMARK) {
+        esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_CRITICAL_DATA_LOW_MEM, NULL, 0, 0);
+    }
+    return ret;
+}
+
 static int rtc_store_data_read_unsafe(rbuf_data_t *rbuf_data, uint8_t *buf, size_t size);
 
 esp_err_t rtc_store_non_critical_data_write(const char *dg, void *data, size_t len)
@@ -289,8 +403,8 @@ esp_err_t rtc_store_non_critical_data_write(const char *dg, void *data, size_t l
     size_t curr_free;
 
     if (req_free > DIAG_NON_CRITICAL_BUF_SIZE) {
-        printf("rtc_store_non_critical_data_write: len too large %d, size %d\n",
-                req_free, DIAG_NON_CRITICAL_BUF_SIZE);
+        printf("rtc_store_non_critical_data_write: len too large %u, size %u\n",
+                (unsigned) req_free, (unsigned) DIAG_NON_CRITICAL_BUF_SIZE);
         return ESP_FAIL;
     }
 
@@ -299,6 +413,12 @@ esp_err_t rtc_store_non_critical_data_write(const char *dg, void *data, size_t l
     }
 
 #if CONFIG_RTC_STORE_OVERWRITE_NON_CRITICAL_DATA
+    /* Old data is being consumed in place, do not overwrite it */
+    if (s_priv_data.non_critical.spans_held &&
+            data_store_get_free(s_priv_data.non_critical.store) < req_free) {
+        xSemaphoreGive(s_priv_data.non_critical.lock);
+        return ESP_ERR_NO_MEM;
+    }
     /* Make enough room for the item */
     while (data_store_get_free(s_priv_data.non_critical.store) < req_free) {
         uint8_t tmp_buf[sizeof(header) + 1];
@@ -309,11 +429,26 @@ esp_err_t rtc_store_non_critical_data_write(const char *dg, void *data, size_t l
     }
 #else // just check if we have enough space to write the item
     curr_free = data_store_get_free(s_priv_data.non_critical.store);
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    if (curr_free < req_free || rtc_store_overflow_pending(RTC_STORE_OVERFLOW_NON_CRITICAL)) {
+        bool post_low_mem = rtc_store_spill_start(&s_priv_data.non_critical);
+        xSemaphoreGive(s_priv_data.non_critical.lock);
+        memset(&header, 0, sizeof(header));
+        header.len = len;
+        esp_err_t err = rtc_store_overflow_write(RTC_STORE_OVERFLOW_NON_CRITICAL, s_rtc_store.meta_hdr_idx,
+                                                 &header, sizeof(header), data, len);
+        if (post_low_mem) {
+            esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_NON_CRITICAL_DATA_LOW_MEM, NULL, 0, 0);
+        }
+        return (err == ESP_OK) ? ESP_OK : ESP_ERR_NO_MEM;
+    }
+#else
     if (curr_free < req_free) {
         xSemaphoreGive(s_priv_data.non_critical.lock);
         esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_NON_CRITICAL_DATA_LOW_MEM, NULL, 0, 0);
         return ESP_ERR_NO_MEM;
     }
+#endif /* CONFIG_RTC_STORE_FLASH_OVERFLOW */
 #endif
     memset(&header, 0, sizeof(header));
     header.len = len;
@@ -334,6 +469,102 @@ esp_err_t rtc_store_non_critical_data_write(const char *dg, void *data, size_t l
     return ESP_OK;
 }
 
+esp_err_t rtc_store_non_critical_data_writev(const esp_diag_data_store_iov_t *iov, size_t iovcnt)
+{
+    if (!iov || !iovcnt) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_priv_data.init) {
+        printf("rtc_store init not done! skipping non_critical_data_writev...\n");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    rtc_store_non_critical_data_hdr_t header;
+    size_t req_free = 0;
+    size_t curr_free;
+
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (!iov[i].dg || !iov[i].data || !iov[i].len || !esp_ptr_in_drom(iov[i].dg)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        req_free += sizeof(header) + iov[i].len + 1; // 1 byte for meta index
+    }
+    if (req_free > DIAG_NON_CRITICAL_BUF_SIZE) {
+        printf("rtc_store_non_critical_data_writev: len too large %u, size %u\n",
+                (unsigned) req_free, (unsigned) DIAG_NON_CRITICAL_BUF_SIZE);
+        return ESP_FAIL;
+    }
+
+    if (xSemaphoreTake(s_priv_data.non_critical.lock, 0) == pdFALSE) {
+        return ESP_FAIL;
+    }
+
+#if CONFIG_RTC_STORE_OVERWRITE_NON_CRITICAL_DATA
+    /* Old data is being consumed in place, do not overwrite it */
+    if (s_priv_data.non_critical.spans_held &&
+            data_store_get_free(s_priv_data.non_critical.store) < req_free) {
+        xSemaphoreGive(s_priv_data.non_critical.lock);
+        return ESP_ERR_NO_MEM;
+    }
+    /* Make enough room for the whole batch */
+    while (data_store_get_free(s_priv_data.non_critical.store) < req_free) {
+        uint8_t tmp_buf[sizeof(header) + 1];
+        rtc_store_data_read_unsafe(&s_priv_data.non_critical, tmp_buf, sizeof(tmp_buf));
+        memcpy(&header, tmp_buf + 1, sizeof(header)); // because 1 byte is meta_hdr idx
+        size_t to_free = sizeof(tmp_buf) + header.len;
+        rtc_store_read_complete(&s_priv_data.non_critical, to_free);
+    }
+#else
+    curr_free = data_store_get_free(s_priv_data.non_critical.store);
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    // Batch does not fit as a whole, spill it record by record to keep the order
+    if (curr_free < req_free || rtc_store_overflow_pending(RTC_STORE_OVERFLOW_NON_CRITICAL)) {
+        bool post_low_mem = rtc_store_spill_start(&s_priv_data.non_critical);
+        xSemaphoreGive(s_priv_data.non_critical.lock);
+        esp_err_t ret = ESP_OK;
+        for (size_t i = 0; i < iovcnt; i++) {
+            memset(&header, 0, sizeof(header));
+            header.len = iov[i].len;
+            if (rtc_store_overflow_write(RTC_STORE_OVERFLOW_NON_CRITICAL, s_rtc_store.meta_hdr_idx,
+                                         &header, sizeof(header), iov[i].data, iov[i].len) != ESP_OK) {
+                ret = ESP_ERR_NO_MEM;
+            }
+        }
+        if (post_low_mem) {
+            esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_NON_CRITICAL_DATA_LOW_MEM, NULL, 0, 0);
+        }
+        return ret;
+    }
+#else
+    if (curr_free < req_free) {
+        xSemaphoreGive(s_priv_data.non_critical.lock);
+        esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_NON_CRITICAL_DATA_LOW_MEM, NULL, 0, 0);
+        return ESP_ERR_NO_MEM;
+    }
+#endif /* CONFIG_RTC_STORE_FLASH_OVERFLOW */
+#endif
+
+    // Write all the records past the write pointer and commit them at once
+    size_t offset = 0;
+    for (size_t i = 0; i < iovcnt; i++) {
+        memset(&header, 0, sizeof(header));
+        header.len = iov[i].len;
+        rtc_store_write_at_offset(&s_priv_data.non_critical, &s_rtc_store.meta_hdr_idx, 1, offset);
+        rtc_store_write_at_offset(&s_priv_data.non_critical, &header, sizeof(header), offset + 1);
+        rtc_store_write_at_offset(&s_priv_data.non_critical, iov[i].data, iov[i].len, offset + 1 + sizeof(header));
+        offset += sizeof(header) + iov[i].len + 1;
+    }
+    rtc_store_write_complete(&s_priv_data.non_critical, offset);
+
+    curr_free = data_store_get_free(s_priv_data.non_critical.store);
+    xSemaphoreGive(s_priv_data.non_critical.lock);
+
+    if (curr_free < DIAG_NON_CRITICAL_DATA_REPORTING_WATERMARK) {
+        esp_event_post(ESP_DIAG_DATA_STORE_EVENT, ESP_DIAG_DATA_STORE_EVENT_NON_CRITICAL_DATA_LOW_MEM, NULL, 0, 0);
+    }
+    return ESP_OK;
+}
+
 static int rtc_store_data_read_unsafe(rbuf_data_t *rbuf_data, uint8_t *buf, size_t size)
 {
     data_store_info_t *info = (data_store_info_t *) &rbuf_data->store->info;
@@ -369,6 +600,84 @@ static int rtc_store_data_read(rbuf_data_t *rbuf_data, uint8_t *buf, size_t size
     return size;
 }
 
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+#define RTC_STORE_OVERFLOW_DRAIN_CHUNK  128 // flash is read in chunks of this size, without the lock
+
+/* Copy a chunk of the record being drained to the free space, offset bytes after the written data */
+static void rtc_store_overflow_chunk_copy(rbuf_data_t *rbuf_data, size_t offset, const uint8_t *chunk, size_t len)
+{
+    data_store_info_t *info = (data_store_info_t *) &rbuf_data->store->info;
+    size_t write_offset = (info->read_offset + info->filled + offset) % rbuf_data->store->size;
+    size_t at_end = rbuf_data->store->size - write_offset;
+    if (at_end > len) {
+        at_end = len;
+    }
+    memcpy(rbuf_data->store->buf + write_offset, chunk, at_end);
+    memcpy(rbuf_data->store->buf, chunk + at_end, len - at_end);
+}
+
+/* Move spilled records back from flash, oldest first, as long as they fit.
+ * Flash is read without the lock, so that writers are not blocked by it. The lock is taken to copy every
+ * chunk to the free space after the written data, and to complete the record once it is all copied.
+ * Writes, a discard or another drain meanwhile leave the record in flash, to be drained later.
+ */
+static void rtc_store_overflow_drain(rbuf_data_t *rbuf_data)
+{
+    uint8_t chunk[RTC_STORE_OVERFLOW_DRAIN_CHUNK];
+    size_t len;
+    rtc_store_overflow_type_t type = (rbuf_data == &s_priv_data.critical) ?
+                                     RTC_STORE_OVERFLOW_CRITICAL : RTC_STORE_OVERFLOW_NON_CRITICAL;
+    while (rtc_store_overflow_pending(type) && rtc_store_overflow_peek(type, &len) == ESP_OK) {
+        xSemaphoreTake(rbuf_data->lock, portMAX_DELAY);
+        uint32_t written = rbuf_data->written;
+        uint32_t discard_cnt = rbuf_data->discard_cnt;
+        bool fits = data_store_get_free(rbuf_data->store) >= len;
+        xSemaphoreGive(rbuf_data->lock);
+        if (!fits) {
+            break;
+        }
+        // record is already in RTC store format, copy it as is
+        bool copied = true;
+        for (size_t offset = 0; copied && offset < len; offset += sizeof(chunk)) {
+            size_t chunk_len = (len - offset < sizeof(chunk)) ? len - offset : sizeof(chunk);
+            if (rtc_store_overflow_read(type, offset, chunk, chunk_len) != ESP_OK) {
+                copied = false;
+                break;
+            }
+            xSemaphoreTake(rbuf_data->lock, portMAX_DELAY);
+            copied = (rbuf_data->written == written && rbuf_data->discard_cnt == discard_cnt);
+            if (copied) {
+                rtc_store_overflow_chunk_copy(rbuf_data, offset, chunk, chunk_len);
+            }
+            xSemaphoreGive(rbuf_data->lock);
+        }
+        if (!copied) {
+            break;
+        }
+        xSemaphoreTake(rbuf_data->lock, portMAX_DELAY);
+        copied = (rbuf_data->written == written && rbuf_data->discard_cnt == discard_cnt);
+        if (copied) {
+            rtc_store_write_complete(rbuf_data, len);
+            rtc_store_overflow_pop(type);
+        }
+        xSemaphoreGive(rbuf_data->lock);
+        if (!copied) {
+            break;
+        }
+    }
+    xSemaphoreTake(rbuf_data->lock, portMAX_DELAY);
+    if (rbuf_data->spilling && !rtc_store_overflow_pending(type)) {
+        // pressure is over, next spill posts LOW_MEM again
+        rbuf_data->spilling = false;
+#if RTC_STORE_DBG_PRINTS
+        printf("%s: overflow drained, %" PRIu32 " records dropped so far\n", TAG, rtc_store_overflow_dropped(type));
+#endif
+    }
+    xSemaphoreGive(rbuf_data->lock);
+}
+
+#endif /* CONFIG_RTC_STORE_FLASH_OVERFLOW */
+
 static esp_err_t rtc_store_data_release(rbuf_data_t *rbuf_data, size_t size)
 {
     if (!s_priv_data.init) {
@@ -382,6 +691,9 @@ static esp_err_t rtc_store_data_release(rbuf_data_t *rbuf_data, size_t size)
     }
     rtc_store_read_complete(rbuf_data, size);
     xSemaphoreGive(rbuf_data->lock);
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    rtc_store_overflow_drain(rbuf_data);
+#endif
     return ESP_OK;
 }
 
@@ -423,16 +735,106 @@ esp_err_t rtc_store_non_critical_data_release(size_t size)
     return rtc_store_data_release(&s_priv_data.non_critical, size);
 }
 
+static int rtc_store_data_read_spans(rbuf_data_t *rbuf_data, esp_diag_data_store_span_t *spans, size_t size)
+{
+    if (!spans || !size) {
+        return -1;
+    }
+    if (!s_priv_data.init) {
+        return -1;
+    }
+
+    xSemaphoreTake(rbuf_data->lock, portMAX_DELAY);
+    if (rbuf_data->spans_held) {
+        xSemaphoreGive(rbuf_data->lock);
+        return -1;
+    }
+    data_store_info_t *info = (data_store_info_t *) &rbuf_data->store->info;
+    if (info->filled < size) {
+        size = info->filled;
+    }
+    size_t read_offset = info->read_offset;
+    if (read_offset >= rbuf_data->store->size) {
+        read_offset -= rbuf_data->store->size;
+    }
+    size_t data_at_end = rbuf_data->store->size - read_offset;
+
+    memset(spans, 0, sizeof(esp_diag_data_store_span_t) * ESP_DIAG_DATA_STORE_MAX_SPANS);
+    if (size) {
+        spans[0].ptr = rbuf_data->store->buf + read_offset;
+        spans[0].len = (data_at_end < size) ? data_at_end : size;
+        if (spans[0].len < size) {
+            // data is wrapped, rest of it is at the start of buffer
+            spans[1].ptr = rbuf_data->store->buf;
+            spans[1].len = size - spans[0].len;
+        }
+    }
+    rbuf_data->spans_held = true;
+    xSemaphoreGive(rbuf_data->lock);
+    return size;
+}
+
+static esp_err_t rtc_store_data_release_spans(rbuf_data_t *rbuf_data, size_t size)
+{
+    esp_err_t ret = ESP_OK;
+    if (!s_priv_data.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(rbuf_data->lock, portMAX_DELAY);
+    if (!rbuf_data->spans_held) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (data_store_get_filled(rbuf_data->store) < size) {
+        ret = ESP_FAIL;
+    } else {
+        if (size) {
+            rtc_store_read_complete(rbuf_data, size);
+        }
+        rbuf_data->spans_held = false;
+    }
+    // on ESP_FAIL the reader may still use the spans, they stay held until released with a valid size
+    xSemaphoreGive(rbuf_data->lock);
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    if (ret == ESP_OK && size) {
+        rtc_store_overflow_drain(rbuf_data);
+    }
+#endif
+    return ret;
+}
+
+int rtc_store_critical_data_read_spans(esp_diag_data_store_span_t *spans, size_t size)
+{
+    return rtc_store_data_read_spans(&s_priv_data.critical, spans, size);
+}
+
+esp_err_t rtc_store_critical_data_release_spans(size_t size)
+{
+    return rtc_store_data_release_spans(&s_priv_data.critical, size);
+}
+
+int rtc_store_non_critical_data_read_spans(esp_diag_data_store_span_t *spans, size_t size)
+{
+    return rtc_store_data_read_spans(&s_priv_data.non_critical, spans, size);
+}
+
+esp_err_t rtc_store_non_critical_data_release_spans(size_t size)
+{
+    return rtc_store_data_release_spans(&s_priv_data.non_critical, size);
+}
+
 static void rtc_store_rbuf_deinit(rbuf_data_t *rbuf_data)
 {
     if (rbuf_data->lock) {
         vSemaphoreDelete(rbuf_data->lock);
         rbuf_data->lock = NULL;
     }
+    rbuf_data->spans_held = false;
 }
 
 void rtc_store_deinit(void)
 {
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    rtc_store_overflow_deinit();
+#endif
     rtc_store_rbuf_deinit(&s_priv_data.critical);
     rtc_store_rbuf_deinit(&s_priv_data.non_critical);
     s_priv_data.init = false;
@@ -577,12 +979,50 @@ esp_err_t rtc_store_discard_data(void)
         ESP_LOGW(TAG, "RTC Store not initialized yet. Cannot discard data.");
         return ESP_ERR_INVALID_STATE;
     }
+    /* A span read in progress ends with its data, its release finds nothing held */
     xSemaphoreTake(s_priv_data.critical.lock, portMAX_DELAY);
     s_rtc_store.critical.store.info.value = 0;
+    s_priv_data.critical.spans_held = false;
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    s_priv_data.critical.discard_cnt++;
+#endif
     xSemaphoreGive(s_priv_data.critical.lock);
     xSemaphoreTake(s_priv_data.non_critical.lock, portMAX_DELAY);
     s_rtc_store.non_critical.store.info.value = 0;
+    s_priv_data.non_critical.spans_held = false;
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    s_priv_data.non_critical.discard_cnt++;
+#endif
     xSemaphoreGive(s_priv_data.non_critical.lock);
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    if (rtc_store_overflow_discard() != ESP_OK) {
+        printf("%s: failed to discard flash overflow data\n", TAG);
+    }
+#endif
+    return ESP_OK;
+}
+
+static void rtc_store_rbuf_get_usage(rbuf_data_t *rbuf_data, size_t *size, size_t *filled, uint32_t *written)
+{
+    xSemaphoreTake(rbuf_data->lock, portMAX_DELAY);
+    *size = data_store_get_size(rbuf_data->store);
+    *filled = data_store_get_filled(rbuf_data->store);
+    *written = rbuf_data->written;
+    xSemaphoreGive(rbuf_data->lock);
+}
+
+esp_err_t rtc_store_get_usage(esp_diag_data_store_usage_t *usage)
+{
+    if (!usage) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_priv_data.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    rtc_store_rbuf_get_usage(&s_priv_data.critical, &usage->critical_size,
+                             &usage->critical_filled, &usage->critical_written);
+    rtc_store_rbuf_get_usage(&s_priv_data.non_critical, &usage->non_critical_size,
+                             &usage->non_critical_filled, &usage->non_critical_written);
     return ESP_OK;
 }
 
@@ -641,5 +1081,19 @@ esp_err_t rtc_store_init(void)
     rtc_store_meta_hdr_init();
 
     s_priv_data.init = true;
+
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+    /* Meta records do not survive power loss, so spilled records cannot be attributed anymore */
+    bool discard = (reset_reason == ESP_RST_UNKNOWN ||
+                    reset_reason == ESP_RST_POWERON ||
+                    reset_reason == ESP_RST_BROWNOUT);
+    if (rtc_store_overflow_init(discard) == ESP_OK) {
+        rtc_store_overflow_drain(&s_priv_data.critical);
+        rtc_store_overflow_drain(&s_priv_data.non_critical);
+    } else {
+        // not fatal, continue with RTC store only
+        printf("%s: flash overflow init failed\n", TAG);
+    }
+#endif
     return ESP_OK;
 }
@@ -8,6 +8,7 @@
 
 #include <esp_err.h>
 #include <esp_event.h>
+#include <esp_diag_data_store.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -58,6 +59,16 @@ typedef struct {
  */
 esp_err_t rtc_store_critical_data_write(void *data, size_t len);
 
+/**
+ * @brief Write several critical records to the RTC storage under one reservation
+ *
+ * @param[in] iov Array of records
+ * @param[in] iovcnt Number of records
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t rtc_store_critical_data_writev(const esp_diag_data_store_iov_t *iov, size_t iovcnt);
+
 /**
  * @brief Read critical data from the RTC storage
  *
@@ -89,6 +100,28 @@ esp_err_t rtc_store_critical_data_release(size_t size);
  */
 int rtc_store_critical_data_read_and_release(uint8_t *buf, size_t size);
 
+/**
+ * @brief Get critical data from the RTC storage without copying it
+ *
+ * Spans point directly into the RTC buffer and stay valid till
+ * rtc_store_critical_data_release_spans() is called.
+ *
+ * @param[out] spans Array of ESP_DIAG_DATA_STORE_MAX_SPANS spans
+ * @param[in] size Maximum number of bytes to get
+ *
+ * @return Total number of bytes in the spans or -1 on error
+ */
+int rtc_store_critical_data_read_spans(esp_diag_data_store_span_t *spans, size_t size);
+
+/**
+ * @brief Finish the critical span read and release size bytes from RTC storage
+ *
+ * @param[in] size Number of bytes to free, zero keeps the data.
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t rtc_store_critical_data_release_spans(size_t size);
+
 /**
  * @brief Write non critical data to the RTC storage
  *
@@ -107,6 +140,16 @@ int rtc_store_critical_data_read_and_release(uint8_t *buf, size_t size);
  */
 esp_err_t rtc_store_non_critical_data_write(const char *dg, void *data, size_t len);
 
+/**
+ * @brief Write several non critical records to the RTC storage under one reservation
+ *
+ * @param[in] iov Array of records, data group of every record must be the string stored in RODATA
+ * @param[in] iovcnt Number of records
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t rtc_store_non_critical_data_writev(const esp_diag_data_store_iov_t *iov, size_t iovcnt);
+
 /**
  * @brief Read non critical data from the RTC storage
  *
@@ -136,6 +179,27 @@ esp_err_t rtc_store_non_critical_data_release(size_t size);
  */
 int rtc_store_non_critical_data_read_and_release(uint8_t *buf, size_t size);
 
+/**
+ * @brief Get non critical data from the RTC storage without copying it
+ *
+ * While spans are held, non critical writes do not overwrite the old data.
+ *
+ * @param[out] spans Array of ESP_DIAG_DATA_STORE_MAX_SPANS spans
+ * @param[in] size Maximum number of bytes to get
+ *
+ * @return Total number of bytes in the spans or -1 on error
+ */
+int rtc_store_non_critical_data_read_spans(esp_diag_data_store_span_t *spans, size_t size);
+
+/**
+ * @brief Finish the non critical span read and release size bytes from RTC storage
+ *
+ * @param[in] size Number of bytes to free, zero keeps the data.
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t rtc_store_non_critical_data_release_spans(size_t size);
+
 /**
  * @brief Initializes the RTC storage
  *
@@ -155,6 +219,15 @@ void rtc_store_deinit(void);
  */
 uint32_t rtc_store_get_crc(void);
 
+/**
+ * @brief Get size, fill level and number of bytes written of the RTC storage
+ *
+ * @param[out] usage Usage of critical and non_critical buffers
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t rtc_store_get_usage(esp_diag_data_store_usage_t *usage);
+
 /**
  * @brief Discard values from RTC Store. This API should be called after rtc_store_init();
  *
@@ -0,0 +1,512 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <inttypes.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <esp_partition.h>
+#include <esp_crc.h>
+
+#include "rtc_store_overflow.h"
+
+#define TAG "RTC_STORE_OVF"
+
+/**
+ * @brief Manages flash overflow log of RTC store
+ *
+ * @attention Like rtc_store.c, this file uses prints and not logs, logs are written to the RTC store
+ *    and may end up here again.
+ *
+ * Partition layout:
+ *  - Partition is divided in sectors, every sector starts with ovf_sector_hdr_t.
+ *  - Sectors are used one after another with increasing sequence number, after the last sector
+ *    the first one is erased and reused. Chain of consecutive sequence numbers ending at the
+ *    highest one gives the live sectors, oldest first.
+ *  - Records never cross the sector boundary. Every record is ovf_rec_hdr_t followed by
+ *    the record (meta index, header, data) padded to 4 bytes.
+ *  - Header is written before the data and has CRC of the data, so a record torn by power loss
+ *    is detected and skipped while draining.
+ *  - Consumed records are marked by clearing the state byte of the header in place.
+ */
+
+#if CONFIG_DIAG_DATA_STORE_DBG_PRINTS
+#define RTC_STORE_OVF_DBG_PRINTS 1
+#endif
+
+#define OVF_SECTOR_SIZE         4096
+#define OVF_SECTOR_MAGIC        0x564f4744  // "DGOV"
+#define OVF_REC_FREE            0xFF        // type byte of the erased flash
+#define OVF_REC_PENDING         0xFF
+#define OVF_REC_CONSUMED        0x00
+#define OVF_ALIGN(x)            (((x) + 3) & ~3)
+#define OVF_CRC_CHUNK           64
+#define OVF_LOCK_WAIT_MS        50          // covers a sector erase of the drain or another writer
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // sequence number, incremented for every newly opened sector
+} ovf_sector_hdr_t;
+
+typedef struct {
+    uint8_t type;           // rtc_store_overflow_type_t, OVF_REC_FREE if unused
+    uint8_t state;          // OVF_REC_PENDING or OVF_REC_CONSUMED
+    uint16_t len;           // length of the record without padding
+    uint32_t crc;           // crc of the record
+} ovf_rec_hdr_t;
+
+typedef struct {
+    uint16_t sector;
+    uint16_t offset;
+} ovf_pos_t;
+
+typedef struct {
+    bool init;
+    const esp_partition_t *part;
+    SemaphoreHandle_t lock;
+    uint16_t sector_cnt;
+    uint32_t head_seq;                          // sequence number of the head sector
+    ovf_pos_t head;                             // position of the next write
+    ovf_pos_t rd[RTC_STORE_OVERFLOW_MAX];       // no pending record of type is before this position
+    uint32_t pending[RTC_STORE_OVERFLOW_MAX];   // number of pending records of type, read without the lock
+    uint32_t dropped[RTC_STORE_OVERFLOW_MAX];   // number of records of type which could not be spilled
+} ovf_priv_data_t;
+
+static ovf_priv_data_t s_ovf;
+
+static inline size_t ovf_addr(ovf_pos_t pos)
+{
+    return (size_t) pos.sector * OVF_SECTOR_SIZE + pos.offset;
+}
+
+static inline bool ovf_pos_at_head(ovf_pos_t pos)
+{
+    return (pos.sector == s_ovf.head.sector) && (pos.offset >= s_ovf.head.offset);
+}
+
+static inline uint16_t ovf_next_sector(uint16_t sector)
+{
+    return (sector + 1) % s_ovf.sector_cnt;
+}
+
+static inline bool ovf_rec_hdr_valid(const ovf_rec_hdr_t *hdr, uint16_t offset)
+{
+    return (hdr->type < RTC_STORE_OVERFLOW_MAX) && hdr->len &&
+           (offset + sizeof(*hdr) + OVF_ALIGN(hdr->len) <= OVF_SECTOR_SIZE);
+}
+
+static esp_err_t ovf_sector_open(uint16_t sector, uint32_t seq)
+{
+    ovf_sector_hdr_t hdr = {
+        .magic = OVF_SECTOR_MAGIC,
+        .seq = seq,
+    };
+    esp_err_t err = esp_partition_erase_range(s_ovf.part, (size_t) sector * OVF_SECTOR_SIZE, OVF_SECTOR_SIZE);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = esp_partition_write(s_ovf.part, (size_t) sector * OVF_SECTOR_SIZE, &hdr, sizeof(hdr));
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_ovf.head.sector = sector;
+    s_ovf.head.offset = sizeof(hdr);
+    s_ovf.head_seq = seq;
+    return ESP_OK;
+}
+
+/* Walk from rd[type] to the next pending record of type, rd[type] points to it on success */
+static esp_err_t ovf_find(rtc_store_overflow_type_t type, ovf_rec_hdr_t *hdr)
+{
+    ovf_pos_t pos = s_ovf.rd[type];
+    if (!s_ovf.pending[type]) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    while (!ovf_pos_at_head(pos)) {
+        if (pos.offset + sizeof(*hdr) <= OVF_SECTOR_SIZE &&
+                esp_partition_read(s_ovf.part, ovf_addr(pos), hdr, sizeof(*hdr)) == ESP_OK &&
+                ovf_rec_hdr_valid(hdr, pos.offset)) {
+            if (hdr->type == type && hdr->state == OVF_REC_PENDING) {
+                s_ovf.rd[type] = pos;
+                return ESP_OK;
+            }
+            pos.offset += sizeof(*hdr) + OVF_ALIGN(hdr->len);
+            continue;
+        }
+        // rest of the sector is unused or unreadable
+        pos.sector = ovf_next_sector(pos.sector);
+        pos.offset = sizeof(ovf_sector_hdr_t);
+    }
+    // pending count went out of sync with flash, nothing more to drain
+    s_ovf.pending[type] = 0;
+    s_ovf.rd[type] = s_ovf.head;
+    return ESP_ERR_NOT_FOUND;
+}
+
+/* Mark the record at rd[type] as consumed and move past it */
+static esp_err_t ovf_consume(rtc_store_overflow_type_t type, const ovf_rec_hdr_t *hdr)
+{
+    uint8_t state = OVF_REC_CONSUMED;
+    esp_err_t err = esp_partition_write(s_ovf.part, ovf_addr(s_ovf.rd[type]) + offsetof(ovf_rec_hdr_t, state),
+                                        &state, sizeof(state));
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_ovf.rd[type].offset += sizeof(*hdr) + OVF_ALIGN(hdr->len);
+    __atomic_sub_fetch(&s_ovf.pending[type], 1, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+static bool ovf_rec_crc_ok(rtc_store_overflow_type_t type, const ovf_rec_hdr_t *hdr)
+{
+    uint8_t chunk[OVF_CRC_CHUNK];
+    size_t addr = ovf_addr(s_ovf.rd[type]) + sizeof(*hdr);
+    size_t done = 0;
+    uint32_t crc = 0;
+    while (done < hdr->len) {
+        size_t to_read = hdr->len - done;
+        if (to_read > sizeof(chunk)) {
+            to_read = sizeof(chunk);
+        }
+        if (esp_partition_read(s_ovf.part, addr + done, chunk, to_read) != ESP_OK) {
+            return false;
+        }
+        crc = esp_crc32_le(crc, chunk, to_read);
+        done += to_read;
+    }
+    return crc == hdr->crc;
+}
+
+/* Find live sectors, write position and the oldest pending record of every type */
+static esp_err_t ovf_scan(void)
+{
+    ovf_sector_hdr_t sec_hdr;
+    ovf_rec_hdr_t hdr;
+    bool found = false;
+    uint16_t sector, oldest;
+    uint16_t i;
+
+    for (i = 0; i < s_ovf.sector_cnt; i++) {
+        if (esp_partition_read(s_ovf.part, (size_t) i * OVF_SECTOR_SIZE, &sec_hdr, sizeof(sec_hdr)) != ESP_OK) {
+            continue;
+        }
+        if (sec_hdr.magic == OVF_SECTOR_MAGIC && (!found || sec_hdr.seq > s_ovf.head_seq)) {
+            s_ovf.head_seq = sec_hdr.seq;
+            s_ovf.head.sector = i;
+            found = true;
+        }
+    }
+    if (!found) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // walk back the chain of consecutive sequence numbers
+    oldest = s_ovf.head.sector;
+    for (i = 1; i < s_ovf.sector_cnt; i++) {
+        sector = (s_ovf.head.sector + s_ovf.sector_cnt - i) % s_ovf.sector_cnt;
+        if (esp_partition_read(s_ovf.part, (size_t) sector * OVF_SECTOR_SIZE, &sec_hdr, sizeof(sec_hdr)) != ESP_OK ||
+                sec_hdr.magic != OVF_SECTOR_MAGIC || sec_hdr.seq != s_ovf.head_seq - i) {
+            break;
+        }
+        oldest = sector;
+    }
+
+    memset(s_ovf.pending, 0, sizeof(s_ovf.pending));
+    sector = oldest;
+    while (1) {
+        bool is_head = (sector == s_ovf.head.sector);
+        ovf_pos_t pos = {
+            .sector = sector,
+            .offset = sizeof(ovf_sector_hdr_t),
+        };
+        while (pos.offset + sizeof(hdr) <= OVF_SECTOR_SIZE) {
+            if (esp_partition_read(s_ovf.part, ovf_addr(pos), &hdr, sizeof(hdr)) != ESP_OK ||
+                    hdr.type == OVF_REC_FREE) {
+                break;
+            }
+            if (!ovf_rec_hdr_valid(&hdr, pos.offset)) {
+                // do not append after garbage
+                pos.offset = OVF_SECTOR_SIZE;
+                break;
+            }
+            if (hdr.state == OVF_REC_PENDING) {
+                if (s_ovf.pending[hdr.type] == 0) {
+                    s_ovf.rd[hdr.type] = pos;
+                }
+                s_ovf.pending[hdr.type]++;
+            }
+            pos.offset += sizeof(hdr) + OVF_ALIGN(hdr.len);
+        }
+        if (is_head) {
+            s_ovf.head.offset = pos.offset;
+            break;
+        }
+        sector = ovf_next_sector(sector);
+    }
+
+    for (i = 0; i < RTC_STORE_OVERFLOW_MAX; i++) {
+        if (s_ovf.pending[i] == 0) {
+            s_ovf.rd[i] = s_ovf.head;
+        }
+    }
+#if RTC_STORE_OVF_DBG_PRINTS
+    printf("%s: head sector %u offset %u, pending critical %" PRIu32 " non_critical %" PRIu32 "\n", TAG,
+           s_ovf.head.sector, s_ovf.head.offset,
+           s_ovf.pending[RTC_STORE_OVERFLOW_CRITICAL], s_ovf.pending[RTC_STORE_OVERFLOW_NON_CRITICAL]);
+#endif
+    return ESP_OK;
+}
+
+/* Start a fresh chain, sequence number jump makes all the old sectors stale */
+static esp_err_t ovf_discard_unsafe(void)
+{
+    esp_err_t err = ovf_sector_open(ovf_next_sector(s_ovf.head.sector), s_ovf.head_seq + s_ovf.sector_cnt + 1);
+    if (err != ESP_OK) {
+        return err;
+    }
+    memset(s_ovf.pending, 0, sizeof(s_ovf.pending));
+    for (int i = 0; i < RTC_STORE_OVERFLOW_MAX; i++) {
+        s_ovf.rd[i] = s_ovf.head;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ovf_sector_open_next(void)
+{
+    ovf_rec_hdr_t hdr;
+    uint16_t next = ovf_next_sector(s_ovf.head.sector);
+    for (int i = 0; i < RTC_STORE_OVERFLOW_MAX; i++) {
+        if (s_ovf.pending[i] && s_ovf.rd[i].sector == next) {
+            ovf_find(i, &hdr);
+            if (s_ovf.pending[i] && s_ovf.rd[i].sector == next) {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+    }
+    return ovf_sector_open(next, s_ovf.head_seq + 1);
+}
+
+esp_err_t rtc_store_overflow_write(rtc_store_overflow_type_t type, uint8_t meta_idx,
+                                   const void *hdr, size_t hdr_len, const void *data, size_t len)
+{
+    esp_err_t err = ESP_OK;
+    size_t rec_len = sizeof(meta_idx) + hdr_len + len;
+    size_t need = sizeof(ovf_rec_hdr_t) + OVF_ALIGN(rec_len);
+
+    if (type >= RTC_STORE_OVERFLOW_MAX || !data || !len || (hdr_len && !hdr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_ovf.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (need > OVF_SECTOR_SIZE - sizeof(ovf_sector_hdr_t)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // We may be here again from the logs emitted while holding the lock, do not wait on ourselves
+    if (xSemaphoreGetMutexHolder(s_ovf.lock) == xTaskGetCurrentTaskHandle() ||
+            xSemaphoreTake(s_ovf.lock, pdMS_TO_TICKS(OVF_LOCK_WAIT_MS)) == pdFALSE) {
+        __atomic_add_fetch(&s_ovf.dropped[type], 1, __ATOMIC_RELAXED);
+        return ESP_ERR_TIMEOUT;
+    }
+    if (s_ovf.head.offset + need > OVF_SECTOR_SIZE) {
+        err = ovf_sector_open_next();
+        if (err != ESP_OK) {
+            goto write_end;
+        }
+    }
+    for (int i = 0; i < RTC_STORE_OVERFLOW_MAX; i++) {
+        if (s_ovf.pending[i] == 0) {
+            s_ovf.rd[i] = s_ovf.head;
+        }
+    }
+
+    ovf_rec_hdr_t rec_hdr = {
+        .type = type,
+        .state = OVF_REC_PENDING,
+        .len = rec_len,
+    };
+    rec_hdr.crc = esp_crc32_le(0, &meta_idx, sizeof(meta_idx));
+    if (hdr_len) {
+        rec_hdr.crc = esp_crc32_le(rec_hdr.crc, hdr, hdr_len);
+    }
+    rec_hdr.crc = esp_crc32_le(rec_hdr.crc, data, len);
+
+    size_t addr = ovf_addr(s_ovf.head);
+    err = esp_partition_write(s_ovf.part, addr, &rec_hdr, sizeof(rec_hdr));
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_ovf.part, addr + sizeof(rec_hdr), &meta_idx, sizeof(meta_idx));
+    }
+    if (err == ESP_OK && hdr_len) {
+        err = esp_partition_write(s_ovf.part, addr + sizeof(rec_hdr) + sizeof(meta_idx), hdr, hdr_len);
+    }
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_ovf.part, addr + sizeof(rec_hdr) + sizeof(meta_idx) + hdr_len, data, len);
+    }
+    // header is already written, skip the space even if data write failed
+    s_ovf.head.offset += need;
+    if (err == ESP_OK) {
+        __atomic_add_fetch(&s_ovf.pending[type], 1, __ATOMIC_RELEASE);
+    }
+write_end:
+    xSemaphoreGive(s_ovf.lock);
+    if (err != ESP_OK) {
+        __atomic_add_fetch(&s_ovf.dropped[type], 1, __ATOMIC_RELAXED);
+    }
+    return err;
+}
+
+bool rtc_store_overflow_pending(rtc_store_overflow_type_t type)
+{
+    // Called with the RTC store lock held, which may be taken while this lock is held on re-entry
+    return s_ovf.init && (type < RTC_STORE_OVERFLOW_MAX) &&
+           __atomic_load_n(&s_ovf.pending[type], __ATOMIC_ACQUIRE);
+}
+
+uint32_t rtc_store_overflow_dropped(rtc_store_overflow_type_t type)
+{
+    if (type >= RTC_STORE_OVERFLOW_MAX) {
+        return 0;
+    }
+    return __atomic_load_n(&s_ovf.dropped[type], __ATOMIC_RELAXED);
+}
+
+esp_err_t rtc_store_overflow_peek(rtc_store_overflow_type_t type, size_t *len)
+{
+    esp_err_t err;
+    ovf_rec_hdr_t hdr;
+    if (type >= RTC_STORE_OVERFLOW_MAX || !len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_ovf.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_ovf.lock, portMAX_DELAY);
+    while ((err = ovf_find(type, &hdr)) == ESP_OK) {
+        if (ovf_rec_crc_ok(type, &hdr)) {
+            *len = hdr.len;
+            break;
+        }
+        printf("%s: corrupted record, skipping...\n", TAG);
+        if (ovf_consume(type, &hdr) != ESP_OK) {
+            err = ESP_FAIL;
+            break;
+        }
+    }
+    xSemaphoreGive(s_ovf.lock);
+    return err;
+}
+
+esp_err_t rtc_store_overflow_read(rtc_store_overflow_type_t type, size_t offset, void *buf, size_t len)
+{
+    esp_err_t err;
+    ovf_rec_hdr_t hdr;
+    if (type >= RTC_STORE_OVERFLOW_MAX || !buf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_ovf.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!len) {
+        return ESP_OK;
+    }
+    xSemaphoreTake(s_ovf.lock, portMAX_DELAY);
+    err = ovf_find(type, &hdr);
+    if (err == ESP_OK) {
+        if (offset + len > hdr.len) {
+            err = ESP_ERR_INVALID_SIZE;
+        } else {
+            err = esp_partition_read(s_ovf.part, ovf_addr(s_ovf.rd[type]) + sizeof(hdr) + offset, buf, len);
+        }
+    }
+    xSemaphoreGive(s_ovf.lock);
+    return err;
+}
+
+esp_err_t rtc_store_overflow_pop(rtc_store_overflow_type_t type)
+{
+    esp_err_t err;
+    ovf_rec_hdr_t hdr;
+    if (type >= RTC_STORE_OVERFLOW_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_ovf.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_ovf.lock, portMAX_DELAY);
+    err = ovf_find(type, &hdr);
+    if (err == ESP_OK) {
+        err = ovf_consume(type, &hdr);
+    }
+    xSemaphoreGive(s_ovf.lock);
+    return err;
+}
+
+esp_err_t rtc_store_overflow_discard(void)
+{
+    esp_err_t err;
+    if (!s_ovf.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(s_ovf.lock, portMAX_DELAY);
+    err = ovf_discard_unsafe();
+    xSemaphoreGive(s_ovf.lock);
+    return err;
+}
+
+esp_err_t rtc_store_overflow_init(bool discard)
+{
+    esp_err_t err;
+    if (s_ovf.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memset(&s_ovf, 0, sizeof(s_ovf));
+    s_ovf.part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                          CONFIG_RTC_STORE_FLASH_OVERFLOW_PARTITION_LABEL);
+    if (!s_ovf.part) {
+        printf("%s: partition %s not found\n", TAG, CONFIG_RTC_STORE_FLASH_OVERFLOW_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_ovf.sector_cnt = s_ovf.part->size / OVF_SECTOR_SIZE;
+    if (s_ovf.sector_cnt < 2) {
+        printf("%s: partition too small, at least 2 sectors are required\n", TAG);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_ovf.lock = xSemaphoreCreateMutex();
+    if (!s_ovf.lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    err = ovf_scan();
+    if (err == ESP_ERR_NOT_FOUND) {
+        // fresh partition
+        err = ovf_sector_open(0, 0);
+        for (int i = 0; i < RTC_STORE_OVERFLOW_MAX; i++) {
+            s_ovf.rd[i] = s_ovf.head;
+        }
+    } else if (err == ESP_OK && discard) {
+        err = ovf_discard_unsafe();
+    }
+    if (err != ESP_OK) {
+        printf("%s: init failed, err %d\n", TAG, err);
+        vSemaphoreDelete(s_ovf.lock);
+        s_ovf.lock = NULL;
+        return err;
+    }
+    s_ovf.init = true;
+    return ESP_OK;
+}
+
+void rtc_store_overflow_deinit(void)
+{
+    if (s_ovf.lock) {
+        vSemaphoreDelete(s_ovf.lock);
+        s_ovf.lock = NULL;
+    }
+    s_ovf.init = false;
+}
@@ -0,0 +1,130 @@
+/*
+ * SPDX-FileCopyrightText: 2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Flash overflow tier for RTC store
+ *
+ * Records which do not fit in the RTC buffers are appended to a log on flash partition.
+ * Log is written sector by sector in circular fashion, so every sector is erased once per
+ * full cycle of the partition, which levels the wear across the partition.
+ * Records are drained back to RTC store in the order they were written.
+ *
+ * @attention Consumed records are marked in place, so partition must not be encrypted.
+ */
+
+/**
+ * @brief Type of the records stored in overflow log
+ */
+typedef enum {
+    RTC_STORE_OVERFLOW_CRITICAL = 0,
+    RTC_STORE_OVERFLOW_NON_CRITICAL,
+    RTC_STORE_OVERFLOW_MAX,
+} rtc_store_overflow_type_t;
+
+/**
+ * @brief Initialize the overflow log
+ *
+ * @param[in] discard Discard all the records present on flash
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t rtc_store_overflow_init(bool discard);
+
+/**
+ * @brief Deinitialize the overflow log
+ */
+void rtc_store_overflow_deinit(void);
+
+/**
+ * @brief Append a record to overflow log
+ *
+ * Record is stored as meta index, header and data, exactly like it is stored in RTC store.
+ *
+ * @param[in] type Type of the record
+ * @param[in] meta_idx Meta index of the record
+ * @param[in] hdr Record header, can be NULL
+ * @param[in] hdr_len Length of the header
+ * @param[in] data Record data
+ * @param[in] len Length of the data
+ *
+ * Waits for a short while if the log is busy, e.g. being drained. Failed records are counted
+ * as dropped.
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if log is full, ESP_ERR_TIMEOUT if log stayed busy,
+ *         appropriate error code otherwise.
+ */
+esp_err_t rtc_store_overflow_write(rtc_store_overflow_type_t type, uint8_t meta_idx,
+                                   const void *hdr, size_t hdr_len, const void *data, size_t len);
+
+/**
+ * @brief Check if there are records of type waiting in the overflow log
+ *
+ * @param[in] type Type of the record
+ *
+ * @return true if records are pending, false otherwise
+ */
+bool rtc_store_overflow_pending(rtc_store_overflow_type_t type);
+
+/**
+ * @brief Get the number of records of type which could not be written to overflow log
+ *
+ * @param[in] type Type of the record
+ *
+ * @return Number of dropped records since boot
+ */
+uint32_t rtc_store_overflow_dropped(rtc_store_overflow_type_t type);
+
+/**
+ * @brief Get the length of the oldest pending record of type
+ *
+ * @param[in] type Type of the record
+ * @param[out] len Length of the record
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no pending record
+ */
+esp_err_t rtc_store_overflow_peek(rtc_store_overflow_type_t type, size_t *len);
+
+/**
+ * @brief Read part of the oldest pending record of type
+ *
+ * @param[in] type Type of the record
+ * @param[in] offset Offset in the record
+ * @param[out] buf Buffer to read data in
+ * @param[in] len Number of bytes to read
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t rtc_store_overflow_read(rtc_store_overflow_type_t type, size_t offset, void *buf, size_t len);
+
+/**
+ * @brief Mark the oldest pending record of type as consumed
+ *
+ * @param[in] type Type of the record
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t rtc_store_overflow_pop(rtc_store_overflow_type_t type);
+
+/**
+ * @brief Discard all the records in overflow log
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+esp_err_t rtc_store_overflow_discard(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -213,6 +213,145 @@ TEST_CASE("data store write read release_zero read release_zero release_all", "[
     nvs_flash_deinit();
 }
 
+TEST_CASE("data store wrapped span read release_spans", "[data-store]")
+{
+    size_t len = 0;
+    uint32_t count = 15;
+    char char_list[count];
+    esp_diag_data_store_span_t spans[ESP_DIAG_DATA_STORE_MAX_SPANS];
+
+    /* diag data store init */
+    init_nvs_flash();
+    assert(rtc_store_init() == ESP_OK);
+
+    // move read offset near the end of buffer so that next records wrap
+    memset(data, 0, CONFIG_RTC_STORE_CRITICAL_DATA_SIZE);
+    rtc_store_critical_data_write(data, CONFIG_RTC_STORE_CRITICAL_DATA_SIZE - 64);
+    len = rtc_store_critical_data_read(data, READ_DATA_SIZE);
+    TEST_ASSERT(rtc_store_critical_data_release(len) == ESP_OK);
+
+    write_random_critical_data(count, char_list);
+
+    /* Get spans and validate the linearized data */
+    len = rtc_store_critical_data_read_spans(spans, READ_DATA_SIZE);
+    TEST_ASSERT(((len - count) == (count * sizeof(test_data_t) + s_sha_off)));
+    TEST_ASSERT(spans[1].len != 0);
+    TEST_ASSERT(spans[0].len + spans[1].len == len);
+    memcpy(data, spans[0].ptr, spans[0].len);
+    memcpy(data + spans[0].len, spans[1].ptr, spans[1].len);
+    validate_critical_data(data + s_sha_off, len - s_sha_off, count, char_list);
+
+    /* Only one span read can be outstanding */
+    TEST_ASSERT(rtc_store_critical_data_read_spans(spans, READ_DATA_SIZE) == -1);
+
+    /* A failed release keeps the spans held */
+    TEST_ASSERT(rtc_store_critical_data_release_spans(CONFIG_RTC_STORE_CRITICAL_DATA_SIZE + 1) == ESP_FAIL);
+    TEST_ASSERT(rtc_store_critical_data_read_spans(spans, READ_DATA_SIZE) == -1);
+
+    /* Release all the data */
+    TEST_ASSERT(rtc_store_critical_data_release_spans(len) == ESP_OK);
+    TEST_ASSERT(rtc_store_critical_data_release_spans(0) == ESP_ERR_INVALID_STATE);
+
+    /* Nothing left, spans are empty */
+    TEST_ASSERT(rtc_store_critical_data_read_spans(spans, READ_DATA_SIZE) == 0);
+    TEST_ASSERT(spans[0].len == 0 && spans[1].len == 0);
+    TEST_ASSERT(rtc_store_critical_data_release_spans(0) == ESP_OK);
+
+    /* Discard ends the span read, later reads are not blocked by it */
+    write_random_critical_data(count, char_list);
+    len = rtc_store_critical_data_read_spans(spans, READ_DATA_SIZE);
+    TEST_ASSERT(len > 0);
+    TEST_ASSERT(rtc_store_discard_data() == ESP_OK);
+    TEST_ASSERT(rtc_store_critical_data_release_spans(len) == ESP_ERR_INVALID_STATE);
+    TEST_ASSERT(rtc_store_critical_data_read_spans(spans, READ_DATA_SIZE) == 0);
+    TEST_ASSERT(rtc_store_critical_data_release_spans(0) == ESP_OK);
+
+    /* data store deinit */
+    rtc_store_deinit();
+    nvs_flash_deinit();
+}
+
+TEST_CASE("data store wrapped writev read release_all", "[data-store]")
+{
+    size_t len = 0;
+    uint32_t count = 6;
+    char char_list[count];
+    test_data_t records[count];
+    esp_diag_data_store_iov_t iov[count];
+
+    /* diag data store init */
+    init_nvs_flash();
+    assert(rtc_store_init() == ESP_OK);
+
+    ESP_LOGI(TAG, "Write invalid arguments");
+    TEST_ASSERT(rtc_store_critical_data_writev(NULL, 1) == ESP_ERR_INVALID_ARG);
+    TEST_ASSERT(rtc_store_critical_data_writev(iov, 0) == ESP_ERR_INVALID_ARG);
+
+    // move read offset near the end of buffer so that the batch wraps
+    memset(data, 0, CONFIG_RTC_STORE_CRITICAL_DATA_SIZE);
+    rtc_store_critical_data_write(data, CONFIG_RTC_STORE_CRITICAL_DATA_SIZE - 64);
+    len = rtc_store_critical_data_read(data, READ_DATA_SIZE);
+    TEST_ASSERT(rtc_store_critical_data_release(len) == ESP_OK);
+
+    for (uint32_t i = 0; i < count; i++) {
+        records[i].alphabet = char_list[i] = 'a' + (esp_random() % 26);
+        records[i].len = sizeof(records[i].buf);
+        memset(records[i].buf, records[i].alphabet, records[i].len);
+        iov[i].dg = NULL;
+        iov[i].data = &records[i];
+        iov[i].len = sizeof(records[i]);
+    }
+    TEST_ASSERT(rtc_store_critical_data_writev(iov, count) == ESP_OK);
+
+    /* Records are stored exactly like the single writes */
+    len = rtc_store_critical_data_read(data, READ_DATA_SIZE);
+    TEST_ASSERT(((len - count) == (count * sizeof(test_data_t) + s_sha_off)));
+    validate_critical_data(data + s_sha_off, len - s_sha_off, count, char_list);
+    TEST_ASSERT(rtc_store_critical_data_release(len) == ESP_OK);
+
+    /* data store deinit */
+    rtc_store_deinit();
+    nvs_flash_deinit();
+}
+
+#if CONFIG_RTC_STORE_FLASH_OVERFLOW
+TEST_CASE("data store spill to flash and drain in order", "[data-store]")
+{
+    test_data_t record;
+    size_t len = 0;
+    uint32_t i, read = 0;
+    /* twice the records that fit in RTC store */
+    uint32_t count = 2 * (CONFIG_RTC_STORE_CRITICAL_DATA_SIZE / (sizeof(record) + 1));
+
+    /* diag data store init */
+    init_nvs_flash();
+    assert(rtc_store_init() == ESP_OK);
+    TEST_ASSERT(rtc_store_discard_data() == ESP_OK);
+
+    for (i = 0; i < count; i++) {
+        memset(&record, 0, sizeof(record));
+        record.alphabet = i;
+        TEST_ASSERT(rtc_store_critical_data_write(&record, sizeof(record)) == ESP_OK);
+    }
+
+    /* read in small chunks, every release drains spilled records back */
+    while ((len = rtc_store_critical_data_read(data, 10 * (sizeof(record) + 1))) > 0) {
+        size_t records = len / (sizeof(record) + 1);
+        for (i = 0; i < records; i++) {
+            memcpy(&record, data + i * (sizeof(record) + 1) + 1, sizeof(record));
+            TEST_ASSERT(record.alphabet == read);
+            read++;
+        }
+        TEST_ASSERT(rtc_store_critical_data_release(records * (sizeof(record) + 1)) == ESP_OK);
+    }
+    TEST_ASSERT(read == count);
+
+    /* data store deinit */
+    rtc_store_deinit();
+    nvs_flash_deinit();
+}
+#endif /* CONFIG_RTC_STORE_FLASH_OVERFLOW */
+
 static char *nvs_read_chars(size_t *len, uint32_t bank)
 {
     nvs_handle_t handle;
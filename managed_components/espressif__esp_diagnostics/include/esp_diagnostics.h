@@ -21,12 +21,28 @@ extern "C" {
  */
 typedef esp_err_t (*esp_diag_log_write_cb_t)(void *data, size_t len, void *priv_data);
 
+/**
+ * @brief Record passed to the batch write callbacks
+ */
+typedef struct {
+    const char *tag;    /*!< Tag of the record, NULL for logs */
+    void *data;         /*!< Record data */
+    size_t len;         /*!< Length of record data */
+} esp_diag_iov_t;
+
+/**
+ * @brief Callback to write several logs to diagnostics storage at once
+ */
+typedef esp_err_t (*esp_diag_log_writev_cb_t)(const esp_diag_iov_t *iov, size_t iovcnt, void *priv_data);
+
 /**
  * @brief Diagnostics log configurations
  */
 typedef struct {
     esp_diag_log_write_cb_t write_cb;   /*!< Callback function to write diagnostics data */
     void *cb_arg;                       /*!< User data to pass in callback function */
+    esp_diag_log_writev_cb_t writev_cb; /*!< Optional callback to write the batched logs at once,
+                                             if NULL then batched logs are written one by one using write_cb */
 } esp_diag_log_config_t;
 
 /**
@@ -123,6 +139,64 @@ typedef struct {
     char task_name[CONFIG_FREERTOS_MAX_TASK_NAME_LEN];  /*!< Task name */
 } esp_diag_log_data_t;
 
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+/**
+ * Compact log record, passed to the write callbacks instead of \ref esp_diag_log_data_t
+ *
+ * Multi-byte fields are little endian, varints are LEB128 encoded.
+ * | Field    | Size          | Description                                                      |
+ * |----------|---------------|------------------------------------------------------------------|
+ * | type     | 1             | \ref esp_diag_log_type_t, ORed with ESP_DIAG_LOG_PACKED_TS_ABS   |
+ * | tag      | 1 [+ 1 + len] | Index in string table or ESP_DIAG_LOG_PACKED_STR_INLINE,          |
+ * |          |               | length and characters                                            |
+ * | task     | 1 [+ 1 + len] | Same as tag, for task name                                       |
+ * | ts       | 1 - 10        | Absolute timestamp if ESP_DIAG_LOG_PACKED_TS_ABS is set,         |
+ * |          |               | otherwise zigzag encoded delta from previous record in storage   |
+ * | pc       | 4             | Program counter                                                  |
+ * | msg_ptr  | ptr size      | Address of message in rodata, 4 bytes on the targets             |
+ * | args_len | 1             | Length of the arguments                                          |
+ * | args     | args_len      | Arguments of log message                                         |
+ */
+#define ESP_DIAG_LOG_PACKED_TS_ABS      0x80    /*!< Timestamp in record is absolute */
+#define ESP_DIAG_LOG_PACKED_STR_INLINE  0xFF    /*!< String is stored inline in the record */
+
+/**
+ * @brief Maximum length of a compact log record
+ */
+#define ESP_DIAG_LOG_PACKED_MAX_LEN (1 + (2 + sizeof(((esp_diag_log_data_t *)0)->tag)) \
+                                     + (2 + CONFIG_FREERTOS_MAX_TASK_NAME_LEN) + 10 + 4 + sizeof(uintptr_t) \
+                                     + 1 + CONFIG_DIAG_LOG_MSG_ARG_MAX_SIZE)
+
+/**
+ * @brief Decode a compact log record
+ *
+ * @param[in] data Compact log record
+ * @param[in] size Number of bytes available at data
+ * @param[in,out] ts Timestamp of the previous record in storage, updated with the timestamp of this record
+ * @param[out] log Decoded log
+ *
+ * @return length of the record, 0 if record is incomplete
+ */
+size_t esp_diag_log_unpack(const uint8_t *data, size_t size, uint64_t *ts, esp_diag_log_data_t *log);
+
+/**
+ * @brief Get the timestamp of the last log record released from storage
+ *
+ * Timestamps in compact records are stored as delta from the previous record, so decoding starts from this value.
+ * Value is retained across software resets along with the string table.
+ *
+ * @return timestamp
+ */
+uint64_t esp_diag_log_ts_base_get(void);
+
+/**
+ * @brief Set the timestamp of the last log record released from storage
+ *
+ * @param[in] ts Timestamp of the last released record, \see esp_diag_log_unpack()
+ */
+void esp_diag_log_ts_base_set(uint64_t ts);
+#endif /* CONFIG_DIAG_LOG_COMPACT_RECORDS */
+
 /**
  * @brief Device information structure
  */
@@ -153,6 +227,10 @@ typedef struct {
     char name[CONFIG_FREERTOS_MAX_TASK_NAME_LEN];   /*!< Task name */
     uint32_t state;                                 /*!< Task state */
     uint32_t high_watermark;                        /*!< Task high watermark */
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    void *handle;                                   /*!< Task handle, identifies the task across snapshots */
+    uint32_t run_time;                              /*!< Run time counter of the task */
+#endif /* CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS */
 #ifndef CONFIG_IDF_TARGET_ARCH_RISCV
     esp_diag_task_bt_t bt_info;                     /*!< Backtrace of the task */
 #endif /* !CONFIG_IDF_TARGET_ARCH_RISCV */
@@ -219,6 +297,28 @@ void esp_diag_log_hook_enable(uint32_t type);
  */
 void esp_diag_log_hook_disable(uint32_t type);
 
+/**
+ * @brief Start batching the diagnostics logs of the calling task
+ *
+ * Logs recorded by the calling task are buffered till \ref esp_diag_log_batch_end is called
+ * or buffer is full, and then written together using the writev_cb from \ref esp_diag_log_config_t.
+ * Only one task can batch the logs at a time, logs from other tasks are written as usual.
+ *
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_STATE if log hook is not initialized or other task is batching the logs
+ * @return ESP_ERR_NOT_SUPPORTED if batching is disabled using CONFIG_DIAG_LOG_BATCH_MAX_COUNT
+ */
+esp_err_t esp_diag_log_batch_begin(void);
+
+/**
+ * @brief Write the batched logs and stop batching
+ *
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_STATE if calling task has not started the batch
+ * @return error returned by the write callback otherwise
+ */
+esp_err_t esp_diag_log_batch_end(void);
+
 /**
  * @brief Add diagnostics event
  *
@@ -290,6 +390,8 @@ void esp_diag_task_snapshot_dump(void);
 /**
  * @brief Get CRC of diagnostics metadata
  *
+ * CRC is updated when metrics and variables are registered or unregistered, so this is cheap to call.
+ *
  * @return crc
  */
 uint32_t esp_diag_meta_crc_get(void);
@@ -25,12 +25,23 @@ extern "C"
  */
 typedef esp_err_t (*esp_diag_metrics_write_cb_t)(const char *tag, void *data, size_t len, void *cb_arg);
 
+/**
+ * @brief Callback to write several metrics data points at once
+ *
+ * @param[in] iov    Array of data points, tag of each record is the tag for metrics
+ * @param[in] iovcnt Number of data points
+ * @param[in] cb_arg User data to pass in write callback
+ */
+typedef esp_err_t (*esp_diag_metrics_writev_cb_t)(const esp_diag_iov_t *iov, size_t iovcnt, void *cb_arg);
+
 /**
  * @brief Diagnostics metrics config structure
  */
 typedef struct {
     esp_diag_metrics_write_cb_t write_cb; /*!< Callback function to write diagnostics data */
     void *cb_arg;                         /*!< User data to pass in callback function */
+    esp_diag_metrics_writev_cb_t writev_cb; /*!< Optional callback to write the batched data points at once,
+                                                 if NULL then batched data points are written one by one using write_cb */
 } esp_diag_metrics_config_t;
 
 /**
@@ -62,6 +73,28 @@ esp_err_t esp_diag_metrics_init(esp_diag_metrics_config_t *config);
  */
 esp_err_t esp_diag_metrics_deinit(void);
 
+/**
+ * @brief Start batching the metrics reported by the calling task
+ *
+ * Data points reported by the calling task are buffered till \ref esp_diag_metrics_batch_end is called
+ * or buffer is full, and then written together using the writev_cb from \ref esp_diag_metrics_config_t.
+ * Only one task can batch the metrics at a time, metrics from other tasks are written as usual.
+ *
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_STATE if metrics are not initialized or other task is batching the metrics
+ * @return ESP_ERR_NOT_SUPPORTED if batching is disabled using CONFIG_DIAG_METRICS_BATCH_MAX_COUNT
+ */
+esp_err_t esp_diag_metrics_batch_begin(void);
+
+/**
+ * @brief Write the batched metrics and stop batching
+ *
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_STATE if calling task has not started the batch
+ * @return error returned by the write callback otherwise
+ */
+esp_err_t esp_diag_metrics_batch_end(void);
+
 /**
  * @brief Register a metrics
  *
@@ -93,6 +93,66 @@ void esp_diag_wifi_metrics_reset_interval(uint32_t period);
 
 #endif /* CONFIG_DIAG_ENABLE_WIFI_METRICS */
 
+#if CONFIG_DIAG_ENABLE_TASK_METRICS
+
+/**
+ * @brief Initialize the task metrics
+ *
+ * Task snapshot is taken periodically and CPU share of every task since the previous snapshot is computed
+ * from the FreeRTOS run time counters. Overall CPU load, and CPU share and minimum free stack of the tasks
+ * listed in CONFIG_DIAG_TASK_METRICS_TASKS are reported as metrics.
+ *
+ * Default periodic interval is 30 seconds and can be changed with esp_diag_task_metrics_reset_interval().
+ *
+ * @return ESP_OK if successful, appropriate error code otherwise.
+ */
+esp_err_t esp_diag_task_metrics_init(void);
+
+/**
+ * @brief Deinitialize the task metrics
+ *
+ * @return ESP_OK if successful, appropriate error code otherwise.
+ */
+esp_err_t esp_diag_task_metrics_deinit(void);
+
+/**
+ * @brief Reset the periodic interval
+ *
+ * By default, task metrics are collected every 30 seconds, this function can be used to change the interval.
+ * If the interval is set to 0, task metrics collection disabled.
+ *
+ * @param[in] period Period interval in seconds
+ */
+void esp_diag_task_metrics_reset_interval(uint32_t period);
+
+/**
+ * @brief Reports the task metrics for the window since the previous report.
+ *
+ * @return ESP_OK if successful, appropriate error code otherwise.
+ */
+esp_err_t esp_diag_task_metrics_dump(void);
+
+/**
+ * @brief Prints CPU share, state and minimum free stack of all the tasks to the console.
+ *
+ * CPU share is for the window since the previous call, the first call covers the time since boot.
+ * This does not need esp_diag_task_metrics_init() and does not affect the reported metrics.
+ *
+ * @return ESP_OK if successful, appropriate error code otherwise.
+ */
+esp_err_t esp_diag_task_metrics_print(void);
+
+/**
+ * @brief Register "task-top" console command which calls esp_diag_task_metrics_print()
+ *
+ * @note Console must be initialized before calling this.
+ *
+ * @return ESP_OK if successful, appropriate error code otherwise.
+ */
+esp_err_t esp_diag_task_metrics_register_cmd(void);
+
+#endif /* CONFIG_DIAG_ENABLE_TASK_METRICS */
+
 #ifdef __cplusplus
 }
 #endif
@@ -41,12 +41,8 @@ typedef struct {
 
 static heap_diag_priv_data_t s_priv_data;
 
-esp_err_t esp_diag_heap_metrics_dump(void)
+static esp_err_t heap_metrics_report(void)
 {
-    if (!s_priv_data.init) {
-        ESP_LOGW(LOG_TAG, "Heap metrics not initialized");
-        return ESP_ERR_INVALID_STATE;
-    }
     uint32_t free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
     uint32_t lfb = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
     uint32_t min_free_ever = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
@@ -100,6 +96,26 @@ esp_err_t esp_diag_heap_metrics_dump(void)
     return ESP_OK;
 }
 
+esp_err_t esp_diag_heap_metrics_dump(void)
+{
+    if (!s_priv_data.init) {
+        ESP_LOGW(LOG_TAG, "Heap metrics not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* All the heap metrics are written to the storage at once. Batch may already be
+     * open if this is called from the alloc failed hook, then data points join that batch.
+     */
+    bool batched = (esp_diag_metrics_batch_begin() == ESP_OK);
+    esp_err_t err = heap_metrics_report();
+    if (batched) {
+        esp_err_t ret = esp_diag_metrics_batch_end();
+        if (err == ESP_OK) {
+            err = ret;
+        }
+    }
+    return err;
+}
+
 static void heap_metrics_dump_cb(void *arg)
 {
     esp_diag_heap_metrics_dump();
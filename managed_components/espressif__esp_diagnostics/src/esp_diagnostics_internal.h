@@ -20,6 +20,23 @@ extern "C" {
 
 #define SEC2TICKS(s) ((s * 1000) / portTICK_PERIOD_MS)
 
+#define DIAG_META_CRC_METRICS   'm'
+#define DIAG_META_CRC_VARIABLES 'v'
+
+/* Metadata CRC is XOR of the CRCs of all the registered metrics and variables, so that it is updated
+ * on register and unregister instead of going through all the entries when it is read.
+ */
+uint32_t esp_diag_meta_entry_crc(uint8_t kind, const char *tag, const char *key,
+                                 const char *label, const char *path, uint32_t type);
+
+#if CONFIG_DIAG_ENABLE_METRICS
+uint32_t esp_diag_metrics_meta_crc_get(void);
+#endif
+
+#if CONFIG_DIAG_ENABLE_VARIABLES
+uint32_t esp_diag_variables_meta_crc_get(void);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,6 +12,9 @@
 #include "esp_idf_version.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_attr.h>
+#include <esp_system.h>
 
 /* Onwards esp-idf v5.0 esp_cpu_process_stack_pc() is moved to
  * components/xtensa/include/esp_cpu_utils.h
@@ -28,14 +31,57 @@
 
 #define IS_LOG_TYPE_ENABLED(type) (s_priv_data.init && (type & s_priv_data.enabled_log_type))
 
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+#define DIAG_LOG_RECORD_MAX_LEN     ESP_DIAG_LOG_PACKED_MAX_LEN
+#define DIAG_LOG_STR_TABLE_SIZE     CONFIG_DIAG_LOG_STR_TABLE_SIZE
+#define DIAG_LOG_STR_MAX_LEN        sizeof(((esp_diag_log_data_t *)0)->tag)
+#define DIAG_LOG_RTC_DATA_MAGIC     0x474f4c44  /* "DLOG" */
+
+/* Records in storage refer to this data, so it is retained across resets along with the RTC store */
+typedef struct {
+    uint32_t magic;
+    uint32_t str_count;
+    uint64_t ts_base;   /* Timestamp of the last record released from storage */
+    char str[DIAG_LOG_STR_TABLE_SIZE ? DIAG_LOG_STR_TABLE_SIZE : 1][DIAG_LOG_STR_MAX_LEN];
+} log_rtc_data_t;
+
+RTC_NOINIT_ATTR static log_rtc_data_t s_rtc_data;
+#else
+#define DIAG_LOG_RECORD_MAX_LEN     sizeof(esp_diag_log_data_t)
+#endif /* CONFIG_DIAG_LOG_COMPACT_RECORDS */
+
 typedef struct {
     uint32_t enabled_log_type;
     esp_diag_log_config_t config;
     bool init;
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+    SemaphoreHandle_t lock;     /* Protects string table, writer timestamp and buf */
+    bool ts_valid;              /* Previous record in storage was written by this boot */
+    uint64_t last_ts;           /* Timestamp of the previous record in storage */
+    uint8_t buf[DIAG_LOG_RECORD_MAX_LEN];
+#endif
 } log_hook_priv_data_t;
 
 static log_hook_priv_data_t s_priv_data;
 
+#if CONFIG_DIAG_LOG_BATCH_MAX_COUNT
+#define DIAG_LOG_BATCH_MAX_COUNT CONFIG_DIAG_LOG_BATCH_MAX_COUNT
+
+/* Logs of the owner task are buffered here and written together */
+typedef struct {
+    TaskHandle_t owner;
+    bool flushing;
+    size_t count;
+    size_t used;
+    uint64_t last_ts;
+    esp_diag_iov_t iov[DIAG_LOG_BATCH_MAX_COUNT];
+    uint8_t buf[DIAG_LOG_BATCH_MAX_COUNT * DIAG_LOG_RECORD_MAX_LEN];
+} log_batch_t;
+
+static log_batch_t s_batch;
+static portMUX_TYPE s_batch_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif /* CONFIG_DIAG_LOG_BATCH_MAX_COUNT */
+
 #ifdef CONFIG_DIAG_LOG_MSG_ARG_FORMAT_TLV
 typedef enum {
     MOD_NONE,   /* none */
@@ -299,6 +345,296 @@ static esp_err_t write_data(void *data, size_t len)
     return ESP_FAIL;
 }
 
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+static void log_rtc_data_init(void)
+{
+    esp_reset_reason_t reset_reason = esp_reset_reason();
+    bool valid = (s_rtc_data.magic == DIAG_LOG_RTC_DATA_MAGIC) && (s_rtc_data.str_count <= DIAG_LOG_STR_TABLE_SIZE);
+    uint32_t i;
+
+    for (i = 0; valid && i < s_rtc_data.str_count; i++) {
+        if (!memchr(s_rtc_data.str[i], '\0', DIAG_LOG_STR_MAX_LEN)) {
+            valid = false;
+        }
+    }
+    // RTC store discards the data on these resets, so start with an empty table
+    if (reset_reason == ESP_RST_UNKNOWN ||
+            reset_reason == ESP_RST_POWERON ||
+            reset_reason == ESP_RST_BROWNOUT) {
+        valid = false;
+    }
+    if (!valid) {
+        memset(&s_rtc_data, 0, sizeof(s_rtc_data));
+        s_rtc_data.magic = DIAG_LOG_RTC_DATA_MAGIC;
+    }
+}
+
+/* Logs recorded while a record is being written, e.g. from the write callback, are dropped */
+static bool log_lock_take(void)
+{
+    if (xSemaphoreGetMutexHolder(s_priv_data.lock) == xTaskGetCurrentTaskHandle()) {
+        return false;
+    }
+    xSemaphoreTake(s_priv_data.lock, portMAX_DELAY);
+    return true;
+}
+
+/* Entries are only appended, so indices in the records stay valid. Called with lock held */
+static uint8_t *pack_str(uint8_t *p, const char *str)
+{
+    size_t len = strlen(str);
+    uint32_t i;
+
+    if (len < DIAG_LOG_STR_MAX_LEN) {
+        for (i = 0; i < s_rtc_data.str_count; i++) {
+            if (strcmp(s_rtc_data.str[i], str) == 0) {
+                *p++ = i;
+                return p;
+            }
+        }
+        if (i < DIAG_LOG_STR_TABLE_SIZE) {
+            memcpy(s_rtc_data.str[i], str, len + 1);
+            s_rtc_data.str_count++;
+            *p++ = i;
+            return p;
+        }
+    }
+    *p++ = ESP_DIAG_LOG_PACKED_STR_INLINE;
+    *p++ = len;
+    memcpy(p, str, len);
+    return p + len;
+}
+
+static uint8_t *pack_varint(uint8_t *p, uint64_t val)
+{
+    while (val >= 0x80) {
+        *p++ = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+    return p;
+}
+
+/* Returns length of the record. Called with lock held */
+static size_t log_pack(const esp_diag_log_data_t *log, uint8_t *buf, bool ts_valid, uint64_t prev_ts)
+{
+    uint8_t *p = buf;
+    uintptr_t ro = (uintptr_t)log->msg_ptr;
+
+    *p++ = ts_valid ? log->type : (log->type | ESP_DIAG_LOG_PACKED_TS_ABS);
+    p = pack_str(p, log->tag);
+    p = pack_str(p, log->task_name);
+    if (ts_valid) {
+        int64_t delta = (int64_t)(log->timestamp - prev_ts);
+        p = pack_varint(p, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+    } else {
+        p = pack_varint(p, log->timestamp);
+    }
+    memcpy(p, &log->pc, sizeof(log->pc));
+    p += sizeof(log->pc);
+    memcpy(p, &ro, sizeof(ro));
+    p += sizeof(ro);
+    *p++ = log->msg_args_len;
+    memcpy(p, log->msg_args, log->msg_args_len);
+    p += log->msg_args_len;
+    return p - buf;
+}
+
+static const uint8_t *unpack_str(const uint8_t *p, const uint8_t *end, char *out, size_t out_size)
+{
+    uint8_t idx, len;
+
+    if (p >= end) {
+        return NULL;
+    }
+    idx = *p++;
+    if (idx != ESP_DIAG_LOG_PACKED_STR_INLINE) {
+        strlcpy(out, (idx < s_rtc_data.str_count) ? s_rtc_data.str[idx] : "", out_size);
+        return p;
+    }
+    if (p >= end) {
+        return NULL;
+    }
+    len = *p++;
+    if ((end - p) < len) {
+        return NULL;
+    }
+    strlcpy(out, (const char *)p, (len < out_size) ? (len + 1) : out_size);
+    return p + len;
+}
+
+static const uint8_t *unpack_varint(const uint8_t *p, const uint8_t *end, uint64_t *val)
+{
+    uint64_t v = 0;
+    uint8_t shift = 0;
+
+    while (p < end && shift < 64) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *val = v;
+            return p;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+size_t esp_diag_log_unpack(const uint8_t *data, size_t size, uint64_t *ts, esp_diag_log_data_t *log)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+    uint64_t val = 0;
+    uintptr_t ro;
+    uint8_t args_len;
+    bool ts_abs;
+
+    if (!data || !ts || !log || !size) {
+        return 0;
+    }
+    memset(log, 0, sizeof(*log));
+    ts_abs = (*p & ESP_DIAG_LOG_PACKED_TS_ABS);
+    log->type = *p++ & ~ESP_DIAG_LOG_PACKED_TS_ABS;
+    p = unpack_str(p, end, log->tag, sizeof(log->tag));
+    if (p) {
+        p = unpack_str(p, end, log->task_name, sizeof(log->task_name));
+    }
+    if (p) {
+        p = unpack_varint(p, end, &val);
+    }
+    if (!p || (end - p) < (sizeof(log->pc) + sizeof(ro) + 1)) {
+        return 0;
+    }
+    log->timestamp = ts_abs ? val : (*ts + (int64_t)((val >> 1) ^ (~(val & 1) + 1)));
+    memcpy(&log->pc, p, sizeof(log->pc));
+    p += sizeof(log->pc);
+    memcpy(&ro, p, sizeof(ro));
+    p += sizeof(ro);
+    log->msg_ptr = (void *)ro;
+    args_len = *p++;
+    if ((end - p) < args_len) {
+        return 0;
+    }
+    log->msg_args_len = (args_len < sizeof(log->msg_args)) ? args_len : sizeof(log->msg_args);
+    memcpy(log->msg_args, p, log->msg_args_len);
+    p += args_len;
+    *ts = log->timestamp;
+    return p - data;
+}
+
+uint64_t esp_diag_log_ts_base_get(void)
+{
+    return s_rtc_data.ts_base;
+}
+
+void esp_diag_log_ts_base_set(uint64_t ts)
+{
+    s_rtc_data.ts_base = ts;
+}
+#endif /* CONFIG_DIAG_LOG_COMPACT_RECORDS */
+
+#if CONFIG_DIAG_LOG_BATCH_MAX_COUNT
+/* Called only from the owner task */
+static esp_err_t log_batch_flush(void)
+{
+    esp_err_t err = ESP_OK;
+    size_t i;
+
+    if (s_batch.count == 0) {
+        return ESP_OK;
+    }
+    /* Logs recorded while writing the batch are written directly */
+    s_batch.flushing = true;
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+    /* Keep the batch contiguous in storage, next record carries delta from the last one in batch */
+    if (!log_lock_take()) {
+        err = ESP_ERR_INVALID_STATE;
+        goto flush_end;
+    }
+#endif
+    if (s_priv_data.config.writev_cb) {
+        err = s_priv_data.config.writev_cb(s_batch.iov, s_batch.count, s_priv_data.config.cb_arg);
+    } else {
+        for (i = 0; i < s_batch.count; i++) {
+            // Storage is full, rest of the records are dropped as well
+            err = write_data(s_batch.iov[i].data, s_batch.iov[i].len);
+            if (err != ESP_OK) {
+                break;
+            }
+        }
+    }
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+    s_priv_data.ts_valid = (err == ESP_OK);
+    s_priv_data.last_ts = s_batch.last_ts;
+    xSemaphoreGive(s_priv_data.lock);
+flush_end:
+#endif
+    s_batch.count = 0;
+    s_batch.used = 0;
+    s_batch.flushing = false;
+    return err;
+}
+
+/* Called only from the owner task */
+static esp_err_t log_batch_add(const esp_diag_log_data_t *log)
+{
+    uint8_t *rec = s_batch.buf + s_batch.used;
+    size_t len;
+
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+    if (!log_lock_take()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* First record of the batch carries absolute timestamp, as batch may not follow the last written record */
+    len = log_pack(log, rec, s_batch.count > 0, s_batch.last_ts);
+    xSemaphoreGive(s_priv_data.lock);
+    s_batch.last_ts = log->timestamp;
+#else
+    len = sizeof(*log);
+    memcpy(rec, log, len);
+#endif
+    s_batch.iov[s_batch.count].tag = NULL;
+    s_batch.iov[s_batch.count].data = rec;
+    s_batch.iov[s_batch.count].len = len;
+    s_batch.used += len;
+    if (++s_batch.count < DIAG_LOG_BATCH_MAX_COUNT) {
+        return ESP_OK;
+    }
+    return log_batch_flush();
+}
+
+static bool log_batch_is_active(void)
+{
+    return s_batch.owner && (s_batch.owner == xTaskGetCurrentTaskHandle()) && !s_batch.flushing;
+}
+#endif /* CONFIG_DIAG_LOG_BATCH_MAX_COUNT */
+
+static esp_err_t log_write(const esp_diag_log_data_t *log)
+{
+#if CONFIG_DIAG_LOG_BATCH_MAX_COUNT
+    if (log_batch_is_active()) {
+        return log_batch_add(log);
+    }
+#endif
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+    esp_err_t err;
+    size_t len;
+
+    if (!log_lock_take()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    len = log_pack(log, s_priv_data.buf, s_priv_data.ts_valid, s_priv_data.last_ts);
+    err = write_data(s_priv_data.buf, len);
+    // If record is dropped then next record must not refer to it
+    s_priv_data.ts_valid = (err == ESP_OK);
+    s_priv_data.last_ts = log->timestamp;
+    xSemaphoreGive(s_priv_data.lock);
+    return err;
+#else
+    return write_data((void *)log, sizeof(*log));
+#endif
+}
+
 static esp_err_t diag_log_add(esp_diag_log_type_t type, uint32_t pc, const char *tag, const char *format, va_list args)
 {
     esp_diag_log_data_t log;
@@ -332,7 +668,7 @@ static esp_err_t diag_log_add(esp_diag_log_type_t type, uint32_t pc, const char
     if (task_name) {
         strlcpy(log.task_name, task_name, sizeof(log.task_name));
     }
-    return write_data(&log, sizeof(log));
+    return log_write(&log);
 }
 
 /**
@@ -360,7 +696,7 @@ esp_err_t esp_diag_log_event(const char *tag, const char *format, ...)
 {
     esp_err_t err;
     va_list args;
-    uint32_t pc = esp_cpu_process_stack_pc((uint32_t)__builtin_return_address(0));
+    uint32_t pc = esp_cpu_process_stack_pc((uint32_t)(uintptr_t)__builtin_return_address(0));
     va_start(args, format);
     err = diag_log_add(ESP_DIAG_LOG_TYPE_EVENT, pc, tag, format, args);
     va_end(args);
@@ -377,6 +713,47 @@ void esp_diag_log_hook_disable(uint32_t type)
     s_priv_data.enabled_log_type &= (~type);
 }
 
+esp_err_t esp_diag_log_batch_begin(void)
+{
+#if CONFIG_DIAG_LOG_BATCH_MAX_COUNT
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+
+    if (!s_priv_data.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    portENTER_CRITICAL(&s_batch_lock);
+    if (!s_batch.owner) {
+        s_batch.count = 0;
+        s_batch.used = 0;
+        s_batch.flushing = false;
+        s_batch.owner = xTaskGetCurrentTaskHandle();
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_batch_lock);
+    return err;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t esp_diag_log_batch_end(void)
+{
+#if CONFIG_DIAG_LOG_BATCH_MAX_COUNT
+    esp_err_t err;
+
+    if (!s_batch.owner || s_batch.owner != xTaskGetCurrentTaskHandle()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    err = log_batch_flush();
+    portENTER_CRITICAL(&s_batch_lock);
+    s_batch.owner = NULL;
+    portEXIT_CRITICAL(&s_batch_lock);
+    return err;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
 static void esp_diag_log(esp_log_level_t level, uint32_t pc, const char *tag, const char *format, va_list list)
 {
     if (level == ESP_LOG_ERROR) {
@@ -394,6 +771,14 @@ esp_err_t esp_diag_log_hook_init(esp_diag_log_config_t *config)
     if (s_priv_data.init) {
         return ESP_FAIL;
     }
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+    s_priv_data.lock = xSemaphoreCreateMutex();
+    if (!s_priv_data.lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    log_rtc_data_init();
+    s_priv_data.ts_valid = false;
+#endif
     memcpy(&s_priv_data.config, config, sizeof(esp_diag_log_config_t));
     s_priv_data.init = true;
     return ESP_OK;
@@ -409,7 +794,7 @@ void __wrap_log_printf(const char *format, ...)
     va_list list;
     va_start(list, format);
     uint32_t pc = 0;
-    pc = esp_cpu_process_stack_pc((uint32_t)__builtin_return_address(0));
+    pc = esp_cpu_process_stack_pc((uint32_t)(uintptr_t)__builtin_return_address(0));
     if (strlen(format) > 7 && format[6] == 'E') {
         esp_diag_log(ESP_LOG_ERROR, pc, "arduino-esp32", format, list);
     } else if (strlen(format) > 7 && format[6] == 'W') {
@@ -429,7 +814,7 @@ void esp_diag_log_writev(esp_log_level_t level,
     /* Only collect logs with "wifi" tag */
     if (strcmp(tag, "wifi") == 0) {
         uint32_t pc = 0;
-        pc = esp_cpu_process_stack_pc((uint32_t)__builtin_return_address(0));
+        pc = esp_cpu_process_stack_pc((uint32_t)(uintptr_t)__builtin_return_address(0));
         esp_diag_log(level, pc, tag, format, args);
     }
 #endif /* !CONFIG_DIAG_LOG_DROP_WIFI_LOGS */
@@ -444,7 +829,7 @@ void esp_diag_log_write(esp_log_level_t level,
     /* Logs with "wifi" tag, will be collected in esp_log_writev() */
     if (strcmp(tag, "wifi") != 0) {
         uint32_t pc = 0;
-        pc = esp_cpu_process_stack_pc((uint32_t)__builtin_return_address(0));
+        pc = esp_cpu_process_stack_pc((uint32_t)(uintptr_t)__builtin_return_address(0));
         esp_diag_log(level, pc, tag, format, list);
     }
 #endif
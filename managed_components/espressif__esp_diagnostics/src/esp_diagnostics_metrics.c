@@ -10,6 +10,9 @@
 #include <esp_log.h>
 #include <esp_diagnostics.h>
 #include <esp_diagnostics_metrics.h>
+#include "esp_diagnostics_internal.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 #define TAG "DIAG_METRICS"
 #define DIAG_METRICS_MAX_COUNT   CONFIG_DIAG_METRICS_MAX_COUNT
@@ -21,6 +24,7 @@
 
 typedef struct {
     size_t metrics_count;
+    uint32_t meta_crc;  /* XOR of CRCs of registered entries */
     esp_diag_metrics_meta_t metrics[DIAG_METRICS_MAX_COUNT];
     esp_diag_metrics_config_t config;
     bool init;
@@ -28,6 +32,48 @@ typedef struct {
 
 static metrics_priv_data_t s_priv_data;
 
+#if CONFIG_DIAG_METRICS_BATCH_MAX_COUNT
+#define DIAG_METRICS_BATCH_MAX_COUNT CONFIG_DIAG_METRICS_BATCH_MAX_COUNT
+
+/* Data points reported by the owner task are buffered here and written together */
+typedef struct {
+    TaskHandle_t owner;
+    bool flushing;
+    size_t count;
+    esp_diag_iov_t iov[DIAG_METRICS_BATCH_MAX_COUNT];
+    esp_diag_str_data_pt_t data[DIAG_METRICS_BATCH_MAX_COUNT];
+} metrics_batch_t;
+
+static metrics_batch_t s_batch;
+static portMUX_TYPE s_batch_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Called only from the owner task */
+static esp_err_t metrics_batch_flush(void)
+{
+    esp_err_t err = ESP_OK;
+    size_t i;
+
+    if (s_batch.count == 0) {
+        return ESP_OK;
+    }
+    s_batch.flushing = true;
+    if (s_priv_data.config.writev_cb) {
+        err = s_priv_data.config.writev_cb(s_batch.iov, s_batch.count, s_priv_data.config.cb_arg);
+    } else if (s_priv_data.config.write_cb) {
+        for (i = 0; i < s_batch.count; i++) {
+            esp_err_t ret = s_priv_data.config.write_cb(s_batch.iov[i].tag, s_batch.iov[i].data,
+                                                        s_batch.iov[i].len, s_priv_data.config.cb_arg);
+            if (ret != ESP_OK) {
+                err = ret;
+            }
+        }
+    }
+    s_batch.count = 0;
+    s_batch.flushing = false;
+    return err;
+}
+#endif /* CONFIG_DIAG_METRICS_BATCH_MAX_COUNT */
+
 static esp_diag_metrics_meta_t *esp_diag_metrics_meta_get(const char *tag, const char *key)
 {
     uint32_t i;
@@ -93,6 +139,7 @@ esp_err_t esp_diag_metrics_register(const char *tag, const char *key,
     s_priv_data.metrics[s_priv_data.metrics_count].path = path;
     s_priv_data.metrics[s_priv_data.metrics_count].type = type;
     s_priv_data.metrics_count++;
+    s_priv_data.meta_crc ^= esp_diag_meta_entry_crc(DIAG_META_CRC_METRICS, tag, key, label, path, type);
     return ESP_OK;
 }
 
@@ -156,6 +203,9 @@ esp_err_t esp_diag_metrics_unregister(const char *tag, const char *key)
         }
     }
     if (i < s_priv_data.metrics_count) {
+        const esp_diag_metrics_meta_t *meta = &s_priv_data.metrics[i];
+        s_priv_data.meta_crc ^= esp_diag_meta_entry_crc(DIAG_META_CRC_METRICS, meta->tag, meta->key,
+                                                        meta->label, meta->path, meta->type);
         s_priv_data.metrics[i] = s_priv_data.metrics[s_priv_data.metrics_count - 1];
         memset(&s_priv_data.metrics[s_priv_data.metrics_count - 1], 0, sizeof(esp_diag_metrics_meta_t));
         s_priv_data.metrics_count--;
@@ -171,6 +221,7 @@ esp_err_t esp_diag_metrics_unregister_all(void)
     }
     memset(&s_priv_data.metrics, 0, sizeof(s_priv_data.metrics));
     s_priv_data.metrics_count = 0;
+    s_priv_data.meta_crc = 0;
     return ESP_OK;
 }
 
@@ -184,6 +235,11 @@ const esp_diag_metrics_meta_t *esp_diag_metrics_meta_get_all(uint32_t *len)
     return &s_priv_data.metrics[0];
 }
 
+uint32_t esp_diag_metrics_meta_crc_get(void)
+{
+    return s_priv_data.meta_crc;
+}
+
 void esp_diag_metrics_meta_print_all(void)
 {
     uint32_t len;
@@ -219,6 +275,46 @@ esp_err_t esp_diag_metrics_deinit(void)
     return ESP_OK;
 }
 
+esp_err_t esp_diag_metrics_batch_begin(void)
+{
+#if CONFIG_DIAG_METRICS_BATCH_MAX_COUNT
+    esp_err_t err = ESP_ERR_INVALID_STATE;
+
+    if (!s_priv_data.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    portENTER_CRITICAL(&s_batch_lock);
+    if (!s_batch.owner) {
+        s_batch.count = 0;
+        s_batch.flushing = false;
+        s_batch.owner = xTaskGetCurrentTaskHandle();
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_batch_lock);
+    return err;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t esp_diag_metrics_batch_end(void)
+{
+#if CONFIG_DIAG_METRICS_BATCH_MAX_COUNT
+    esp_err_t err;
+
+    if (!s_batch.owner || s_batch.owner != xTaskGetCurrentTaskHandle()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    err = metrics_batch_flush();
+    portENTER_CRITICAL(&s_batch_lock);
+    s_batch.owner = NULL;
+    portEXIT_CRITICAL(&s_batch_lock);
+    return err;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
 #ifdef CONFIG_ESP_INSIGHTS_META_VERSION_10
 esp_err_t esp_diag_metrics_add(esp_diag_data_type_t data_type,
 #else
@@ -260,19 +356,38 @@ esp_err_t esp_diag_metrics_report(esp_diag_data_type_t data_type, const char *ta
         write_sz = MAX_STR_METRICS_WRITE_SZ;
     }
 
-    esp_diag_str_data_pt_t data;
-    memset(&data, 0, sizeof(data));
-    data.type = ESP_DIAG_DATA_PT_METRICS;
-    data.data_type = data_type;
+    esp_diag_str_data_pt_t _data;
+    esp_diag_str_data_pt_t *data = &_data;
+#if CONFIG_DIAG_METRICS_BATCH_MAX_COUNT
+    bool batched = s_batch.owner && (s_batch.owner == xTaskGetCurrentTaskHandle()) && !s_batch.flushing;
+    if (batched) {
+        /* Build the data point in place in the batch buffer */
+        data = &s_batch.data[s_batch.count];
+    }
+#endif
+    memset(data, 0, sizeof(*data));
+    data->type = ESP_DIAG_DATA_PT_METRICS;
+    data->data_type = data_type;
 #ifndef CONFIG_ESP_INSIGHTS_META_VERSION_10
-    strlcpy(data.tag, tag, sizeof(data.tag));
+    strlcpy(data->tag, tag, sizeof(data->tag));
+#endif
+    strlcpy(data->key, key, sizeof(data->key));
+    data->ts = ts;
+    memcpy(&data->value, val, val_sz);
+
+#if CONFIG_DIAG_METRICS_BATCH_MAX_COUNT
+    if (batched) {
+        s_batch.iov[s_batch.count].tag = metrics->tag;
+        s_batch.iov[s_batch.count].data = data;
+        s_batch.iov[s_batch.count].len = write_sz;
+        if (++s_batch.count < DIAG_METRICS_BATCH_MAX_COUNT) {
+            return ESP_OK;
+        }
+        return metrics_batch_flush();
+    }
 #endif
-    strlcpy(data.key, key, sizeof(data.key));
-    data.ts = ts;
-    memcpy(&data.value, val, val_sz);
-
     if (s_priv_data.config.write_cb) {
-        return s_priv_data.config.write_cb(metrics->tag, &data, write_sz, s_priv_data.config.cb_arg);
+        return s_priv_data.config.write_cb(metrics->tag, data, write_sz, s_priv_data.config.cb_arg);
     }
     return ESP_OK;
 }
@@ -0,0 +1,391 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <esp_idf_version.h>
+#include <esp_log.h>
+#include <esp_console.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
+
+#include <esp_rmaker_work_queue.h>
+#include <esp_diagnostics.h>
+#include <esp_diagnostics_metrics.h>
+#include <esp_diagnostics_system_metrics.h>
+#include "esp_diagnostics_internal.h"
+
+#define LOG_TAG            "task_metrics"
+#define METRICS_TAG        "task"
+#define METRICS_CPU_UNIT   "%"
+#define METRICS_STACK_UNIT "bytes"
+
+#define KEY_CPU_LOAD       "cpu_load"
+#define KEY_CPU_PREFIX     "cpu_"
+#define KEY_STACK_PREFIX   "stk_"
+
+#define PATH_TASK_CPU      "task.cpu"
+#define PATH_TASK_STACK    "task.stack"
+
+#define IDLE_TASK_PREFIX   "IDLE"
+
+#define DEFAULT_POLLING_INTERVAL 30 /* 30 seconds */
+/* Tasks created between counting the tasks and taking the snapshot */
+#define TASK_COUNT_MARGIN        4
+#define MAX_TRACKED_TASKS        8
+
+#define KEY_LEN            sizeof(((esp_diag_data_pt_t *)0)->key)
+
+/* Per task usage over one sampling window */
+typedef struct {
+    char name[CONFIG_FREERTOS_MAX_TASK_NAME_LEN];
+    uint32_t state;
+    uint32_t high_watermark;
+    uint32_t run_time;
+} task_usage_t;
+
+/* Run time counters of the previous snapshot, deltas are computed against these */
+typedef struct {
+    void *handle;
+    uint32_t run_time;
+} task_run_time_t;
+
+typedef struct {
+    task_run_time_t *prev;
+    size_t prev_count;
+} task_sampler_t;
+
+/* Task reported as metrics, key strings are referenced by the metrics meta */
+typedef struct {
+    char name[CONFIG_FREERTOS_MAX_TASK_NAME_LEN];
+    char cpu_key[KEY_LEN];
+    char stack_key[KEY_LEN];
+} tracked_task_t;
+
+typedef struct {
+    bool init;
+    TimerHandle_t handle;
+    task_sampler_t sampler;
+    size_t tracked_count;
+    tracked_task_t tracked[MAX_TRACKED_TASKS];
+} task_diag_priv_data_t;
+
+static task_diag_priv_data_t s_priv_data;
+/* Console has its own window, so that printing does not shorten the reporting window */
+static task_sampler_t s_console_sampler;
+
+static const char *task_state_str(uint32_t state)
+{
+    switch (state) {
+        case eRunning:   return "run";
+        case eReady:     return "ready";
+        case eBlocked:   return "block";
+        case eSuspended: return "susp";
+        case eDeleted:   return "del";
+        default:         return "?";
+    }
+}
+
+/*
+ * Takes a task snapshot and fills the run time of every task since the previous call on the same sampler.
+ * On the first call run time is since the task was created. Counter is 32 bit, so the window must be
+ * shorter than the counter wrap around time, about 71 minutes with the default esp_timer clock.
+ */
+static esp_err_t task_usage_sample(task_sampler_t *sampler, task_usage_t **usage, size_t *count, uint32_t *total)
+{
+    size_t size = uxTaskGetNumberOfTasks() + TASK_COUNT_MARGIN;
+    esp_diag_task_info_t *tasks = calloc(size, sizeof(esp_diag_task_info_t));
+    task_usage_t *cur_usage = calloc(size, sizeof(task_usage_t));
+    task_run_time_t *cur = calloc(size, sizeof(task_run_time_t));
+    if (!tasks || !cur_usage || !cur) {
+        free(tasks);
+        free(cur_usage);
+        free(cur);
+        return ESP_ERR_NO_MEM;
+    }
+    uint32_t n = esp_diag_task_snapshot_get(tasks, size);
+    uint32_t sum = 0;
+    size_t i, j;
+
+    for (i = 0; i < n; i++) {
+        uint32_t run_time = tasks[i].run_time;
+        for (j = 0; j < sampler->prev_count; j++) {
+            if (sampler->prev[j].handle == tasks[i].handle) {
+                run_time -= sampler->prev[j].run_time;
+                break;
+            }
+        }
+        strlcpy(cur_usage[i].name, tasks[i].name, sizeof(cur_usage[i].name));
+        cur_usage[i].state = tasks[i].state;
+        cur_usage[i].high_watermark = tasks[i].high_watermark;
+        cur_usage[i].run_time = run_time;
+        cur[i].handle = tasks[i].handle;
+        cur[i].run_time = tasks[i].run_time;
+        sum += run_time;
+    }
+    free(tasks);
+    free(sampler->prev);
+    sampler->prev = cur;
+    sampler->prev_count = n;
+
+    *usage = cur_usage;
+    *count = n;
+    *total = sum;
+    return ESP_OK;
+}
+
+/* CPU share in percent of the total run time of all the tasks in the window */
+static float task_cpu_share(uint32_t run_time, uint32_t total)
+{
+    return total ? ((float)run_time * 100.0f / total) : 0.0f;
+}
+
+static esp_err_t task_metrics_report(const task_usage_t *usage, size_t count, uint32_t total)
+{
+    uint32_t idle = 0;
+    size_t i, j;
+
+    for (i = 0; i < count; i++) {
+        if (strncmp(usage[i].name, IDLE_TASK_PREFIX, strlen(IDLE_TASK_PREFIX)) == 0) {
+            idle += usage[i].run_time;
+        }
+    }
+    float load = 100.0f - task_cpu_share(idle, total);
+#ifndef CONFIG_ESP_INSIGHTS_META_VERSION_10
+    RET_ON_ERR_WITH_LOG(esp_diag_metrics_report_float(METRICS_TAG, KEY_CPU_LOAD, load), ESP_LOG_WARN, LOG_TAG,
+                        "Failed to add task metric key:" KEY_CPU_LOAD);
+#else
+    RET_ON_ERR_WITH_LOG(esp_diag_metrics_add_float(KEY_CPU_LOAD, load), ESP_LOG_WARN, LOG_TAG,
+                        "Failed to add task metric key:" KEY_CPU_LOAD);
+#endif
+
+    for (j = 0; j < s_priv_data.tracked_count; j++) {
+        const tracked_task_t *tracked = &s_priv_data.tracked[j];
+        for (i = 0; i < count; i++) {
+            if (strcmp(usage[i].name, tracked->name) == 0) {
+                break;
+            }
+        }
+        if (i == count) {
+            continue;
+        }
+        float cpu = task_cpu_share(usage[i].run_time, total);
+#ifndef CONFIG_ESP_INSIGHTS_META_VERSION_10
+        esp_diag_metrics_report_float(METRICS_TAG, tracked->cpu_key, cpu);
+        esp_diag_metrics_report_uint(METRICS_TAG, tracked->stack_key, usage[i].high_watermark);
+#else
+        esp_diag_metrics_add_float(tracked->cpu_key, cpu);
+        esp_diag_metrics_add_uint(tracked->stack_key, usage[i].high_watermark);
+#endif
+        ESP_LOGD(LOG_TAG, "%s cpu:%.1f%% stack:%" PRIu32, tracked->name, cpu, usage[i].high_watermark);
+    }
+    ESP_LOGI(LOG_TAG, KEY_CPU_LOAD ":%.1f%%", load);
+    return ESP_OK;
+}
+
+esp_err_t esp_diag_task_metrics_dump(void)
+{
+    task_usage_t *usage;
+    size_t count;
+    uint32_t total;
+
+    if (!s_priv_data.init) {
+        ESP_LOGW(LOG_TAG, "Task metrics not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = task_usage_sample(&s_priv_data.sampler, &usage, &count, &total);
+    if (err != ESP_OK) {
+        return err;
+    }
+    bool batched = (esp_diag_metrics_batch_begin() == ESP_OK);
+    err = task_metrics_report(usage, count, total);
+    if (batched) {
+        esp_err_t ret = esp_diag_metrics_batch_end();
+        if (err == ESP_OK) {
+            err = ret;
+        }
+    }
+    free(usage);
+    return err;
+}
+
+static int task_usage_cmp(const void *a, const void *b)
+{
+    const task_usage_t *ua = a;
+    const task_usage_t *ub = b;
+    return (ua->run_time < ub->run_time) - (ua->run_time > ub->run_time);
+}
+
+esp_err_t esp_diag_task_metrics_print(void)
+{
+    task_usage_t *usage;
+    size_t count, i;
+    uint32_t total;
+
+    esp_err_t err = task_usage_sample(&s_console_sampler, &usage, &count, &total);
+    if (err != ESP_OK) {
+        return err;
+    }
+    qsort(usage, count, sizeof(task_usage_t), task_usage_cmp);
+    printf("%-16s %-6s %7s %12s %10s\n", "Task", "State", "CPU%", "Run time(us)", "Stack free");
+    for (i = 0; i < count; i++) {
+        printf("%-16s %-6s %6.1f%% %12" PRIu32 " %10" PRIu32 "\n", usage[i].name,
+               task_state_str(usage[i].state), task_cpu_share(usage[i].run_time, total),
+               usage[i].run_time, usage[i].high_watermark);
+    }
+    free(usage);
+    return ESP_OK;
+}
+
+static int task_top_cli_handler(int argc, char *argv[])
+{
+    if (esp_diag_task_metrics_print() != ESP_OK) {
+        printf("%s: Failed to get task snapshot\n", LOG_TAG);
+        return -1;
+    }
+    return 0;
+}
+
+esp_err_t esp_diag_task_metrics_register_cmd(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "task-top",
+        .help = "Get CPU share and minimum free stack of every task since the previous call.",
+        .func = &task_top_cli_handler,
+    };
+    return esp_console_cmd_register(&cmd);
+}
+
+static void task_metrics_dump_cb(void *arg)
+{
+    esp_diag_task_metrics_dump();
+}
+
+static void task_timer_cb(TimerHandle_t handle)
+{
+    esp_rmaker_work_queue_add_task(task_metrics_dump_cb, NULL);
+}
+
+/* Parses comma separated task names from CONFIG_DIAG_TASK_METRICS_TASKS */
+static void tracked_tasks_parse(void)
+{
+    const char *p = CONFIG_DIAG_TASK_METRICS_TASKS;
+
+    while (*p && s_priv_data.tracked_count < MAX_TRACKED_TASKS) {
+        size_t len = strcspn(p, ",");
+        if (len > 0 && len < CONFIG_FREERTOS_MAX_TASK_NAME_LEN) {
+            tracked_task_t *tracked = &s_priv_data.tracked[s_priv_data.tracked_count++];
+            memcpy(tracked->name, p, len);
+            tracked->name[len] = '\0';
+            snprintf(tracked->cpu_key, sizeof(tracked->cpu_key), KEY_CPU_PREFIX "%s", tracked->name);
+            snprintf(tracked->stack_key, sizeof(tracked->stack_key), KEY_STACK_PREFIX "%s", tracked->name);
+        } else if (len > 0) {
+            ESP_LOGW(LOG_TAG, "Task name too long in task list, skipping");
+        }
+        p += len;
+        if (*p == ',') {
+            p++;
+        }
+    }
+}
+
+static void task_metrics_register(void)
+{
+    size_t i;
+
+    esp_diag_metrics_register(METRICS_TAG, KEY_CPU_LOAD, "CPU load", PATH_TASK_CPU, ESP_DIAG_DATA_TYPE_FLOAT);
+#ifndef CONFIG_ESP_INSIGHTS_META_VERSION_10
+    esp_diag_metrics_add_unit(METRICS_TAG, KEY_CPU_LOAD, METRICS_CPU_UNIT);
+#else
+    esp_diag_metrics_add_unit(KEY_CPU_LOAD, METRICS_CPU_UNIT);
+#endif
+    for (i = 0; i < s_priv_data.tracked_count; i++) {
+        tracked_task_t *tracked = &s_priv_data.tracked[i];
+        esp_diag_metrics_register(METRICS_TAG, tracked->cpu_key, tracked->name, PATH_TASK_CPU, ESP_DIAG_DATA_TYPE_FLOAT);
+        esp_diag_metrics_register(METRICS_TAG, tracked->stack_key, tracked->name, PATH_TASK_STACK, ESP_DIAG_DATA_TYPE_UINT);
+#ifndef CONFIG_ESP_INSIGHTS_META_VERSION_10
+        esp_diag_metrics_add_unit(METRICS_TAG, tracked->cpu_key, METRICS_CPU_UNIT);
+        esp_diag_metrics_add_unit(METRICS_TAG, tracked->stack_key, METRICS_STACK_UNIT);
+#else
+        esp_diag_metrics_add_unit(tracked->cpu_key, METRICS_CPU_UNIT);
+        esp_diag_metrics_add_unit(tracked->stack_key, METRICS_STACK_UNIT);
+#endif
+    }
+}
+
+static void task_metrics_unregister(void)
+{
+    size_t i;
+
+#ifdef CONFIG_ESP_INSIGHTS_META_VERSION_10
+    esp_diag_metrics_unregister(KEY_CPU_LOAD);
+    for (i = 0; i < s_priv_data.tracked_count; i++) {
+        esp_diag_metrics_unregister(s_priv_data.tracked[i].cpu_key);
+        esp_diag_metrics_unregister(s_priv_data.tracked[i].stack_key);
+    }
+#else
+    esp_diag_metrics_unregister(METRICS_TAG, KEY_CPU_LOAD);
+    for (i = 0; i < s_priv_data.tracked_count; i++) {
+        esp_diag_metrics_unregister(METRICS_TAG, s_priv_data.tracked[i].cpu_key);
+        esp_diag_metrics_unregister(METRICS_TAG, s_priv_data.tracked[i].stack_key);
+    }
+#endif
+}
+
+esp_err_t esp_diag_task_metrics_init(void)
+{
+    if (s_priv_data.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    tracked_tasks_parse();
+    task_metrics_register();
+
+    s_priv_data.handle = xTimerCreate("task_metrics", SEC2TICKS(DEFAULT_POLLING_INTERVAL),
+                                      pdTRUE, NULL, task_timer_cb);
+    if (s_priv_data.handle) {
+        xTimerStart(s_priv_data.handle, 0);
+    }
+    s_priv_data.init = true;
+
+    // Take the first snapshot, the first report covers the first interval
+    task_usage_t *usage;
+    size_t count;
+    uint32_t total;
+    if (task_usage_sample(&s_priv_data.sampler, &usage, &count, &total) == ESP_OK) {
+        free(usage);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_diag_task_metrics_deinit(void)
+{
+    if (!s_priv_data.init) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* Try to delete timer with 10 ticks wait time */
+    if (xTimerDelete(s_priv_data.handle, 10) == pdFALSE) {
+        ESP_LOGW(LOG_TAG, "Failed to delete task metric timer");
+    }
+    task_metrics_unregister();
+    free(s_priv_data.sampler.prev);
+    memset(&s_priv_data, 0, sizeof(s_priv_data));
+    return ESP_OK;
+}
+
+void esp_diag_task_metrics_reset_interval(uint32_t period)
+{
+    if (!s_priv_data.init) {
+        return;
+    }
+    if (period == 0) {
+        xTimerStop(s_priv_data.handle, 0);
+        return;
+    }
+    xTimerChangePeriod(s_priv_data.handle, SEC2TICKS(period), 0);
+}
@@ -19,6 +19,7 @@
 #include "esp_debug_helpers.h"
 #include "esp_diagnostics_metrics.h"
 #include "esp_diagnostics_variables.h"
+#include "esp_diagnostics_internal.h"
 
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
 #include "esp_chip_info.h"
@@ -136,25 +137,23 @@ uint32_t esp_diag_task_snapshot_get(esp_diag_task_info_t *tasks, size_t size)
     if (!tasks || !size) {
         return 0;
     }
-    unsigned irq_state = DISABLE_INTERRUPTS();
-#if !CONFIG_FREERTOS_UNICORE
-    int other_cpu = xPortGetCoreID() ? 0 : 1;
-    esp_cpu_stall(other_cpu);
-#endif
-
     uint32_t i = 0;
+    /* Allocate before disabling the interrupts, snapshot is capped to this many tasks */
     uint32_t task_count = uxTaskGetNumberOfTasks();
     TaskSnapshot_t *snapshots = calloc(task_count, sizeof(TaskSnapshot_t));
     if (!snapshots) {
         return 0;
     }
+
+    unsigned irq_state = DISABLE_INTERRUPTS();
+#if !CONFIG_FREERTOS_UNICORE
+    int other_cpu = xPortGetCoreID() ? 0 : 1;
+    esp_cpu_stall(other_cpu);
+#endif
+
     size_t tcb_size; /* unused */
     uint32_t count = uxTaskGetSnapshotAll(snapshots, task_count, &tcb_size);
-    if (count == 0) {
-        free(snapshots);
-        return 0;
-    }
-    for (i = 0; i < count; i++) {
+    for (i = 0; i < count && i < size; i++) {
         TaskHandle_t handle = (TaskHandle_t)snapshots[i].pxTCB;
         char *name = TASK_GET_NAME(handle);
         if (name && *name) {
@@ -162,16 +161,20 @@ uint32_t esp_diag_task_snapshot_get(esp_diag_task_info_t *tasks, size_t size)
         }
         tasks[i].state = eTaskGetState(handle);
         tasks[i].high_watermark = uxTaskGetStackHighWaterMark(handle);
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        tasks[i].handle = handle;
+        tasks[i].run_time = ulTaskGetRunTimeCounter(handle);
+#endif /* CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS */
 #ifndef CONFIG_IDF_TARGET_ARCH_RISCV
         diag_task_get_bt(&tasks[i].bt_info, (XtExcFrame *)snapshots[i].pxTopOfStack);
 #endif /* !CONFIG_IDF_TARGET_ARCH_RISCV */
     }
-    free(snapshots);
 
 #if !CONFIG_FREERTOS_UNICORE
     esp_cpu_unstall(other_cpu);
 #endif
     ENABLE_INTERRUPTS(irq_state);
+    free(snapshots);
     return i;
 }
 
@@ -301,9 +304,14 @@ void esp_diag_task_snapshot_dump(void)
         return;
     }
     uint32_t count = esp_diag_task_snapshot_get(tasks, task_count);
+    /* Snapshot events are written to the storage in batches */
+    bool batched = (esp_diag_log_batch_begin() == ESP_OK);
     for (i = 0; i < count; i++) {
         print_task_info(&tasks[i]);
     }
+    if (batched) {
+        esp_diag_log_batch_end();
+    }
     free(tasks);
 }
 
@@ -312,47 +320,47 @@ uint32_t esp_diag_data_size_get_crc(void)
     size_t diag_data_size = sizeof(esp_diag_data_pt_t) + sizeof(esp_diag_str_data_pt_t) + sizeof(esp_diag_log_data_t);
     uint32_t crc = 0;
     crc = esp_crc32_le(crc, (const unsigned char *)&diag_data_size, sizeof(diag_data_size));
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+    // Logs are not stored as esp_diag_log_data_t, discard the data written in other format
+    size_t log_record_max_len = ESP_DIAG_LOG_PACKED_MAX_LEN;
+    crc = esp_crc32_le(crc, (const unsigned char *)&log_record_max_len, sizeof(log_record_max_len));
+#endif
+    return crc;
+}
+
+uint32_t esp_diag_meta_entry_crc(uint8_t kind, const char *tag, const char *key,
+                                 const char *label, const char *path, uint32_t type)
+{
+    uint32_t crc = ESP_CRC32_LE(0, &kind, sizeof(kind));
+    crc = ESP_CRC32_LE(crc, (const uint8_t *)tag, strlen(tag));
+    crc = ESP_CRC32_LE(crc, (const uint8_t *)key, strlen(key));
+    crc = ESP_CRC32_LE(crc, (const uint8_t *)label, strlen(label));
+    crc = ESP_CRC32_LE(crc, (const uint8_t *)path, strlen(path));
+    crc = ESP_CRC32_LE(crc, (const uint8_t *)&type, sizeof(type));
     return crc;
 }
 
 uint32_t esp_diag_meta_crc_get(void)
 {
-    uint32_t crc = 0;
-    const esp_app_desc_t *app_desc;
+    /* App does not change at runtime */
+    static uint32_t s_app_crc;
+    static bool s_app_crc_valid;
+    if (!s_app_crc_valid) {
+        const esp_app_desc_t *app_desc;
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
-    app_desc = esp_app_get_description();
+        app_desc = esp_app_get_description();
 #else
-    app_desc = esp_ota_get_app_description();
+        app_desc = esp_ota_get_app_description();
 #endif
-    crc = ESP_CRC32_LE(crc, (const uint8_t *) app_desc->app_elf_sha256, sizeof(app_desc->app_elf_sha256));
-#if CONFIG_DIAG_ENABLE_METRICS
-    uint32_t metrics_len = 0;
-    const esp_diag_metrics_meta_t *metrics = esp_diag_metrics_meta_get_all(&metrics_len);
-    if (metrics) {
-        uint32_t i;
-        for (i = 0; i < metrics_len; i++) {
-            crc = ESP_CRC32_LE(crc, (const uint8_t *)metrics[i].tag, strlen(metrics[i].tag));
-            crc = ESP_CRC32_LE(crc, (const uint8_t *)metrics[i].key, strlen(metrics[i].key));
-            crc = ESP_CRC32_LE(crc, (const uint8_t *)metrics[i].label, strlen(metrics[i].label));
-            crc = ESP_CRC32_LE(crc, (const uint8_t *)metrics[i].path, strlen(metrics[i].path));
-            crc = ESP_CRC32_LE(crc, (const uint8_t *)&metrics[i].type, sizeof(metrics[i].type));
-        }
+        s_app_crc = ESP_CRC32_LE(0, (const uint8_t *) app_desc->app_elf_sha256, sizeof(app_desc->app_elf_sha256));
+        s_app_crc_valid = true;
     }
-#endif /* CONFIG_DIAG_ENABLE_METRICS */
-
+    uint32_t crc = s_app_crc;
+#if CONFIG_DIAG_ENABLE_METRICS
+    crc ^= esp_diag_metrics_meta_crc_get();
+#endif
 #if CONFIG_DIAG_ENABLE_VARIABLES
-    uint32_t variables_len = 0;
-    const esp_diag_variable_meta_t *variables = esp_diag_variable_meta_get_all(&variables_len);
-    if (variables) {
-        uint32_t i;
-        for (i = 0; i < variables_len; i++) {
-            crc = ESP_CRC32_LE(crc, (const uint8_t *)variables[i].tag, strlen(variables[i].tag));
-            crc = ESP_CRC32_LE(crc, (const uint8_t *)variables[i].key, strlen(variables[i].key));
-            crc = ESP_CRC32_LE(crc, (const uint8_t *)variables[i].label, strlen(variables[i].label));
-            crc = ESP_CRC32_LE(crc, (const uint8_t *)variables[i].path, strlen(variables[i].path));
-            crc = ESP_CRC32_LE(crc, (const uint8_t *)&variables[i].type, sizeof(variables[i].type));
-        }
-    }
-#endif /* CONFIG_DIAG_ENABLE_VARIABLES */
+    crc ^= esp_diag_variables_meta_crc_get();
+#endif
     return crc;
 }
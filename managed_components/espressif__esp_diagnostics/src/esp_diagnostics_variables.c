@@ -10,6 +10,7 @@
 #include <esp_log.h>
 #include <esp_diagnostics.h>
 #include <esp_diagnostics_variables.h>
+#include "esp_diagnostics_internal.h"
 
 #define TAG "DIAG_VARIABLES"
 #define DIAG_VARIABLES_MAX_COUNT   CONFIG_DIAG_VARIABLES_MAX_COUNT
@@ -21,6 +22,7 @@
 
 typedef struct {
     size_t variables_count;
+    uint32_t meta_crc;  /* XOR of CRCs of registered entries */
     esp_diag_variable_meta_t variables[DIAG_VARIABLES_MAX_COUNT];
     esp_diag_variable_config_t config;
     bool init;
@@ -93,6 +95,7 @@ esp_err_t esp_diag_variable_register(const char *tag, const char *key,
     s_priv_data.variables[s_priv_data.variables_count].path = path;
     s_priv_data.variables[s_priv_data.variables_count].type = type;
     s_priv_data.variables_count++;
+    s_priv_data.meta_crc ^= esp_diag_meta_entry_crc(DIAG_META_CRC_VARIABLES, tag, key, label, path, type);
     return ESP_OK;
 }
 
@@ -150,6 +153,9 @@ esp_err_t esp_diag_variable_unregister(const char *tag, const char *key)
         }
     }
     if (i < s_priv_data.variables_count) {
+        const esp_diag_variable_meta_t *meta = &s_priv_data.variables[i];
+        s_priv_data.meta_crc ^= esp_diag_meta_entry_crc(DIAG_META_CRC_VARIABLES, meta->tag, meta->key,
+                                                        meta->label, meta->path, meta->type);
         s_priv_data.variables[i] = s_priv_data.variables[s_priv_data.variables_count - 1];
         memset(&s_priv_data.variables[s_priv_data.variables_count - 1], 0, sizeof(esp_diag_variable_meta_t));
         s_priv_data.variables_count--;
@@ -165,6 +171,7 @@ esp_err_t esp_diag_variable_unregister_all(void)
     }
     memset(&s_priv_data.variables, 0, sizeof(s_priv_data.variables));
     s_priv_data.variables_count = 0;
+    s_priv_data.meta_crc = 0;
     return ESP_OK;
 }
 
@@ -178,6 +185,11 @@ const esp_diag_variable_meta_t *esp_diag_variable_meta_get_all(uint32_t *len)
     return &s_priv_data.variables[0];
 }
 
+uint32_t esp_diag_variables_meta_crc_get(void)
+{
+    return s_priv_data.meta_crc;
+}
+
 void esp_diag_variable_meta_print_all(void)
 {
     uint32_t len;
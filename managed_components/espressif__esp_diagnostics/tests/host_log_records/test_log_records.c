@@ -0,0 +1,152 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Host test of the compact log records of the log hook.
+ * Logs are reported through the log hook into a buffer of the size of the critical RTC store, stored as
+ * the RTC store does (meta index byte and record). Every stored record is unpacked again and compared
+ * with what was reported, then the number of records which fit in the store is printed for the compact
+ * and for the full esp_diag_log_data_t records.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_diagnostics.h>
+
+#define STORE_SIZE      CONFIG_RTC_STORE_CRITICAL_DATA_SIZE
+#define MAX_RECORDS     (STORE_SIZE / 2)
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                   \
+        }                                                               \
+    } while (0)
+
+/* What was reported, to compare the unpacked records with */
+typedef struct {
+    esp_diag_log_type_t type;
+    const char *tag;
+    const char *format;
+    uint64_t ts_before;
+    uint64_t ts_after;
+} reported_t;
+
+static struct {
+    uint8_t buf[STORE_SIZE];
+    size_t used;
+    size_t cnt;
+    size_t offset[MAX_RECORDS];
+} s_store;
+
+static reported_t s_reported[MAX_RECORDS];
+
+/* Same as the critical data write of the RTC store: meta index byte, then the record */
+static esp_err_t store_write(void *data, size_t len, void *priv)
+{
+    if (s_store.used + len + 1 > sizeof(s_store.buf) || s_store.cnt == MAX_RECORDS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_store.offset[s_store.cnt++] = s_store.used;
+    s_store.buf[s_store.used++] = 0;
+    memcpy(s_store.buf + s_store.used, data, len);
+    s_store.used += len;
+    return ESP_OK;
+}
+
+/* Mix of a device which logs now and then: a few tags, two int args and a short string */
+static const char *s_tags[] = { "wifi_mgr", "app_main", "ota", "sensor" };
+static const char s_fmt_event[] = "Reconnect %d of %d to %s";
+static const char s_fmt_error[] = "Read failed, err %d retry %d in %s";
+static const char s_fmt_warn[] = "Queue %d at %d%% of %s";
+
+static esp_err_t report(size_t i)
+{
+    reported_t *r = &s_reported[i];
+    const char *tag = s_tags[i % (sizeof(s_tags) / sizeof(s_tags[0]))];
+    size_t cnt = s_store.cnt;
+
+    r->tag = tag;
+    r->ts_before = esp_diag_timestamp_get();
+    switch (i % 3) {
+    case 0:
+        r->type = ESP_DIAG_LOG_TYPE_EVENT;
+        r->format = s_fmt_event;
+        esp_diag_log_event(tag, s_fmt_event, (int)i, 5, "home-ap");
+        break;
+    case 1:
+        r->type = ESP_DIAG_LOG_TYPE_ERROR;
+        r->format = s_fmt_error;
+        esp_log_write(ESP_LOG_ERROR, tag, s_fmt_error, -(int)i, 3, "1s");
+        break;
+    default:
+        r->type = ESP_DIAG_LOG_TYPE_WARNING;
+        r->format = s_fmt_warn;
+        esp_log_write(ESP_LOG_WARN, tag, s_fmt_warn, (int)i % 8, 90, "rx");
+        break;
+    }
+    r->ts_after = esp_diag_timestamp_get();
+    return (s_store.cnt > cnt) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static int unpack_checks(void)
+{
+    uint64_t ts = 0;
+    size_t len_min = SIZE_MAX, len_max = 0;
+
+    for (size_t i = 0; i < s_store.cnt; i++) {
+        const uint8_t *rec = s_store.buf + s_store.offset[i] + 1;
+        size_t end = (i + 1 < s_store.cnt) ? s_store.offset[i + 1] : s_store.used;
+        size_t size = end - s_store.offset[i] - 1;
+        esp_diag_log_data_t log;
+
+        CHECK(esp_diag_log_unpack(rec, size, &ts, &log) == size);
+        CHECK(log.type == s_reported[i].type);
+        CHECK(strcmp(log.tag, s_reported[i].tag) == 0);
+        CHECK(strcmp(log.task_name, "thread") == 0);
+        CHECK(log.msg_ptr == (void *)s_reported[i].format);
+        CHECK(log.timestamp >= s_reported[i].ts_before && log.timestamp <= s_reported[i].ts_after);
+        /* TLV of two ints and a short string */
+        CHECK(log.msg_args_len > 0 && log.msg_args_len < sizeof(log.msg_args));
+        /* A truncated record is not decoded */
+        CHECK(esp_diag_log_unpack(rec, size - 1, &(uint64_t){ ts }, &log) == 0);
+        len_min = size < len_min ? size : len_min;
+        len_max = size > len_max ? size : len_max;
+    }
+    printf("compact record %zu to %zu bytes, first record carries absolute timestamp and inline strings\n",
+           len_min, len_max);
+    return 0;
+}
+
+int main(void)
+{
+    esp_diag_log_config_t config = {
+        .write_cb = store_write,
+    };
+    size_t i;
+
+    esp_log_level_set("*", ESP_LOG_NONE);
+    CHECK(esp_diag_log_hook_init(&config) == ESP_OK);
+    esp_diag_log_hook_enable(ESP_DIAG_LOG_TYPE_ERROR | ESP_DIAG_LOG_TYPE_WARNING | ESP_DIAG_LOG_TYPE_EVENT);
+
+    for (i = 0; i < MAX_RECORDS; i++) {
+        if (report(i) != ESP_OK) {
+            break;
+        }
+    }
+    CHECK(s_store.cnt == i && s_store.cnt > 0);
+    if (unpack_checks()) {
+        printf("FAIL\n");
+        return 1;
+    }
+
+    size_t full = STORE_SIZE / (sizeof(esp_diag_log_data_t) + 1);
+    printf("%u byte store: %zu compact records (%zu bytes per record on average), %zu full records of %zu bytes\n",
+           (unsigned)STORE_SIZE, s_store.cnt, s_store.used / s_store.cnt, full, sizeof(esp_diag_log_data_t) + 1);
+    printf("PASS\n");
+    return 0;
+}
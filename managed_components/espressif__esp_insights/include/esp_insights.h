@@ -102,6 +102,38 @@ typedef void(*esp_insights_transport_disconnect_t)(void);
  */
 typedef int(*esp_insights_transport_data_send_t)(void *data, size_t len);
 
+/**
+ * @brief Insights transport streamed data send begin callback prototype
+ *
+ * Starts sending a message of known length, which is then written in pieces using
+ * \ref esp_insights_transport_data_send_write_t. This lets the agent encode the message
+ * directly into the transport without buffering it.
+ *
+ * @param[in] len Total length of the message
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+typedef esp_err_t(*esp_insights_transport_data_send_begin_t)(size_t len);
+
+/**
+ * @brief Insights transport streamed data write callback prototype
+ *
+ * @param[in] data Part of the message to send
+ * @param[in] len  Length of data
+ *
+ * @return ESP_OK on success, appropriate error code otherwise.
+ */
+typedef esp_err_t(*esp_insights_transport_data_send_write_t)(const void *data, size_t len);
+
+/**
+ * @brief Insights transport streamed data send end callback prototype
+ *
+ * @param[in] complete true if the complete message was written, false if sending is aborted
+ *
+ * @return msg_id  Same as \ref esp_insights_transport_data_send_t, -1 if sending is aborted
+ */
+typedef int(*esp_insights_transport_data_send_end_t)(bool complete);
+
 /**
  * @brief Insights transport configurations
  */
@@ -118,6 +150,12 @@ typedef struct {
         esp_insights_transport_disconnect_t disconnect;
         /** Function to send data */
         esp_insights_transport_data_send_t data_send;
+        /** Optional, function to begin streamed data send. All three streamed send functions must be set to use it */
+        esp_insights_transport_data_send_begin_t data_send_begin;
+        /** Optional, function to write the data of streamed send */
+        esp_insights_transport_data_send_write_t data_send_write;
+        /** Optional, function to end streamed data send */
+        esp_insights_transport_data_send_end_t data_send_end;
     } callbacks;
     /** User data */
     void *userdata;
@@ -29,6 +29,7 @@
 
 #include "esp_insights_client_data.h"
 #include "esp_insights_encoder.h"
+#include "esp_insights_compress.h"
 #include "esp_insights_cbor_decoder.h"
 
 #ifdef CONFIG_ESP_INSIGHTS_CMD_RESP_ENABLED
@@ -50,18 +51,10 @@
 #define CLOUD_REPORTING_PERIOD_MAX_SEC    CONFIG_ESP_INSIGHTS_CLOUD_POST_MAX_INTERVAL_SEC
 #define CLOUD_REPORTING_TIMEOUT_TICKS     ((30 * 1000) / portTICK_PERIOD_MS)
 
-#ifdef CONFIG_DIAG_DATA_STORE_RTC
-#if CONFIG_RTC_STORE_DATA_SIZE > (1024 * 4)
-#define INSIGHTS_DATA_MAX_SIZE  (CONFIG_RTC_STORE_DATA_SIZE - 1024)
-#else
-#define INSIGHTS_DATA_MAX_SIZE  CONFIG_RTC_STORE_DATA_SIZE
-#endif
-#else
-/* TODO: Hardcoding it to 6K but needs to think about clearer way to define this */
-#define INSIGHTS_DATA_MAX_SIZE (1024 * 6)
-#endif
-
+#define INSIGHTS_STREAM_CHUNK_SIZE  CONFIG_ESP_INSIGHTS_STREAM_CHUNK_SIZE
 #define INSIGHTS_READ_BUF_SIZE  (1024)  // read this much data from data store in one go
+#define INSIGHTS_DATA_MSG_WINDOW    CONFIG_ESP_INSIGHTS_DATA_MSG_WINDOW
+#define INSIGHTS_MSG_MAX_SIZE       CONFIG_ESP_INSIGHTS_MSG_MAX_SIZE
 
 #define SEND_INSIGHTS_META (CONFIG_DIAG_ENABLE_METRICS || CONFIG_DIAG_ENABLE_VARIABLES)
 
@@ -69,6 +62,15 @@
 #define TAG_DIAG            "diag"
 #define KEY_LOG_WR_FAIL     "log_wr_fail"
 
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_TARGET_FILL_PERCENT >= CONFIG_DIAG_DATA_STORE_REPORTING_WATERMARK_PERCENT
+#error "CONFIG_ESP_INSIGHTS_ADAPTIVE_TARGET_FILL_PERCENT must be less than CONFIG_DIAG_DATA_STORE_REPORTING_WATERMARK_PERCENT"
+#endif
+#define KEY_RPT_INTERVAL    "rpt_intvl"
+#define KEY_FILL_RATE       "fill_rate"
+#define KEY_RPT_EARLY       "rpt_early"
+#endif /* CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL */
+
 #define DIAG_DATA_STORE_CRC_KEY "rtc_buf_sha"
 #define INSIGHTS_NVS_NAMESPACE  "storage"
 
@@ -87,14 +89,47 @@ typedef struct esp_insights_entry {
     void *priv_data;
 } esp_insights_entry_t;
 
+/* Data message waiting for the acknowledgement */
+typedef struct {
+    int msg_id;
+    uint32_t len;           // length of critical data in the message
+    uint64_t log_ts;        // timestamp of the last log in the message
+    bool acked;
+} insights_inflight_msg_t;
+
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL
+/* State of the reporting interval picked from the data store fill rate */
 typedef struct {
-    uint8_t *scratch_buf;
-    uint8_t *read_buf;      // buffer to hold data read from RTC buf
-    int data_msg_id;
-    uint32_t data_msg_len;
+    bool sampled;                   // usage of the data store was sampled at least once
+    TickType_t sample_tick;         // time of the previous sample
+    uint32_t critical_written;      // written counters of the data store at the previous sample
+    uint32_t non_critical_written;
+    uint32_t critical_rate;         // estimated fill rate, bytes per minute
+    uint32_t non_critical_rate;
+    bool low_mem;                   // data store reached the reporting watermark since the previous sample
+    TickType_t send_tick;           // time of the last scheduled or early send
+    uint32_t early_cnt;             // sends batched with other traffic
+    bool report;                    // decision changed, report it with the next data message
+} insights_adaptive_t;
+#endif /* CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL */
+
+typedef struct {
+    uint8_t *chunk_buf;     // buffer to collect encoded data for streamed send
+    bool alloc_ext_ram;     // allocate transient buffers in external RAM
+    insights_inflight_msg_t data_msgs[INSIGHTS_DATA_MSG_WINDOW];    // in flight data messages, oldest first
+    uint8_t data_msg_cnt;
+    uint32_t data_msgs_len;     // length of critical data in flight
+    uint32_t data_msgs_drop_gen;    // incremented when the in flight messages are dropped
+    int early_acks[INSIGHTS_DATA_MSG_WINDOW];   // acked before the send returned and the message was recorded, oldest first
+    uint8_t early_ack_cnt;
+    uint32_t early_ack_drop_cnt;    // early acks pushed out by newer ones
+    bool data_pending;          // last data message did not take all the critical data
     SemaphoreHandle_t data_lock;
     char app_sha256[DIAG_HEX_SHA_SIZE + 1];
     bool data_sent;
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL
+    insights_adaptive_t adaptive;
+#endif
 #if SEND_INSIGHTS_META
 #if INSIGHTS_CMD_RESP
      bool conf_meta_msg_pending;
@@ -103,10 +138,12 @@ typedef struct {
     bool meta_msg_pending;
     uint32_t meta_msg_id;
     uint32_t meta_crc;
+    uint32_t meta_nvs_crc;      /* copy of the CRC stored in NVS */
+    bool meta_nvs_crc_valid;
 #endif /* SEND_INSIGHTS_META */
-    bool data_send_inprogress;
+    bool data_send_inprogress;  /* data messages are being encoded and sent */
     uint32_t log_write_fail_cnt; /* Count of failed log write */
-    TimerHandle_t data_send_timer; /* timer to reset data_send_inprogress flag on timeout */
+    TimerHandle_t data_send_timer; /* timer to drop in flight messages on timeout */
     char *node_id;
     int boot_msg_id;   /* To track whether first message is sent or not, -1:failed, 0:success, >0:inprogress */
 #if INSIGHTS_CMD_RESP
@@ -128,6 +165,11 @@ static void esp_insights_first_call(void *priv_data)
     }
     esp_insights_entry_t *entry = (esp_insights_entry_t *)priv_data;
     esp_rmaker_work_queue_add_task(entry->work_fn, entry->priv_data);
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL
+    xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
+    s_insights_data.adaptive.send_tick = xTaskGetTickCount();
+    xSemaphoreGive(s_insights_data.data_lock);
+#endif
     /* Start timer here so that the function is called periodically */
     ESP_LOGI(TAG, "Scheduling Insights timer for %" PRIu32 " seconds.", entry->cur_seconds);
     xTimerStart(entry->timer, 0);
@@ -149,6 +191,157 @@ static bool is_wifi_connected(void)
     return wifi_connected;
 }
 
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL
+/* Update the estimate of the fill rate with bytes written in elapsed_ms.
+ * Rising rate is taken as is, so that a burst does not overflow the store,
+ * falling rate decays slowly, so that the interval does not swing with every quiet period.
+ */
+static uint32_t insights_adaptive_rate(uint32_t prev_rate, uint32_t written, uint32_t elapsed_ms)
+{
+    uint32_t rate = ((uint64_t) written * 60 * 1000) / elapsed_ms;
+    if (rate >= prev_rate) {
+        return rate;
+    }
+    return prev_rate - (prev_rate - rate) / 4;
+}
+
+/* Seconds till an empty store of given size is filled to the target at rate bytes per minute */
+static uint32_t insights_adaptive_store_period(size_t size, uint32_t rate, uint32_t max_seconds)
+{
+    size_t target = (size * CONFIG_ESP_INSIGHTS_ADAPTIVE_TARGET_FILL_PERCENT) / 100;
+    if (rate == 0) {
+        return max_seconds;
+    }
+    uint64_t seconds = ((uint64_t) target * 60) / rate;
+    return seconds > max_seconds ? max_seconds : seconds;
+}
+
+/* This executes in the context of timer task, along with the scheduled send.
+ *
+ * Next period is the time till the fuller of critical and non_critical store reaches
+ * CONFIG_ESP_INSIGHTS_ADAPTIVE_TARGET_FILL_PERCENT at the estimated fill rate. Low memory event
+ * since the previous timeout means that data came faster than estimated, so the period is halved.
+ */
+static uint32_t insights_adaptive_next_period(esp_insights_entry_t *entry)
+{
+    insights_adaptive_t *adaptive = &s_insights_data.adaptive;
+    esp_diag_data_store_usage_t usage;
+    TickType_t now = xTaskGetTickCount();
+    uint32_t period = entry->min_seconds;
+
+    bool have_usage = esp_diag_data_store_get_usage(&usage) == ESP_OK;
+
+    xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
+    bool low_mem = adaptive->low_mem;
+    adaptive->low_mem = false;
+    adaptive->send_tick = now;
+    if (have_usage) {
+        uint32_t elapsed_ms = (now - adaptive->sample_tick) * portTICK_PERIOD_MS;
+        if (adaptive->sampled && elapsed_ms) {
+            adaptive->critical_rate = insights_adaptive_rate(adaptive->critical_rate,
+                                                             usage.critical_written - adaptive->critical_written,
+                                                             elapsed_ms);
+            adaptive->non_critical_rate = insights_adaptive_rate(adaptive->non_critical_rate,
+                                                                 usage.non_critical_written - adaptive->non_critical_written,
+                                                                 elapsed_ms);
+        }
+        adaptive->sampled = true;
+        adaptive->sample_tick = now;
+        adaptive->critical_written = usage.critical_written;
+        adaptive->non_critical_written = usage.non_critical_written;
+
+        /* Store is drained by the send queued just now, so the period starts from an empty store */
+        uint32_t critical_period = insights_adaptive_store_period(usage.critical_size,
+                                                                  adaptive->critical_rate, entry->max_seconds);
+        uint32_t non_critical_period = insights_adaptive_store_period(usage.non_critical_size,
+                                                                      adaptive->non_critical_rate, entry->max_seconds);
+        period = critical_period < non_critical_period ? critical_period : non_critical_period;
+        if (low_mem) {
+            period >>= 1;
+        }
+        if (period < entry->min_seconds) {
+            period = entry->min_seconds;
+        }
+    }
+    if (period != entry->cur_seconds) {
+        adaptive->report = true;
+    }
+    xSemaphoreGive(s_insights_data.data_lock);
+#if INSIGHTS_DEBUG_ENABLED
+    ESP_LOGI(TAG, "Fill rate %" PRIu32 "/%" PRIu32 " bytes/min, next report in %" PRIu32 " seconds",
+             adaptive->critical_rate, adaptive->non_critical_rate, period);
+#endif
+    return period;
+}
+
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_BATCH_PERCENT
+/* Called with data_lock held, when the transport has sent a message that is not ours.
+ *
+ * Radio is awake for the other traffic anyway, so if enough of the interval has passed
+ * and there is data, send it now and restart the timer.
+ */
+static void insights_adaptive_batch(void)
+{
+    esp_insights_entry_t *entry = s_periodic_insights_entry;
+    insights_adaptive_t *adaptive = &s_insights_data.adaptive;
+    esp_diag_data_store_usage_t usage;
+
+    if (!entry || !entry->timer || is_insights_active() == false) {
+        return;
+    }
+    TickType_t now = xTaskGetTickCount();
+    uint32_t elapsed_ms = (now - adaptive->send_tick) * portTICK_PERIOD_MS;
+    if (elapsed_ms < entry->min_seconds * 1000 ||
+            elapsed_ms < entry->cur_seconds * 10 * CONFIG_ESP_INSIGHTS_ADAPTIVE_BATCH_PERCENT) {
+        return;
+    }
+    if (esp_diag_data_store_get_usage(&usage) != ESP_OK ||
+            (usage.critical_filled == 0 && usage.non_critical_filled == 0)) {
+        return;
+    }
+    if (esp_rmaker_work_queue_add_task(entry->work_fn, entry->priv_data) != ESP_OK) {
+        return;
+    }
+#if INSIGHTS_DEBUG_ENABLED
+    ESP_LOGI(TAG, "Sending data along with other traffic, %" PRIu32 " ms after the previous send", elapsed_ms);
+#endif
+    adaptive->send_tick = now;
+    adaptive->early_cnt++;
+    adaptive->report = true;
+    xTimerReset(entry->timer, 0);
+}
+#endif /* CONFIG_ESP_INSIGHTS_ADAPTIVE_BATCH_PERCENT */
+
+#if CONFIG_DIAG_ENABLE_VARIABLES
+/* Report the decisions of the adaptive interval, if changed since the previous report */
+static void insights_adaptive_report(void)
+{
+    insights_adaptive_t *adaptive = &s_insights_data.adaptive;
+
+    xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
+    bool report = adaptive->report;
+    adaptive->report = false;
+    uint32_t interval = s_periodic_insights_entry ? s_periodic_insights_entry->cur_seconds : 0;
+    uint32_t fill_rate = adaptive->critical_rate + adaptive->non_critical_rate;
+    uint32_t early_cnt = adaptive->early_cnt;
+    xSemaphoreGive(s_insights_data.data_lock);
+
+    if (!report) {
+        return;
+    }
+#ifdef CONFIG_ESP_INSIGHTS_META_VERSION_10
+    esp_diag_variable_add_uint(KEY_RPT_INTERVAL, interval);
+    esp_diag_variable_add_uint(KEY_FILL_RATE, fill_rate);
+    esp_diag_variable_add_uint(KEY_RPT_EARLY, early_cnt);
+#else
+    esp_diag_variable_report_uint(TAG_DIAG, KEY_RPT_INTERVAL, interval);
+    esp_diag_variable_report_uint(TAG_DIAG, KEY_FILL_RATE, fill_rate);
+    esp_diag_variable_report_uint(TAG_DIAG, KEY_RPT_EARLY, early_cnt);
+#endif
+}
+#endif /* CONFIG_DIAG_ENABLE_VARIABLES */
+#endif /* CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL */
+
 /* This executes in the context of timer task.
  *
  * There is a dynamic logic to decide the next instance when the insights
@@ -159,6 +352,9 @@ static bool is_wifi_connected(void)
  * into too frquent publishes.
  * The period will keep changing between CLOUD_REPORTING_PERIOD_MIN_SEC and
  * CLOUD_REPORTING_PERIOD_MAX_SEC
+ *
+ * With CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL the period is picked from the
+ * data store fill rate instead, see insights_adaptive_next_period().
  */
 static void esp_insights_common_cb(TimerHandle_t handle)
 {
@@ -173,6 +369,10 @@ static void esp_insights_common_cb(TimerHandle_t handle)
         if (is_insights_active() == true) {
             esp_rmaker_work_queue_add_task(entry->work_fn, entry->priv_data);
         }
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL
+        (void) l_data_sent;
+        entry->cur_seconds = insights_adaptive_next_period(entry);
+#else
         /* If data was sent during previous timer interval, double the period */
         if (l_data_sent) {
             entry->cur_seconds <<= 1; /* Double the period */
@@ -186,6 +386,7 @@ static void esp_insights_common_cb(TimerHandle_t handle)
                 entry->cur_seconds = entry->min_seconds;
             }
         }
+#endif /* CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL */
         xTimerChangePeriod(handle, (entry->cur_seconds * 1000)/ portTICK_PERIOD_MS, 100);
         xTimerStart(handle, 0);
     }
@@ -253,10 +454,123 @@ static esp_err_t esp_insights_register_periodic_handler(esp_rmaker_work_fn_t wor
     return ret;
 }
 
+/* Logs in compact format are decoded starting from the timestamp of the last released log */
+static void insights_critical_data_release(size_t len, uint64_t log_ts)
+{
+    esp_diag_data_store_critical_release(len);
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+    if (len) {
+        esp_diag_log_ts_base_set(log_ts);
+    }
+#endif
+}
+
+/* Acknowledgements may arrive out of order, critical data of a message is released only
+ * after all the earlier messages are acknowledged, so that it is released in order.
+ * Must be called with data_lock held.
+ *
+ * Returns false if msg_id is not of an in flight data message.
+ */
+static bool insights_data_msg_ack(int msg_id)
+{
+    int i, released = 0;
+    for (i = 0; i < s_insights_data.data_msg_cnt; i++) {
+        if (s_insights_data.data_msgs[i].msg_id == msg_id) {
+            break;
+        }
+    }
+    if (i == s_insights_data.data_msg_cnt) {
+        return false;
+    }
+    s_insights_data.data_msgs[i].acked = true;
+    while (released < s_insights_data.data_msg_cnt && s_insights_data.data_msgs[released].acked) {
+        insights_inflight_msg_t *msg = &s_insights_data.data_msgs[released];
+        insights_critical_data_release(msg->len, msg->log_ts);
+        s_insights_data.data_msgs_len -= msg->len;
+        released++;
+    }
+    s_insights_data.data_msg_cnt -= released;
+    memmove(&s_insights_data.data_msgs[0], &s_insights_data.data_msgs[released],
+            s_insights_data.data_msg_cnt * sizeof(insights_inflight_msg_t));
+    return true;
+}
+
+/* Forget the in flight messages, their data is sent again with the next message.
+ * Must be called with data_lock held.
+ */
+static void insights_data_msgs_drop(void)
+{
+    s_insights_data.data_msg_cnt = 0;
+    s_insights_data.data_msgs_len = 0;
+    s_insights_data.data_msgs_drop_gen++;
+}
+
+/* The transport may report the acknowledgement before the send call returns (e.g. MQTT PUBACK
+ * handled by the event loop first), such ack is kept until the message is recorded.
+ * Must be called with data_lock held.
+ */
+static void insights_data_msg_early_ack_check(int msg_id)
+{
+    for (int i = 0; i < s_insights_data.early_ack_cnt; i++) {
+        if (s_insights_data.early_acks[i] == msg_id) {
+            s_insights_data.early_ack_cnt--;
+            memmove(&s_insights_data.early_acks[i], &s_insights_data.early_acks[i + 1],
+                    (s_insights_data.early_ack_cnt - i) * sizeof(s_insights_data.early_acks[0]));
+            insights_data_msg_ack(msg_id);
+            s_insights_data.data_sent = true;
+            if (s_insights_data.data_msg_cnt == 0) {
+                xTimerStop(s_insights_data.data_send_timer, portMAX_DELAY);
+            }
+            return;
+        }
+    }
+}
+
+/* Keeps the ack of a message which may be a data message not recorded yet, acks of other
+ * messages of the transport land here too. When full, the oldest ack is pushed out, the ack
+ * of the message being sent is the most recent one. Must be called with data_lock held.
+ */
+static void insights_data_msg_early_ack_add(int msg_id)
+{
+    if (s_insights_data.early_ack_cnt == INSIGHTS_DATA_MSG_WINDOW) {
+        s_insights_data.early_ack_cnt--;
+        memmove(&s_insights_data.early_acks[0], &s_insights_data.early_acks[1],
+                s_insights_data.early_ack_cnt * sizeof(s_insights_data.early_acks[0]));
+        s_insights_data.early_ack_drop_cnt++;
+#if INSIGHTS_DEBUG_ENABLED
+        ESP_LOGI(TAG, "Early ack dropped, count: %" PRIu32, s_insights_data.early_ack_drop_cnt);
+#endif
+    }
+    s_insights_data.early_acks[s_insights_data.early_ack_cnt++] = msg_id;
+}
+
+static bool insights_data_msg_find(int msg_id)
+{
+    for (int i = 0; i < s_insights_data.data_msg_cnt; i++) {
+        if (s_insights_data.data_msgs[i].msg_id == msg_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#if SEND_INSIGHTS_META
+/* Saves the CRC of the sent metadata, copy is kept to avoid reading NVS in every cycle */
+static void insights_meta_crc_save(void)
+{
+    if (esp_insights_meta_nvs_crc_set(s_insights_data.meta_crc) == ESP_OK) {
+        s_insights_data.meta_nvs_crc = s_insights_data.meta_crc;
+        s_insights_data.meta_nvs_crc_valid = true;
+    }
+}
+#endif /* SEND_INSIGHTS_META */
+
+static void insights_data_send_work(void *priv_data);
+
 static void data_send_timeout_cb(TimerHandle_t handle)
 {
     xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
-    s_insights_data.data_send_inprogress = false;
+    insights_data_msgs_drop();
     if (s_insights_data.boot_msg_id > 0) {
         s_insights_data.boot_msg_id = -1;
     }
@@ -280,22 +594,26 @@ static void insights_event_handler(void* arg, esp_event_base_t event_base,
         case INSIGHTS_EVENT_TRANSPORT_SEND_SUCCESS:
             if (data && data->msg_id) {
                 xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
-                if (data->msg_id == s_insights_data.data_msg_id) {
+                if (insights_data_msg_ack(data->msg_id)) {
 #if INSIGHTS_DEBUG_ENABLED
                     ESP_LOGI(TAG, "Data message send success, msg_id:%d.", data ? data->msg_id : 0);
 #endif
-                    esp_diag_data_store_critical_release(s_insights_data.data_msg_len);
                     s_insights_data.data_sent = true;
-                    s_insights_data.data_send_inprogress = false;
-                    if (xTimerIsTimerActive(s_insights_data.data_send_timer) == pdTRUE) {
+                    if (s_insights_data.data_msg_cnt == 0 &&
+                            xTimerIsTimerActive(s_insights_data.data_send_timer) == pdTRUE) {
                         xTimerStop(s_insights_data.data_send_timer, portMAX_DELAY);
                     }
+                    /* Window has room now, keep draining the backlog */
+                    if (s_insights_data.data_pending && !s_insights_data.data_send_inprogress) {
+                        s_insights_data.data_pending = false;
+                        esp_rmaker_work_queue_add_task(insights_data_send_work, NULL);
+                    }
 #if SEND_INSIGHTS_META
                 } else if (s_insights_data.meta_msg_pending && data->msg_id == s_insights_data.meta_msg_id) {
 #if INSIGHTS_DEBUG_ENABLED
                     ESP_LOGI(TAG, "Meta message send success, msg_id:%d.", data ? data->msg_id : 0);
 #endif
-                    esp_insights_meta_nvs_crc_set(s_insights_data.meta_crc);
+                    insights_meta_crc_save();
                     s_insights_data.meta_msg_pending = false;
                     s_insights_data.data_sent = true;
 #endif /* SEND_INSIGHTS_META */
@@ -316,17 +634,28 @@ static void insights_event_handler(void* arg, esp_event_base_t event_base,
                     s_insights_data.conf_msg_id = 0;
                 }
 #endif
+                else if (s_insights_data.data_send_inprogress) {
+                    insights_data_msg_early_ack_add(data->msg_id);
+                }
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL && CONFIG_ESP_INSIGHTS_ADAPTIVE_BATCH_PERCENT
+                else if (!s_insights_data.data_send_inprogress) {
+                    /* Message of some other module, e.g. MQTT publish of the application */
+                    insights_adaptive_batch();
+                }
+#endif
 
                 xSemaphoreGive(s_insights_data.data_lock);
             }
             break;
         case INSIGHTS_EVENT_TRANSPORT_SEND_FAILED:
             xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
-            if (xTimerIsTimerActive(s_insights_data.data_send_timer) == pdTRUE) {
-                xTimerStop(s_insights_data.data_send_timer, portMAX_DELAY);
-            }
-            s_insights_data.data_send_inprogress = false;
-            if (s_insights_data.boot_msg_id > 0 && data->msg_id == s_insights_data.boot_msg_id) {
+            if (data && insights_data_msg_find(data->msg_id)) {
+                /* Later messages are sent again along with the data of the failed one */
+                insights_data_msgs_drop();
+                if (xTimerIsTimerActive(s_insights_data.data_send_timer) == pdTRUE) {
+                    xTimerStop(s_insights_data.data_send_timer, portMAX_DELAY);
+                }
+            } else if (s_insights_data.boot_msg_id > 0 && data->msg_id == s_insights_data.boot_msg_id) {
                 s_insights_data.boot_msg_id = -1;
             }
 #if INSIGHTS_CMD_RESP
@@ -350,7 +679,7 @@ static void hex_dump(uint8_t *data, uint32_t len)
         if ((index % 16) == 0) {
             printf("\n");
         }
-        printf("0x%02x ", s_insights_data.scratch_buf[index]);
+        printf("0x%02x ", data[index]);
     }
     printf("\n");
 }
@@ -359,28 +688,201 @@ static void hex_dump(uint8_t *data, uint32_t len)
 static void insights_dbg_dump(uint8_t *data, uint32_t len)
 {
 #if CONFIG_ESP_INSIGHTS_DEBUG_PRINT_JSON
-    esp_insights_cbor_decode_dump((const uint8_t *) (s_insights_data.scratch_buf + 3), len - 3);
+    esp_insights_cbor_decode_dump((const uint8_t *) (data + 3), len - 3);
 #else
     hex_dump(data, len);
 #endif
 }
 #endif /* INSIGHTS_DEBUG_ENABLED */
 
-static void send_boottime_data(void)
+static void *insights_buf_alloc(size_t size)
 {
-    uint16_t len = 0;
-    esp_insights_encode_data_begin(s_insights_data.scratch_buf, INSIGHTS_DATA_MAX_SIZE);
-    esp_insights_encode_boottime_data();
-    len = esp_insights_encode_data_end(s_insights_data.scratch_buf);
+    return s_insights_data.alloc_ext_ram ? MEM_ALLOC_EXTRAM(size) : malloc(size);
+}
+
+/* Encodes the message and returns its length, 0 if there is nothing to send.
+ * Called twice for every message and must encode the same message every time.
+ */
+typedef size_t (*insights_msg_encode_t)(void *priv);
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    bool stream;    // buf is a chunk, written to the transport whenever it gets full
+} insights_msg_writer_t;
+
+static esp_err_t insights_msg_write(const void *data, size_t len, void *priv)
+{
+    insights_msg_writer_t *writer = priv;
+    while (len > 0) {
+        if (writer->len == writer->size) {
+            if (!writer->stream) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            esp_err_t err = esp_insights_transport_data_send_write(writer->buf, writer->len);
+            if (err != ESP_OK) {
+                return err;
+            }
+            writer->len = 0;
+        }
+        size_t copy_len = writer->size - writer->len;
+        if (copy_len > len) {
+            copy_len = len;
+        }
+        memcpy(writer->buf + writer->len, data, copy_len);
+        writer->len += copy_len;
+        data = (const uint8_t *)data + copy_len;
+        len -= copy_len;
+    }
+    return ESP_OK;
+}
+
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+/* Compresses the message without writing it anywhere. Returns the context to be used for
+ * sending the message if compressed message is smaller, NULL otherwise.
+ */
+static esp_insights_compress_t *insights_msg_compress_check(insights_msg_encode_t encode, void *priv,
+                                                            size_t len, size_t *compressed_len)
+{
+    esp_insights_compress_t *compress = insights_buf_alloc(sizeof(esp_insights_compress_t));
+    if (!compress) {
+        return NULL;
+    }
+    esp_insights_compress_init(compress, NULL, NULL);
+    esp_insights_encode_stream_begin(esp_insights_compress_write, compress, len);
+    encode(priv);
+    esp_err_t err = esp_insights_encode_stream_end();
+    if (err == ESP_OK) {
+        err = esp_insights_compress_finish(compress);
+    }
+    if (err != ESP_OK || compress->out_len >= len) {
+        free(compress);
+        return NULL;
+    }
+    *compressed_len = compress->out_len;
+    return compress;
+}
+#endif /* CONFIG_ESP_INSIGHTS_COMPRESSION */
+
+/* Message is encoded once to find its length and then again to send it. If the transport
+ * supports streamed send, message is written to it in chunks as it is encoded, otherwise
+ * it is encoded in a buffer of exact size which is freed after the send.
+ * With compression enabled, there is one more pass to find the compressed length, and the
+ * message is sent compressed only if that is smaller.
+ *
+ * Returns ESP_ERR_NOT_FOUND if there is nothing to send, ESP_ERR_INVALID_SIZE without sending if the
+ * message is longer than max_len, msg_id is as returned by the transport.
+ */
+static esp_err_t insights_msg_send(insights_msg_encode_t encode, void *priv, size_t max_len, int *msg_id)
+{
+    *msg_id = -1;
+    esp_insights_encode_stream_begin(NULL, NULL, 0);
+    size_t len = encode(priv);
+    esp_insights_encode_stream_end();
     if (len == 0) {
-        ESP_LOGE(TAG, "No boottime data to send");
-        s_insights_data.boot_msg_id = 0; // mark it sent
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (len > UINT16_MAX) {
+        ESP_LOGE(TAG, "Message of length %u is too large", (unsigned) len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t msg_len = len;
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+    esp_insights_compress_t *compress = insights_msg_compress_check(encode, priv, len, &msg_len);
+#endif
+    if (msg_len > max_len) {
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+        free(compress);
+#endif
+        return ESP_ERR_INVALID_SIZE;
+    }
+#if INSIGHTS_DEBUG_ENABLED
+    ESP_LOGI(TAG, "Sending message of length: %u (encoded length: %u)", (unsigned) msg_len, (unsigned) len);
+#endif
+    esp_err_t err;
+    insights_msg_writer_t writer = { 0 };
+    writer.stream = esp_insights_transport_data_stream_supported();
+    if (writer.stream) {
+        writer.buf = s_insights_data.chunk_buf;
+        writer.size = INSIGHTS_STREAM_CHUNK_SIZE;
+        err = esp_insights_transport_data_send_begin(msg_len);
+    } else {
+        writer.buf = insights_buf_alloc(msg_len);
+        writer.size = msg_len;
+        err = writer.buf ? ESP_OK : ESP_ERR_NO_MEM;
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to allocate %u bytes for the message", (unsigned) msg_len);
+        }
+    }
+    if (err != ESP_OK) {
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+        free(compress);
+#endif
+        return err;
+    }
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+    if (compress) {
+        esp_insights_compress_init(compress, insights_msg_write, &writer);
+        esp_insights_encode_stream_begin(esp_insights_compress_write, compress, len);
+    } else
+#endif
+    {
+        esp_insights_encode_stream_begin(insights_msg_write, &writer, len);
+    }
+    encode(priv);
+    err = esp_insights_encode_stream_end();
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+    if (compress) {
+        if (err == ESP_OK) {
+            err = esp_insights_compress_finish(compress);
+        }
+        if (err == ESP_OK && compress->out_len != msg_len) {
+            err = ESP_ERR_INVALID_SIZE;
+        }
+        free(compress);
     }
+#endif
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to encode message, err:0x%x", err);
+    }
+
+    if (writer.stream) {
+        if (err == ESP_OK && writer.len) {
+            err = esp_insights_transport_data_send_write(writer.buf, writer.len);
+        }
+        *msg_id = esp_insights_transport_data_send_end(err == ESP_OK);
+    } else {
+        if (err == ESP_OK) {
 #if INSIGHTS_DEBUG_ENABLED
-    ESP_LOGI(TAG, "Sending boottime data of length: %d", len);
-    insights_dbg_dump(s_insights_data.scratch_buf, len);
+            if (msg_len == len) {
+                insights_dbg_dump(writer.buf, len);
+            }
 #endif
-    int msg_id = esp_insights_transport_data_send(s_insights_data.scratch_buf, len);
+            *msg_id = esp_insights_transport_data_send(writer.buf, msg_len);
+        }
+        free(writer.buf);
+    }
+    return err;
+}
+
+static size_t boottime_data_encode(void *priv)
+{
+    esp_insights_encode_data_begin(NULL, 0);
+    esp_insights_encode_boottime_data();
+    return esp_insights_encode_data_end(NULL);
+}
+
+static void send_boottime_data(void)
+{
+    int msg_id;
+    esp_err_t err = insights_msg_send(boottime_data_encode, NULL, UINT16_MAX, &msg_id);
+    if (err == ESP_ERR_NOT_FOUND) {
+        ESP_LOGE(TAG, "No boottime data to send");
+        s_insights_data.boot_msg_id = 0; // mark it sent
+        return;
+    }
     s_insights_data.boot_msg_id = msg_id;
     if (msg_id > 0) {
         return;
@@ -404,13 +906,16 @@ static void send_insights_config(void)
 #endif
 
 #if SEND_INSIGHTS_META
-/* Returns true if ESP Insights metadata CRC is changed */
+/* Returns true if ESP Insights metadata CRC is changed.
+ * Metadata CRC is maintained by diagnostics and the NVS copy is read only once, so this is cheap when nothing changed.
+ */
 static bool insights_meta_changed(void)
 {
-    uint32_t nvs_crc;
     uint32_t meta_crc = esp_diag_meta_crc_get();
-    esp_err_t err = esp_insights_meta_nvs_crc_get(&nvs_crc);
-    if (err == ESP_OK && nvs_crc == meta_crc) {
+    if (!s_insights_data.meta_nvs_crc_valid) {
+        s_insights_data.meta_nvs_crc_valid = (esp_insights_meta_nvs_crc_get(&s_insights_data.meta_nvs_crc) == ESP_OK);
+    }
+    if (s_insights_data.meta_nvs_crc_valid && s_insights_data.meta_nvs_crc == meta_crc) {
         /* crc found and matched, no need to send insights meta */
         return false;
     }
@@ -419,30 +924,70 @@ static bool insights_meta_changed(void)
     return true;
 }
 
-static void send_insights_meta(void)
+/* Copies the metadata tables, for every pass of the message to encode the same entries even if
+ * metrics or variables are registered meanwhile. Returns the buffer of the copy, to be freed.
+ */
+static void *insights_meta_snapshot_take(esp_insights_meta_snapshot_t *meta)
+{
+    size_t metrics_size = 0, variables_size = 0;
+    memset(meta, 0, sizeof(*meta));
+#if CONFIG_DIAG_ENABLE_METRICS
+    const esp_diag_metrics_meta_t *metrics = esp_diag_metrics_meta_get_all(&meta->metrics_len);
+    metrics_size = meta->metrics_len * sizeof(esp_diag_metrics_meta_t);
+#endif
+#if CONFIG_DIAG_ENABLE_VARIABLES
+    const esp_diag_variable_meta_t *variables = esp_diag_variable_meta_get_all(&meta->variables_len);
+    variables_size = meta->variables_len * sizeof(esp_diag_variable_meta_t);
+#endif
+    /* never empty, for the allocation to tell the failure apart */
+    uint8_t *buf = insights_buf_alloc(metrics_size + variables_size + 1);
+    if (!buf) {
+        return NULL;
+    }
+#if CONFIG_DIAG_ENABLE_METRICS
+    if (metrics) {
+        memcpy(buf, metrics, metrics_size);
+        meta->metrics = (const esp_diag_metrics_meta_t *) buf;
+    }
+#endif
+#if CONFIG_DIAG_ENABLE_VARIABLES
+    if (variables) {
+        memcpy(buf + metrics_size, variables, variables_size);
+        meta->variables = (const esp_diag_variable_meta_t *) (buf + metrics_size);
+    }
+#endif
+    return buf;
+}
+
+static size_t insights_meta_encode(void *priv)
 {
-    uint16_t len = 0;
+    return esp_insights_encode_meta(NULL, 0, s_insights_data.app_sha256, priv);
+}
 
-    memset(s_insights_data.scratch_buf, 0, INSIGHTS_DATA_MAX_SIZE);
-    len = esp_insights_encode_meta(s_insights_data.scratch_buf, INSIGHTS_DATA_MAX_SIZE, s_insights_data.app_sha256);
-    if (len == 0) {
+static void send_insights_meta(void)
+{
+    int msg_id;
+    esp_insights_meta_snapshot_t meta;
+    void *meta_buf = insights_meta_snapshot_take(&meta);
+    if (!meta_buf) {
+        ESP_LOGE(TAG, "Failed to allocate the metadata snapshot");
+        return;
+    }
+    esp_err_t err = insights_msg_send(insights_meta_encode, &meta, UINT16_MAX, &msg_id);
+    free(meta_buf);
+    if (err == ESP_ERR_NOT_FOUND) {
 #if INSIGHTS_DEBUG_ENABLED
         ESP_LOGI(TAG, "No metadata to send");
 #endif
         return;
     }
-#if INSIGHTS_DEBUG_ENABLED
-    ESP_LOGI(TAG, "Insights meta data length %d", len);
-    insights_dbg_dump(s_insights_data.scratch_buf, len);
-#endif
-    int msg_id = esp_insights_transport_data_send(s_insights_data.scratch_buf, len);
     if (msg_id > 0) {
         xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
         s_insights_data.meta_msg_pending = true;
         s_insights_data.meta_msg_id = msg_id;
         xSemaphoreGive(s_insights_data.data_lock);
     } else if (msg_id == 0) {
-        esp_insights_meta_nvs_crc_set(s_insights_data.meta_crc);
+        insights_meta_crc_save();
     } else {
 #if INSIGHTS_DEBUG_ENABLED
         ESP_LOGI(TAG, "meta message send failed");
@@ -452,23 +997,21 @@ static void send_insights_meta(void)
 #endif /* SEND_INSIGHTS_META */
 
 #if INSIGHTS_CMD_RESP
-static void send_insights_conf_meta(void)
+static size_t insights_conf_meta_encode(void *priv)
 {
-    uint16_t len = 0;
+    return esp_insights_encode_conf_meta(NULL, 0, s_insights_data.app_sha256);
+}
 
-    memset(s_insights_data.scratch_buf, 0, INSIGHTS_DATA_MAX_SIZE);
-    len = esp_insights_encode_conf_meta(s_insights_data.scratch_buf, INSIGHTS_DATA_MAX_SIZE, s_insights_data.app_sha256);
-    if (len == 0) {
+static void send_insights_conf_meta(void)
+{
+    int msg_id;
+    esp_err_t err = insights_msg_send(insights_conf_meta_encode, NULL, UINT16_MAX, &msg_id);
+    if (err == ESP_ERR_NOT_FOUND) {
 #if INSIGHTS_DEBUG_ENABLED
         ESP_LOGI(TAG, "No conf metadata to send");
 #endif
         return;
     }
-#if INSIGHTS_DEBUG_ENABLED
-    ESP_LOGI(TAG, "Insights conf meta data length %d", len);
-    insights_dbg_dump(s_insights_data.scratch_buf, len);
-#endif
-    int msg_id = esp_insights_transport_data_send(s_insights_data.scratch_buf, len);
     if (msg_id > 0) {
         xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
         s_insights_data.conf_meta_msg_pending = true;
@@ -489,16 +1032,111 @@ static void send_insights_conf_meta(void)
  * In short, there is the possibility of data duplication, so cloud should be able to handle it.
  */
 
-/* This encodes and sends insights data */
-static void send_insights_data(void)
+/* Records are encoded in place in the store, on both sides of the wrap point of the ring buffer */
+typedef struct {
+    esp_diag_data_store_span_t critical_spans[ESP_DIAG_DATA_STORE_MAX_SPANS];
+    int critical_data_size;
+    esp_diag_data_store_span_t non_critical_spans[ESP_DIAG_DATA_STORE_MAX_SPANS];
+    int non_critical_data_size;
+    uint64_t log_ts_base;           // timestamp preceding the critical data
+    uint64_t log_ts;                // timestamp of the last consumed log
+    size_t critical_consumed;
+    size_t non_critical_consumed;
+} insights_data_msg_t;
+
+static size_t insights_data_encode(void *priv)
+{
+    insights_data_msg_t *msg = priv;
+    msg->log_ts = msg->log_ts_base;
+    msg->critical_consumed = 0;
+    msg->non_critical_consumed = 0;
+    if (msg->critical_data_size <= 0 && msg->non_critical_data_size <= 0) {
+        return 0; // nothing to encode
+    }
+
+    esp_insights_encode_data_begin(NULL, 0);
+    if (msg->critical_data_size > 0) {
+        msg->critical_consumed = esp_insights_encode_critical_data(msg->critical_spans, msg->critical_data_size,
+                                                                   &msg->log_ts);
+    }
+    if (msg->non_critical_data_size > 0) {
+        msg->non_critical_consumed = esp_insights_encode_non_critical_data(msg->non_critical_spans,
+                                                                           msg->non_critical_data_size);
+    }
+    size_t len = esp_insights_encode_data_end(NULL);
+    if (!msg->critical_consumed && !msg->non_critical_consumed) {
+        len = 0; // just ignore the encoded data
+    }
+    return len;
+}
+
+/* Skip the data of the messages in flight */
+static int insights_spans_skip(esp_diag_data_store_span_t *spans, int size, size_t skip)
+{
+    if (size <= (int) skip) {
+        return 0;
+    }
+    if (skip >= spans[0].len) {
+        skip -= spans[0].len;
+        spans[0].ptr = spans[1].ptr + skip;
+        spans[0].len = spans[1].len - skip;
+        spans[1].len = 0;
+    } else {
+        spans[0].ptr += skip;
+        spans[0].len -= skip;
+    }
+    return size - skip;
+}
+
+/* Ends the span read of a store, freeing consumed bytes. A store which has less data than that, e.g. written
+ * over meanwhile, keeps the spans held, so the read is then ended without freeing anything, for the next
+ * reads not to fail. A store discarded meanwhile has ended the read already.
+ */
+static void insights_spans_release(esp_err_t (*release)(size_t size), size_t consumed)
+{
+    esp_err_t err = release(consumed);
+    if (err == ESP_FAIL) {
+        ESP_LOGW(TAG, "Data store has less than the %u bytes consumed, keeping it", (unsigned) consumed);
+        err = release(0);
+    }
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to release the data store spans, err:0x%x", err);
+    }
+}
+
+/* Takes a quarter less of the data of the message from each store, for it to fit in the size limit.
+ * Returns false if there is no data left to take.
+ */
+static bool insights_data_msg_shrink(insights_data_msg_t *msg)
 {
-    uint16_t len = 0;
-    size_t critical_data_size = 0;
-    size_t non_critical_data_size = 0;
-    size_t critical_consumed = 0;
-    size_t non_critical_consumed = 0;
+    if (msg->critical_data_size <= 0 && msg->non_critical_data_size <= 0) {
+        return false;
+    }
+    if (msg->critical_data_size > 0) {
+        msg->critical_data_size -= (msg->critical_data_size + 3) / 4;
+    }
+    if (msg->non_critical_data_size > 0) {
+        msg->non_critical_data_size -= (msg->non_critical_data_size + 3) / 4;
+    }
+    return true;
+}
 
-    memset(s_insights_data.scratch_buf, 0, INSIGHTS_DATA_MAX_SIZE);
+/* This encodes and sends insights data.
+ *
+ * Critical data of a message is held in the store until the message is acknowledged,
+ * next message takes the data after it, so that up to INSIGHTS_DATA_MSG_WINDOW messages
+ * can be in flight. Without streamed send, the message takes only the data which fits in
+ * INSIGHTS_MSG_MAX_SIZE, the rest is left for the next message.
+ *
+ * Returns ESP_OK if the message was sent and there may be more data to send.
+ */
+static esp_err_t send_insights_data(void)
+{
+    insights_data_msg_t msg = { 0 };
+    int msg_id = -1;
+    int critical_read = 0;
+    size_t inflight_len;
+    uint32_t drop_gen;
 
 #if CONFIG_DIAG_ENABLE_VARIABLES
     static uint32_t prev_log_write_fail_cnt = 0;
@@ -510,55 +1148,122 @@ static void send_insights_data(void)
         esp_diag_variable_report_uint(TAG_DIAG, KEY_LOG_WR_FAIL, prev_log_write_fail_cnt);
 #endif
     }
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL
+    insights_adaptive_report();
+#endif
 #endif /* CONFIG_DIAG_ENABLE_VARIABLES */
 
-    esp_insights_encode_data_begin(s_insights_data.scratch_buf, INSIGHTS_DATA_MAX_SIZE);
+    /* Data is held in the store while the message is encoded and sent */
+    xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
+    if (s_insights_data.data_msg_cnt == INSIGHTS_DATA_MSG_WINDOW) {
+        s_insights_data.data_pending = true;
+        xSemaphoreGive(s_insights_data.data_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    inflight_len = s_insights_data.data_msgs_len;
+    drop_gen = s_insights_data.data_msgs_drop_gen;
+    critical_read = esp_diag_data_store_critical_read_spans(msg.critical_spans, inflight_len + INSIGHTS_READ_BUF_SIZE);
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+    if (s_insights_data.data_msg_cnt) {
+        msg.log_ts_base = s_insights_data.data_msgs[s_insights_data.data_msg_cnt - 1].log_ts;
+    } else {
+        msg.log_ts_base = esp_diag_log_ts_base_get();
+    }
+#endif
+    xSemaphoreGive(s_insights_data.data_lock);
+    msg.critical_data_size = critical_read;
+    if (critical_read > 0) {
+        msg.critical_data_size = insights_spans_skip(msg.critical_spans, critical_read, inflight_len);
+    }
+    msg.non_critical_data_size = esp_diag_data_store_non_critical_read_spans(msg.non_critical_spans,
+                                                                             INSIGHTS_READ_BUF_SIZE);
 
-    critical_data_size = esp_diag_data_store_critical_read(s_insights_data.read_buf, INSIGHTS_READ_BUF_SIZE);
-    if (critical_data_size > 0) {
-        critical_consumed = esp_insights_encode_critical_data(s_insights_data.read_buf, critical_data_size);
+    size_t max_len = esp_insights_transport_data_stream_supported() ? UINT16_MAX : INSIGHTS_MSG_MAX_SIZE;
+    bool shrunk = false;
+    esp_err_t err;
+    while ((err = insights_msg_send(insights_data_encode, &msg, max_len, &msg_id)) == ESP_ERR_INVALID_SIZE
+           && msg_id < 0 && insights_data_msg_shrink(&msg)) {
+        shrunk = true;
     }
 
-    non_critical_data_size = esp_diag_data_store_non_critical_read(s_insights_data.read_buf, INSIGHTS_READ_BUF_SIZE);
-    if (non_critical_data_size > 0) {
-        non_critical_consumed = esp_insights_encode_non_critical_data(s_insights_data.read_buf, non_critical_data_size);
-        esp_diag_data_store_non_critical_release(non_critical_consumed);
+    /* Critical data is released only after the message is acknowledged */
+    if (critical_read >= 0) {
+        insights_spans_release(esp_diag_data_store_critical_release_spans, 0);
     }
-    len = esp_insights_encode_data_end(s_insights_data.scratch_buf);
-    if (!critical_consumed && !non_critical_consumed) {
-        len = 0; // just ignore the encoded data
+    if (msg.non_critical_data_size >= 0) {
+        insights_spans_release(esp_diag_data_store_non_critical_release_spans, msg.non_critical_consumed);
     }
 
-    if (len == 0) {
+    if (err == ESP_ERR_NOT_FOUND) {
 #if INSIGHTS_DEBUG_ENABLED
         ESP_LOGI(TAG, "No data to send");
 #endif
-        goto data_send_end;
+        return err;
     }
+    /* store had more data than what was read, or the message took only part of it */
+    bool more_data = critical_read == (int) (inflight_len + INSIGHTS_READ_BUF_SIZE)
+                     || msg.non_critical_data_size == INSIGHTS_READ_BUF_SIZE || shrunk;
+    if (msg_id >= 0) {
+        xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
+        /* Messages before this one were dropped while it was sent, its data does not start where
+         * the window ends now, so it is sent again along with theirs
+         */
+        if (s_insights_data.data_msgs_drop_gen != drop_gen) {
+            xSemaphoreGive(s_insights_data.data_lock);
 #if INSIGHTS_DEBUG_ENABLED
-    ESP_LOGI(TAG, "Sending data of length: %d", len);
-    insights_dbg_dump(s_insights_data.scratch_buf, len);
+            ESP_LOGI(TAG, "In flight messages dropped while sending msg_id:%d", msg_id);
 #endif
-    int msg_id = esp_insights_transport_data_send(s_insights_data.scratch_buf, len);
-    if (msg_id > 0) {
-        xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
-        s_insights_data.data_msg_len = critical_consumed;
-        s_insights_data.data_msg_id = msg_id;
+            return ESP_FAIL;
+        }
+        if (msg_id == 0) {
+            xSemaphoreGive(s_insights_data.data_lock);
+            insights_critical_data_release(msg.critical_consumed, msg.log_ts);
+            s_insights_data.data_sent = true;
+            return more_data ? ESP_OK : ESP_ERR_NOT_FOUND;
+        }
+        insights_inflight_msg_t *inflight = &s_insights_data.data_msgs[s_insights_data.data_msg_cnt++];
+        inflight->msg_id = msg_id;
+        inflight->len = msg.critical_consumed;
+        inflight->log_ts = msg.log_ts;
+        inflight->acked = false;
+        s_insights_data.data_msgs_len += msg.critical_consumed;
+        s_insights_data.data_pending = more_data;
         xTimerReset(s_insights_data.data_send_timer, portMAX_DELAY);
+        insights_data_msg_early_ack_check(msg_id);
         xSemaphoreGive(s_insights_data.data_lock);
-        return;
-    } else if (msg_id == 0) {
-        esp_diag_data_store_critical_release(critical_consumed);
-        s_insights_data.data_sent = true;
-    } else {
+        return more_data ? ESP_OK : ESP_ERR_NOT_FOUND;
+    }
 #if INSIGHTS_DEBUG_ENABLED
-        ESP_LOGI(TAG, "insights_data message send failed");
+    ESP_LOGI(TAG, "insights_data message send failed");
 #endif
+    return ESP_FAIL;
+}
+
+/* Sends data messages while there is data and the window of in flight messages has room */
+static void send_insights_data_window(void)
+{
+    for (int i = 0; i < INSIGHTS_DATA_MSG_WINDOW; i++) {
+        if (send_insights_data() != ESP_OK) {
+            break;
+        }
     }
-data_send_end:
     xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
     s_insights_data.data_send_inprogress = false;
+    s_insights_data.early_ack_cnt = 0;
+    xSemaphoreGive(s_insights_data.data_lock);
+}
+
+/* Queued when a message is acknowledged and the store has more data */
+static void insights_data_send_work(void *priv_data)
+{
+    xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
+    if (is_insights_active() == false || s_insights_data.data_send_inprogress) {
+        xSemaphoreGive(s_insights_data.data_lock);
+        return;
+    }
+    s_insights_data.data_send_inprogress = true;
     xSemaphoreGive(s_insights_data.data_lock);
+    send_insights_data_window();
 }
 
 #if INSIGHTS_CMD_RESP
@@ -608,7 +1313,7 @@ static void insights_periodic_handler(void *priv_data)
     } else {
         xSemaphoreGive(s_insights_data.data_lock);
     }
-    send_insights_data();
+    send_insights_data_window();
 }
 
 esp_err_t esp_insights_send_data(void)
@@ -651,6 +1356,11 @@ static void data_store_event_handler(void* arg, esp_event_base_t event_base,
 #if INSIGHTS_DEBUG_ENABLED
             ESP_LOGI(TAG, "ESP_DIAG_DATA_STORE_EVENT_%sCRITICAL_DATA_LOW_MEM",
                     event_id == ESP_DIAG_DATA_STORE_EVENT_CRITICAL_DATA_LOW_MEM ? "" : "NON_");
+#endif
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL
+            xSemaphoreTake(s_insights_data.data_lock, portMAX_DELAY);
+            s_insights_data.adaptive.low_mem = true;
+            xSemaphoreGive(s_insights_data.data_lock);
 #endif
             if (is_insights_active() == true) {
                 esp_rmaker_work_queue_add_task(insights_periodic_handler, NULL);
@@ -687,7 +1397,46 @@ static esp_err_t log_write_cb(void *data, size_t len, void *priv_data)
     return ret_val;
 }
 
+/* Batches are bounded by CONFIG_DIAG_LOG_BATCH_MAX_COUNT and CONFIG_DIAG_METRICS_BATCH_MAX_COUNT,
+ * so records are converted on stack.
+ */
+static esp_err_t data_store_writev(bool critical, const esp_diag_iov_t *iov, size_t iovcnt)
+{
+    esp_diag_data_store_iov_t store_iov[iovcnt];
+    for (size_t i = 0; i < iovcnt; i++) {
+        store_iov[i].dg = iov[i].tag;
+        store_iov[i].data = iov[i].data;
+        store_iov[i].len = iov[i].len;
+    }
+    if (critical) {
+        return esp_diag_data_store_critical_writev(store_iov, iovcnt);
+    }
+    return esp_diag_data_store_non_critical_writev(store_iov, iovcnt);
+}
+
+static esp_err_t log_writev_cb(const esp_diag_iov_t *iov, size_t iovcnt, void *priv_data)
+{
+    esp_err_t ret_val = data_store_writev(true, iov, iovcnt);
+#if INSIGHTS_DEBUG_ENABLED
+    if (ret_val != ESP_OK) {
+        ESP_LOGI(TAG, "esp_diag_data_store_critical_writev failed count %d, err 0x%04x", iovcnt, ret_val);
+    }
+#endif
+    return ret_val;
+}
+
 #if CONFIG_DIAG_ENABLE_METRICS
+static esp_err_t metrics_writev_cb(const esp_diag_iov_t *iov, size_t iovcnt, void *cb_arg)
+{
+    esp_err_t ret_val = data_store_writev(false, iov, iovcnt);
+#if INSIGHTS_DEBUG_ENABLED
+    if (ret_val != ESP_OK) {
+        ESP_LOGI(TAG, "esp_diag_data_store_non_critical_writev failed count %d, err 0x%04x", iovcnt, ret_val);
+    }
+#endif
+    return ret_val;
+}
+
 static esp_err_t metrics_write_cb(const char *group, void *data, size_t len, void *cb_arg)
 {
     esp_err_t ret_val = esp_diag_data_store_non_critical_write(group, data, len);
@@ -705,6 +1454,7 @@ static void metrics_init(void)
     esp_diag_metrics_config_t metrics_config = {
         .write_cb = metrics_write_cb,
         .cb_arg = NULL,
+        .writev_cb = metrics_writev_cb,
     };
     esp_err_t ret = esp_diag_metrics_init(&metrics_config);
     if (ret == ESP_OK) {
@@ -720,6 +1470,12 @@ static void metrics_init(void)
             ESP_LOGW(TAG, "Failed to initialize wifi metrics");
         }
 #endif /* CONFIG_DIAG_ENABLE_WIFI_METRICS */
+#if CONFIG_DIAG_ENABLE_TASK_METRICS
+        ret = esp_diag_task_metrics_init();
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to initialize task metrics");
+        }
+#endif /* CONFIG_DIAG_ENABLE_TASK_METRICS */
         return;
     }
     ESP_LOGE(TAG, "Failed to initialize metrics.");
@@ -732,6 +1488,9 @@ static void metrics_deinit(void)
 #endif
 #if CONFIG_DIAG_ENABLE_WIFI_METRICS
     esp_diag_wifi_metrics_deinit();
+#endif
+#if CONFIG_DIAG_ENABLE_TASK_METRICS
+    esp_diag_task_metrics_deinit();
 #endif
     esp_diag_metrics_deinit();
 }
@@ -759,6 +1518,11 @@ static void variables_init(void)
         }
 #endif /* CONFIG_DIAG_ENABLE_NETWORK_VARIABLES */
         esp_diag_variable_register(TAG_DIAG, KEY_LOG_WR_FAIL, "Log write fail count", "Diagnostics.Log", ESP_DIAG_DATA_TYPE_UINT);
+#if CONFIG_ESP_INSIGHTS_ADAPTIVE_INTERVAL
+        esp_diag_variable_register(TAG_DIAG, KEY_RPT_INTERVAL, "Reporting interval (sec)", "Diagnostics.Insights", ESP_DIAG_DATA_TYPE_UINT);
+        esp_diag_variable_register(TAG_DIAG, KEY_FILL_RATE, "Data store fill rate (bytes/min)", "Diagnostics.Insights", ESP_DIAG_DATA_TYPE_UINT);
+        esp_diag_variable_register(TAG_DIAG, KEY_RPT_EARLY, "Reports sent with other traffic", "Diagnostics.Insights", ESP_DIAG_DATA_TYPE_UINT);
+#endif
         return;
     }
     ESP_LOGE(TAG, "Failed to initialize param-values.");
@@ -792,9 +1556,11 @@ void esp_insights_disable(void)
         vSemaphoreDelete(s_insights_data.data_lock);
         s_insights_data.data_lock = NULL;
     }
-    if (s_insights_data.scratch_buf) {
-        free(s_insights_data.scratch_buf);
-        s_insights_data.scratch_buf = NULL;
+    insights_data_msgs_drop();
+    s_insights_data.data_pending = false;
+    if (s_insights_data.chunk_buf) {
+        free(s_insights_data.chunk_buf);
+        s_insights_data.chunk_buf = NULL;
     }
     if (s_insights_data.data_send_timer) {
         xTimerDelete(s_insights_data.data_send_timer, portMAX_DELAY);
@@ -905,21 +1671,11 @@ esp_err_t esp_insights_enable(esp_insights_config_t *config)
         ESP_LOGE(TAG, "Failed to set node id");
         goto enable_err;
     }
-    if (config->alloc_ext_ram) {
-        s_insights_data.scratch_buf = MEM_ALLOC_EXTRAM(INSIGHTS_DATA_MAX_SIZE);
-        s_insights_data.read_buf = MEM_ALLOC_EXTRAM(INSIGHTS_READ_BUF_SIZE);
-    } else {
-        s_insights_data.scratch_buf = malloc(INSIGHTS_DATA_MAX_SIZE);
-        s_insights_data.read_buf = malloc(INSIGHTS_READ_BUF_SIZE);
-    }
-    if (!s_insights_data.scratch_buf) {
-        ESP_LOGE(TAG, "Failed to allocate memory for scratch buffer.");
-        err = ESP_ERR_NO_MEM;
-        goto enable_err;
-    }
-    if (!s_insights_data.read_buf) {
-        ESP_LOGE(TAG, "Failed to allocate memory for read_buf");
-        free(s_insights_data.scratch_buf);
+    /* Messages are encoded only while sending, only the chunk buffer is kept */
+    s_insights_data.alloc_ext_ram = config->alloc_ext_ram;
+    s_insights_data.chunk_buf = insights_buf_alloc(INSIGHTS_STREAM_CHUNK_SIZE);
+    if (!s_insights_data.chunk_buf) {
+        ESP_LOGE(TAG, "Failed to allocate memory for chunk buffer.");
         err = ESP_ERR_NO_MEM;
         goto enable_err;
     }
@@ -964,6 +1720,7 @@ esp_err_t esp_insights_enable(esp_insights_config_t *config)
     esp_diag_log_config_t log_config = {
         .write_cb = log_write_cb,
         .cb_arg = NULL,
+        .writev_cb = log_writev_cb,
     };
     err = esp_diag_log_hook_init(&log_config);
     if (err != ESP_OK) {
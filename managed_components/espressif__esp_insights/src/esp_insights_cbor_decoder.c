@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -316,6 +317,238 @@ char *esp_insights_cbor_decoder_get_string(CborValue *val)
     return NULL;
 }
 
+/* Element size of RFC 8746 typed array, tag is 0b010fsell. 0 if not supported */
+static size_t typed_array_elem_size(CborTag tag)
+{
+    if (tag < 64 || tag > 87) {
+        return 0;
+    }
+    bool is_float = tag & 0x10;
+    bool is_signed = tag & 0x08;
+    bool is_le = tag & 0x04;
+    size_t ll = tag & 0x03;
+    if (!is_float && ll == 0) {
+        return (is_signed && is_le) ? 0 : 1; // 76 is reserved, 68 is uint8 clamped
+    }
+    if (!is_le) {
+        return 0;
+    }
+    return is_float ? (2 << ll) : (1 << ll);
+}
+
+esp_err_t esp_insights_cbor_decode_typed_array(CborValue *val, CborTag *tag, void *buf, size_t *len)
+{
+    if (!val || !tag || !buf || !len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!cbor_value_is_tag(val) || cbor_value_get_tag(val, tag) != CborNoError) {
+        return ESP_FAIL;
+    }
+    size_t elem_size = typed_array_elem_size(*tag);
+    if (elem_size == 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    CborValue next = *val;
+    if (cbor_value_skip_tag(&next) != CborNoError || !cbor_value_is_byte_string(&next)) {
+        return ESP_FAIL;
+    }
+    size_t n = *len;
+    CborError ret = cbor_value_copy_byte_string(&next, buf, &n, &next);
+    if (ret == CborErrorOutOfMemory) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (ret != CborNoError || n % elem_size) {
+        return ESP_FAIL;
+    }
+    *len = n;
+    *val = next;
+    return ESP_OK;
+}
+
+static esp_err_t schema_uint_store(void *dst, size_t size, uint64_t val)
+{
+    switch (size) {
+    case sizeof(uint8_t):
+        if (val > UINT8_MAX) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        *(uint8_t *) dst = val;
+        break;
+    case sizeof(uint16_t):
+        if (val > UINT16_MAX) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        *(uint16_t *) dst = val;
+        break;
+    case sizeof(uint32_t):
+        if (val > UINT32_MAX) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        *(uint32_t *) dst = val;
+        break;
+    case sizeof(uint64_t):
+        *(uint64_t *) dst = val;
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+/* Copies text string at it to char[size] and advances it */
+static esp_err_t schema_text_copy(CborValue *it, char *dst, size_t size)
+{
+    size_t len = size - 1;
+    CborError err = cbor_value_copy_text_string(it, dst, &len, it);
+    if (err == CborErrorOutOfMemory) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (err != CborNoError) {
+        return ESP_FAIL;
+    }
+    dst[len] = '\0';
+    return ESP_OK;
+}
+
+static bool schema_type_matches(CborValue *it, uint8_t type)
+{
+    switch (type) {
+    case INS_CBOR_FIELD_BOOL:
+        return cbor_value_is_boolean(it);
+    case INS_CBOR_FIELD_UINT:
+        return cbor_value_is_unsigned_integer(it);
+    case INS_CBOR_FIELD_TEXT:
+        return cbor_value_is_text_string(it);
+    case INS_CBOR_FIELD_TEXT_ARRAY:
+    case INS_CBOR_FIELD_ARRAY:
+        return cbor_value_is_array(it);
+    default:
+        return false;
+    }
+}
+
+/* Decodes the value at it into the member of out and advances it */
+static esp_err_t schema_field_decode(CborValue *it, const ins_cbor_field_t *field, void *out)
+{
+    uint8_t *dst = (uint8_t *) out + field->offset;
+    CborValue elem;
+    esp_err_t ret = ESP_OK;
+
+    switch (field->type) {
+    case INS_CBOR_FIELD_BOOL: {
+        bool val;
+        cbor_value_get_boolean(it, &val);
+        *(bool *) dst = val;
+        return cbor_value_advance_fixed(it) == CborNoError ? ESP_OK : ESP_FAIL;
+    }
+    case INS_CBOR_FIELD_UINT: {
+        uint64_t val;
+        cbor_value_get_uint64(it, &val);
+        ret = schema_uint_store(dst, field->size, val);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        return cbor_value_advance_fixed(it) == CborNoError ? ESP_OK : ESP_FAIL;
+    }
+    case INS_CBOR_FIELD_TEXT:
+        return schema_text_copy(it, (char *) dst, field->size);
+    case INS_CBOR_FIELD_TEXT_ARRAY: {
+        uint8_t cnt = 0;
+        if (cbor_value_enter_container(it, &elem) != CborNoError) {
+            return ESP_FAIL;
+        }
+        while (!cbor_value_at_end(&elem)) {
+            if (cnt == field->cnt) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            if (!cbor_value_is_text_string(&elem)) {
+                return ESP_FAIL;
+            }
+            ret = schema_text_copy(&elem, (char *) dst + cnt * field->size, field->size);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            cnt++;
+        }
+        *((uint8_t *) out + field->cnt_offset) = cnt;
+        break;
+    }
+    case INS_CBOR_FIELD_ARRAY:
+        if (cbor_value_enter_container(it, &elem) != CborNoError) {
+            return ESP_FAIL;
+        }
+        while (!cbor_value_at_end(&elem)) {
+            ret = field->cb(&elem, out);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+    return cbor_value_leave_container(it, &elem) == CborNoError ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_insights_cbor_decode_schema(CborValue *map, const ins_cbor_field_t *fields, size_t field_cnt,
+                                          void *out, uint32_t *found)
+{
+    CborValue it;
+    uint32_t decoded = 0;
+    esp_err_t ret = ESP_OK;
+
+    if (!map || !fields || !out || field_cnt > 32) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!cbor_value_is_map(map) || cbor_value_enter_container(map, &it) != CborNoError) {
+        return ESP_FAIL;
+    }
+    while (!cbor_value_at_end(&it)) {
+        const ins_cbor_field_t *field = NULL;
+        if (cbor_value_is_text_string(&it)) {
+            char key[INS_CBOR_SCHEMA_KEY_MAX_LEN + 1];
+            size_t key_len = sizeof(key);
+            /* Longer keys can not be in the schema, they still advance it */
+            CborError err = cbor_value_copy_text_string(&it, key, &key_len, &it);
+            if (err != CborNoError && err != CborErrorOutOfMemory) {
+                return ESP_FAIL;
+            }
+            for (size_t i = 0; err == CborNoError && i < field_cnt; i++) {
+                if (fields[i].key_len == key_len && memcmp(fields[i].key, key, key_len) == 0) {
+                    field = &fields[i];
+                    break;
+                }
+            }
+        } else if (cbor_value_advance(&it) != CborNoError) {
+            return ESP_FAIL;
+        }
+        if (cbor_value_at_end(&it)) {
+            return ESP_FAIL; /* key without value */
+        }
+        if (field && schema_type_matches(&it, field->type)) {
+            ret = schema_field_decode(&it, field, out);
+            if (ret == ESP_ERR_INVALID_SIZE && field->type == INS_CBOR_FIELD_TEXT) {
+                /* Text which does not fit is skipped, copy of the text has advanced it past it */
+                *((char *) out + field->offset) = '\0';
+                continue;
+            }
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            decoded |= 1UL << (field - fields);
+        } else if (cbor_value_advance(&it) != CborNoError) {
+            return ESP_FAIL;
+        }
+    }
+    if (cbor_value_leave_container(map, &it) != CborNoError) {
+        return ESP_FAIL;
+    }
+    if (found) {
+        *found = decoded;
+    }
+    return ESP_OK;
+}
+
 esp_err_t esp_insights_cbor_decoder_enter_container(cbor_parse_ctx_t *ctx)
 {
     CborError ret = CborNoError;
@@ -372,10 +605,11 @@ cbor_parse_ctx_t *esp_insights_cbor_decoder_start(const uint8_t *buffer, int len
         ESP_LOGE(TAG, "failed to allocate cbor ctx");
         return NULL;
     }
-    CborParser root_parser = ctx->root_parser;
     CborValue *it = &ctx->it[0];
-    if (cbor_parser_init(buffer, len, 0, &root_parser, it) != CborNoError) {
+    /* iterators keep pointer to the parser, it must live as long as ctx */
+    if (cbor_parser_init(buffer, len, 0, &ctx->root_parser, it) != CborNoError) {
         ESP_LOGE(TAG, "Error initializing cbor parser");
+        free(ctx);
         return NULL;
     }
     return ctx;
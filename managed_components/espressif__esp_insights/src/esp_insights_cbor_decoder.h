@@ -13,6 +13,7 @@
  * @note please keep this file as utility, avoid taking insights decisions here
  */
 
+#include <stddef.h>
 #include <cbor.h>
 
 #include <esp_err.h>
@@ -36,6 +37,94 @@ char *esp_insights_cbor_decoder_get_string(CborValue *val);
 esp_err_t esp_insights_cbor_decoder_enter_container(cbor_parse_ctx_t *ctx);
 esp_err_t esp_insights_cbor_decoder_exit_container(cbor_parse_ctx_t *ctx);
 
+/**
+ * @brief decodes RFC 8746 typed array
+ *
+ * Only little endian and single byte element types are supported, elements are copied as is.
+ *
+ * @param val   value at the tag of typed array, advanced to the next value on success
+ * @param tag   typed array tag, tells the type of elements
+ * @param buf   buffer to copy the elements to
+ * @param len   [in] size of the buffer, [out] size of the elements copied
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_SUPPORTED if tag is not of supported typed array,
+ *         ESP_ERR_INVALID_SIZE if buffer is small, ESP_FAIL otherwise
+ */
+esp_err_t esp_insights_cbor_decode_typed_array(CborValue *val, CborTag *tag, void *buf, size_t *len);
+
+/** Max length of the key which can be matched against the schema */
+#define INS_CBOR_SCHEMA_KEY_MAX_LEN 15
+
+/** Types of the fields in the schema, tells what the value is decoded into */
+typedef enum {
+    INS_CBOR_FIELD_BOOL,        /*!< bool */
+    INS_CBOR_FIELD_UINT,        /*!< unsigned integer of size 1, 2, 4 or 8 bytes */
+    INS_CBOR_FIELD_TEXT,        /*!< char[size], always NULL terminated */
+    INS_CBOR_FIELD_TEXT_ARRAY,  /*!< char[cnt][size] of array of text strings, count is stored as uint8_t */
+    INS_CBOR_FIELD_ARRAY,       /*!< array, callback is called for every element */
+} ins_cbor_field_type_t;
+
+/**
+ * @brief callback for the elements of INS_CBOR_FIELD_ARRAY
+ *
+ * @param elem  element of the array, callback must advance it to the next element on success
+ * @param out   output structure passed to esp_insights_cbor_decode_schema()
+ * @return esp_err_t ESP_OK on success, error is returned by esp_insights_cbor_decode_schema() as is
+ */
+typedef esp_err_t (*ins_cbor_elem_cb_t)(CborValue *elem, void *out);
+
+/** Binding of the key of a map to the member of the output structure */
+typedef struct {
+    const char *key;
+    uint8_t key_len;
+    uint8_t type;           /*!< ins_cbor_field_type_t */
+    uint8_t cnt;            /*!< max count of strings for INS_CBOR_FIELD_TEXT_ARRAY */
+    uint16_t offset;        /*!< offset of the member */
+    uint16_t size;          /*!< size of the member, size of one string for INS_CBOR_FIELD_TEXT_ARRAY */
+    uint16_t cnt_offset;    /*!< offset of the uint8_t count member for INS_CBOR_FIELD_TEXT_ARRAY */
+    ins_cbor_elem_cb_t cb;  /*!< callback for INS_CBOR_FIELD_ARRAY */
+} ins_cbor_field_t;
+
+#define INS_CBOR_MEMBER_SIZE(_struct, _member) sizeof(((_struct *) 0)->_member)
+
+/** Schema entry for the bool, uint and text members */
+#define INS_CBOR_FIELD(_key, _type, _struct, _member) {                         \
+    .key = _key, .key_len = sizeof(_key) - 1, .type = _type,                    \
+    .offset = offsetof(_struct, _member),                                       \
+    .size = INS_CBOR_MEMBER_SIZE(_struct, _member),                             \
+}
+
+/** Schema entry for the array of text strings decoded into char _member[cnt][size] */
+#define INS_CBOR_FIELD_TEXT_ARRAY_OF(_key, _struct, _member, _cnt_member) {     \
+    .key = _key, .key_len = sizeof(_key) - 1, .type = INS_CBOR_FIELD_TEXT_ARRAY, \
+    .cnt = INS_CBOR_MEMBER_SIZE(_struct, _member) / INS_CBOR_MEMBER_SIZE(_struct, _member[0]), \
+    .offset = offsetof(_struct, _member),                                       \
+    .size = INS_CBOR_MEMBER_SIZE(_struct, _member[0]),                          \
+    .cnt_offset = offsetof(_struct, _cnt_member),                               \
+}
+
+/** Schema entry for the array, elements are passed to the callback as they are parsed */
+#define INS_CBOR_FIELD_ARRAY_OF(_key, _cb) {                                    \
+    .key = _key, .key_len = sizeof(_key) - 1, .type = INS_CBOR_FIELD_ARRAY, .cb = _cb, \
+}
+
+/**
+ * @brief decodes a map into the structure as described by the schema
+ *
+ * The map is parsed once, keys are matched against the schema without any heap allocation and values are
+ * stored in the members they are bound to. Unknown keys and values of unexpected type are skipped, so is
+ * a text longer than its INS_CBOR_FIELD_TEXT member, which is left empty and not reported as found.
+ *
+ * @param map       value at the map, advanced to the next value on success
+ * @param fields    schema, keys must not be longer than INS_CBOR_SCHEMA_KEY_MAX_LEN
+ * @param field_cnt count of fields in the schema, at most 32
+ * @param out       structure to decode into
+ * @param found     [out] bit n is set if fields[n] is decoded, can be NULL
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_SIZE if a text array does not fit in its member,
+ *         ESP_FAIL if the map is malformed, error of the callback otherwise
+ */
+esp_err_t esp_insights_cbor_decode_schema(CborValue *map, const ins_cbor_field_t *fields, size_t field_cnt,
+                                          void *out, uint32_t *found);
+
 /* Do cleanups if any */
 esp_err_t esp_insights_cbor_decoder_done(cbor_parse_ctx_t *ctx);
 
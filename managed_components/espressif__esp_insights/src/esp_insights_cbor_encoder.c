@@ -5,6 +5,8 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
+#include <sys/param.h>
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -35,8 +37,42 @@ static struct cbor_encoder_data {
     int cb_cnt;
 } s_priv_data;
 
+static struct cbor_encoder_writer {
+    CborEncoderWriteFunction writer;
+    void *token;
+    uint64_t ts;
+} s_writer;
+
 static inline void _cbor_encode_meta_hdr(CborEncoder *hdr_map, const rtc_store_meta_header_t *hdr);
 
+void esp_insights_cbor_encoder_set_writer(CborEncoderWriteFunction writer, void *token, uint64_t ts)
+{
+    s_writer.writer = writer;
+    s_writer.token = token;
+    s_writer.ts = ts;
+}
+
+static void encoder_init(CborEncoder *encoder, void *data, size_t data_size)
+{
+    if (s_writer.writer) {
+        cbor_encoder_init_writer(encoder, s_writer.writer, s_writer.token);
+    } else {
+        cbor_encoder_init(encoder, data, data_size, 0);
+    }
+}
+
+// message encoded with the writer must be same in every pass, hence timestamp is fixed by the writer
+static inline uint64_t encoder_timestamp_get(void)
+{
+    return s_writer.writer ? s_writer.ts : esp_diag_timestamp_get();
+}
+
+static inline size_t encoder_size_get(CborEncoder *encoder, void *data)
+{
+    // data is not buffered with the writer, it keeps the count itself
+    return s_writer.writer ? 0 : cbor_encoder_get_buffer_size(encoder, data);
+}
+
 esp_err_t esp_insights_cbor_encoder_register_meta_cb(insights_cbor_encoder_cb_t cb)
 {
     if (s_priv_data.cb_cnt == CBOR_ENC_MAX_CBS) {
@@ -49,7 +85,7 @@ esp_err_t esp_insights_cbor_encoder_register_meta_cb(insights_cbor_encoder_cb_t
 
 void esp_insights_cbor_encode_diag_begin(void *data, size_t data_size, const char *version)
 {
-    cbor_encoder_init(&s_encoder, data, data_size, 0);
+    encoder_init(&s_encoder, data, data_size);
     cbor_encoder_create_map(&s_encoder, &s_result_map, 1);
     cbor_encode_text_stringz(&s_result_map, "diag");
     cbor_encoder_create_map(&s_result_map, &s_diag_map, CborIndefiniteLength);
@@ -58,7 +94,7 @@ void esp_insights_cbor_encode_diag_begin(void *data, size_t data_size, const cha
     cbor_encode_text_stringz(&s_diag_map, version);
 
     cbor_encode_text_stringz(&s_diag_map, "ts");
-    cbor_encode_uint(&s_diag_map, esp_diag_timestamp_get());
+    cbor_encode_uint(&s_diag_map, encoder_timestamp_get());
 
     // cbor_encode_text_stringz(&s_diag_map, "sha256");
     // cbor_encode_text_stringz(&s_diag_map, sha256);
@@ -72,7 +108,7 @@ size_t esp_insights_cbor_encode_diag_end(void *data)
 {
     cbor_encoder_close_container(&s_result_map, &s_diag_map);
     cbor_encoder_close_container(&s_encoder, &s_result_map);
-    return cbor_encoder_get_buffer_size(&s_encoder, data);
+    return encoder_size_get(&s_encoder, data);
 }
 
 void esp_insights_cbor_encode_diag_data_begin(void)
@@ -199,6 +235,29 @@ static union encode_scratch_buf {
     char sha_sum[DIAG_HEX_SHA_SIZE + 1];
 } enc_scratch_buf;
 
+// records are encoded in place in the data store, only the one straddling its wrap point is copied here
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
+#define LOG_RECORD_MAX_LEN      ESP_DIAG_LOG_PACKED_MAX_LEN
+#else
+#define LOG_RECORD_MAX_LEN      sizeof(esp_diag_log_data_t)
+#endif
+#define DATA_PT_RECORD_MAX_LEN  (sizeof(rtc_store_non_critical_data_hdr_t) + sizeof(esp_diag_str_data_pt_t))
+#define RECORD_MAX_LEN          (1 + MAX(LOG_RECORD_MAX_LEN, DATA_PT_RECORD_MAX_LEN)) // with the meta_idx byte
+
+static uint8_t s_record_seam[RECORD_MAX_LEN];
+
+#if CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Typed arrays are encoded with the little endian tags"
+#endif
+
+// samples of the metrics series being encoded, packed as typed array elements
+static struct {
+    uint32_t ts[INSIGHTS_METRICS_SERIES_MAX_SAMPLES];   // offset from the first sample
+    uint32_t val[INSIGHTS_METRICS_SERIES_MAX_SAMPLES];
+} s_series;
+#endif /* CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS */
+
 static inline uint8_t to_hex_digit(unsigned val)
 {
     return (val < 10) ? ('0' + val) : ('a' + val - 10);
@@ -234,7 +293,7 @@ void esp_insights_cbor_encode_diag_boot_info(esp_diag_device_info_t *device_info
      * For boot timestamp, we subtract the ticks since boot to get closest timestamp to bootup
      */
     cbor_encode_text_stringz(&boot_map, "ts");
-    cbor_encode_uint(&boot_map, esp_diag_timestamp_get() - (uint64_t)(pdTICKS_TO_MS(xTaskGetTickCount()) * 1000));
+    cbor_encode_uint(&boot_map, encoder_timestamp_get() - (uint64_t)(pdTICKS_TO_MS(xTaskGetTickCount()) * 1000));
 
     cbor_encode_text_stringz(&boot_map, "chip");
     cbor_encode_uint(&boot_map, device_info->chip_model);
@@ -283,7 +342,7 @@ void esp_insights_cbor_encode_meta_nc_hdr(const rtc_store_meta_header_t *hdr)
     cbor_encoder_close_container(&s_diag_data_map, &hdr_map);
 }
 
-static void encode_msg_args(CborEncoder *element, uint8_t *args, uint8_t args_len)
+static void encode_msg_args(CborEncoder *element, const uint8_t *args, uint8_t args_len)
 {
 #ifdef CONFIG_DIAG_LOG_MSG_ARG_FORMAT_TLV
     uint8_t type, len, i = 0;
@@ -426,13 +485,9 @@ static void encode_msg_args(CborEncoder *element, uint8_t *args, uint8_t args_le
 #endif /* CONFIG_DIAG_LOG_MSG_ARG_FORMAT_TLV */
 }
 
-static void encode_log_element(CborEncoder *list, esp_diag_log_data_t *data)
+static void encode_log(CborEncoder *list, const esp_diag_log_data_t *log)
 {
     CborEncoder element;
-    esp_diag_log_data_t *log = &enc_scratch_buf.log_data_pt;
-    // copy at aligned address to avoid potential alignment issue
-    memcpy(log, data, sizeof(esp_diag_log_data_t));
-
     cbor_encoder_create_map(list, &element, CborIndefiniteLength);
     cbor_encode_text_stringz(&element, "ts");
     cbor_encode_uint(&element, log->timestamp);
@@ -441,7 +496,7 @@ static void encode_log_element(CborEncoder *list, esp_diag_log_data_t *data)
     cbor_encode_text_stringz(&element, "pc");
     cbor_encode_uint(&element, log->pc);
     cbor_encode_text_stringz(&element, "ro");
-    cbor_encode_uint(&element, (uint32_t)log->msg_ptr);
+    cbor_encode_uint(&element, (uintptr_t)log->msg_ptr);
     cbor_encode_text_stringz(&element, "av");
     encode_msg_args(&element, log->msg_args, log->msg_args_len);
     if (strlen(log->task_name) > 0) {
@@ -451,28 +506,74 @@ static void encode_log_element(CborEncoder *list, esp_diag_log_data_t *data)
     cbor_encoder_close_container(list, &element);
 }
 
+#if CONFIG_DIAG_LOG_COMPACT_RECORDS
 static size_t encode_log_list(CborEncoder *map, esp_diag_log_type_t type,
-                              const char *key, const uint8_t *data, size_t size)
+                              const char *key, const esp_diag_data_store_view_t *view, uint64_t *ts)
 {
-    int i = 0, len = 0;
+    size_t i = 0, len = 0, avail;
+    size_t size = view->size;
     CborEncoder list;
-    esp_diag_log_data_t *log = NULL;
+    // decode at aligned address
+    esp_diag_log_data_t *log = &enc_scratch_buf.log_data_pt;
+    const uint8_t *data;
     cbor_encode_text_stringz(map, key);
     cbor_encoder_create_array(map, &list, CborIndefiniteLength);
-    uint8_t meta_idx = data[0];
+    uint8_t meta_idx = view->spans[0].ptr[0];
+    while (size > 1) {
+        data = esp_diag_data_store_view_get(view, i, RECORD_MAX_LEN, &avail);
+        if (data[0] != meta_idx) {
+#if INSIGHTS_DEBUG_ENABLED
+            printf("%s: skip data for next iteration meta: %d, data[i]: %d, itr: %d\n",
+                    "insights_cbor_enocoder", meta_idx, data[0], i);
+#endif
+            break; // do not encode for next meta info
+        }
+        // record length is known only after decoding, incomplete record is encoded in next iteration
+        len = esp_diag_log_unpack(&data[1], avail - 1, ts, log);
+        if (len == 0) {
+            break;
+        }
+        if (log->type == type) {
+            encode_log(&list, log);
+        }
+        i += len + 1; // meta byte and record
+        size -= len + 1;
+    }
+    cbor_encoder_close_container(map, &list);
+    return i;
+}
+#else
+static void encode_log_element(CborEncoder *list, const uint8_t *data)
+{
+    esp_diag_log_data_t *log = &enc_scratch_buf.log_data_pt;
+    // copy at aligned address to avoid potential alignment issue
+    memcpy(log, data, sizeof(esp_diag_log_data_t));
+    encode_log(list, log);
+}
+
+static size_t encode_log_list(CborEncoder *map, esp_diag_log_type_t type,
+                              const char *key, const esp_diag_data_store_view_t *view, uint64_t *ts)
+{
+    size_t i = 0, len = 0, avail;
+    size_t size = view->size;
+    CborEncoder list;
+    const uint8_t *data;
+    cbor_encode_text_stringz(map, key);
+    cbor_encoder_create_array(map, &list, CborIndefiniteLength);
+    uint8_t meta_idx = view->spans[0].ptr[0];
     while (size > sizeof (esp_diag_log_data_t)) {
-        if (data[i] != meta_idx) {
+        data = esp_diag_data_store_view_get(view, i, 1 + sizeof(esp_diag_log_data_t), &avail);
+        if (data[0] != meta_idx) {
 #if INSIGHTS_DEBUG_ENABLED
             printf("%s: skip data for next iteration meta: %d, data[i]: %d, itr: %d\n",
-                    "insights_cbor_enocoder", meta_idx, data[i], i);
+                    "insights_cbor_enocoder", meta_idx, data[0], i);
 #endif
             break; // do not encode for next meta info
         }
         i += 1; // skip meta byte
         size -= 1;
-        if (data[i] == type) {
-            log = (esp_diag_log_data_t *)&data[i];
-            encode_log_element(&list, log);
+        if (data[1] == type) {
+            encode_log_element(&list, &data[1]);
         }
         len = sizeof(esp_diag_log_data_t);
         i += len;
@@ -481,22 +582,29 @@ static size_t encode_log_list(CborEncoder *map, esp_diag_log_type_t type,
     cbor_encoder_close_container(map, &list);
     return i;
 }
+#endif /* CONFIG_DIAG_LOG_COMPACT_RECORDS */
 
 /* The TinyCBOR library does not support DOM (Document Object Model)-like API.
  * So, we need to traverse through the entire data to encode every type of log.
  */
-size_t esp_insights_cbor_encode_diag_logs(const uint8_t *data, size_t size)
+size_t esp_insights_cbor_encode_diag_logs(const esp_diag_data_store_span_t *spans, size_t size, uint64_t *ts)
 {
     CborEncoder log_map;
+    esp_diag_data_store_view_t view;
+    esp_diag_data_store_view_init(&view, spans, size, s_record_seam, sizeof(s_record_seam));
     cbor_encode_text_stringz(&s_diag_data_map, "traces");
     cbor_encoder_create_map(&s_diag_data_map, &log_map, CborIndefiniteLength);
     size_t consumed = 0, consumed_max = 0;
-    consumed_max = encode_log_list(&log_map, ESP_DIAG_LOG_TYPE_ERROR, "errors", data, size);
-    consumed = encode_log_list(&log_map, ESP_DIAG_LOG_TYPE_WARNING, "warnings", data, size);
+    // every pass walks the same records, so timestamp is updated only by the first one
+    const uint64_t ts_base = *ts;
+    uint64_t ts_pass = ts_base;
+    consumed_max = encode_log_list(&log_map, ESP_DIAG_LOG_TYPE_ERROR, "errors", &view, ts);
+    consumed = encode_log_list(&log_map, ESP_DIAG_LOG_TYPE_WARNING, "warnings", &view, &ts_pass);
     if (consumed > consumed_max) {
         consumed_max = consumed;
     }
-    consumed = encode_log_list(&log_map, ESP_DIAG_LOG_TYPE_EVENT, "events", data, size);
+    ts_pass = ts_base;
+    consumed = encode_log_list(&log_map, ESP_DIAG_LOG_TYPE_EVENT, "events", &view, &ts_pass);
     if (consumed > consumed_max) {
         consumed_max = consumed;
     }
@@ -505,9 +613,162 @@ size_t esp_insights_cbor_encode_diag_logs(const uint8_t *data, size_t size)
 }
 
 #if (CONFIG_DIAG_ENABLE_METRICS || CONFIG_DIAG_ENABLE_VARIABLES)
+#if CONFIG_ESP_INSIGHTS_CBOR_FAST_PATH
+#define CBOR_MAJOR_UINT     0x00
+#define CBOR_MAJOR_NINT     0x20
+#define CBOR_MAJOR_BYTES    0x40
+#define CBOR_MAJOR_TEXT     0x60
+#define CBOR_FALSE          0xf4
+#define CBOR_TRUE           0xf5
+#define CBOR_FLOAT32        0xfa
+#define CBOR_BREAK          0xff
+
+#define DATA_PT_STR_SIZE    sizeof(((esp_diag_str_data_pt_t *)0)->value.str)
+#define DATA_PT_KEY_SIZE    sizeof(((esp_diag_data_pt_t *)0)->key)
+// map and name array with the path, three text heads of name, longest value, timestamp, breaks
+#define DATA_PT_MAX_LEN     (sizeof(s_data_pt_metrics_hdr) + 2 * (1 + DATA_PT_KEY_SIZE) + sizeof(s_data_pt_val_key) + \
+                             (2 + DATA_PT_STR_SIZE) + sizeof(s_data_pt_ts_key) + 9 + 1)
+
+// {"n": is the same for every data point, along with the path of the name for metadata 1.1
+#ifdef CONFIG_ESP_INSIGHTS_META_VERSION_10
+static const uint8_t s_data_pt_metrics_hdr[] = {0xbf, 0x61, 'n'};
+#define s_data_pt_variables_hdr s_data_pt_metrics_hdr
+static const uint8_t s_data_pt_val_key[] = {0x61, 'v'};
+#else
+// ["M" or ["P", same as METRICS_PATH_VALUE and VARIABLES_PATH_VALUE
+static const uint8_t s_data_pt_metrics_hdr[] = {0xbf, 0x61, 'n', 0x9f, 0x61, 'M'};
+static const uint8_t s_data_pt_variables_hdr[] = {0xbf, 0x61, 'n', 0x9f, 0x61, 'P'};
+static const uint8_t s_data_pt_val_key[] = {CBOR_BREAK, 0x61, 'v'};
+#endif
+static const uint8_t s_data_pt_ts_key[] = {0x61, 't'};
+
+static inline uint8_t *put_head(uint8_t *p, uint8_t major, uint64_t val)
+{
+    int len;
+    if (val < 24) {
+        *p++ = major | val;
+        return p;
+    } else if (val <= UINT8_MAX) {
+        *p++ = major | 24;
+        len = 1;
+    } else if (val <= UINT16_MAX) {
+        *p++ = major | 25;
+        len = 2;
+    } else if (val <= UINT32_MAX) {
+        *p++ = major | 26;
+        len = 4;
+    } else {
+        *p++ = major | 27;
+        len = 8;
+    }
+    for (int k = len - 1; k >= 0; k--) {
+        *p++ = val >> (8 * k);
+    }
+    return p;
+}
+
+static inline uint8_t *put_bytes(uint8_t *p, uint8_t major, const void *data, size_t len)
+{
+    p = put_head(p, major, len);
+    memcpy(p, data, len);
+    return p + len;
+}
+
+static inline uint8_t *put_fixed(uint8_t *p, const uint8_t *bytes, size_t len)
+{
+    memcpy(p, bytes, len);
+    return p + len;
+}
+
+/* Encodes the data point, numeric or string, the same way as encode_data_pt() and encode_str_data_pt().
+ *
+ * Fixed bytes of the record are copied from the templates above and only the name, value and timestamp
+ * are encoded, straight into the buffer of the encoder. Only done for the encoder with a buffer, where the
+ * room left can be checked against the longest record. Returns false for the writer of the streamed send,
+ * if there is no room for the longest record or if the data type is unknown, generic encoder is used then,
+ * reports the errors of the writer and keeps the count of bytes needed.
+ */
+static bool encode_data_pt_fast(CborEncoder *array, const uint8_t *data, bool str)
+{
+    uint8_t *p;
+
+    if ((array->flags & CborIteratorFlag_WriterFunction) || !array->end ||
+            array->end - array->data.ptr < (ptrdiff_t) DATA_PT_MAX_LEN) {
+        return false;
+    }
+    // copy at aligned address to avoid potential alignment issue, common fields are at same offsets
+    esp_diag_str_data_pt_t *m_data = &enc_scratch_buf.str_data_pt;
+    const esp_diag_data_pt_t *pt = &enc_scratch_buf.data_pt;
+    memcpy(m_data, data, str ? sizeof(esp_diag_str_data_pt_t) : sizeof(esp_diag_data_pt_t));
+    if (str != (m_data->data_type == ESP_DIAG_DATA_TYPE_STR) || m_data->data_type > ESP_DIAG_DATA_TYPE_MAC) {
+        return false;
+    }
+
+    p = array->data.ptr;
+    if ((m_data->type & 0xffff) == ESP_DIAG_DATA_PT_METRICS) {
+        p = put_fixed(p, s_data_pt_metrics_hdr, sizeof(s_data_pt_metrics_hdr));
+    } else {
+        p = put_fixed(p, s_data_pt_variables_hdr, sizeof(s_data_pt_variables_hdr));
+    }
+#ifndef CONFIG_ESP_INSIGHTS_META_VERSION_10
+    p = put_bytes(p, CBOR_MAJOR_TEXT, m_data->tag, strnlen(m_data->tag, sizeof(m_data->tag)));
+#endif
+    p = put_bytes(p, CBOR_MAJOR_TEXT, m_data->key, strnlen(m_data->key, sizeof(m_data->key)));
+    p = put_fixed(p, s_data_pt_val_key, sizeof(s_data_pt_val_key));
+    switch (m_data->data_type) {
+        case ESP_DIAG_DATA_TYPE_BOOL:
+            *p++ = pt->value.b ? CBOR_TRUE : CBOR_FALSE;
+            break;
+        case ESP_DIAG_DATA_TYPE_INT:
+            if (pt->value.i < 0) {
+                p = put_head(p, CBOR_MAJOR_NINT, -1 - (int64_t) pt->value.i);
+            } else {
+                p = put_head(p, CBOR_MAJOR_UINT, pt->value.i);
+            }
+            break;
+        case ESP_DIAG_DATA_TYPE_UINT:
+            p = put_head(p, CBOR_MAJOR_UINT, pt->value.u);
+            break;
+        case ESP_DIAG_DATA_TYPE_FLOAT: {
+            uint32_t bits;
+            memcpy(&bits, &pt->value.f, sizeof(bits));
+            *p++ = CBOR_FLOAT32;
+            for (int k = 3; k >= 0; k--) {
+                *p++ = bits >> (8 * k);
+            }
+            break;
+        }
+        case ESP_DIAG_DATA_TYPE_IPv4:
+            p = put_bytes(p, CBOR_MAJOR_BYTES, &pt->value.ipv4, sizeof(pt->value.ipv4));
+            break;
+        case ESP_DIAG_DATA_TYPE_MAC:
+            p = put_bytes(p, CBOR_MAJOR_BYTES, pt->value.mac, sizeof(pt->value.mac));
+            break;
+        case ESP_DIAG_DATA_TYPE_STR:
+            p = put_bytes(p, CBOR_MAJOR_TEXT, m_data->value.str, strnlen(m_data->value.str, DATA_PT_STR_SIZE));
+            break;
+        default:
+            break;
+    }
+    p = put_fixed(p, s_data_pt_ts_key, sizeof(s_data_pt_ts_key));
+    p = put_head(p, CBOR_MAJOR_UINT, m_data->ts);
+    *p++ = CBOR_BREAK;
+    array->data.ptr = p;
+    if (array->remaining) {
+        array->remaining--;
+    }
+    return true;
+}
+#endif /* CONFIG_ESP_INSIGHTS_CBOR_FAST_PATH */
+
 // {"n":<key>, "v": <value>, "t": <ts> }
 static void encode_str_data_pt(CborEncoder *array, const uint8_t *data)
 {
+#if CONFIG_ESP_INSIGHTS_CBOR_FAST_PATH
+    if (encode_data_pt_fast(array, data, true)) {
+        return;
+    }
+#endif
     CborEncoder map;
     cbor_encoder_create_map(array, &map, CborIndefiniteLength);
     esp_diag_str_data_pt_t *m_data = &enc_scratch_buf.str_data_pt;
@@ -534,37 +795,44 @@ static void encode_str_data_pt(CborEncoder *array, const uint8_t *data)
     cbor_encoder_close_container(array, &map);
 }
 
-static void encode_data_pt(CborEncoder *array, const uint8_t *data)
+static void encode_data_pt_name(CborEncoder *map, const esp_diag_data_pt_t *m_data)
 {
-    CborEncoder map;
-    cbor_encoder_create_map(array, &map, CborIndefiniteLength);
-    esp_diag_data_pt_t *m_data = &enc_scratch_buf.data_pt;
-    // copy at aligned address to avoid potential alignment issue
-    memcpy(m_data, data, sizeof(esp_diag_data_pt_t));
-    cbor_encode_text_stringz(&map, "n");
+    cbor_encode_text_stringz(map, "n");
 #ifndef CONFIG_ESP_INSIGHTS_META_VERSION_10
     char temp_path_key[10] = {0};
     snprintf(temp_path_key, sizeof(temp_path_key), "%s", ((m_data->type & 0xffff)==ESP_DIAG_DATA_PT_METRICS)?METRICS_PATH_VALUE:VARIABLES_PATH_VALUE);
     CborEncoder key_arr;
-    cbor_encoder_create_array(&map, &key_arr, CborIndefiniteLength);
+    cbor_encoder_create_array(map, &key_arr, CborIndefiniteLength);
     cbor_encode_text_stringz(&key_arr, temp_path_key);
     cbor_encode_text_stringz(&key_arr, m_data->tag);
     cbor_encode_text_stringz(&key_arr, m_data->key);
-    cbor_encoder_close_container(&map, &key_arr);
+    cbor_encoder_close_container(map, &key_arr);
 #else
-    cbor_encode_text_stringz(&map, m_data->key);
+    cbor_encode_text_stringz(map, m_data->key);
 #endif
+}
+
+static void encode_data_pt(CborEncoder *array, const uint8_t *data)
+{
+#if CONFIG_ESP_INSIGHTS_CBOR_FAST_PATH
+    if (encode_data_pt_fast(array, data, false)) {
+        return;
+    }
+#endif
+    CborEncoder map;
+    cbor_encoder_create_map(array, &map, CborIndefiniteLength);
+    esp_diag_data_pt_t *m_data = &enc_scratch_buf.data_pt;
+    // copy at aligned address to avoid potential alignment issue
+    memcpy(m_data, data, sizeof(esp_diag_data_pt_t));
+    encode_data_pt_name(&map, m_data);
     cbor_encode_text_stringz(&map, "v");
     switch (m_data->data_type) {
         case ESP_DIAG_DATA_TYPE_BOOL:
             cbor_encode_boolean(&map, m_data->value.b);
             break;
         case ESP_DIAG_DATA_TYPE_INT:
-            if (m_data->value.i < 0) {
-                cbor_encode_negative_int(&map, -(m_data->value.i));
-            } else {
-                cbor_encode_int(&map, m_data->value.i);
-            }
+            // negating INT32_MIN overflows, cbor_encode_int() takes care of the sign
+            cbor_encode_int(&map, m_data->value.i);
             break;
         case ESP_DIAG_DATA_TYPE_UINT:
             cbor_encode_uint(&map, m_data->value.u);
@@ -587,36 +855,184 @@ static void encode_data_pt(CborEncoder *array, const uint8_t *data)
     cbor_encoder_close_container(array, &map);
 }
 
-static size_t encode_data_points(const uint8_t *data, size_t size, const char *key, uint16_t type)
+#if CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS
+/* Typed array tag for the values of the series, 0 if data type is not encoded as series */
+static CborTag series_tag_get(uint16_t data_type)
+{
+    switch (data_type) {
+        case ESP_DIAG_DATA_TYPE_BOOL:
+            return INSIGHTS_CBOR_TAG_TA_UINT8;
+        case ESP_DIAG_DATA_TYPE_INT:
+            return INSIGHTS_CBOR_TAG_TA_SINT32_LE;
+        case ESP_DIAG_DATA_TYPE_UINT:
+            return INSIGHTS_CBOR_TAG_TA_UINT32_LE;
+        case ESP_DIAG_DATA_TYPE_FLOAT:
+            return INSIGHTS_CBOR_TAG_TA_FLOAT32_LE;
+        default:
+            return 0;
+    }
+}
+
+/* Returns the data point of the record at offset i if it can be part of a series, NULL otherwise.
+ * Records till the end must be complete, offset of the next record is set in next.
+ * Data point is valid until the next access to the view.
+ */
+static const uint8_t *series_data_pt_get(const esp_diag_data_store_view_t *view, size_t i, uint16_t type, size_t *next)
+{
+    rtc_store_non_critical_data_hdr_t header;
+    uint16_t pt_type, data_type;
+    size_t avail;
+    const uint8_t *pt = esp_diag_data_store_view_get(view, i + 1, sizeof(header) + sizeof(esp_diag_data_pt_t), &avail);
+    memcpy(&header, pt, sizeof(header));
+    *next = i + 1 + sizeof(header) + header.len;
+    if (header.len != sizeof(esp_diag_data_pt_t)) {
+        return NULL;
+    }
+    pt += sizeof(header); // skip meta_idx byte and header
+    memcpy(&pt_type, pt + offsetof(esp_diag_data_pt_t, type), sizeof(pt_type));
+    memcpy(&data_type, pt + offsetof(esp_diag_data_pt_t, data_type), sizeof(data_type));
+    if (pt_type != type || !series_tag_get(data_type)) {
+        return NULL;
+    }
+    return pt;
+}
+
+static bool series_match(const uint8_t *a, const uint8_t *b)
+{
+    return memcmp(a + offsetof(esp_diag_data_pt_t, data_type), b + offsetof(esp_diag_data_pt_t, data_type),
+                  sizeof(uint16_t)) == 0 &&
+#ifndef CONFIG_ESP_INSIGHTS_META_VERSION_10
+           strncmp((const char *) a + offsetof(esp_diag_data_pt_t, tag), (const char *) b + offsetof(esp_diag_data_pt_t, tag),
+                   sizeof(((esp_diag_data_pt_t *)0)->tag)) == 0 &&
+#endif
+           strncmp((const char *) a + offsetof(esp_diag_data_pt_t, key), (const char *) b + offsetof(esp_diag_data_pt_t, key),
+                   sizeof(((esp_diag_data_pt_t *)0)->key)) == 0;
+}
+
+// {"n":<key>, "t0": <ts>, "t": <uint32 typed array of ts offsets>, "v": <typed array of values> }
+static void encode_series_element(CborEncoder *array, const esp_diag_data_pt_t *name, uint64_t ts0, size_t cnt)
+{
+    CborEncoder map;
+    CborTag tag = series_tag_get(name->data_type);
+    size_t val_size = sizeof(s_series.val[0]);
+    if (tag == INSIGHTS_CBOR_TAG_TA_UINT8) {
+        // pack in place, byte k is written after reading the element k
+        for (size_t k = 0; k < cnt; k++) {
+            ((uint8_t *) s_series.val)[k] = s_series.val[k];
+        }
+        val_size = sizeof(uint8_t);
+    }
+    cbor_encoder_create_map(array, &map, CborIndefiniteLength);
+    encode_data_pt_name(&map, name);
+    cbor_encode_text_stringz(&map, "t0");
+    cbor_encode_uint(&map, ts0);
+    cbor_encode_text_stringz(&map, "t");
+    cbor_encode_tag(&map, INSIGHTS_CBOR_TAG_TA_UINT32_LE);
+    cbor_encode_byte_string(&map, (const uint8_t *) s_series.ts, cnt * sizeof(s_series.ts[0]));
+    cbor_encode_text_stringz(&map, "v");
+    cbor_encode_tag(&map, tag);
+    cbor_encode_byte_string(&map, (const uint8_t *) s_series.val, cnt * val_size);
+    cbor_encoder_close_container(array, &map);
+}
+
+/* Encodes the samples of the series starting at offset start */
+static void encode_series(CborEncoder *array, const esp_diag_data_store_view_t *view, size_t start, size_t end,
+                          uint16_t type)
+{
+    esp_diag_data_pt_t name;
+    esp_diag_data_pt_t *m_data = &enc_scratch_buf.data_pt;
+    size_t i, next, cnt = 0;
+    const uint8_t *first = series_data_pt_get(view, start, type, &next);
+    bool split = false;
+    uint64_t ts0;
+
+    // first sample is kept in name, view may reuse its seam for the next ones
+    memcpy(&name, first, sizeof(name));
+    ts0 = name.ts;
+    for (i = start; i < end; i = next) {
+        const uint8_t *pt = series_data_pt_get(view, i, type, &next);
+        if (!pt || !series_match(pt, (const uint8_t *) &name)) {
+            continue;
+        }
+        memcpy(m_data, pt, sizeof(esp_diag_data_pt_t));
+        // offsets are uint32, start a new element if timestamp goes back or too far
+        if (cnt == INSIGHTS_METRICS_SERIES_MAX_SAMPLES || m_data->ts < ts0 || m_data->ts - ts0 > UINT32_MAX) {
+            encode_series_element(array, &name, ts0, cnt);
+            split = true;
+            cnt = 0;
+            ts0 = m_data->ts;
+        }
+        s_series.ts[cnt] = m_data->ts - ts0;
+        s_series.val[cnt] = (m_data->data_type == ESP_DIAG_DATA_TYPE_BOOL) ? m_data->value.b : m_data->value.u;
+        cnt++;
+    }
+    if (cnt == 1 && !split) {
+        // single sample is smaller as a data point
+        encode_data_pt(array, (const uint8_t *) &name);
+    } else {
+        encode_series_element(array, &name, ts0, cnt);
+    }
+}
+
+/* Encodes all the series in the records in [0, len), every series is encoded at its first sample */
+static void encode_series_all(CborEncoder *array, const esp_diag_data_store_view_t *view, size_t len, uint16_t type)
+{
+    size_t i, j, next, next_j;
+    esp_diag_data_pt_t cur;
+    for (i = 0; i < len; i = next) {
+        const uint8_t *pt = series_data_pt_get(view, i, type, &next);
+        if (!pt) {
+            continue;
+        }
+        memcpy(&cur, pt, sizeof(cur));
+        for (j = 0; j < i; j = next_j) {
+            const uint8_t *prev = series_data_pt_get(view, j, type, &next_j);
+            if (prev && series_match(prev, (const uint8_t *) &cur)) {
+                break;
+            }
+        }
+        if (j == i) {
+            encode_series(array, view, i, len, type);
+        }
+    }
+}
+#endif /* CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS */
+
+static size_t encode_data_points(const esp_diag_data_store_span_t *spans, size_t size, const char *key, uint16_t type)
 {
     assert(key);
-    size_t i = 0;
+    size_t i = 0, avail;
     CborEncoder array;
     /* FIXME */
     rtc_store_non_critical_data_hdr_t header;
     esp_diag_data_type_t data_type;
+    esp_diag_data_store_view_t view;
+    const uint8_t *data;
 
-    if (!data || (size <= sizeof(header))) {
-        printf("%s: Invalid arg! data %p, size %d. line %d\n",
-                "insights_cbor_enocoder", data, size, __LINE__);
+    if (!spans || !spans[0].ptr || (size <= sizeof(header))) {
+        printf("%s: Invalid arg! data %p, size %u. line %d\n",
+                "insights_cbor_enocoder", spans ? spans[0].ptr : NULL, (unsigned) size, __LINE__);
         return 0;
     }
+    esp_diag_data_store_view_init(&view, spans, size, s_record_seam, sizeof(s_record_seam));
     cbor_encode_text_stringz(&s_diag_data_map, key);
     cbor_encoder_create_array(&s_diag_data_map, &array, CborIndefiniteLength);
 
-    uint8_t meta_idx = data[0];
+    uint8_t meta_idx = spans[0].ptr[0];
     while (size > sizeof(header)) { // if remaining
-        if (data[i] != meta_idx) {
+        // record is read in place, header is enough to skip the records of other types
+        data = esp_diag_data_store_view_get(&view, i, 1 + DATA_PT_RECORD_MAX_LEN, &avail);
+        if (data[0] != meta_idx) {
 #if INSIGHTS_DEBUG_ENABLED
             printf("%s: skip data for next iteration meta: %d, data[i]: %d, itr: %d\n",
-                    "insights_cbor_enocoder", meta_idx, data[i], i);
+                    "insights_cbor_enocoder", meta_idx, data[0], i);
 #endif
             break; // do not encode for next meta info
         }
         i += 1; // skip meta_idx byte
         size -= 1;
 
-        memcpy(&header, data + i, sizeof(header));
+        memcpy(&header, data + 1, sizeof(header));
         if (sizeof(header) + header.len > size) {
 #if INSIGHTS_DEBUG_ENABLED
             // partial record
@@ -633,41 +1049,55 @@ static size_t encode_data_points(const uint8_t *data, size_t size, const char *k
             // invalid record
             printf("%s: invalid record, header.len %d\n", "insights_cbor_enocoder", header.len);
 
-            ESP_LOG_BUFFER_HEX_LEVEL("cbor_enc", data, size, ESP_LOG_INFO);
+            ESP_LOG_BUFFER_HEX_LEVEL("cbor_enc", data, avail, ESP_LOG_INFO);
 #endif
             i -= 1;
             size += 1;
             break;
         }
         uint32_t type_int;
-        memcpy(&type_int, &data[i + sizeof(header)], 4); // copy, (b'cos alignment!)
+        // only the data points fit in the seam, longer records are not encoded
+        if (header.len <= DATA_PT_RECORD_MAX_LEN - sizeof(header)) {
+            memcpy(&type_int, &data[1 + sizeof(header)], 4); // copy, (b'cos alignment!)
+        } else {
+            type_int = 0;
+        }
         if ((type_int & 0xffff) == type) {
             data_type = (type_int >> 16) & 0xffff;
             if (data_type == ESP_DIAG_DATA_TYPE_STR && header.len == sizeof(esp_diag_str_data_pt_t)) {
-                encode_str_data_pt(&array, data + i + sizeof(header));
+                encode_str_data_pt(&array, data + 1 + sizeof(header));
             } else if (header.len == sizeof(esp_diag_data_pt_t)) {
-                encode_data_pt(&array, data + i + sizeof(header));
+#if CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS
+                // metrics series are encoded after all the records are checked
+                if (type != ESP_DIAG_DATA_PT_METRICS || !series_tag_get(data_type))
+#endif
+                encode_data_pt(&array, data + 1 + sizeof(header));
             }
         }
         size -= (sizeof(header) + header.len);
         i += (sizeof(header) + header.len);
     }
+#if CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS
+    if (type == ESP_DIAG_DATA_PT_METRICS) {
+        encode_series_all(&array, &view, i, type);
+    }
+#endif
     cbor_encoder_close_container(&s_diag_data_map, &array);
     return i;
 }
 #endif /* (CONFIG_DIAG_ENABLE_METRICS || CONFIG_DIAG_ENABLE_VARIABLES) */
 
 #if CONFIG_DIAG_ENABLE_METRICS
-size_t esp_insights_cbor_encode_diag_metrics(const uint8_t *data, size_t size)
+size_t esp_insights_cbor_encode_diag_metrics(const esp_diag_data_store_span_t *spans, size_t size)
 {
-    return encode_data_points(data, size, "metrics", ESP_DIAG_DATA_PT_METRICS);
+    return encode_data_points(spans, size, "metrics", ESP_DIAG_DATA_PT_METRICS);
 }
 #endif /* CONFIG_DIAG_ENABLE_METRICS */
 
 #if CONFIG_DIAG_ENABLE_VARIABLES
-size_t  esp_insights_cbor_encode_diag_variables(const uint8_t *data, size_t size)
+size_t  esp_insights_cbor_encode_diag_variables(const esp_diag_data_store_span_t *spans, size_t size)
 {
-    return encode_data_points(data, size, "params", ESP_DIAG_DATA_PT_VARIABLE);
+    return encode_data_points(spans, size, "params", ESP_DIAG_DATA_PT_VARIABLE);
 }
 #endif /* CONFIG_DIAG_ENABLE_VARIABLES */
 
@@ -675,7 +1105,7 @@ size_t  esp_insights_cbor_encode_diag_variables(const uint8_t *data, size_t size
 
 void esp_insights_cbor_encode_meta_begin(void *data, size_t data_size, const char *version, const char *sha256)
 {
-    cbor_encoder_init(&s_meta_encoder, data, data_size, 0);
+    encoder_init(&s_meta_encoder, data, data_size);
     cbor_encoder_create_map(&s_meta_encoder, &s_meta_result_map, 1);
     cbor_encode_text_stringz(&s_meta_result_map, "diagmeta");
     cbor_encoder_create_map(&s_meta_result_map, &s_diag_meta_map, CborIndefiniteLength);
@@ -684,7 +1114,7 @@ void esp_insights_cbor_encode_meta_begin(void *data, size_t data_size, const cha
     cbor_encode_text_stringz(&s_diag_meta_map, version);
 
     cbor_encode_text_stringz(&s_diag_meta_map, "ts");
-    cbor_encode_uint(&s_diag_meta_map, esp_diag_timestamp_get()); 
+    cbor_encode_uint(&s_diag_meta_map, encoder_timestamp_get());
     cbor_encode_text_stringz(&s_diag_meta_map, "sha256");
     cbor_encode_text_stringz(&s_diag_meta_map, sha256);
 }
@@ -693,7 +1123,7 @@ size_t esp_insights_cbor_encode_meta_end(void *data)
 {
     cbor_encoder_close_container(&s_meta_result_map, &s_diag_meta_map);
     cbor_encoder_close_container(&s_meta_encoder, &s_meta_result_map);
-    return cbor_encoder_get_buffer_size(&s_meta_encoder, data);
+    return encoder_size_get(&s_meta_encoder, data);
 }
 
 void esp_insights_cbor_encode_meta_data_begin(void)
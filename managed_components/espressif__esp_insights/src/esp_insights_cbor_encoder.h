@@ -13,6 +13,7 @@
 #include <esp_core_dump.h>
 #endif /* CONFIG_ESP_INSIGHTS_COREDUMP_ENABLE */
 #include <rtc_store.h>
+#include <esp_diag_data_store.h>
 
 // make tag/group as a outer key and actual keys from it are contained within
 #ifndef CONFIG_ESP_INSIGHTS_META_VERSION_10
@@ -20,6 +21,17 @@
 #define NEW_META_STRUCT 1
 #endif
 
+#if CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS
+/* RFC 8746 typed array tags used for the metrics series, elements are little endian */
+#define INSIGHTS_CBOR_TAG_TA_UINT8          64
+#define INSIGHTS_CBOR_TAG_TA_UINT32_LE      70
+#define INSIGHTS_CBOR_TAG_TA_SINT32_LE      78
+#define INSIGHTS_CBOR_TAG_TA_FLOAT32_LE     85
+
+/* Maximum samples in one series element, more samples are encoded in next elements */
+#define INSIGHTS_METRICS_SERIES_MAX_SAMPLES 32
+#endif /* CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS */
+
 typedef enum {
     INSIGHTS_MSG_TYPE_META,
     INSIGHTS_MSG_TYPE_DATA
@@ -42,6 +54,18 @@ typedef void (*insights_cbor_encoder_cb_t) (CborEncoder *map, insights_msg_type_
  */
 esp_err_t esp_insights_cbor_encoder_register_meta_cb(insights_cbor_encoder_cb_t cb);
 
+/**
+ * @brief set the writer for the messages encoded after this
+ *
+ * With the writer set, encoded data is handed to the writer instead of the buffer passed to
+ * begin functions, and end functions return 0. Writer must track the length itself.
+ *
+ * @param writer writer function, NULL to encode in the buffer again
+ * @param token  token passed to the writer
+ * @param ts     timestamp to encode in the message, so that all the passes encode the same length
+ */
+void esp_insights_cbor_encoder_set_writer(CborEncoderWriteFunction writer, void *token, uint64_t ts);
+
 void esp_insights_cbor_encode_diag_begin(void *data, size_t data_size, const char *version);
 void esp_insights_cbor_encode_diag_data_begin(void);
 void esp_insights_cbor_encode_diag_boot_info(esp_diag_device_info_t *device_info);
@@ -58,9 +82,10 @@ void esp_insights_cbor_encode_meta_nc_hdr(const rtc_store_meta_header_t *hdr);
 #if CONFIG_ESP_INSIGHTS_COREDUMP_ENABLE
 void esp_insights_cbor_encode_diag_crash(esp_core_dump_summary_t *summary);
 #endif /* CONFIG_ESP_INSIGHTS_COREDUMP_ENABLE */
-size_t esp_insights_cbor_encode_diag_logs(const uint8_t *data, size_t size);
-size_t esp_insights_cbor_encode_diag_metrics(const uint8_t *data, size_t size);
-size_t esp_insights_cbor_encode_diag_variables(const uint8_t *data, size_t size);
+/* Records are encoded in place in the spans of the data store, size is the total length of the spans */
+size_t esp_insights_cbor_encode_diag_logs(const esp_diag_data_store_span_t *spans, size_t size, uint64_t *ts);
+size_t esp_insights_cbor_encode_diag_metrics(const esp_diag_data_store_span_t *spans, size_t size);
+size_t esp_insights_cbor_encode_diag_variables(const esp_diag_data_store_span_t *spans, size_t size);
 void esp_insights_cbor_encode_diag_data_end(void);
 size_t esp_insights_cbor_encode_diag_end(void *data);
 
@@ -124,14 +124,43 @@ esp_err_t esp_insights_cmd_resp_register_cmd(esp_insights_cmd_cb_t cb, void *prv
     return ESP_OK;
 }
 
-static esp_err_t insights_cmd_resp_search_execute_cmd_store(char **cmd_tree, int cmd_depth)
+/* command names longer than this are rejected by the parser */
+#define CMD_NAME_MAX_LEN 32
+
+/* one entry of the `config` array: {"n": [path of the command], "v": value} */
+typedef struct {
+    char path[MAX_CMD_DEPTH][CMD_NAME_MAX_LEN];
+    uint8_t depth;
+    bool value;
+} insights_cmd_entry_t;
+
+typedef struct {
+    char ver[16];
+    uint64_t ts;
+    char sha256[65];
+    int cmd_cnt;
+} insights_cmd_payload_t;
+
+enum {
+    CMD_ENTRY_FIELD_NAME,
+    CMD_ENTRY_FIELD_VALUE,
+};
+
+enum {
+    CMD_PAYLOAD_FIELD_VER,
+    CMD_PAYLOAD_FIELD_TS,
+    CMD_PAYLOAD_FIELD_SHA256,
+    CMD_PAYLOAD_FIELD_CONFIG,
+};
+
+static esp_err_t insights_cmd_resp_search_execute_cmd_store(const insights_cmd_entry_t *entry)
 {
     for(int i = 0; i< s_cmd_resp_data.cmd_cnt; i++) {
-        if (cmd_depth == s_cmd_resp_data.cmd_store[i].depth) {
+        if (entry->depth == s_cmd_resp_data.cmd_store[i].depth) {
             bool match_found = true;
             /* the command depth matches, now go for whole path */
-            for (int j = 0; j < cmd_depth; j++) {
-                if (strcmp(cmd_tree[j], s_cmd_resp_data.cmd_store[i].cmd[j]) != 0) {
+            for (int j = 0; j < entry->depth; j++) {
+                if (strcmp(entry->path[j], s_cmd_resp_data.cmd_store[i].cmd[j]) != 0) {
                     match_found = false;
                     break; /* break at first mismatch */
                 }
@@ -146,286 +175,97 @@ static esp_err_t insights_cmd_resp_search_execute_cmd_store(char **cmd_tree, int
     return ESP_ERR_NOT_FOUND;
 }
 
-static void insights_cmd_parser_clear_cmd_tree(char *cmd_tree[])
+static void insights_cmd_parser_print_cmd_tree(const insights_cmd_entry_t *entry)
 {
-    for (int i = 0; i < MAX_CMD_DEPTH; i++) {
-        if (cmd_tree[i]) {
-            free(cmd_tree[i]);
-            cmd_tree[i] = NULL;
-        } else {
-            return;
-        }
-    }
-}
-
-static void insights_cmd_parser_add_cmd_to_tree(char * cmd_tree[], char *cmd, int pos)
-{
-    ESP_LOGV(TAG, "Adding %s to command path\n", cmd);
-    /* free depth already consumed */
-    for (int i = pos; i < MAX_CMD_DEPTH; i++) {
-        if (cmd_tree[i]) {
-            free(cmd_tree[i]);
-            cmd_tree[i] = NULL;
-        } else {
-            break;
-        }
-    }
-
-    /* insert at the position */
-    cmd_tree[pos] = cmd;
-}
-
-static void insights_cmd_parser_print_cmd_tree(const char *cmd_tree[], int depth)
-{
-    if (depth <= 0) {
+    if (entry->depth == 0) {
         ESP_LOGI(TAG, "No command found to be printed");
         return;
     }
     printf("The command is: ");
-    for (int i = 0; i < depth - 1; i++) {
-        if (cmd_tree[i]) {
-            printf("%s > ", cmd_tree[i]);
-        } else {
-            printf("\ncouldn't find complete depth\n");
-            return;
-        }
-    }
-    if (cmd_tree[depth - 1]) {
-        printf("%s\n", cmd_tree[depth - 1]);
-    } else {
-        printf("\ncouldn't find complete depth\n");
+    for (int i = 0; i < entry->depth - 1; i++) {
+        printf("%s > ", entry->path[i]);
     }
+    printf("%s\n", entry->path[entry->depth - 1]);
 }
 
-#define MAX_BUFFER_SIZE 100
-
-/* extract top level fields from CBOR and check for sanity */
-esp_err_t check_top_fields_from_cbor(const uint8_t *cbor_data, size_t cbor_data_len)
-{
-    CborParser parser;
-    CborValue map, value;
-    CborError err;
-
-    /* Initialize the parser */
-    cbor_parser_init(cbor_data, cbor_data_len, 0, &parser, &map);
-
-    /* Parse the top-level map */
-    if (!cbor_value_is_map(&map)) {
-        ESP_LOGE(TAG, "Invalid CBOR format: top-level map expected");
-        return ESP_FAIL;
-    }
-
-    if (CborNoError != cbor_value_enter_container(&map, &value)) {
-        ESP_LOGE(TAG, "Error entering the container");
-        return ESP_FAIL;
-    }
-
-    /* Iterate through the map and extract the desired fields */
-    while (!cbor_value_at_end(&value)) {
-        CborValue map_key;
-
-        /* Check the map key and extract the corresponding field */
-        if (cbor_value_is_text_string(&value)) {
-            char buffer[MAX_BUFFER_SIZE];
-            size_t buffer_size = sizeof(buffer);
-            err = cbor_value_copy_text_string(&value, buffer, &buffer_size, &map_key);
-            if (err != CborNoError) {
-                ESP_LOGE(TAG, "CBOR value copy text string failed: %d", err);
-                return ESP_FAIL;
-            }
-
-            buffer_size = sizeof(buffer);
-            if (strcmp(buffer, "ver") == 0) {
-                if (cbor_value_is_text_string(&map_key)) {
-                    err = cbor_value_copy_text_string(&map_key, buffer, &buffer_size, &map_key);
-                    if (err != CborNoError) {
-                        ESP_LOGE(TAG, "CBOR value copy text string failed: %d", err);
-                        return ESP_FAIL;
-                    }
-                    ESP_LOGI(TAG, "ver: %s", buffer);
-                } else {
-                    ESP_LOGE(TAG, "Invalid CBOR format: text string expected as ver key");
-                }
-            } else if (strcmp(buffer, "ts") == 0) {
-                CborType _type = cbor_value_get_type(&map_key);
-                ESP_LOGI(TAG, "ts is of type %d", _type);
-            } else if (strcmp(buffer, "sha256") == 0) {
-                if (cbor_value_is_text_string(&map_key)) {
-                    err = cbor_value_copy_text_string(&map_key, buffer, &buffer_size, &map_key);
-                    if (err != CborNoError) {
-                        ESP_LOGE(TAG, "CBOR value copy text string failed: %d", err);
-                        return ESP_FAIL;
-                    }
-                    ESP_LOGI(TAG, "sha256: %s", buffer);
-                } else {
-                    ESP_LOGE(TAG, "Invalid CBOR format: text string expected as sha256 key");
-                }
-            } else if (strcmp(buffer, INS_CONF_STR) == 0) {
-                /* Nothing to do here */
-            }
-
-            /* skip this string now */
-            err = cbor_value_advance(&value);
-            if (err != CborNoError) {
-                ESP_LOGE(TAG, "CBOR value advance failed: %d", err);
-                return ESP_FAIL;
-            }
-        }
-
-        /* advance the value */
-        CborType _type = cbor_value_get_type(&value);
-        ESP_LOGI(TAG, "Skipping type %d", _type);
-        err = cbor_value_advance(&value);
-        if (err != CborNoError) {
-            ESP_LOGE(TAG, "CBOR value advance failed: %d", err);
-            return ESP_FAIL;
-        }
-    }
-    return ESP_OK;
-}
+static const ins_cbor_field_t s_cmd_entry_fields[] = {
+    [CMD_ENTRY_FIELD_NAME] = INS_CBOR_FIELD_TEXT_ARRAY_OF("n", insights_cmd_entry_t, path, depth),
+    [CMD_ENTRY_FIELD_VALUE] = INS_CBOR_FIELD("v", INS_CBOR_FIELD_BOOL, insights_cmd_entry_t, value),
+};
 
 /**
- * @brief Get next config entry from data
+ * @brief Decode one config entry and execute the command
  *
  */
-static esp_err_t esp_insights_cmd_resp_parse_one_entry(cbor_parse_ctx_t *ctx)
+static esp_err_t esp_insights_cmd_resp_parse_one_entry(CborValue *elem, void *priv)
 {
-    char *tmp_str = NULL;
-    int cmd_depth = 0;
-    bool cmd_value_b;
-    size_t val_sz = 0;
-    esp_err_t ret = ESP_OK;
-    char *cmd_tree[MAX_CMD_DEPTH] = {0, };
-
-    /* parse till we are at the end */
-    while (!esp_insights_cbor_decoder_at_end(ctx)) {
-        CborType type = esp_insights_cbor_decode_get_value_type(ctx);
-        CborValue *it = &ctx->it[ctx->curr_itr];
-        switch (type)
-        {
-        case CborTextStringType:
-            tmp_str = esp_insights_cbor_decoder_get_string(it);
-            if (!tmp_str) {
-                return ESP_FAIL;
-            }
-            ESP_LOGI(TAG, "found \"%s\"", tmp_str);
-            if (strcmp(tmp_str, "n") == 0) {
-                CborType _type = esp_insights_cbor_decode_get_value_type(ctx);
-                if (_type == CborArrayType) {
-                    if (esp_insights_cbor_decoder_enter_container(ctx) == ESP_OK) {
-                        while(!esp_insights_cbor_decoder_at_end(ctx)) {
-                            char *buffer = esp_insights_cbor_decoder_get_string(&ctx->it[ctx->curr_itr]);
-                            if (!buffer) {
-                                ESP_LOGE(TAG, "Invalid entry");
-                                break;
-                            }
-                            insights_cmd_parser_add_cmd_to_tree(cmd_tree, buffer, cmd_depth);
-                            ++cmd_depth;
-                        }
-
-                        insights_cmd_parser_print_cmd_tree((const char **) cmd_tree, cmd_depth);
-                        esp_insights_cbor_decoder_exit_container(ctx);
-                    }
-                } else {
-                    ESP_LOGE(TAG, "A config name must be of array type");
-                }
-            } else if (strcmp(tmp_str, "v") == 0) {
-                /* decide the type of the value first and then fetch it (bool for now) */
-                esp_diag_data_type_t type = ESP_DIAG_DATA_TYPE_BOOL;
-                /* get the value in val */
-                switch (type)
-                {
-                case ESP_DIAG_DATA_TYPE_BOOL:
-                    cbor_value_get_boolean(it, &cmd_value_b);
-                    val_sz = 1;
-                    break;
-                default:
-                    val_sz = 0;
-                    break;
-                }
-                cbor_value_advance_fixed(it);
-            } else {
-                esp_insights_cbor_decoder_advance(ctx);
-            }
-
-            if (tmp_str) {
-                free(tmp_str);
-                tmp_str = NULL;
-            }
-            break;
-
-        default:
-            esp_insights_cbor_decoder_advance(ctx);
-            break;
-        }
+    insights_cmd_payload_t *payload = (insights_cmd_payload_t *) priv;
+    insights_cmd_entry_t entry = { .depth = 0 };
+    uint32_t found = 0;
+
+    esp_err_t ret = esp_insights_cbor_decode_schema(elem, s_cmd_entry_fields,
+                                                    sizeof(s_cmd_entry_fields) / sizeof(s_cmd_entry_fields[0]),
+                                                    &entry, &found);
+    if (ret == ESP_ERR_INVALID_SIZE) {
+        /* Path too deep or a name too long, skip the entry and go on with the rest of the config */
+        ESP_LOGW(TAG, "Config entry does not fit, skipped");
+        return cbor_value_advance(elem) == CborNoError ? ESP_OK : ESP_FAIL;
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Invalid config entry, err 0x%x", ret);
+        return ret;
+    }
+    payload->cmd_cnt++;
+    if (!(found & (1 << CMD_ENTRY_FIELD_NAME))) {
+        ESP_LOGE(TAG, "A config name must be of array type");
+        return ESP_OK;
     }
-
-    insights_cmd_resp_search_execute_cmd_store(cmd_tree, cmd_depth);
-    insights_cmd_parser_clear_cmd_tree(cmd_tree);
-
-    return ret;
+    insights_cmd_parser_print_cmd_tree(&entry);
+    insights_cmd_resp_search_execute_cmd_store(&entry);
+    return ESP_OK;
 }
 
-static esp_err_t esp_insights_cmd_resp_parse_execute(cbor_parse_ctx_t *ctx)
+static const ins_cbor_field_t s_cmd_payload_fields[] = {
+    [CMD_PAYLOAD_FIELD_VER] = INS_CBOR_FIELD("ver", INS_CBOR_FIELD_TEXT, insights_cmd_payload_t, ver),
+    [CMD_PAYLOAD_FIELD_TS] = INS_CBOR_FIELD("ts", INS_CBOR_FIELD_UINT, insights_cmd_payload_t, ts),
+    [CMD_PAYLOAD_FIELD_SHA256] = INS_CBOR_FIELD("sha256", INS_CBOR_FIELD_TEXT, insights_cmd_payload_t, sha256),
+    [CMD_PAYLOAD_FIELD_CONFIG] = INS_CBOR_FIELD_ARRAY_OF(INS_CONF_STR, esp_insights_cmd_resp_parse_one_entry),
+};
+
+/* Parse the payload in one pass, commands are executed as their entries are decoded */
+static esp_err_t esp_insights_cmd_resp_parse_execute(const uint8_t *data, size_t len)
 {
-    esp_insights_cbor_decoder_enter_container(ctx);
-    int cmd_cnt = 0;
-    /* iterate till we are done with current container */
-    while (!esp_insights_cbor_decoder_at_end(ctx)) {
-        esp_insights_cbor_decoder_enter_container(ctx);
-        esp_insights_cmd_resp_parse_one_entry(ctx);
-        esp_insights_cbor_decoder_exit_container(ctx);
-        cmd_cnt++;
+    CborParser parser;
+    CborValue value;
+    insights_cmd_payload_t payload = { .cmd_cnt = 0 };
+    uint32_t found = 0;
+
+    if (cbor_parser_init(data, len, 0, &parser, &value) != CborNoError) {
+        ESP_LOGE(TAG, "Error initializing cbor parser");
+        return ESP_FAIL;
     }
-    if (cmd_cnt) {
+    esp_err_t ret = esp_insights_cbor_decode_schema(&value, s_cmd_payload_fields,
+                                                    sizeof(s_cmd_payload_fields) / sizeof(s_cmd_payload_fields[0]),
+                                                    &payload, &found);
+    if (payload.cmd_cnt) {
         esp_insights_report_config_update();
     }
-    esp_insights_cbor_decoder_exit_container(ctx);
-    ESP_LOGI(TAG, "parsed and executed %d commands", cmd_cnt);
-    return ESP_OK;
-}
-
-static esp_err_t esp_insights_cmd_resp_iterate_to_cmds_array(cbor_parse_ctx_t *ctx)
-{
-    /* layer one */
-    if (esp_insights_cbor_decoder_at_end(ctx)) {
-        ESP_LOGW(TAG, "invalid cmd_resp payload");
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "invalid cmd_resp payload, err 0x%x", ret);
         return ESP_FAIL;
     }
-
-    if (esp_insights_cbor_decode_get_value_type(ctx) != CborMapType) {
-        ESP_LOGE(TAG, "invalid cmd_resp payload. line (%d)", __LINE__);
-        return ESP_FAIL;
+    if (found & (1 << CMD_PAYLOAD_FIELD_VER)) {
+        ESP_LOGI(TAG, "ver: %s", payload.ver);
     }
-
-    if (esp_insights_cbor_decoder_enter_container(ctx) == ESP_OK) {
-        while(!esp_insights_cbor_decoder_at_end(ctx)) {
-            char *buffer = esp_insights_cbor_decoder_get_string(&ctx->it[ctx->curr_itr]);
-
-            if (!buffer) {
-                ESP_LOGE(TAG, "Parsing problem...");
-                return ESP_FAIL;
-            }
-
-            if (strcmp(buffer, INS_CONF_STR) == 0) {
-                free(buffer);
-                buffer = NULL;
-                ESP_LOGI(TAG, "Found commands array:");
-                return ESP_OK;
-            } else {
-                ESP_LOGI(TAG, "skipping token %s", buffer);
-            }
-            free(buffer);
-            buffer = NULL;
-            /* skip the value and find next for INS_CONF_STR */
-            esp_insights_cbor_decoder_advance(ctx);
-        }
+    if (found & (1 << CMD_PAYLOAD_FIELD_SHA256)) {
+        ESP_LOGI(TAG, "sha256: %s", payload.sha256);
+    }
+    if (!(found & (1 << CMD_PAYLOAD_FIELD_CONFIG))) {
         ESP_LOGI(TAG, "failed to find a `config` array!");
         return ESP_FAIL;
     }
-
-    ESP_LOGI(TAG, "invalid payload type");
-    return ESP_FAIL;
+    ESP_LOGI(TAG, "parsed and executed %d commands", payload.cmd_cnt);
+    return ESP_OK;
 }
 
 static char resp_data[100]; /* FIXME: assumed that the response size is < 100 bytes */
@@ -446,24 +286,12 @@ static esp_err_t esp_insights_cmd_handler(const void *in_data, size_t in_len, vo
     esp_insights_cbor_decode_dump((uint8_t *) in_data, in_len);
 #endif
 
-    if (ESP_FAIL == check_top_fields_from_cbor(in_data, in_len)) {
-        snprintf(resp_data, sizeof(resp_data), "{\"status\":\"payload error\"}");
-        goto out;
-    }
-    cbor_parse_ctx_t *cbor_ctx = esp_insights_cbor_decoder_start(in_data, in_len);
-    if (cbor_ctx) {
-        ret = esp_insights_cmd_resp_iterate_to_cmds_array(cbor_ctx);
-        if (ret == ESP_OK) {
-            esp_insights_cmd_resp_parse_execute(cbor_ctx); /* it is okay if this is empty */
-            snprintf(resp_data, sizeof(resp_data), "{\"status\":\"success\"}");
-        } else {
-            snprintf(resp_data, sizeof(resp_data), "{\"status\":\"payload error\"}");
-        }
-        esp_insights_cbor_decoder_done(cbor_ctx);
+    ret = esp_insights_cmd_resp_parse_execute(in_data, in_len);
+    if (ret == ESP_OK) {
+        snprintf(resp_data, sizeof(resp_data), "{\"status\":\"success\"}");
     } else {
-        snprintf(resp_data, sizeof(resp_data), "{\"status\":\"internal error\"}");
+        snprintf(resp_data, sizeof(resp_data), "{\"status\":\"payload error\"}");
     }
-out:
     *out_data = resp_data;
     *out_len = strlen(resp_data);
     return ret;
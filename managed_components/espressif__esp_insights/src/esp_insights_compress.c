@@ -0,0 +1,143 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Streaming encoder for the heatshrink format (LZSS).
+ * Output is the bit stream of tokens, most significant bit first:
+ * literal: 1, 8 bits of byte
+ * backref: 0, WINDOW_BITS bits of (offset - 1), LOOKAHEAD_BITS bits of (count - 1)
+ * Memory is the fixed context, input is compressed as it arrives and output is flushed
+ * to the writer in small pieces, so complete message is never held in the memory.
+ */
+
+#include <string.h>
+#include "esp_insights_compress.h"
+
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+
+#define WINDOW_BITS     ESP_INSIGHTS_COMPRESS_WINDOW_BITS
+#define LOOKAHEAD_BITS  ESP_INSIGHTS_COMPRESS_LOOKAHEAD_BITS
+#define WINDOW_SIZE     (1 << WINDOW_BITS)
+#define LOOKAHEAD_SIZE  (1 << LOOKAHEAD_BITS)
+#define BUF_MASK        (ESP_INSIGHTS_COMPRESS_BUF_SIZE - 1)
+
+_Static_assert(LOOKAHEAD_BITS < WINDOW_BITS, "Lookahead bits must be less than window bits");
+
+static void compress_flush(esp_insights_compress_t *ctx)
+{
+    if (ctx->out && ctx->out_buf_len && ctx->err == ESP_OK) {
+        ctx->err = ctx->out(ctx->out_buf, ctx->out_buf_len, ctx->priv);
+    }
+    ctx->out_buf_len = 0;
+}
+
+static void compress_put_byte(esp_insights_compress_t *ctx, uint8_t byte)
+{
+    ctx->out_len++;
+    if (!ctx->out) {
+        return;
+    }
+    ctx->out_buf[ctx->out_buf_len++] = byte;
+    if (ctx->out_buf_len == sizeof(ctx->out_buf)) {
+        compress_flush(ctx);
+    }
+}
+
+static void compress_put_bits(esp_insights_compress_t *ctx, uint32_t val, uint8_t cnt)
+{
+    while (cnt--) {
+        ctx->bits = (ctx->bits << 1) | ((val >> cnt) & 1);
+        if (++ctx->bit_cnt == 8) {
+            compress_put_byte(ctx, ctx->bits);
+            ctx->bits = 0;
+            ctx->bit_cnt = 0;
+        }
+    }
+}
+
+/* Encodes one token from the bytes at ctx->pos */
+static void compress_token(esp_insights_compress_t *ctx)
+{
+    const uint8_t *buf = ctx->buf;
+    uint32_t pos = ctx->pos;
+    uint32_t avail = ctx->in - pos;
+    uint32_t max_off = pos < WINDOW_SIZE ? pos : WINDOW_SIZE;
+    uint32_t best_len = 0, best_off = 0;
+    uint8_t first = buf[pos & BUF_MASK];
+
+    /* Match can overlap the bytes being encoded, decoder copies byte by byte */
+    for (uint32_t off = 1; off <= max_off; off++) {
+        uint32_t start = pos - off;
+        /* Only longer match is useful, check the byte which makes it longer first */
+        if (buf[start & BUF_MASK] != first ||
+            buf[(start + best_len) & BUF_MASK] != buf[(pos + best_len) & BUF_MASK]) {
+            continue;
+        }
+        uint32_t len = 1;
+        while (len < avail && buf[(start + len) & BUF_MASK] == buf[(pos + len) & BUF_MASK]) {
+            len++;
+        }
+        if (len > best_len) {
+            best_len = len;
+            best_off = off;
+            if (len == avail) {
+                break;
+            }
+        }
+    }
+    /* Backref only if it is shorter than the literals it replaces */
+    if (best_len * 9 > 1 + WINDOW_BITS + LOOKAHEAD_BITS) {
+        compress_put_bits(ctx, 0, 1);
+        compress_put_bits(ctx, best_off - 1, WINDOW_BITS);
+        compress_put_bits(ctx, best_len - 1, LOOKAHEAD_BITS);
+        ctx->pos += best_len;
+    } else {
+        compress_put_bits(ctx, 0x100 | first, 9);
+        ctx->pos++;
+    }
+}
+
+void esp_insights_compress_init(esp_insights_compress_t *ctx, esp_insights_encode_writer_t out, void *priv)
+{
+    ctx->in = 0;
+    ctx->pos = 0;
+    ctx->out_buf_len = 0;
+    ctx->bits = 0;
+    ctx->bit_cnt = 0;
+    ctx->out_len = 0;
+    ctx->out = out;
+    ctx->priv = priv;
+    ctx->err = ESP_OK;
+    compress_put_byte(ctx, ESP_INSIGHTS_COMPRESS_MARKER);
+    compress_put_byte(ctx, (WINDOW_BITS << 4) | LOOKAHEAD_BITS);
+}
+
+esp_err_t esp_insights_compress_write(const void *data, size_t len, void *priv)
+{
+    esp_insights_compress_t *ctx = priv;
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len && ctx->err == ESP_OK; i++) {
+        ctx->buf[ctx->in++ & BUF_MASK] = p[i];
+        if (ctx->in - ctx->pos == LOOKAHEAD_SIZE) {
+            compress_token(ctx);
+        }
+    }
+    return ctx->err;
+}
+
+esp_err_t esp_insights_compress_finish(esp_insights_compress_t *ctx)
+{
+    while (ctx->pos != ctx->in && ctx->err == ESP_OK) {
+        compress_token(ctx);
+    }
+    /* Zero padding is read by the decoder as an incomplete backref and ignored */
+    if (ctx->bit_cnt) {
+        compress_put_bits(ctx, 0, 8 - ctx->bit_cnt);
+    }
+    compress_flush(ctx);
+    return ctx->err;
+}
+
+#endif /* CONFIG_ESP_INSIGHTS_COMPRESSION */
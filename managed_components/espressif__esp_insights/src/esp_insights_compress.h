@@ -0,0 +1,74 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include "esp_insights_encoder.h"
+
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+
+/* Compressed message is the marker byte, window and lookahead bits (4 bits each)
+ * followed by heatshrink compressed TLV message.
+ */
+#define ESP_INSIGHTS_COMPRESS_MARKER        0x48    /* 'H' for heatshrink */
+#define ESP_INSIGHTS_COMPRESS_HDR_SIZE      2
+
+#define ESP_INSIGHTS_COMPRESS_WINDOW_BITS       CONFIG_ESP_INSIGHTS_COMPRESSION_WINDOW_BITS
+#define ESP_INSIGHTS_COMPRESS_LOOKAHEAD_BITS    CONFIG_ESP_INSIGHTS_COMPRESSION_LOOKAHEAD_BITS
+
+/* Holds the history window and the lookahead, must be at least their sum */
+#define ESP_INSIGHTS_COMPRESS_BUF_SIZE      (2 << ESP_INSIGHTS_COMPRESS_WINDOW_BITS)
+#define ESP_INSIGHTS_COMPRESS_OUT_BUF_SIZE  32
+
+typedef struct {
+    uint8_t buf[ESP_INSIGHTS_COMPRESS_BUF_SIZE];    /* ring buffer of input */
+    uint32_t in;                /* bytes received */
+    uint32_t pos;               /* bytes encoded */
+    uint8_t out_buf[ESP_INSIGHTS_COMPRESS_OUT_BUF_SIZE];
+    size_t out_buf_len;
+    uint8_t bits;               /* pending bits of the output byte */
+    uint8_t bit_cnt;
+    size_t out_len;             /* total compressed length */
+    esp_insights_encode_writer_t out;
+    void *priv;
+    esp_err_t err;
+} esp_insights_compress_t;
+
+/**
+ * @brief initialize the compressor for a new message
+ *
+ * @param ctx   compressor context
+ * @param out   writer which receives the compressed data, NULL to count the length only
+ * @param priv  private data passed to the writer
+ */
+void esp_insights_compress_init(esp_insights_compress_t *ctx, esp_insights_encode_writer_t out, void *priv);
+
+/**
+ * @brief compress the data
+ *
+ * Has the signature of \ref esp_insights_encode_writer_t, so that the encoder can write into it.
+ *
+ * @param data  data to compress
+ * @param len   length of the data
+ * @param ctx   compressor context
+ * @return ESP_OK on success, error returned by the writer otherwise
+ */
+esp_err_t esp_insights_compress_write(const void *data, size_t len, void *ctx);
+
+/**
+ * @brief compress the remaining data and flush it to the writer
+ *
+ * Compressed length is in ctx->out_len after this.
+ *
+ * @param ctx   compressor context
+ * @return ESP_OK on success, error returned by the writer otherwise
+ */
+esp_err_t esp_insights_compress_finish(esp_insights_compress_t *ctx);
+
+#endif /* CONFIG_ESP_INSIGHTS_COMPRESSION */
@@ -10,6 +10,7 @@
 #include <esp_diagnostics_variables.h>
 
 #include "esp_insights_cbor_encoder.h"
+#include "esp_insights_encoder.h"
 
 #if CONFIG_ESP_INSIGHTS_META_VERSION_10
 #define INSIGHTS_VERSION_MAJOR           "1"
@@ -35,79 +36,149 @@
 #define INSIGHTS_CONF_DATA_TYPE     0x12
 #define TLV_OFFSET                  3
 
-static void esp_insights_encode_meta_data(void)
+/* In streaming mode message is encoded twice, first pass only counts the length and
+ * second pass hands the data to the writer as it is encoded.
+ */
+static struct {
+    bool active;
+    esp_insights_encode_writer_t writer;
+    void *priv;
+    size_t len;
+    size_t written;
+    uint64_t ts;
+    esp_err_t err;
+} s_stream;
+
+static CborError stream_write(void *token, const void *data, size_t len, CborEncoderAppendType type)
+{
+    if (s_stream.writer && s_stream.err == ESP_OK) {
+        if (s_stream.written + len > s_stream.len) {
+            s_stream.err = ESP_ERR_INVALID_SIZE;
+        } else {
+            s_stream.err = s_stream.writer(data, len, s_stream.priv);
+        }
+    }
+    /* keep counting even on error, so that the length mismatch is reported */
+    s_stream.written += len;
+    return CborNoError;
+}
+
+void esp_insights_encode_stream_begin(esp_insights_encode_writer_t writer, void *priv, size_t len)
+{
+    if (!writer) {
+        /* sizing pass, timestamp is fixed for the next pass */
+        s_stream.ts = esp_diag_timestamp_get();
+        len = 0;
+    }
+    s_stream.writer = writer;
+    s_stream.priv = priv;
+    s_stream.len = len;
+    s_stream.written = 0;
+    s_stream.err = ESP_OK;
+    s_stream.active = true;
+    esp_insights_cbor_encoder_set_writer(stream_write, NULL, s_stream.ts);
+}
+
+esp_err_t esp_insights_encode_stream_end(void)
+{
+    esp_insights_cbor_encoder_set_writer(NULL, NULL, 0);
+    s_stream.active = false;
+    if (s_stream.err == ESP_OK && s_stream.writer && s_stream.written != s_stream.len) {
+        s_stream.err = ESP_ERR_INVALID_SIZE;
+    }
+    return s_stream.err;
+}
+
+/* TLV header is written before the message, length of the message is known from the sizing pass */
+static uint8_t *encode_hdr_begin(uint8_t type, uint8_t *out_data)
+{
+    if (!s_stream.active) {
+        return out_data + TLV_OFFSET;
+    }
+    uint8_t hdr[TLV_OFFSET] = { type };
+    uint16_t len = s_stream.len > TLV_OFFSET ? s_stream.len - TLV_OFFSET : 0;
+    memcpy(&hdr[1], &len, sizeof(len));
+    stream_write(NULL, hdr, sizeof(hdr), CborEncoderAppendCborData);
+    return NULL;
+}
+
+static size_t encode_hdr_end(uint8_t type, uint8_t *out_data, uint16_t len)
+{
+    if (s_stream.active) {
+        return s_stream.written;
+    }
+    out_data[0] = type;                         /* Data type - 1 byte */
+    memcpy(&out_data[1], &len, sizeof(len));    /* Data length - 2 bytes */
+    return len + TLV_OFFSET;
+}
+
+static void esp_insights_encode_meta_data(const esp_insights_meta_snapshot_t *meta)
 {
 #if CONFIG_DIAG_ENABLE_METRICS
-    uint32_t metrics_len = 0;
-    const esp_diag_metrics_meta_t *metrics = esp_diag_metrics_meta_get_all(&metrics_len);
-    if (!metrics) {
+    if (!meta->metrics) {
         return;
     }
-    esp_insights_cbor_encode_meta_metrics((const esp_diag_metrics_meta_t *)metrics, metrics_len);
+    esp_insights_cbor_encode_meta_metrics(meta->metrics, meta->metrics_len);
 #endif /* CONFIG_DIAG_ENABLE_METRICS */
 
 #if CONFIG_DIAG_ENABLE_VARIABLES
-    uint32_t variables_len = 0;
-    const esp_diag_variable_meta_t *variables = esp_diag_variable_meta_get_all(&variables_len);
-    if (!variables) {
+    if (!meta->variables) {
         return;
     }
-    esp_insights_cbor_encode_meta_variables((const esp_diag_variable_meta_t *)variables, variables_len);
+    esp_insights_cbor_encode_meta_variables(meta->variables, meta->variables_len);
 #endif /* CONFIG_DIAG_ENABLE_VARIABLES */
 }
 
-size_t esp_insights_encode_meta(uint8_t *out_data, size_t out_data_size, char *sha256)
+size_t esp_insights_encode_meta(uint8_t *out_data, size_t out_data_size, char *sha256,
+                                const esp_insights_meta_snapshot_t *meta)
 {
-    if (!out_data || !out_data_size) {
+    if (!s_stream.active && (!out_data || out_data_size <= TLV_OFFSET)) {
         return 0;
     }
     char sha[DIAG_HEX_SHA_SIZE + 1];
     bytes_to_hex((uint8_t *) sha256,(uint8_t *) sha, DIAG_SHA_SIZE);
-    esp_insights_cbor_encode_meta_begin(out_data + TLV_OFFSET,
-                                        out_data_size - TLV_OFFSET,
+    uint8_t *cbor_data = encode_hdr_begin(INSIGHTS_META_DATA_TYPE, out_data);
+    esp_insights_cbor_encode_meta_begin(cbor_data, out_data_size - TLV_OFFSET,
                                         INSIGHTS_META_VERSION, sha);
     esp_insights_cbor_encode_meta_data_begin();
-    esp_insights_encode_meta_data();
+    esp_insights_encode_meta_data(meta);
     esp_insights_cbor_encode_meta_data_end();
-    uint16_t len = esp_insights_cbor_encode_meta_end(out_data + TLV_OFFSET);
+    uint16_t len = esp_insights_cbor_encode_meta_end(cbor_data);
 
-    out_data[0] = INSIGHTS_META_DATA_TYPE;      /* Data type inidcation diagnostics meta - 1 byte */
-    memcpy(&out_data[1], &len, sizeof(len));    /* Data length - 2 bytes */
-    len += TLV_OFFSET;
-    return len;
+    /* Data type inidcation diagnostics meta */
+    return encode_hdr_end(INSIGHTS_META_DATA_TYPE, out_data, len);
 }
 
-esp_err_t esp_insights_encode_data_begin(void *out_data, size_t out_data_size)
+esp_err_t esp_insights_encode_data_begin(uint8_t *out_data, size_t out_data_size)
 {
-    if (!out_data || !out_data_size) {
+    if (!s_stream.active && (!out_data || out_data_size <= TLV_OFFSET)) {
         return ESP_ERR_INVALID_ARG;
     }
-    esp_insights_cbor_encode_diag_begin(out_data + TLV_OFFSET, out_data_size - TLV_OFFSET, INSIGHTS_VERSION);
+    uint8_t *cbor_data = encode_hdr_begin(INSIGHTS_DATA_TYPE, out_data);
+    esp_insights_cbor_encode_diag_begin(cbor_data, out_data_size - TLV_OFFSET, INSIGHTS_VERSION);
     esp_insights_cbor_encode_diag_data_begin();
     return ESP_OK;
 }
 
 size_t esp_insights_encode_conf_meta(uint8_t *out_data, size_t out_data_size, char *sha256)
 {
-    if (!out_data || !out_data_size) {
+    if (!s_stream.active && (!out_data || out_data_size <= TLV_OFFSET)) {
         return 0;
     }
     char sha[DIAG_HEX_SHA_SIZE + 1];
     bytes_to_hex((uint8_t *) sha256,(uint8_t *) sha, DIAG_SHA_SIZE);
-    esp_insights_cbor_encode_meta_begin(out_data + TLV_OFFSET,
-                                        out_data_size - TLV_OFFSET,
+    uint8_t *cbor_data = encode_hdr_begin(INSIGHTS_META_DATA_TYPE, out_data);
+    esp_insights_cbor_encode_meta_begin(cbor_data, out_data_size - TLV_OFFSET,
                                         INSIGHTS_META_VERSION, sha);
     esp_insights_cbor_encode_conf_meta_data_begin();
     /* TODO: Implement and collect diagnostics specific conf meta */
     // esp_insights_encode_conf_meta_data();
     esp_insights_cbor_encode_conf_meta_data_end();
 
-    uint16_t len = esp_insights_cbor_encode_meta_end(out_data + TLV_OFFSET);
+    uint16_t len = esp_insights_cbor_encode_meta_end(cbor_data);
 
-    out_data[0] = INSIGHTS_META_DATA_TYPE;      /* Data type inidcation diagnostics meta - 1 byte */
-    memcpy(&out_data[1], &len, sizeof(len));    /* Data length - 2 bytes */
-    len += TLV_OFFSET;
-    return len;
+    /* Data type inidcation diagnostics meta */
+    return encode_hdr_end(INSIGHTS_META_DATA_TYPE, out_data, len);
 }
 
 void esp_insights_encode_boottime_data(void)
@@ -160,13 +231,13 @@ size_t esp_insights_encode_conf_end(uint8_t *out_data)
     return len;
 }
 
-size_t esp_insights_encode_critical_data(const void *data, size_t data_size)
+size_t esp_insights_encode_critical_data(const esp_diag_data_store_span_t *spans, size_t data_size, uint64_t *ts)
 {
     size_t consumed = 0;
-    if (data) {
-        consumed = esp_insights_cbor_encode_diag_logs(data, data_size);
+    if (spans && spans[0].ptr) {
+        consumed = esp_insights_cbor_encode_diag_logs(spans, data_size, ts);
         if (consumed) {
-            uint8_t meta_idx = ((uint8_t *) data)[0];
+            uint8_t meta_idx = spans[0].ptr[0];
             const rtc_store_meta_header_t *hdr = rtc_store_get_meta_record_by_index(meta_idx);
             if (hdr) {
                 esp_insights_cbor_encode_meta_c_hdr(hdr);
@@ -176,22 +247,22 @@ size_t esp_insights_encode_critical_data(const void *data, size_t data_size)
     return consumed;
 }
 
-size_t esp_insights_encode_non_critical_data(const void *data, size_t data_size)
+size_t esp_insights_encode_non_critical_data(const esp_diag_data_store_span_t *spans, size_t data_size)
 {
     size_t consumed_max = 0;
-    if (data) {
+    if (spans && spans[0].ptr) {
 #if CONFIG_DIAG_ENABLE_METRICS
-        consumed_max = esp_insights_cbor_encode_diag_metrics(data, data_size);
+        consumed_max = esp_insights_cbor_encode_diag_metrics(spans, data_size);
 #endif /* CONFIG_DIAG_ENABLE_METRICS */
 #if CONFIG_DIAG_ENABLE_VARIABLES
-        size_t consumed = esp_insights_cbor_encode_diag_variables(data, data_size);
+        size_t consumed = esp_insights_cbor_encode_diag_variables(spans, data_size);
         if (consumed > consumed_max) {
             consumed_max = consumed;
         }
 #endif /* CONFIG_DIAG_ENABLE_VARIABLES */
 #if CONFIG_DIAG_ENABLE_METRICS || CONFIG_DIAG_ENABLE_VARIABLES
         if (consumed_max) {
-            uint8_t meta_idx = ((uint8_t *) data)[0];
+            uint8_t meta_idx = spans[0].ptr[0];
             const rtc_store_meta_header_t *hdr = rtc_store_get_meta_record_by_index(meta_idx);
             if (hdr) {
                 esp_insights_cbor_encode_meta_nc_hdr(hdr);
@@ -204,14 +275,12 @@ size_t esp_insights_encode_non_critical_data(const void *data, size_t data_size)
 
 size_t esp_insights_encode_data_end(uint8_t *out_data)
 {
-    if (!out_data) {
+    if (!s_stream.active && !out_data) {
         return 0;
     }
     esp_insights_cbor_encode_diag_data_end();
-    uint16_t len = esp_insights_cbor_encode_diag_end(out_data + TLV_OFFSET);
+    uint16_t len = esp_insights_cbor_encode_diag_end(s_stream.active ? NULL : out_data + TLV_OFFSET);
 
-    out_data[0] = INSIGHTS_DATA_TYPE;               /* Data type indicating diagnostics - 1 byte */
-    memcpy(&out_data[1], &len, sizeof(len));    /* Data length - 2 bytes */
-    len += TLV_OFFSET;
-    return len;
+    /* Data type indicating diagnostics */
+    return encode_hdr_end(INSIGHTS_DATA_TYPE, out_data, len);
 }
@@ -6,11 +6,78 @@
 
 #pragma once
 
+#include <esp_err.h>
+#include <esp_diag_data_store.h>
+
 #if CONFIG_ESP_INSIGHTS_COREDUMP_ENABLE
 #include <esp_core_dump.h>
 #endif
+#if CONFIG_DIAG_ENABLE_METRICS
+#include <esp_diagnostics_metrics.h>
+#endif
+#if CONFIG_DIAG_ENABLE_VARIABLES
+#include <esp_diagnostics_variables.h>
+#endif
+
+/**
+ * @brief writer which receives the encoded message in streaming mode
+ *
+ * @param data  encoded data
+ * @param len   length of the data
+ * @param priv  private data passed to esp_insights_encode_stream_begin()
+ * @return ESP_OK on success, encoding is aborted otherwise
+ */
+typedef esp_err_t (*esp_insights_encode_writer_t)(const void *data, size_t len, void *priv);
 
-size_t esp_insights_encode_meta(uint8_t *out_data, size_t out_data_size, char *sha256);
+/**
+ * @brief start encoding the next message in streaming mode
+ *
+ * In streaming mode the output buffer passed to encode functions is not used and may be NULL.
+ * Message is encoded twice with the same input: first with writer as NULL which only counts the length,
+ * returned by the end function, and then with the writer and the length from the first pass.
+ * Writer receives the complete message including the TLV header, in pieces of a few bytes.
+ *
+ * @param writer writer function, NULL for the sizing pass
+ * @param priv   private data passed to the writer
+ * @param len    length of the message from the sizing pass, ignored for the sizing pass
+ */
+void esp_insights_encode_stream_begin(esp_insights_encode_writer_t writer, void *priv, size_t len);
+
+/**
+ * @brief finish streaming mode
+ *
+ * @return ESP_OK on success, error returned by the writer, or ESP_ERR_INVALID_SIZE if the message
+ *         length differs from the sizing pass
+ */
+esp_err_t esp_insights_encode_stream_end(void);
+
+/**
+ * @brief metadata of the registered metrics and variables, copied once for all the passes of a message
+ *
+ * A table is NULL if its module is not initialized.
+ */
+typedef struct {
+#if CONFIG_DIAG_ENABLE_METRICS
+    const esp_diag_metrics_meta_t *metrics;
+    uint32_t metrics_len;
+#endif
+#if CONFIG_DIAG_ENABLE_VARIABLES
+    const esp_diag_variable_meta_t *variables;
+    uint32_t variables_len;
+#endif
+} esp_insights_meta_snapshot_t;
+
+/**
+ * @brief encode metadata message
+ *
+ * @param out_data      output buffer, not used in streaming mode
+ * @param out_data_size size of the output buffer
+ * @param sha256        SHA256 of the application
+ * @param meta          metadata to encode, the same for all the passes of the message
+ * @return length of the encoded message
+ */
+size_t esp_insights_encode_meta(uint8_t *out_data, size_t out_data_size, char *sha256,
+                                const esp_insights_meta_snapshot_t *meta);
 size_t esp_insights_encode_conf_meta(uint8_t *out_data, size_t out_data_size, char *sha256);
 esp_err_t esp_insights_encode_data_begin(uint8_t *out_data, size_t out_data_size);
 void esp_insights_encode_boottime_data(void);
@@ -18,20 +85,27 @@ void esp_insights_encode_boottime_data(void);
 /**
  * @brief encode critical data
  *
- * @param critical_data pointer to critical data
+ * Records are encoded in place, the spans are as returned by esp_diag_data_store_critical_read_spans().
+ *
+ * @param spans spans of critical data
  * @param critical_data_size size of critical data
+ * @param ts timestamp of the log preceding the data, updated with timestamp of the last consumed log.
+ *           Used only with compact log records (CONFIG_DIAG_LOG_COMPACT_RECORDS)
  * @return size_t length of data consumed
  */
-size_t esp_insights_encode_critical_data(const void *critical_data, size_t critical_data_size);
+size_t esp_insights_encode_critical_data(const esp_diag_data_store_span_t *spans, size_t critical_data_size,
+                                         uint64_t *ts);
 
 /**
  * @brief encode non_critical data
  *
- * @param critical_data pointer to non_critical data
- * @param critical_data_size size of non_critical data
+ * Records are encoded in place, the spans are as returned by esp_diag_data_store_non_critical_read_spans().
+ *
+ * @param spans spans of non_critical data
+ * @param non_critical_data_size size of non_critical data
  * @return size_t length of data consumed
  */
-size_t esp_insights_encode_non_critical_data(const void *non_critical_data, size_t non_critical_data_size);
+size_t esp_insights_encode_non_critical_data(const esp_diag_data_store_span_t *spans, size_t non_critical_data_size);
 
 /**
  * @brief finish encoding message
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <esp_err.h>
 
 #ifdef CONFIG_ESP_INSIGHTS_TRANSPORT_MQTT
@@ -47,6 +48,41 @@ void esp_insights_transport_disconnect(void);
  */
 int esp_insights_transport_data_send(void *data, size_t len);
 
+/**
+ * @brief Check if the transport supports streamed data send
+ *
+ * @return true if all the streamed data send callbacks are set, false otherwise
+ */
+bool esp_insights_transport_data_stream_supported(void);
+
+/**
+ * @brief Begin streamed data send
+ *
+ * @param[in] len Total length of the message
+ *
+ * @return ESP_OK on success, otherwise appropriate error code
+ */
+esp_err_t esp_insights_transport_data_send_begin(size_t len);
+
+/**
+ * @brief Write data of the streamed data send
+ *
+ * @param[in] data Part of the message
+ * @param[in] len  Length of data
+ *
+ * @return ESP_OK on success, otherwise appropriate error code
+ */
+esp_err_t esp_insights_transport_data_send_write(const void *data, size_t len);
+
+/**
+ * @brief End streamed data send
+ *
+ * @param[in] complete true if the complete message was written, false to abort
+ *
+ * @return msg_id  Same as esp_insights_transport_data_send(), -1 if aborted
+ */
+int esp_insights_transport_data_send_end(bool complete);
+
 /**
  * @brief Send update to the cloud about new state
  */
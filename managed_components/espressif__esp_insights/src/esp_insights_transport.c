@@ -86,3 +86,37 @@ int esp_insights_transport_data_send(void *data, size_t len)
     ESP_LOGW(TAG, "data send callback not set");
     return -1;
 }
+
+bool esp_insights_transport_data_stream_supported(void)
+{
+    return s_priv_data.init && s_priv_data.config.callbacks.data_send_begin
+           && s_priv_data.config.callbacks.data_send_write && s_priv_data.config.callbacks.data_send_end;
+}
+
+esp_err_t esp_insights_transport_data_send_begin(size_t len)
+{
+    CHECK_TRANSPORT_INIT(ESP_ERR_INVALID_STATE);
+    if (!esp_insights_transport_data_stream_supported()) {
+        ESP_LOGW(TAG, "streamed data send callbacks not set");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return s_priv_data.config.callbacks.data_send_begin(len);
+}
+
+esp_err_t esp_insights_transport_data_send_write(const void *data, size_t len)
+{
+    CHECK_TRANSPORT_INIT(ESP_ERR_INVALID_STATE);
+    if (!s_priv_data.config.callbacks.data_send_write) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return s_priv_data.config.callbacks.data_send_write(data, len);
+}
+
+int esp_insights_transport_data_send_end(bool complete)
+{
+    CHECK_TRANSPORT_INIT(-1);
+    if (!s_priv_data.config.callbacks.data_send_end) {
+        return -1;
+    }
+    return s_priv_data.config.callbacks.data_send_end(complete);
+}
@@ -24,6 +24,7 @@ typedef struct {
     const char *auth_key;
     const char *node_id;
     const char *url;
+    esp_http_client_handle_t client;    /* request of the streamed send in progress */
 } https_data_t;
 
 static https_data_t s_https_data;
@@ -49,6 +50,9 @@ static esp_err_t esp_insights_https_init(void *userdata)
 
 static void esp_insights_https_deinit(void)
 {
+    if (s_https_data.client) {
+        esp_http_client_cleanup(s_https_data.client);
+    }
     memset(&s_https_data, 0, sizeof(s_https_data));
 }
 
@@ -85,17 +89,8 @@ static esp_err_t http_event_handle(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-static int esp_insights_https_data_send(void *data, size_t len)
+static esp_http_client_handle_t https_client_create(void)
 {
-    if (!data) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    if (!s_https_data.auth_key) {
-        ESP_LOGE(TAG, "Transport not initialized");
-        return ESP_ERR_INVALID_STATE;
-    }
-
-    int msg_id = -1;
     char url[256];
     memset(url, 0, sizeof(url));
     snprintf(url, sizeof(url), "%s?node_id=%s", s_https_data.url, s_https_data.node_id);
@@ -111,7 +106,7 @@ static int esp_insights_https_data_send(void *data, size_t len)
     esp_http_client_handle_t client = esp_http_client_init(&client_config);
     if (!client) {
         ESP_LOGE(TAG, "Failed to initialize esp_http_client");
-        return msg_id;
+        return NULL;
     }
     esp_err_t err = esp_http_client_set_header(client, "Authorization", s_https_data.auth_key);
     if (err != ESP_OK) {
@@ -123,7 +118,37 @@ static int esp_insights_https_data_send(void *data, size_t len)
         ESP_LOGE(TAG, "Failed to set content type err:0x%x", err);
         goto cleanup;
     }
-    err = esp_http_client_set_post_field(client, data, len);
+    return client;
+cleanup:
+    esp_http_client_cleanup(client);
+    return NULL;
+}
+
+static void https_send_status_post(int msg_id)
+{
+    if (msg_id == 0) {
+        esp_event_post(INSIGHTS_EVENT, INSIGHTS_EVENT_TRANSPORT_SEND_SUCCESS, NULL, 0, portMAX_DELAY);
+    } else {
+        esp_event_post(INSIGHTS_EVENT, INSIGHTS_EVENT_TRANSPORT_SEND_FAILED, NULL, 0, portMAX_DELAY);
+    }
+}
+
+static int esp_insights_https_data_send(void *data, size_t len)
+{
+    if (!data) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_https_data.auth_key) {
+        ESP_LOGE(TAG, "Transport not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int msg_id = -1;
+    esp_http_client_handle_t client = https_client_create();
+    if (!client) {
+        return msg_id;
+    }
+    esp_err_t err = esp_http_client_set_post_field(client, data, len);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "esp_http_client_set_post_field failed err:0x%x", err);
         goto cleanup;
@@ -139,20 +164,90 @@ static int esp_insights_https_data_send(void *data, size_t len)
             ESP_LOGE(TAG, "API response status = %d", status);
         }
     }
-    if (msg_id == 0) {
-        esp_event_post(INSIGHTS_EVENT, INSIGHTS_EVENT_TRANSPORT_SEND_SUCCESS, NULL, 0, portMAX_DELAY);
-    } else {
-        esp_event_post(INSIGHTS_EVENT, INSIGHTS_EVENT_TRANSPORT_SEND_FAILED, NULL, 0, portMAX_DELAY);
-    }
+    https_send_status_post(msg_id);
 cleanup:
     esp_http_client_cleanup(client);
     return msg_id;
 }
 
+/* Streamed send: request is opened with the complete length of the message, so that the body
+ * can be written as it is encoded, without buffering it.
+ */
+static esp_err_t esp_insights_https_data_send_begin(size_t len)
+{
+    if (!s_https_data.auth_key) {
+        ESP_LOGE(TAG, "Transport not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_https_data.client) {
+        ESP_LOGE(TAG, "Previous send not finished");
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_http_client_handle_t client = https_client_create();
+    if (!client) {
+        return ESP_FAIL;
+    }
+    esp_err_t err = esp_http_client_open(client, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_http_client_open failed err:0x%x", err);
+        esp_http_client_cleanup(client);
+        return err;
+    }
+    s_https_data.client = client;
+    return ESP_OK;
+}
+
+static esp_err_t esp_insights_https_data_send_write(const void *data, size_t len)
+{
+    if (!s_https_data.client) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while (len > 0) {
+        int wlen = esp_http_client_write(s_https_data.client, data, len);
+        if (wlen <= 0) {
+            ESP_LOGE(TAG, "esp_http_client_write failed, ret:%d", wlen);
+            return ESP_FAIL;
+        }
+        data = (const uint8_t *)data + wlen;
+        len -= wlen;
+    }
+    return ESP_OK;
+}
+
+static int esp_insights_https_data_send_end(bool complete)
+{
+    int msg_id = -1;
+    esp_http_client_handle_t client = s_https_data.client;
+    if (!client) {
+        return msg_id;
+    }
+    s_https_data.client = NULL;
+    if (complete) {
+        if (esp_http_client_fetch_headers(client) < 0) {
+            ESP_LOGE(TAG, "esp_http_client_fetch_headers failed");
+        } else {
+            int status = esp_http_client_get_status_code(client);
+            if (status == HttpStatus_Ok) {
+                msg_id = 0;
+            } else {
+                ESP_LOGE(TAG, "API response status = %d", status);
+            }
+            esp_http_client_flush_response(client, NULL);
+        }
+        https_send_status_post(msg_id);
+    }
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return msg_id;
+}
+
 esp_insights_transport_config_t g_default_insights_transport_https = {
     .callbacks = {
         .init = esp_insights_https_init,
         .deinit = esp_insights_https_deinit,
         .data_send = esp_insights_https_data_send,
+        .data_send_begin = esp_insights_https_data_send_begin,
+        .data_send_write = esp_insights_https_data_send_write,
+        .data_send_end = esp_insights_https_data_send_end,
     }
 };
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+#
+# SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Extracts the CBOR test vectors (raw("...") literals) of the tinycbor tests to one file per vector.
+# Usage: corpus.py <output dir> <data.cpp>...
+
+import os
+import re
+import sys
+
+RAW_RE = re.compile(r'raw\(((?:\s*"(?:[^"\\]|\\.)*")+)\s*\)')
+LITERAL_RE = re.compile(r'"((?:[^"\\]|\\.)*)"')
+ESCAPES = {'n': 10, 't': 9, 'r': 13, 'a': 7, 'b': 8, 'f': 12, 'v': 11, '\\': 92, '"': 34, "'": 39, '?': 63}
+
+
+def c_string_bytes(literal):
+    out = bytearray()
+    i = 0
+    while i < len(literal):
+        c = literal[i]
+        i += 1
+        if c != '\\':
+            out += c.encode()
+            continue
+        c = literal[i]
+        i += 1
+        if c == 'x':
+            # hex escape takes all the hex digits which follow, as in C
+            j = i
+            while j < len(literal) and literal[j] in '0123456789abcdefABCDEF':
+                j += 1
+            out.append(int(literal[i:j], 16) & 0xff)
+            i = j
+        elif c in '01234567':
+            j = i - 1
+            while j < i + 2 and j < len(literal) and literal[j] in '01234567':
+                j += 1
+            out.append(int(literal[i - 1:j], 8) & 0xff)
+            i = j
+        else:
+            out.append(ESCAPES[c])
+    return bytes(out)
+
+
+def main():
+    out_dir = sys.argv[1]
+    os.makedirs(out_dir, exist_ok=True)
+    vectors = set()
+    for path in sys.argv[2:]:
+        with open(path) as f:
+            for raw in RAW_RE.findall(f.read()):
+                vectors.add(b''.join(c_string_bytes(s) for s in LITERAL_RE.findall(raw)))
+    for n, vector in enumerate(sorted(vectors)):
+        with open(os.path.join(out_dir, '%04d.cbor' % n), 'wb') as f:
+            f.write(vector)
+    print('%d vectors written to %s' % (len(vectors), out_dir))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,534 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Host test for the decoding of Insights commands.
+ * Checks esp_insights_cbor_decode_schema() with the schema of the config command, fuzzes it with the
+ * tinycbor test vectors and mutated commands, and compares its speed and allocations with the walk
+ * done earlier with cbor_parse_ctx_t.
+ * Files given as arguments are decoded one by one, for afl-fuzz.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cbor.h>
+#include "esp_insights_cbor_decoder.h"
+
+#define MAX_CMD_DEPTH       10
+#define CMD_NAME_MAX_LEN    32
+#define MSG_BUF_SIZE        2048
+#define FUZZ_ITERATIONS     200000
+#define MIN_BENCH_NS        200000000ULL
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                   \
+        }                                                               \
+    } while (0)
+
+/* Same as in esp_insights_cmd_resp.c */
+typedef struct {
+    char path[MAX_CMD_DEPTH][CMD_NAME_MAX_LEN];
+    uint8_t depth;
+    bool value;
+} insights_cmd_entry_t;
+
+typedef struct {
+    char ver[16];
+    uint64_t ts;
+    char sha256[65];
+    int cmd_cnt;
+    int skip_cnt;       /* entries which do not fit */
+    insights_cmd_entry_t last;
+} insights_cmd_payload_t;
+
+enum {
+    CMD_ENTRY_FIELD_NAME,
+    CMD_ENTRY_FIELD_VALUE,
+};
+
+enum {
+    CMD_PAYLOAD_FIELD_VER,
+    CMD_PAYLOAD_FIELD_TS,
+    CMD_PAYLOAD_FIELD_SHA256,
+    CMD_PAYLOAD_FIELD_CONFIG,
+};
+
+static const ins_cbor_field_t s_cmd_entry_fields[] = {
+    [CMD_ENTRY_FIELD_NAME] = INS_CBOR_FIELD_TEXT_ARRAY_OF("n", insights_cmd_entry_t, path, depth),
+    [CMD_ENTRY_FIELD_VALUE] = INS_CBOR_FIELD("v", INS_CBOR_FIELD_BOOL, insights_cmd_entry_t, value),
+};
+
+static bool s_entry_invalid;
+
+static esp_err_t cmd_entry_decode(CborValue *elem, void *priv)
+{
+    insights_cmd_payload_t *payload = priv;
+    insights_cmd_entry_t entry = { .depth = 0 };
+    uint32_t found = 0;
+    memset(&entry, 0xa5, sizeof(entry.path));
+    esp_err_t ret = esp_insights_cbor_decode_schema(elem, s_cmd_entry_fields,
+                                                    sizeof(s_cmd_entry_fields) / sizeof(s_cmd_entry_fields[0]),
+                                                    &entry, &found);
+    if (ret == ESP_ERR_INVALID_SIZE) {
+        /* Entry which does not fit is skipped, as by esp_insights_cmd_resp.c */
+        payload->skip_cnt++;
+        return cbor_value_advance(elem) == CborNoError ? ESP_OK : ESP_FAIL;
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    /* Decoded names must be terminated within their buffers */
+    for (int i = 0; (found & (1 << CMD_ENTRY_FIELD_NAME)) && i < entry.depth; i++) {
+        if (entry.depth > MAX_CMD_DEPTH || !memchr(entry.path[i], '\0', CMD_NAME_MAX_LEN)) {
+            s_entry_invalid = true;
+        }
+    }
+    payload->cmd_cnt++;
+    payload->last = entry;
+    return ESP_OK;
+}
+
+static const ins_cbor_field_t s_cmd_payload_fields[] = {
+    [CMD_PAYLOAD_FIELD_VER] = INS_CBOR_FIELD("ver", INS_CBOR_FIELD_TEXT, insights_cmd_payload_t, ver),
+    [CMD_PAYLOAD_FIELD_TS] = INS_CBOR_FIELD("ts", INS_CBOR_FIELD_UINT, insights_cmd_payload_t, ts),
+    [CMD_PAYLOAD_FIELD_SHA256] = INS_CBOR_FIELD("sha256", INS_CBOR_FIELD_TEXT, insights_cmd_payload_t, sha256),
+    [CMD_PAYLOAD_FIELD_CONFIG] = INS_CBOR_FIELD_ARRAY_OF("config", cmd_entry_decode),
+};
+
+static esp_err_t schema_decode(const uint8_t *data, size_t len, insights_cmd_payload_t *payload, uint32_t *found)
+{
+    CborParser parser;
+    CborValue value;
+    memset(payload, 0, sizeof(*payload));
+    if (cbor_parser_init(data, len, 0, &parser, &value) != CborNoError) {
+        return ESP_FAIL;
+    }
+    return esp_insights_cbor_decode_schema(&value, s_cmd_payload_fields,
+                                           sizeof(s_cmd_payload_fields) / sizeof(s_cmd_payload_fields[0]),
+                                           payload, found);
+}
+
+/* Walk done by esp_insights_cmd_resp.c before the schema, returns count of commands */
+static int legacy_decode(const uint8_t *data, size_t len)
+{
+    char buffer[100];
+    size_t buffer_size;
+    CborParser parser;
+    CborValue map, value, next;
+    int cmd_cnt = 0;
+
+    /* check_top_fields_from_cbor() */
+    cbor_parser_init(data, len, 0, &parser, &map);
+    if (!cbor_value_is_map(&map) || cbor_value_enter_container(&map, &value) != CborNoError) {
+        return -1;
+    }
+    while (!cbor_value_at_end(&value)) {
+        if (cbor_value_is_text_string(&value)) {
+            buffer_size = sizeof(buffer);
+            if (cbor_value_copy_text_string(&value, buffer, &buffer_size, &next) != CborNoError) {
+                return -1;
+            }
+            buffer_size = sizeof(buffer);
+            if ((strcmp(buffer, "ver") == 0 || strcmp(buffer, "sha256") == 0) && cbor_value_is_text_string(&next)) {
+                cbor_value_copy_text_string(&next, buffer, &buffer_size, &next);
+            }
+            cbor_value_advance(&value);
+        }
+        cbor_value_advance(&value);
+    }
+
+    /* esp_insights_cmd_resp_iterate_to_cmds_array() */
+    cbor_parse_ctx_t *ctx = esp_insights_cbor_decoder_start(data, len);
+    if (!ctx || esp_insights_cbor_decoder_enter_container(ctx) != ESP_OK) {
+        esp_insights_cbor_decoder_done(ctx);
+        return -1;
+    }
+    bool found = false;
+    while (!found && !esp_insights_cbor_decoder_at_end(ctx)) {
+        char *key = esp_insights_cbor_decoder_get_string(&ctx->it[ctx->curr_itr]);
+        if (!key) {
+            break;
+        }
+        found = strcmp(key, "config") == 0;
+        free(key);
+        if (!found) {
+            esp_insights_cbor_decoder_advance(ctx);
+        }
+    }
+    if (!found) {
+        esp_insights_cbor_decoder_done(ctx);
+        return -1;
+    }
+
+    /* esp_insights_cmd_resp_parse_execute() and esp_insights_cmd_resp_parse_one_entry() */
+    esp_insights_cbor_decoder_enter_container(ctx);
+    while (!esp_insights_cbor_decoder_at_end(ctx)) {
+        esp_insights_cbor_decoder_enter_container(ctx);
+        char *cmd_tree[MAX_CMD_DEPTH] = { 0 };
+        int cmd_depth = 0;
+        while (!esp_insights_cbor_decoder_at_end(ctx)) {
+            CborValue *it = &ctx->it[ctx->curr_itr];
+            if (esp_insights_cbor_decode_get_value_type(ctx) != CborTextStringType) {
+                esp_insights_cbor_decoder_advance(ctx);
+                continue;
+            }
+            char *key = esp_insights_cbor_decoder_get_string(it);
+            if (strcmp(key, "n") == 0 && esp_insights_cbor_decode_get_value_type(ctx) == CborArrayType) {
+                if (esp_insights_cbor_decoder_enter_container(ctx) == ESP_OK) {
+                    while (!esp_insights_cbor_decoder_at_end(ctx) && cmd_depth < MAX_CMD_DEPTH) {
+                        cmd_tree[cmd_depth++] = esp_insights_cbor_decoder_get_string(&ctx->it[ctx->curr_itr]);
+                    }
+                    esp_insights_cbor_decoder_exit_container(ctx);
+                }
+            } else if (strcmp(key, "v") == 0) {
+                bool val;
+                cbor_value_get_boolean(it, &val);
+                cbor_value_advance_fixed(it);
+            } else {
+                esp_insights_cbor_decoder_advance(ctx);
+            }
+            free(key);
+        }
+        for (int i = 0; i < cmd_depth; i++) {
+            free(cmd_tree[i]);
+        }
+        esp_insights_cbor_decoder_exit_container(ctx);
+        cmd_cnt++;
+    }
+    esp_insights_cbor_decoder_exit_container(ctx);
+    esp_insights_cbor_decoder_done(ctx);
+    return cmd_cnt;
+}
+
+/* test_buf2 of esp_insights_cmd_resp.c */
+static const uint8_t s_cmd_payload[] = {
+    0xA4, 0x63, 0x76, 0x65, 0x72, 0x63, 0x32, 0x2E, 0x30, 0x62, 0x74, 0x73,
+    0x1B, 0x00, 0x05, 0xC5, 0x85, 0x48, 0x4E, 0xCF, 0x80, 0x66, 0x73, 0x68,
+    0x61, 0x32, 0x35, 0x36, 0x70, 0x37, 0x63, 0x32, 0x65, 0x64, 0x62, 0x31,
+    0x39, 0x34, 0x39, 0x36, 0x33, 0x39, 0x61, 0x37, 0x33, 0x66, 0x63, 0x6F,
+    0x6E, 0x66, 0x69, 0x67, 0x82, 0xA2, 0x61, 0x6E, 0x83, 0x64, 0x68, 0x65,
+    0x61, 0x70, 0x6A, 0x61, 0x6C, 0x6C, 0x6F, 0x63, 0x5F, 0x66, 0x61, 0x69,
+    0x6C, 0x66, 0x65, 0x6E, 0x61, 0x62, 0x6C, 0x65, 0x61, 0x76, 0xF5, 0xA2,
+    0x61, 0x6E, 0x82, 0x64, 0x77, 0x69, 0x66, 0x69, 0x66, 0x65, 0x6E, 0x61,
+    0x62, 0x6C, 0x65, 0x61, 0x76, 0xF5,
+};
+
+static const char *s_cmd_names[][3] = {
+    {"heap", "alloc_fail", "enable"}, {"heap", "free", "enable"}, {"wifi", "enable"}, {"metrics", "enable"},
+    {"params", "enable"}, {"reboot"}, {"heap", "lfb", "enable"}, {"wifi", "rssi", "enable"},
+};
+
+/* Command payload with cnt entries, as sent by the cloud */
+static size_t cmd_payload_encode(uint8_t *buf, size_t size, int cnt, const char *extra_key)
+{
+    CborEncoder encoder, map, config, entry, name;
+    cbor_encoder_init(&encoder, buf, size, 0);
+    cbor_encoder_create_map(&encoder, &map, CborIndefiniteLength);
+    cbor_encode_text_stringz(&map, "ver");
+    cbor_encode_text_stringz(&map, "2.0");
+    cbor_encode_text_stringz(&map, "ts");
+    cbor_encode_uint(&map, 1700000000000000ULL);
+    cbor_encode_text_stringz(&map, "sha256");
+    cbor_encode_text_stringz(&map, "7c2edb1949639a73");
+    if (extra_key) {
+        cbor_encode_text_stringz(&map, extra_key);
+        cbor_encode_int(&map, -1);
+    }
+    cbor_encode_text_stringz(&map, "config");
+    cbor_encoder_create_array(&map, &config, cnt);
+    for (int i = 0; i < cnt; i++) {
+        const char **names = s_cmd_names[i % (sizeof(s_cmd_names) / sizeof(s_cmd_names[0]))];
+        int depth = 0;
+        while (depth < 3 && names[depth]) {
+            depth++;
+        }
+        cbor_encoder_create_map(&config, &entry, 2);
+        cbor_encode_text_stringz(&entry, "n");
+        cbor_encoder_create_array(&entry, &name, depth);
+        for (int j = 0; j < depth; j++) {
+            cbor_encode_text_stringz(&name, names[j]);
+        }
+        cbor_encoder_close_container(&entry, &name);
+        cbor_encode_text_stringz(&entry, "v");
+        cbor_encode_boolean(&entry, i % 2);
+        cbor_encoder_close_container(&config, &entry);
+    }
+    cbor_encoder_close_container(&map, &config);
+    cbor_encoder_close_container(&encoder, &map);
+    return cbor_encoder_get_extra_bytes_needed(&encoder) ? 0 : cbor_encoder_get_buffer_size(&encoder, buf);
+}
+
+static int decode_checks(void)
+{
+    static uint8_t buf[MSG_BUF_SIZE];
+    insights_cmd_payload_t payload;
+    uint32_t found;
+    const uint32_t all = (1 << CMD_PAYLOAD_FIELD_VER) | (1 << CMD_PAYLOAD_FIELD_TS) |
+                         (1 << CMD_PAYLOAD_FIELD_SHA256) | (1 << CMD_PAYLOAD_FIELD_CONFIG);
+
+    CHECK(schema_decode(s_cmd_payload, sizeof(s_cmd_payload), &payload, &found) == ESP_OK);
+    CHECK(found == all);
+    CHECK(strcmp(payload.ver, "2.0") == 0 && strcmp(payload.sha256, "7c2edb1949639a73") == 0);
+    CHECK(payload.ts == 0x0005C585484ECF80ULL);
+    CHECK(payload.cmd_cnt == 2 && payload.last.depth == 2 && payload.last.value);
+    CHECK(strcmp(payload.last.path[0], "wifi") == 0 && strcmp(payload.last.path[1], "enable") == 0);
+    CHECK(legacy_decode(s_cmd_payload, sizeof(s_cmd_payload)) == 2);
+
+    /* Unknown keys, also longer than INS_CBOR_SCHEMA_KEY_MAX_LEN, are skipped */
+    size_t len = cmd_payload_encode(buf, sizeof(buf), 8, "a_key_longer_than_fifteen");
+    CHECK(schema_decode(buf, len, &payload, &found) == ESP_OK && found == all && payload.cmd_cnt == 8);
+    CHECK(strcmp(payload.last.path[2], "enable") == 0 && strcmp(payload.last.path[1], "rssi") == 0);
+
+    /* Value of unexpected type is skipped */
+    const uint8_t wrong_type[] = {0xA2, 0x63, 'v', 'e', 'r', 0x01, 0x66, 'c', 'o', 'n', 'f', 'i', 'g', 0x80};
+    CHECK(schema_decode(wrong_type, sizeof(wrong_type), &payload, &found) == ESP_OK);
+    CHECK(found == (1 << CMD_PAYLOAD_FIELD_CONFIG) && payload.cmd_cnt == 0);
+
+    /* Indefinite length map and chunked strings */
+    const uint8_t chunked[] = {0xBF, 0x7F, 0x62, 'v', 'e', 0x61, 'r', 0xFF, 0x7F, 0x62, '2', '.', 0x61, '0', 0xFF, 0xFF};
+    CHECK(schema_decode(chunked, sizeof(chunked), &payload, &found) == ESP_OK);
+    CHECK(found == (1 << CMD_PAYLOAD_FIELD_VER) && strcmp(payload.ver, "2.0") == 0);
+
+    /* Text which does not fit is skipped, the rest of the map is decoded */
+    const uint8_t long_ver[] = {0xA2, 0x63, 'v', 'e', 'r', 0x70, '0', '1', '2', '3', '4', '5', '6', '7',
+                                '8', '9', 'a', 'b', 'c', 'd', 'e', 'f', 0x62, 't', 's', 0x01};
+    CHECK(schema_decode(long_ver, sizeof(long_ver), &payload, &found) == ESP_OK);
+    CHECK(found == (1 << CMD_PAYLOAD_FIELD_TS) && payload.ver[0] == '\0' && payload.ts == 1);
+    const uint8_t max_ver[] = {0xA1, 0x63, 'v', 'e', 'r', 0x6F, '0', '1', '2', '3', '4', '5', '6', '7',
+                               '8', '9', 'a', 'b', 'c', 'd', 'e'};
+    CHECK(schema_decode(max_ver, sizeof(max_ver), &payload, &found) == ESP_OK && strlen(payload.ver) == 15);
+
+    /* Command deeper than MAX_CMD_DEPTH */
+    uint8_t deep[128] = {0xA1, 0x66, 'c', 'o', 'n', 'f', 'i', 'g', 0x81, 0xA1, 0x61, 'n', 0x80 | (MAX_CMD_DEPTH + 1)};
+    len = 13;
+    for (int i = 0; i <= MAX_CMD_DEPTH; i++) {
+        deep[len++] = 0x61;
+        deep[len++] = 'a' + i;
+    }
+    CHECK(schema_decode(deep, len, &payload, &found) == ESP_OK && payload.cmd_cnt == 0 && payload.skip_cnt == 1);
+    deep[12]--;
+    CHECK(schema_decode(deep, len - 2, &payload, &found) == ESP_OK && payload.last.depth == MAX_CMD_DEPTH);
+
+    /* Entries which do not fit are skipped, the valid entry after them is decoded */
+    deep[8] = 0x83;
+    deep[12]++;
+    const uint8_t long_name[] = {0xA1, 0x61, 'n', 0x81, 0x78, CMD_NAME_MAX_LEN};
+    memcpy(deep + len, long_name, sizeof(long_name));
+    len += sizeof(long_name);
+    memset(deep + len, 'x', CMD_NAME_MAX_LEN);
+    len += CMD_NAME_MAX_LEN;
+    const uint8_t valid[] = {0xA2, 0x61, 'n', 0x81, 0x64, 'w', 'i', 'f', 'i', 0x61, 'v', 0xF5};
+    CHECK(len + sizeof(valid) <= sizeof(deep));
+    memcpy(deep + len, valid, sizeof(valid));
+    len += sizeof(valid);
+    CHECK(schema_decode(deep, len, &payload, &found) == ESP_OK && found == (1 << CMD_PAYLOAD_FIELD_CONFIG));
+    CHECK(payload.skip_cnt == 2 && payload.cmd_cnt == 1 && payload.last.depth == 1 && payload.last.value);
+    CHECK(strcmp(payload.last.path[0], "wifi") == 0);
+
+    /* Integer which does not fit in the member */
+    struct {
+        uint8_t u8;
+        uint32_t u32;
+    } small;
+    const ins_cbor_field_t small_fields[] = {
+        INS_CBOR_FIELD("a", INS_CBOR_FIELD_UINT, __typeof__(small), u8),
+        INS_CBOR_FIELD("b", INS_CBOR_FIELD_UINT, __typeof__(small), u32),
+    };
+    const uint8_t small_ok[] = {0xA2, 0x61, 'a', 0x18, 0xFF, 0x61, 'b', 0x1A, 0xFF, 0xFF, 0xFF, 0xFF};
+    const uint8_t small_big[] = {0xA1, 0x61, 'a', 0x19, 0x01, 0x00};
+    CborParser parser;
+    CborValue value;
+    cbor_parser_init(small_ok, sizeof(small_ok), 0, &parser, &value);
+    CHECK(esp_insights_cbor_decode_schema(&value, small_fields, 2, &small, &found) == ESP_OK && found == 3);
+    CHECK(small.u8 == 0xFF && small.u32 == UINT32_MAX);
+    cbor_parser_init(small_big, sizeof(small_big), 0, &parser, &value);
+    CHECK(esp_insights_cbor_decode_schema(&value, small_fields, 2, &small, &found) == ESP_ERR_INVALID_SIZE);
+
+    /* Truncated payloads */
+    for (size_t i = 0; i < sizeof(s_cmd_payload); i++) {
+        CHECK(schema_decode(s_cmd_payload, i, &payload, &found) != ESP_OK);
+    }
+    printf("decode checks passed\n");
+    return 0;
+}
+
+static uint32_t s_rand = 1;
+
+static uint32_t fuzz_rand(void)
+{
+    s_rand = s_rand * 1103515245 + 12345;
+    return s_rand >> 8;
+}
+
+static void fuzz_one(const uint8_t *data, size_t len)
+{
+    static uint8_t buf[MSG_BUF_SIZE + 64];
+    insights_cmd_payload_t payload;
+    uint32_t found;
+    schema_decode(data, len, &payload, &found);
+    if (len > MSG_BUF_SIZE) {
+        return;
+    }
+    /* The vector as every value of the payload, and as the name and value of a command */
+    const uint8_t prefix[] = {0xA4, 0x63, 'v', 'e', 'r'};
+    const uint8_t cmd_prefix[] = {0x66, 'c', 'o', 'n', 'f', 'i', 'g', 0x81, 0xA2, 0x61, 'n'};
+    size_t n = 0;
+    memcpy(buf, prefix, sizeof(prefix));
+    n += sizeof(prefix);
+    memcpy(buf + n, data, len);
+    n += len;
+    memcpy(buf + n, "\x62ts", 3);
+    n += 3;
+    memcpy(buf + n, data, len);
+    n += len;
+    memcpy(buf + n, cmd_prefix, sizeof(cmd_prefix));
+    n += sizeof(cmd_prefix);
+    memcpy(buf + n, data, len);
+    n += len;
+    memcpy(buf + n, "\x61v", 2);
+    n += 2;
+    memcpy(buf + n, data, len);
+    n += len;
+    schema_decode(buf, n, &payload, &found);
+}
+
+static int fuzz_files(int cnt, char **files)
+{
+    static uint8_t data[MSG_BUF_SIZE * 4];
+    for (int i = 0; i < cnt; i++) {
+        FILE *f = fopen(files[i], "rb");
+        if (!f) {
+            printf("Failed to open %s\n", files[i]);
+            return 1;
+        }
+        size_t len = fread(data, 1, sizeof(data), f);
+        fclose(f);
+        fuzz_one(data, len);
+    }
+    if (s_entry_invalid) {
+        printf("Decoded command is invalid\n");
+        return 1;
+    }
+    printf("%d files decoded\n", cnt);
+    return 0;
+}
+
+static int fuzz_mutations(void)
+{
+    static uint8_t valid[MSG_BUF_SIZE], buf[MSG_BUF_SIZE];
+    size_t valid_len = cmd_payload_encode(valid, sizeof(valid), 6, "unknown");
+    int decoded = 0;
+    for (int i = 0; i < FUZZ_ITERATIONS; i++) {
+        insights_cmd_payload_t payload;
+        uint32_t found;
+        size_t len = valid_len;
+        memcpy(buf, valid, len);
+        for (int m = fuzz_rand() % 4; m >= 0; m--) {
+            size_t pos = fuzz_rand() % len;
+            switch (fuzz_rand() % 4) {
+            case 0:
+                buf[pos] ^= 1 << (fuzz_rand() % 8);
+                break;
+            case 1:
+                buf[pos] = fuzz_rand();
+                break;
+            case 2:
+                /* header bytes of the CBOR items */
+                buf[pos] = (fuzz_rand() % 8) << 5 | (24 + fuzz_rand() % 8);
+                break;
+            default:
+                len = pos + 1;
+                break;
+            }
+        }
+        if (schema_decode(buf, len, &payload, &found) == ESP_OK) {
+            decoded++;
+        }
+    }
+    if (s_entry_invalid) {
+        printf("Decoded command is invalid\n");
+        return 1;
+    }
+    printf("%d mutations, %d decoded\n", FUZZ_ITERATIONS, decoded);
+    return 0;
+}
+
+#ifndef __SANITIZE_ADDRESS__
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Count the allocations, glibc only */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+static size_t s_alloc_cnt;
+
+void *malloc(size_t size)
+{
+    s_alloc_cnt++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    s_alloc_cnt++;
+    return __libc_calloc(n, size);
+}
+
+static void bench(void)
+{
+    static uint8_t buf[MSG_BUF_SIZE];
+    const int cmds[] = {2, 8, 32};
+
+    printf("%6s %8s %12s %10s %12s %10s\n", "cmds", "len", "legacy ns", "allocs", "schema ns", "allocs");
+    for (size_t c = 0; c < sizeof(cmds) / sizeof(cmds[0]); c++) {
+        size_t len = cmd_payload_encode(buf, sizeof(buf), cmds[c], NULL);
+        uint64_t ns[2];
+        size_t allocs[2];
+        for (int mode = 0; mode < 2; mode++) {
+            insights_cmd_payload_t payload;
+            uint32_t found;
+            uint64_t iter = 0, start = now_ns(), elapsed;
+            size_t alloc_start = s_alloc_cnt;
+            do {
+                if (mode == 0) {
+                    legacy_decode(buf, len);
+                } else {
+                    schema_decode(buf, len, &payload, &found);
+                }
+                iter++;
+                elapsed = now_ns() - start;
+            } while (elapsed < MIN_BENCH_NS);
+            ns[mode] = elapsed / iter;
+            allocs[mode] = (s_alloc_cnt - alloc_start) / iter;
+        }
+        printf("%6d %8zu %12llu %10zu %12llu %10zu\n", cmds[c], len, (unsigned long long)ns[0], allocs[0],
+               (unsigned long long)ns[1], allocs[1]);
+    }
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        return fuzz_files(argc - 1, argv + 1);
+    }
+    if (decode_checks() || fuzz_mutations()) {
+        printf("FAIL\n");
+        return 1;
+    }
+#ifndef __SANITIZE_ADDRESS__
+    bench();
+#endif
+    printf("PASS\n");
+    return 0;
+}
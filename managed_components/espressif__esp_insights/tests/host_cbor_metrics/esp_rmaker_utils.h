@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Minimal esp_rmaker_utils.h for the host build */
+#pragma once
+
+#include <stdlib.h>
+
+#define MEM_ALLOC_EXTRAM(size) malloc(size)
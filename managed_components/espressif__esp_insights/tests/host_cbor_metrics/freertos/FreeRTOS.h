@@ -0,0 +1,14 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Minimal FreeRTOS.h for the host build */
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+
+#define pdTICKS_TO_MS(ticks) (ticks)
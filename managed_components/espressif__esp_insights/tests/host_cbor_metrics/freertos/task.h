@@ -0,0 +1,15 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Minimal task.h for the host build */
+#pragma once
+
+#include "FreeRTOS.h"
+
+static inline TickType_t xTaskGetTickCount(void)
+{
+    return 0;
+}
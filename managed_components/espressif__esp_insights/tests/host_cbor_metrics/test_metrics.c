@@ -0,0 +1,454 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Host test for the encoding of metrics.
+ * Encodes the metrics records as they are read from the data store and prints the message size and
+ * encode time. With CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS, decodes the typed arrays back and
+ * checks that every sample is encoded.
+ *
+ * Every message is also encoded in a buffer of its exact size, where the last records go through the
+ * generic encoder, and with a writer, and must be the same. With a file name argument, messages are
+ * written to the file, to compare the output of CONFIG_ESP_INSIGHTS_CBOR_FAST_PATH with the generic one.
+ *
+ * Records are encoded in place as in the data store, the message must be the same for the records
+ * split at any offset across the wrap point of the store.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cbor.h>
+#include <esp_diagnostics.h>
+#include <rtc_store.h>
+#include "esp_insights_cbor_encoder.h"
+#include "esp_insights_cbor_decoder.h"
+
+#define MSG_BUF_SIZE        16384
+#define RECORDS_BUF_SIZE    16384
+#define META_IDX            3
+#define MIN_BENCH_NS        200000000ULL
+
+typedef struct {
+    const char *tag;
+    const char *key;
+    esp_diag_data_type_t data_type;
+} series_t;
+
+static const series_t s_series_list[] = {
+    {"heap", "free", ESP_DIAG_DATA_TYPE_UINT},
+    {"heap", "lfb", ESP_DIAG_DATA_TYPE_UINT},
+    {"wifi", "rssi", ESP_DIAG_DATA_TYPE_INT},
+    {"app", "temp", ESP_DIAG_DATA_TYPE_FLOAT},
+    {"app", "relay", ESP_DIAG_DATA_TYPE_BOOL},
+};
+#define SERIES_CNT (sizeof(s_series_list) / sizeof(s_series_list[0]))
+
+static uint8_t s_records[RECORDS_BUF_SIZE];
+static uint8_t s_var_records[RECORDS_BUF_SIZE];
+static esp_diag_data_pt_t s_samples[RECORDS_BUF_SIZE / sizeof(esp_diag_data_pt_t)];
+static size_t s_sample_cnt;
+static size_t s_wrap_offset;    // records are in one span if 0
+
+#define WRAP_FILL   0xa5
+
+/* Stubs for the functions encoder uses */
+uint64_t esp_diag_timestamp_get(void)
+{
+    return 1700000000000000ULL;
+}
+
+rtc_store_meta_header_t *rtc_store_get_meta_record_current(void)
+{
+    static rtc_store_meta_header_t hdr;
+    return &hdr;
+}
+
+/* Records of samples of every series taken every period_us, interleaved as they are reported */
+static size_t records_fill(int samples_per_series, uint32_t period_us)
+{
+    size_t len = 0;
+    uint64_t ts = 1700000000000000ULL;
+    s_sample_cnt = 0;
+    for (int n = 0; n < samples_per_series; n++) {
+        for (size_t s = 0; s < SERIES_CNT; s++) {
+            esp_diag_data_pt_t pt = { 0 };
+            rtc_store_non_critical_data_hdr_t hdr = { .len = sizeof(pt) };
+            if (len + 1 + sizeof(hdr) + sizeof(pt) > sizeof(s_records)) {
+                return len;
+            }
+            pt.type = ESP_DIAG_DATA_PT_METRICS;
+            pt.data_type = s_series_list[s].data_type;
+            snprintf(pt.tag, sizeof(pt.tag), "%s", s_series_list[s].tag);
+            snprintf(pt.key, sizeof(pt.key), "%s", s_series_list[s].key);
+            pt.ts = ts + s * 1000;
+            switch (pt.data_type) {
+            case ESP_DIAG_DATA_TYPE_UINT:
+                pt.value.u = 150000 + (rand() % 20000);
+                break;
+            case ESP_DIAG_DATA_TYPE_INT:
+                pt.value.i = -40 - (rand() % 40);
+                break;
+            case ESP_DIAG_DATA_TYPE_FLOAT:
+                pt.value.f = 20.0f + (rand() % 1000) / 100.0f;
+                break;
+            default:
+                pt.value.b = rand() % 2;
+                break;
+            }
+            s_records[len++] = META_IDX;
+            memcpy(s_records + len, &hdr, sizeof(hdr));
+            len += sizeof(hdr);
+            memcpy(s_records + len, &pt, sizeof(pt));
+            len += sizeof(pt);
+            s_samples[s_sample_cnt++] = pt;
+        }
+        ts += period_us;
+    }
+    return len;
+}
+
+static size_t record_add(uint8_t *records, size_t len, const void *pt, size_t pt_len)
+{
+    rtc_store_non_critical_data_hdr_t hdr = { .len = pt_len };
+    records[len++] = META_IDX;
+    memcpy(records + len, &hdr, sizeof(hdr));
+    len += sizeof(hdr);
+    memcpy(records + len, pt, pt_len);
+    return len + pt_len;
+}
+
+/* Variables of every data type, with the values at the edges of the integer encodings */
+static size_t variables_fill(void)
+{
+    static const uint32_t uints[] = {0, 23, 24, 255, 256, 65535, 65536, UINT32_MAX};
+    static const int32_t ints[] = {-1, -24, -25, -256, -257, -65537, INT32_MIN, INT32_MAX};
+    static const char *strs[] = {"", "on", "connected to the access point", "0123456789abcdef0123456789abcdef"};
+    size_t len = 0;
+    uint64_t ts = 1700000000000000ULL;
+    for (size_t n = 0; n < sizeof(uints) / sizeof(uints[0]); n++) {
+        esp_diag_data_pt_t pt = { .type = ESP_DIAG_DATA_PT_VARIABLE, .ts = ts++ };
+        snprintf(pt.tag, sizeof(pt.tag), "wifi");
+        snprintf(pt.key, sizeof(pt.key), "u%zu", n);
+        pt.data_type = ESP_DIAG_DATA_TYPE_UINT;
+        pt.value.u = uints[n];
+        len = record_add(s_var_records, len, &pt, sizeof(pt));
+        snprintf(pt.key, sizeof(pt.key), "i%zu", n);
+        pt.data_type = ESP_DIAG_DATA_TYPE_INT;
+        pt.value.i = ints[n];
+        len = record_add(s_var_records, len, &pt, sizeof(pt));
+        // longest key
+        memset(pt.key, 'k', sizeof(pt.key) - 1);
+        pt.data_type = n % 2 ? ESP_DIAG_DATA_TYPE_BOOL : ESP_DIAG_DATA_TYPE_FLOAT;
+        memset(&pt.value, 0, sizeof(pt.value));
+        if (n % 2) {
+            pt.value.b = n % 4 == 1;
+        } else {
+            pt.value.f = -1.5f * n;
+        }
+        len = record_add(s_var_records, len, &pt, sizeof(pt));
+        snprintf(pt.key, sizeof(pt.key), "ip");
+        pt.data_type = ESP_DIAG_DATA_TYPE_IPv4;
+        pt.value.ipv4 = 0x0101a8c0 + n;
+        len = record_add(s_var_records, len, &pt, sizeof(pt));
+        snprintf(pt.key, sizeof(pt.key), "bssid");
+        pt.data_type = ESP_DIAG_DATA_TYPE_MAC;
+        memcpy(pt.value.mac, "\x24\x0a\xc4\x00\x01\x02", 6);
+        pt.value.mac[5] += n;
+        len = record_add(s_var_records, len, &pt, sizeof(pt));
+    }
+    for (size_t n = 0; n < sizeof(strs) / sizeof(strs[0]); n++) {
+        esp_diag_str_data_pt_t pt = { .type = ESP_DIAG_DATA_PT_VARIABLE, .data_type = ESP_DIAG_DATA_TYPE_STR };
+        pt.ts = ts + (n << 40); // timestamps of every width
+        snprintf(pt.tag, sizeof(pt.tag), "app");
+        snprintf(pt.key, sizeof(pt.key), "s%zu", n);
+        memcpy(pt.value.str, strs[n], strlen(strs[n]));
+        len = record_add(s_var_records, len, &pt, sizeof(pt));
+    }
+    return len;
+}
+
+/* Spans of the records as read from the store, wrapped at s_wrap_offset */
+static void spans_get(const uint8_t *records, size_t len, esp_diag_data_store_span_t *spans)
+{
+    // both sides are copied to buffers followed by filler, reads past the end of a span are caught
+    static uint8_t head[RECORDS_BUF_SIZE + 64], tail[RECORDS_BUF_SIZE + 64];
+    memset(spans, 0, ESP_DIAG_DATA_STORE_MAX_SPANS * sizeof(spans[0]));
+    if (!s_wrap_offset) {
+        spans[0].ptr = records;
+        spans[0].len = len;
+        return;
+    }
+    memset(head, WRAP_FILL, sizeof(head));
+    memset(tail, WRAP_FILL, sizeof(tail));
+    memcpy(head, records, s_wrap_offset);
+    memcpy(tail, records + s_wrap_offset, len - s_wrap_offset);
+    spans[0].ptr = head;
+    spans[0].len = s_wrap_offset;
+    spans[1].ptr = tail;
+    spans[1].len = len - s_wrap_offset;
+}
+
+static size_t encode(uint8_t *buf, size_t size, size_t records_len, size_t *consumed)
+{
+    esp_diag_data_store_span_t spans[ESP_DIAG_DATA_STORE_MAX_SPANS];
+    spans_get(s_records, records_len, spans);
+    esp_insights_cbor_encode_diag_begin(buf, size, "1.1");
+    esp_insights_cbor_encode_diag_data_begin();
+    *consumed = esp_insights_cbor_encode_diag_metrics(spans, records_len);
+    esp_insights_cbor_encode_diag_data_end();
+    return esp_insights_cbor_encode_diag_end(buf);
+}
+
+static size_t encode_variables(uint8_t *buf, size_t size, size_t records_len, size_t *consumed)
+{
+    esp_diag_data_store_span_t spans[ESP_DIAG_DATA_STORE_MAX_SPANS];
+    spans_get(s_var_records, records_len, spans);
+    esp_insights_cbor_encode_diag_begin(buf, size, "1.1");
+    esp_insights_cbor_encode_diag_data_begin();
+    *consumed = esp_insights_cbor_encode_diag_variables(spans, records_len);
+    esp_insights_cbor_encode_diag_data_end();
+    return esp_insights_cbor_encode_diag_end(buf);
+}
+
+typedef size_t (*encode_fn_t)(uint8_t *buf, size_t size, size_t records_len, size_t *consumed);
+
+typedef struct {
+    uint8_t buf[MSG_BUF_SIZE];
+    size_t len;
+} mem_writer_t;
+
+static CborError mem_write(void *token, const void *data, size_t len, CborEncoderAppendType type)
+{
+    mem_writer_t *w = token;
+    if (w->len + len > sizeof(w->buf)) {
+        return CborErrorOutOfMemory;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+    return CborNoError;
+}
+
+/* Encodes the message again in a buffer of its exact size and with a writer, both must be the same */
+static bool same_check(encode_fn_t fn, const uint8_t *msg, size_t len, size_t records_len)
+{
+    static uint8_t exact[MSG_BUF_SIZE];
+    static mem_writer_t w;
+    size_t consumed;
+    if (fn(exact, len, records_len, &consumed) != len || memcmp(exact, msg, len)) {
+        printf("Message encoded in a buffer of its size differs\n");
+        return false;
+    }
+    w.len = 0;
+    esp_insights_cbor_encoder_set_writer(mem_write, &w, esp_diag_timestamp_get());
+    fn(NULL, 0, records_len, &consumed);
+    esp_insights_cbor_encoder_set_writer(NULL, NULL, 0);
+    if (w.len != len || memcmp(w.buf, msg, len)) {
+        printf("Message encoded with the writer differs\n");
+        return false;
+    }
+    return true;
+}
+
+/* Encodes the records wrapped at every offset, message must be the same as of the records in one span */
+static bool wrap_check(encode_fn_t fn, const uint8_t *msg, size_t len, size_t records_len)
+{
+    static uint8_t wrapped[MSG_BUF_SIZE];
+    size_t consumed;
+    bool ok = true;
+    for (s_wrap_offset = 1; s_wrap_offset < records_len && ok; s_wrap_offset++) {
+        if (fn(wrapped, sizeof(wrapped), records_len, &consumed) != len || memcmp(wrapped, msg, len)
+            || consumed != records_len) {
+            printf("Message of the records wrapped at %zu differs\n", s_wrap_offset);
+            ok = false;
+        }
+    }
+    s_wrap_offset = 0;
+    return ok;
+}
+
+#if CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS
+static bool text_equal(CborValue *val, const char *str)
+{
+    bool equal = false;
+    return cbor_value_text_string_equals(val, str, &equal) == CborNoError && equal;
+}
+
+/* Checks one element of metrics, series or a single data point, marks the samples found in the records */
+static bool series_check(CborValue *elem, bool *found)
+{
+    CborValue n, t0, t, v, name;
+    uint64_t ts0 = 0;
+    uint32_t ts[INSIGHTS_METRICS_SERIES_MAX_SAMPLES] = { 0 };
+    uint32_t val[INSIGHTS_METRICS_SERIES_MAX_SAMPLES] = { 0 };
+    size_t ts_len = sizeof(ts), val_len = sizeof(val);
+    CborTag ts_tag = INSIGHTS_CBOR_TAG_TA_UINT32_LE, val_tag = INSIGHTS_CBOR_TAG_TA_UINT32_LE;
+
+    cbor_value_map_find_value(elem, "n", &n);
+    cbor_value_map_find_value(elem, "t", &t);
+    cbor_value_map_find_value(elem, "v", &v);
+    cbor_value_map_find_value(elem, "t0", &t0);
+    if (cbor_value_is_valid(&t0)) {
+        cbor_value_get_uint64(&t0, &ts0);
+        if (esp_insights_cbor_decode_typed_array(&t, &ts_tag, ts, &ts_len) != ESP_OK ||
+                esp_insights_cbor_decode_typed_array(&v, &val_tag, val, &val_len) != ESP_OK ||
+                ts_tag != INSIGHTS_CBOR_TAG_TA_UINT32_LE) {
+            printf("Failed to decode typed arrays\n");
+            return false;
+        }
+    } else {
+        // single sample is encoded as a data point
+        cbor_value_get_uint64(&t, &ts0);
+        ts_len = sizeof(ts[0]);
+        val_len = sizeof(val[0]);
+        if (cbor_value_is_boolean(&v)) {
+            bool b;
+            cbor_value_get_boolean(&v, &b);
+            val[0] = b;
+            val_tag = INSIGHTS_CBOR_TAG_TA_UINT8;
+            val_len = 1;
+        } else if (cbor_value_is_float(&v)) {
+            cbor_value_get_float(&v, (float *) &val[0]);
+        } else {
+            int64_t i;
+            cbor_value_get_int64(&v, &i);
+            val[0] = (uint32_t) i;
+        }
+    }
+    size_t cnt = ts_len / sizeof(ts[0]);
+    size_t val_size = (val_tag == INSIGHTS_CBOR_TAG_TA_UINT8) ? 1 : 4;
+    if (val_len != cnt * val_size) {
+        printf("Count of timestamps %zu and values %zu differ\n", cnt, val_len / val_size);
+        return false;
+    }
+    // "n": ["M", tag, key]
+    cbor_value_enter_container(&n, &name);
+    cbor_value_advance(&name);
+    for (size_t k = 0; k < cnt; k++) {
+        size_t i;
+        for (i = 0; i < s_sample_cnt; i++) {
+            esp_diag_data_pt_t *pt = &s_samples[i];
+            uint32_t expected = (pt->data_type == ESP_DIAG_DATA_TYPE_BOOL) ? pt->value.b : pt->value.u;
+            uint32_t decoded = 0;
+            memcpy(&decoded, (uint8_t *) val + k * val_size, val_size);
+            CborValue tag_val = name, key_val;
+            if (found[i] || pt->ts != ts0 + ts[k] || decoded != expected || !text_equal(&tag_val, pt->tag)) {
+                continue;
+            }
+            cbor_value_advance(&tag_val);
+            key_val = tag_val;
+            if (text_equal(&key_val, pt->key)) {
+                found[i] = true;
+                break;
+            }
+        }
+        if (i == s_sample_cnt) {
+            printf("Decoded sample %zu of series not found in the records\n", k);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool round_trip_check(const uint8_t *buf, size_t len)
+{
+    static bool found[sizeof(s_samples) / sizeof(s_samples[0])];
+    CborParser parser;
+    CborValue root, diag, data, metrics, elem;
+    memset(found, 0, sizeof(found));
+    if (cbor_parser_init(buf, len, 0, &parser, &root) != CborNoError ||
+            cbor_value_map_find_value(&root, "diag", &diag) != CborNoError ||
+            cbor_value_map_find_value(&diag, "data", &data) != CborNoError ||
+            cbor_value_map_find_value(&data, "metrics", &metrics) != CborNoError ||
+            cbor_value_enter_container(&metrics, &elem) != CborNoError) {
+        printf("Failed to parse the message\n");
+        return false;
+    }
+    while (!cbor_value_at_end(&elem)) {
+        if (!series_check(&elem, found)) {
+            return false;
+        }
+        cbor_value_advance(&elem);
+    }
+    for (size_t i = 0; i < s_sample_cnt; i++) {
+        if (!found[i]) {
+            printf("Sample %zu is not encoded\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+#endif /* CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    static uint8_t buf[MSG_BUF_SIZE];
+    const int samples[] = {1, 4, 16, 64};
+    int ret = 0;
+    FILE *out = NULL;
+
+    if (argc > 1 && !(out = fopen(argv[1], "wb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+    printf("%s, %s encoder\n", CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS ? "typed arrays" : "maps",
+           CONFIG_ESP_INSIGHTS_CBOR_FAST_PATH ? "fast path" : "generic");
+    printf("%8s %8s %10s %10s %12s\n", "samples", "records", "msg len", "ns/sample", "samples/s");
+    for (size_t n = 0; n < sizeof(samples) / sizeof(samples[0]); n++) {
+        size_t consumed;
+        srand(n);
+        size_t records_len = records_fill(samples[n], 100000);
+        size_t len = encode(buf, sizeof(buf), records_len, &consumed);
+        if (len == 0 || consumed != records_len) {
+            printf("Failed to encode %zu samples, consumed %zu of %zu\n", s_sample_cnt, consumed, records_len);
+            ret = 1;
+            continue;
+        }
+#if CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS
+        if (!round_trip_check(buf, len)) {
+            ret = 1;
+            continue;
+        }
+#endif
+        if (!same_check(encode, buf, len, records_len) || !wrap_check(encode, buf, len, records_len)) {
+            ret = 1;
+            continue;
+        }
+        if (out) {
+            fwrite(buf, 1, len, out);
+        }
+        uint64_t iter = 0, start = now_ns(), elapsed;
+        do {
+            encode(buf, sizeof(buf), records_len, &consumed);
+            iter++;
+            elapsed = now_ns() - start;
+        } while (elapsed < MIN_BENCH_NS);
+        double ns = (double)elapsed / iter / s_sample_cnt;
+        printf("%8zu %8zu %10zu %10.0f %12.0f\n", s_sample_cnt, records_len, len, ns, 1e9 / ns);
+    }
+
+    size_t consumed, records_len = variables_fill();
+    size_t len = encode_variables(buf, sizeof(buf), records_len, &consumed);
+    if (len == 0 || consumed != records_len || !same_check(encode_variables, buf, len, records_len)
+        || !wrap_check(encode_variables, buf, len, records_len)) {
+        printf("Failed to encode variables, consumed %zu of %zu\n", consumed, records_len);
+        ret = 1;
+    } else if (out) {
+        fwrite(buf, 1, len, out);
+    }
+    if (out) {
+        fclose(out);
+    }
+    printf("%s\n", ret ? "FAIL" : "PASS");
+    return ret;
+}
@@ -0,0 +1,251 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Host benchmark for the Insights message compression.
+ * Encodes messages which look like Insights data messages (logs and metrics), compresses them
+ * the same way as the firmware does, verifies the round trip with the heatshrink decoder from detools
+ * and prints the compression ratio and the time taken per KB of input.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cbor.h>
+#include <heatshrink_decoder.h>
+#include "esp_insights_compress.h"
+
+#define MSG_BUF_SIZE    8192
+#define WRITE_SIZE      16      /* encoder writes are a few bytes at a time */
+#define MIN_BENCH_NS    200000000ULL
+
+static uint32_t s_rand = 1;
+
+static uint32_t bench_rand(void)
+{
+    s_rand = s_rand * 1103515245 + 12345;
+    return s_rand >> 8;
+}
+
+static const char *s_tags[] = {"wifi", "mqtt_client", "esp_rmaker_work_queue", "app_main", "esp_matter_core", "chip[DL]"};
+static const char *s_tasks[] = {"main", "CHIP", "tiT", "mqtt_task", "esp_timer"};
+static const char *s_str_args[] = {"sta_disconnected", "192.168.1.34", "node/abc/params", "timeout"};
+static const char *s_metrics[][2] = {{"heap", "free"}, {"heap", "lfb"}, {"heap", "min_free"}, {"wifi", "rssi"}};
+
+/* Log sites, same pc and format string are logged again and again */
+typedef struct {
+    uint8_t tag;
+    uint32_t pc;
+    uint32_t ro;
+    uint8_t argc;
+    bool str_arg;
+} log_site_t;
+
+static log_site_t s_sites[16];
+
+static void log_sites_init(void)
+{
+    for (int i = 0; i < 16; i++) {
+        s_sites[i].tag = bench_rand() % (sizeof(s_tags) / sizeof(s_tags[0]));
+        s_sites[i].pc = 0x42000000 + (bench_rand() & 0xfffff);
+        s_sites[i].ro = 0x3c000000 + (bench_rand() & 0xfffff);
+        s_sites[i].argc = bench_rand() % 3;
+        s_sites[i].str_arg = bench_rand() % 2;
+    }
+}
+
+static void encode_logs(CborEncoder *map, const char *key, int cnt, uint64_t *ts)
+{
+    CborEncoder list, element, args;
+    cbor_encode_text_stringz(map, key);
+    cbor_encoder_create_array(map, &list, CborIndefiniteLength);
+    for (int i = 0; i < cnt; i++) {
+        const log_site_t *site = &s_sites[bench_rand() % 16];
+        *ts += 1000 + bench_rand() % 5000000;
+        cbor_encoder_create_map(&list, &element, CborIndefiniteLength);
+        cbor_encode_text_stringz(&element, "ts");
+        cbor_encode_uint(&element, *ts);
+        cbor_encode_text_stringz(&element, "tag");
+        cbor_encode_text_stringz(&element, s_tags[site->tag]);
+        cbor_encode_text_stringz(&element, "pc");
+        cbor_encode_uint(&element, site->pc);
+        cbor_encode_text_stringz(&element, "ro");
+        cbor_encode_uint(&element, site->ro);
+        cbor_encode_text_stringz(&element, "av");
+        cbor_encoder_create_array(&element, &args, CborIndefiniteLength);
+        for (int j = 0; j < site->argc; j++) {
+            cbor_encode_int(&args, bench_rand() % 1000 - 200);
+        }
+        if (site->str_arg) {
+            cbor_encode_text_stringz(&args, s_str_args[bench_rand() % 4]);
+        }
+        cbor_encoder_close_container(&element, &args);
+        cbor_encode_text_stringz(&element, "task");
+        cbor_encode_text_stringz(&element, s_tasks[bench_rand() % 5]);
+        cbor_encoder_close_container(&list, &element);
+    }
+    cbor_encoder_close_container(map, &list);
+}
+
+static void encode_metrics(CborEncoder *map, int cnt, uint64_t *ts)
+{
+    CborEncoder list, element, key;
+    cbor_encode_text_stringz(map, "metrics");
+    cbor_encoder_create_array(map, &list, CborIndefiniteLength);
+    for (int i = 0; i < cnt; i++) {
+        int m = bench_rand() % 4;
+        *ts += 1000 + bench_rand() % 30000000;
+        cbor_encoder_create_map(&list, &element, CborIndefiniteLength);
+        cbor_encode_text_stringz(&element, "n");
+        cbor_encoder_create_array(&element, &key, CborIndefiniteLength);
+        cbor_encode_text_stringz(&key, "metrics");
+        cbor_encode_text_stringz(&key, s_metrics[m][0]);
+        cbor_encode_text_stringz(&key, s_metrics[m][1]);
+        cbor_encoder_close_container(&element, &key);
+        cbor_encode_text_stringz(&element, "v");
+        if (m == 3) {
+            cbor_encode_int(&element, -40 - (int)(bench_rand() % 40));
+        } else {
+            cbor_encode_uint(&element, 100000 + bench_rand() % 80000);
+        }
+        cbor_encode_text_stringz(&element, "t");
+        cbor_encode_uint(&element, *ts);
+        cbor_encoder_close_container(&list, &element);
+    }
+    cbor_encoder_close_container(map, &list);
+}
+
+/* TLV message with cnt logs and as many metrics, returns the message length */
+static size_t encode_msg(uint8_t *buf, size_t size, int cnt, uint32_t seed)
+{
+    CborEncoder encoder, result, diag, data, traces;
+    uint64_t ts = 1700000000000000ULL;
+    s_rand = seed;
+    cbor_encoder_init(&encoder, buf + 3, size - 3, 0);
+    cbor_encoder_create_map(&encoder, &result, CborIndefiniteLength);
+    cbor_encode_text_stringz(&result, "diag");
+    cbor_encoder_create_map(&result, &diag, CborIndefiniteLength);
+    cbor_encode_text_stringz(&diag, "ver");
+    cbor_encode_text_stringz(&diag, "1.1");
+    cbor_encode_text_stringz(&diag, "ts");
+    cbor_encode_uint(&diag, ts);
+    cbor_encode_text_stringz(&diag, "sha256");
+    cbor_encode_text_stringz(&diag, "8f3a52c9e0d17b64");
+    cbor_encode_text_stringz(&diag, "data");
+    cbor_encoder_create_map(&diag, &data, CborIndefiniteLength);
+    cbor_encode_text_stringz(&data, "traces");
+    cbor_encoder_create_map(&data, &traces, CborIndefiniteLength);
+    encode_logs(&traces, "errors", cnt / 4, &ts);
+    encode_logs(&traces, "warnings", cnt / 4, &ts);
+    encode_logs(&traces, "events", cnt - cnt / 2, &ts);
+    cbor_encoder_close_container(&data, &traces);
+    encode_metrics(&data, cnt, &ts);
+    cbor_encoder_close_container(&diag, &data);
+    cbor_encoder_close_container(&result, &diag);
+    cbor_encoder_close_container(&encoder, &result);
+    if (cbor_encoder_get_extra_bytes_needed(&encoder)) {
+        return 0;
+    }
+    size_t len = cbor_encoder_get_buffer_size(&encoder, buf + 3);
+    buf[0] = 0x02;
+    uint16_t cbor_len = len;
+    memcpy(buf + 1, &cbor_len, sizeof(cbor_len));
+    return len + 3;
+}
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+} sink_t;
+
+static esp_err_t sink_write(const void *data, size_t len, void *priv)
+{
+    sink_t *sink = priv;
+    memcpy(sink->buf + sink->len, data, len);
+    sink->len += len;
+    return ESP_OK;
+}
+
+static size_t compress(esp_insights_compress_t *ctx, const uint8_t *msg, size_t len, sink_t *sink)
+{
+    esp_insights_compress_init(ctx, sink ? sink_write : NULL, sink);
+    for (size_t i = 0; i < len; i += WRITE_SIZE) {
+        esp_insights_compress_write(msg + i, len - i < WRITE_SIZE ? len - i : WRITE_SIZE, ctx);
+    }
+    esp_insights_compress_finish(ctx);
+    return ctx->out_len;
+}
+
+static bool decompress_check(const uint8_t *in, size_t in_len, const uint8_t *msg, size_t len)
+{
+    static uint8_t out[MSG_BUF_SIZE];
+    size_t out_len = 0, sunk = 0, cnt;
+    if (in[0] != ESP_INSIGHTS_COMPRESS_MARKER) {
+        return false;
+    }
+    heatshrink_decoder *hsd = heatshrink_decoder_alloc(256, in[1] >> 4, in[1] & 0xf);
+    if (!hsd) {
+        return false;
+    }
+    in += ESP_INSIGHTS_COMPRESS_HDR_SIZE;
+    in_len -= ESP_INSIGHTS_COMPRESS_HDR_SIZE;
+    while (sunk < in_len) {
+        heatshrink_decoder_sink(hsd, (uint8_t *)in + sunk, in_len - sunk, &cnt);
+        sunk += cnt;
+        HSD_poll_res res;
+        do {
+            res = heatshrink_decoder_poll(hsd, out + out_len, sizeof(out) - out_len, &cnt);
+            out_len += cnt;
+        } while (res == HSDR_POLL_MORE && out_len < sizeof(out));
+    }
+    heatshrink_decoder_finish(hsd);
+    heatshrink_decoder_free(hsd);
+    return out_len == len && memcmp(out, msg, len) == 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(void)
+{
+    static uint8_t msg[MSG_BUF_SIZE], out[MSG_BUF_SIZE];
+    static esp_insights_compress_t ctx;
+    const size_t targets[] = {512, 1024, 2048, 4096};
+    int ret = 0;
+
+    s_rand = 42;
+    log_sites_init();
+    printf("window %d bits, lookahead %d bits, context %zu bytes\n",
+           ESP_INSIGHTS_COMPRESS_WINDOW_BITS, ESP_INSIGHTS_COMPRESS_LOOKAHEAD_BITS, sizeof(ctx));
+    printf("%8s %10s %8s %10s\n", "msg len", "compressed", "ratio", "ns/KB");
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        size_t len = 0;
+        for (int cnt = 2; len < targets[t]; cnt++) {
+            len = encode_msg(msg, sizeof(msg), cnt, 7 + t);
+        }
+        sink_t sink = { .buf = out };
+        size_t out_len = compress(&ctx, msg, len, &sink);
+        if (out_len != sink.len || !decompress_check(out, out_len, msg, len)) {
+            printf("Round trip failed for message of length %zu\n", len);
+            ret = 1;
+            continue;
+        }
+        /* Count only pass, same work as the first of the two passes done by the firmware */
+        uint64_t iter = 0, start = now_ns(), elapsed;
+        do {
+            compress(&ctx, msg, len, NULL);
+            iter++;
+            elapsed = now_ns() - start;
+        } while (elapsed < MIN_BENCH_NS);
+        printf("%8zu %10zu %7.2f%% %10.0f\n", len, out_len, 100.0 * out_len / len,
+               (double)elapsed / iter * 1024 / len);
+    }
+    return ret;
+}
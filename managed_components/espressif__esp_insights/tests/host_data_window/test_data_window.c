@@ -0,0 +1,247 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Host test of the window of in flight data messages of esp_insights.c.
+ * The source is included to drive send_insights_data() directly, with a transport whose send callback
+ * runs the transport events while the message is being sent, i.e. while data_lock is not held.
+ */
+
+/* Less than the message of a full read of the store, for data messages to be split */
+#undef CONFIG_ESP_INSIGHTS_MSG_MAX_SIZE
+#define CONFIG_ESP_INSIGHTS_MSG_MAX_SIZE 1024
+
+#include "esp_insights.c"
+
+#include <stdio.h>
+#include <string.h>
+#include "port.h"
+
+#define STORE_BUF_SIZE  CONFIG_RTC_STORE_CRITICAL_DATA_SIZE
+#define LOGS_PER_MSG    4
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                   \
+        }                                                               \
+    } while (0)
+
+static struct {
+    int next_msg_id;
+    int fail_msg_id;    /* reported as failed from the send of the next message, 0 for none */
+    bool discard;       /* data store is discarded from the send of the next message */
+    size_t max_len;     /* longest message sent */
+} s_transport;
+
+static void transport_event(int32_t event_id, int msg_id)
+{
+    esp_insights_transport_event_data_t data = {
+        .msg_id = msg_id,
+    };
+    insights_event_handler(NULL, INSIGHTS_EVENT, event_id, &data);
+}
+
+static int transport_data_send(void *data, size_t len)
+{
+    if (len > s_transport.max_len) {
+        s_transport.max_len = len;
+    }
+    if (s_transport.discard) {
+        esp_diag_data_discard_data();
+        s_transport.discard = false;
+    }
+    if (s_transport.fail_msg_id) {
+        /* e.g. MQTT reports the failure of the earlier publish while this one is in progress */
+        transport_event(INSIGHTS_EVENT_TRANSPORT_SEND_FAILED, s_transport.fail_msg_id);
+        s_transport.fail_msg_id = 0;
+    }
+    return ++s_transport.next_msg_id;
+}
+
+static void report_logs(int first)
+{
+    for (int i = first; i < first + LOGS_PER_MSG; i++) {
+        ESP_LOGE("window", "Critical record %d", i);
+    }
+}
+
+static int critical_data_len(void)
+{
+    static uint8_t buf[STORE_BUF_SIZE];
+    return esp_diag_data_store_critical_read(buf, sizeof(buf));
+}
+
+static int setup(void)
+{
+    esp_insights_transport_config_t transport = {
+        .callbacks.data_send = transport_data_send,
+    };
+    esp_diag_log_config_t log_config = {
+        .write_cb = log_write_cb,
+    };
+
+    CHECK(esp_event_loop_create_default() == ESP_OK);
+    CHECK(esp_insights_transport_register(&transport) == ESP_OK);
+    s_insights_data.data_lock = xSemaphoreCreateMutex();
+    s_insights_data.data_send_timer = xTimerCreate("data_send_timer", CLOUD_REPORTING_TIMEOUT_TICKS,
+                                                   pdFALSE, NULL, data_send_timeout_cb);
+    CHECK(s_insights_data.data_lock && s_insights_data.data_send_timer);
+    s_insights_data.chunk_buf = insights_buf_alloc(INSIGHTS_STREAM_CHUNK_SIZE);
+    CHECK(s_insights_data.chunk_buf);
+    CHECK(esp_diag_data_store_init() == ESP_OK);
+    esp_diag_data_discard_data();
+    CHECK(esp_diag_log_hook_init(&log_config) == ESP_OK);
+    esp_diag_log_hook_enable(ESP_DIAG_LOG_TYPE_ERROR);
+    esp_log_level_set("*", ESP_LOG_NONE);
+    s_insights_data.data_send_inprogress = true;
+    return 0;
+}
+
+/* Message in flight is dropped while the next one is sent: the next one must not be recorded, as its
+ * data was read after the data of the dropped one, and its ack must not release any data.
+ */
+static int drop_while_sending(void)
+{
+    report_logs(0);
+    int total = critical_data_len();
+    CHECK(total > 0);
+    CHECK(send_insights_data() == ESP_ERR_NOT_FOUND);
+    CHECK(s_insights_data.data_msg_cnt == 1 && s_insights_data.data_msgs_len == (uint32_t) total);
+    int first_id = s_insights_data.data_msgs[0].msg_id;
+
+    report_logs(LOGS_PER_MSG);
+    total = critical_data_len();
+    s_transport.fail_msg_id = first_id;
+    CHECK(send_insights_data() == ESP_FAIL);
+    int second_id = s_transport.next_msg_id;
+    CHECK(s_insights_data.data_msg_cnt == 0 && s_insights_data.data_msgs_len == 0);
+
+    /* Late ack of the unrecorded message releases nothing */
+    transport_event(INSIGHTS_EVENT_TRANSPORT_SEND_SUCCESS, second_id);
+    CHECK(critical_data_len() == total);
+
+    /* Data of both is sent again from the start of the store and released on ack */
+    CHECK(send_insights_data() == ESP_ERR_NOT_FOUND);
+    CHECK(s_insights_data.data_msg_cnt == 1 && s_insights_data.data_msgs_len == (uint32_t) total);
+    transport_event(INSIGHTS_EVENT_TRANSPORT_SEND_SUCCESS, s_insights_data.data_msgs[0].msg_id);
+    CHECK(s_insights_data.data_msg_cnt == 0);
+    CHECK(critical_data_len() <= 0);
+    printf("drop while sending: %d bytes kept until sent again\n", total);
+    return 0;
+}
+
+/* Ack which arrives before the send returns is applied once the message is recorded */
+static int early_ack(void)
+{
+    report_logs(2 * LOGS_PER_MSG);
+    CHECK(critical_data_len() > 0);
+    transport_event(INSIGHTS_EVENT_TRANSPORT_SEND_SUCCESS, s_transport.next_msg_id + 1);
+    CHECK(send_insights_data() == ESP_ERR_NOT_FOUND);
+    CHECK(s_insights_data.data_msg_cnt == 0);
+    CHECK(critical_data_len() <= 0);
+    printf("early ack: message released when recorded\n");
+    return 0;
+}
+
+/* Acks of other messages of the transport fill the early acks, the ack of the data message is kept */
+static int early_ack_full(void)
+{
+    report_logs(3 * LOGS_PER_MSG);
+    for (int i = 0; i < 2 * INSIGHTS_DATA_MSG_WINDOW; i++) {
+        transport_event(INSIGHTS_EVENT_TRANSPORT_SEND_SUCCESS, 1000 + i);
+    }
+    uint32_t drop_cnt = s_insights_data.early_ack_drop_cnt;
+    transport_event(INSIGHTS_EVENT_TRANSPORT_SEND_SUCCESS, s_transport.next_msg_id + 1);
+    CHECK(s_insights_data.early_ack_cnt == INSIGHTS_DATA_MSG_WINDOW);
+    CHECK(s_insights_data.early_ack_drop_cnt == drop_cnt + 1);
+    CHECK(send_insights_data() == ESP_ERR_NOT_FOUND);
+    CHECK(s_insights_data.data_msg_cnt == 0);
+    CHECK(critical_data_len() <= 0);
+    printf("early ack with full early acks: %" PRIu32 " older acks dropped\n", s_insights_data.early_ack_drop_cnt);
+    return 0;
+}
+
+/* Store holds more data than fits in a message of INSIGHTS_MSG_MAX_SIZE: it is sent in several messages,
+ * none of them longer than that, and all of it is released on their acks
+ */
+static int split_to_max_size(void)
+{
+    for (int i = 0; i < 200; i += LOGS_PER_MSG) {
+        report_logs(i);
+    }
+    int total = critical_data_len();
+    CHECK(total > 0);
+    s_transport.max_len = 0;
+    int msg_cnt = 0;
+    esp_err_t err;
+    do {
+        err = send_insights_data();
+        CHECK(err == ESP_OK || err == ESP_ERR_NOT_FOUND);
+        CHECK(s_insights_data.data_msg_cnt == 1);
+        transport_event(INSIGHTS_EVENT_TRANSPORT_SEND_SUCCESS, s_insights_data.data_msgs[0].msg_id);
+        msg_cnt++;
+    } while (err == ESP_OK);
+    CHECK(s_insights_data.data_msg_cnt == 0);
+    CHECK(critical_data_len() <= 0);
+    CHECK(s_transport.max_len <= INSIGHTS_MSG_MAX_SIZE);
+    printf("split to max size: %d bytes in %d messages of up to %zu bytes\n", total, msg_cnt, s_transport.max_len);
+    return 0;
+}
+
+static int non_critical_data_len(void)
+{
+    static uint8_t buf[CONFIG_RTC_STORE_DATA_SIZE - CONFIG_RTC_STORE_CRITICAL_DATA_SIZE];
+    int len = esp_diag_data_store_non_critical_read(buf, sizeof(buf));
+    esp_diag_data_store_non_critical_release(0);
+    return len;
+}
+
+/* Store is discarded while a message is sent from it: the message ends the span reads of the discarded data
+ * without freeing any of the data written after, and the next message reads the store again
+ */
+static int discard_while_sending(void)
+{
+    esp_diag_metrics_config_t metrics_config = {
+        .write_cb = metrics_write_cb,
+    };
+    CHECK(esp_diag_metrics_init(&metrics_config) == ESP_OK);
+    CHECK(esp_diag_metrics_register("window", "value", "Value", "window", ESP_DIAG_DATA_TYPE_UINT) == ESP_OK);
+    for (int i = 0; i < 8; i++) {
+        CHECK(esp_diag_metrics_add_uint("value", i) == ESP_OK);
+    }
+    report_logs(0);
+    CHECK(non_critical_data_len() > 0);
+    s_transport.discard = true;
+    CHECK(send_insights_data() == ESP_ERR_NOT_FOUND);
+    CHECK(s_insights_data.data_msg_cnt == 1);
+    transport_event(INSIGHTS_EVENT_TRANSPORT_SEND_FAILED, s_insights_data.data_msgs[0].msg_id);
+    CHECK(s_insights_data.data_msg_cnt == 0);
+
+    for (int i = 0; i < 8; i++) {
+        CHECK(esp_diag_metrics_add_uint("value", i) == ESP_OK);
+    }
+    report_logs(LOGS_PER_MSG);
+    CHECK(send_insights_data() == ESP_ERR_NOT_FOUND);
+    CHECK(s_insights_data.data_msg_cnt == 1);
+    CHECK(non_critical_data_len() <= 0);
+    transport_event(INSIGHTS_EVENT_TRANSPORT_SEND_SUCCESS, s_insights_data.data_msgs[0].msg_id);
+    CHECK(s_insights_data.data_msg_cnt == 0);
+    CHECK(critical_data_len() <= 0);
+    printf("discard while sending: next message sent from the store\n");
+    return 0;
+}
+
+int main(void)
+{
+    port_thread_register("main");
+    if (setup() || drop_while_sending() || early_ack() || early_ack_full() || split_to_max_size()
+            || discard_while_sending()) {
+        printf("FAIL\n");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
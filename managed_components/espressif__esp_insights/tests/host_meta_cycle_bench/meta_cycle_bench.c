@@ -0,0 +1,168 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Host benchmark of the metadata check of the periodic Insights run.
+ * The source is included to call insights_meta_changed() and insights_periodic_handler() directly, with the
+ * metrics and variables the firmware registers by default, the metadata CRC already in NVS and empty data
+ * stores, i.e. the run of a device with nothing to report. NVS reads busy wait the given microseconds, as
+ * the flash reads of the device do. Prints the time of both per call.
+ * Usage: meta_cycle_bench [nvs_read_us] [cycles]
+ */
+
+#include "esp_insights.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "port.h"
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return 1;                                                   \
+        }                                                               \
+    } while (0)
+
+typedef struct {
+    const char *tag;
+    const char *key;
+    const char *label;
+    const char *path;
+    esp_diag_data_type_t type;
+} meta_entry_t;
+
+/* Heap and Wi-Fi metrics of esp_diagnostics */
+static const meta_entry_t s_metrics[] = {
+    { "heap", "alloc_fail", "Malloc fail", "heap", ESP_DIAG_DATA_TYPE_UINT },
+    { "heap", "ext_free", "External free heap", "heap.external", ESP_DIAG_DATA_TYPE_UINT },
+    { "heap", "ext_lfb", "External largest free block", "heap.external", ESP_DIAG_DATA_TYPE_UINT },
+    { "heap", "ext_min_free_ever", "External minimum free size", "heap.external", ESP_DIAG_DATA_TYPE_UINT },
+    { "heap", "free", "Free heap", "heap.internal", ESP_DIAG_DATA_TYPE_UINT },
+    { "heap", "lfb", "Largest free block", "heap.internal", ESP_DIAG_DATA_TYPE_UINT },
+    { "heap", "min_free_ever", "Minimum free size", "heap.internal", ESP_DIAG_DATA_TYPE_UINT },
+    { "wifi", "rssi", "Wi-Fi RSSI", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_INT },
+    { "wifi", "min_rssi_ever", "Minimum ever Wi-Fi RSSI", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_INT },
+    { "wifi", "conn_status", "Wi-Fi connect status", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_BOOL },
+};
+
+/* Network variables of esp_diagnostics and the variables of Insights */
+static const meta_entry_t s_variables[] = {
+    { "wifi", "ssid", "SSID", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_STR },
+    { "wifi", "bssid", "BSSID", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_MAC },
+    { "wifi", "channel", "Channel", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_INT },
+    { "wifi", "auth", "Auth Mode", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_UINT },
+    { "wifi", "disconn_cnt", "Disconnect count since last reboot", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_INT },
+    { "wifi", "reason", "Last Wi-Fi disconnect reason", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_INT },
+    { "wifi", "protocol", "Protocol", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_UINT },
+    { "wifi", "bandwidth", "Bandwidth", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_UINT },
+    { "wifi", "power_save", "Power Save", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_UINT },
+    { "wifi", "second_ch", "Secondary Channel", "Wi-Fi.Station", ESP_DIAG_DATA_TYPE_UINT },
+    { "wifi", "protocol_ap", "Protocol", "Wi-Fi.AP", ESP_DIAG_DATA_TYPE_UINT },
+    { "wifi", "bandwidth_ap", "Bandwidth", "Wi-Fi.AP", ESP_DIAG_DATA_TYPE_UINT },
+    { "ip", "ipv4", "IPv4", "IP.Station", ESP_DIAG_DATA_TYPE_IPv4 },
+    { "ip", "netmask", "Netmask", "IP.Station", ESP_DIAG_DATA_TYPE_IPv4 },
+    { "ip", "gw", "Gateway", "IP.Station", ESP_DIAG_DATA_TYPE_IPv4 },
+    { "diag", "log_wr_fail", "Log write fail count", "Diagnostics.Log", ESP_DIAG_DATA_TYPE_UINT },
+    { "diag", "rpt_interval", "Reporting interval (sec)", "Diagnostics.Insights", ESP_DIAG_DATA_TYPE_UINT },
+    { "diag", "fill_rate", "Data store fill rate (bytes/min)", "Diagnostics.Insights", ESP_DIAG_DATA_TYPE_UINT },
+    { "diag", "rpt_early", "Reports sent with other traffic", "Diagnostics.Insights", ESP_DIAG_DATA_TYPE_UINT },
+};
+
+#define ENTRY_CNT(entries)  (sizeof(entries) / sizeof(entries[0]))
+
+static int s_sent_cnt;
+
+static int transport_data_send(void *data, size_t len)
+{
+    return ++s_sent_cnt;
+}
+
+static esp_err_t diag_write_cb(const char *tag, void *data, size_t len, void *cb_arg)
+{
+    return ESP_OK;
+}
+
+static int setup(void)
+{
+    esp_insights_transport_config_t transport = {
+        .callbacks.data_send = transport_data_send,
+    };
+    esp_diag_metrics_config_t metrics_config = {
+        .write_cb = diag_write_cb,
+    };
+    esp_diag_variable_config_t variable_config = {
+        .write_cb = diag_write_cb,
+    };
+
+    CHECK(esp_event_loop_create_default() == ESP_OK);
+    CHECK(esp_insights_transport_register(&transport) == ESP_OK);
+    s_insights_data.data_lock = xSemaphoreCreateMutex();
+    s_insights_data.data_send_timer = xTimerCreate("data_send_timer", CLOUD_REPORTING_TIMEOUT_TICKS,
+                                                   pdFALSE, NULL, data_send_timeout_cb);
+    CHECK(s_insights_data.data_lock && s_insights_data.data_send_timer);
+    s_insights_data.chunk_buf = insights_buf_alloc(INSIGHTS_STREAM_CHUNK_SIZE);
+    CHECK(s_insights_data.chunk_buf);
+    CHECK(esp_diag_data_store_init() == ESP_OK);
+    esp_diag_data_discard_data();
+    s_insights_data.enabled = true;
+
+    CHECK(esp_diag_metrics_init(&metrics_config) == ESP_OK);
+    for (size_t i = 0; i < ENTRY_CNT(s_metrics); i++) {
+        const meta_entry_t *m = &s_metrics[i];
+        CHECK(esp_diag_metrics_register(m->tag, m->key, m->label, m->path, m->type) == ESP_OK);
+    }
+    CHECK(esp_diag_variable_init(&variable_config) == ESP_OK);
+    for (size_t i = 0; i < ENTRY_CNT(s_variables); i++) {
+        const meta_entry_t *v = &s_variables[i];
+        CHECK(esp_diag_variable_register(v->tag, v->key, v->label, v->path, v->type) == ESP_OK);
+    }
+    /* Metadata of this firmware was sent on an earlier boot */
+    CHECK(esp_insights_meta_nvs_crc_set(esp_diag_meta_crc_get()) == ESP_OK);
+    esp_log_level_set("*", ESP_LOG_NONE);
+    return 0;
+}
+
+static int bench(unsigned cycles)
+{
+    uint64_t start;
+    double meta_us, cycle_us;
+
+    CHECK(!insights_meta_changed());
+    start = port_time_us();
+    for (unsigned i = 0; i < cycles; i++) {
+        if (insights_meta_changed()) {
+            break;
+        }
+    }
+    meta_us = (double)(port_time_us() - start) / cycles;
+
+    start = port_time_us();
+    for (unsigned i = 0; i < cycles; i++) {
+        insights_periodic_handler(NULL);
+    }
+    cycle_us = (double)(port_time_us() - start) / cycles;
+    CHECK(!s_insights_data.data_send_inprogress && s_sent_cnt == 0);
+
+    printf("%zu metrics, %zu variables, %u cycles\n", ENTRY_CNT(s_metrics), ENTRY_CNT(s_variables), cycles);
+    printf("insights_meta_changed()     %8.2f us\n", meta_us);
+    printf("insights_periodic_handler() %8.2f us\n", cycle_us);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t nvs_read_us = argc > 1 ? strtoul(argv[1], NULL, 0) : 0;
+    unsigned cycles = argc > 2 ? strtoul(argv[2], NULL, 0) : 10000;
+
+    port_thread_register("main");
+    port_nvs_read_us_set(nvs_read_us);
+    printf("NVS read %" PRIu32 " us\n", nvs_read_us);
+    if (setup() || bench(cycles)) {
+        printf("FAIL\n");
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,583 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Local stand-ins of the Insights cloud and of the network clients of the device.
+ *
+ * Device side, used by the transports of Insights:
+ * - MQTT glue (esp_rmaker_mqtt_glue_setup()) with an MQTT 3.1.1 client over TCP. As with esp-mqtt,
+ *   QoS 1 messages are kept in the outbox until PUBACK, which is posted as RMAKER_MQTT_EVENT_PUBLISHED
+ *   from the MQTT task.
+ * - esp_http_client subset, plain HTTP/1.1 over TCP with a connection per request, as the HTTPS
+ *   transport creates a client per message. Host of the URL is replaced by the sink, there is no TLS.
+ *
+ * Cloud side, threads which are not counted as device CPU:
+ * - MQTT broker which acknowledges QoS 1 PUBLISH after handing the payload to the callback.
+ * - HTTP sink which answers 200 after handing the request body to the callback.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_event.h>
+#include <esp_http_client.h>
+#include <esp_rmaker_mqtt_glue.h>
+#include <esp_rmaker_common_events.h>
+#include "port.h"
+#include "loopback.h"
+
+#define LOOPBACK_MSG_MAX        (UINT16_MAX + 1024)
+#define MQTT_OUTBOX_MAX         16
+#define MQTT_CLIENT_ID          "telemetrybench01"
+#define HTTP_CLIENT_BUF_SIZE    512
+#define HTTP_HEADERS_MAX        512
+
+ESP_EVENT_DEFINE_BASE(RMAKER_COMMON_EVENT);
+
+static const char *TAG = "loopback";
+
+static loopback_msg_cb_t s_msg_cb;
+static int s_broker_fd = -1;
+static int s_sink_fd = -1;
+static uint16_t s_broker_port;
+static uint16_t s_sink_port;
+static pthread_t s_broker_thread;
+static pthread_t s_sink_thread;
+
+/* Sockets */
+
+static bool send_all(int fd, const void *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data = (const uint8_t *)data + n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, void *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = recv(fd, data, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        data = (uint8_t *)data + n;
+        len -= n;
+    }
+    return true;
+}
+
+static int listen_any(uint16_t *port)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0 ||
+            getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static int connect_to(uint16_t port)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* MQTT packets */
+
+#define MQTT_CONNECT        1
+#define MQTT_CONNACK        2
+#define MQTT_PUBLISH        3
+#define MQTT_PUBACK         4
+#define MQTT_PINGREQ        12
+#define MQTT_PINGRESP       13
+#define MQTT_DISCONNECT     14
+
+/* Remaining length of the fixed header, returns the bytes used */
+static size_t mqtt_len_put(uint8_t *p, size_t len)
+{
+    size_t i = 0;
+    do {
+        p[i] = len & 0x7f;
+        len >>= 7;
+        if (len) {
+            p[i] |= 0x80;
+        }
+        i++;
+    } while (len);
+    return i;
+}
+
+/* Reads a packet, variable header and payload in buf. hdr_len is the length of the fixed header */
+static bool mqtt_packet_read(int fd, uint8_t *type, uint8_t *buf, size_t size, size_t *len, size_t *hdr_len)
+{
+    uint8_t byte;
+    size_t shift = 0;
+    if (!recv_all(fd, type, 1)) {
+        return false;
+    }
+    *len = 0;
+    *hdr_len = 1;
+    do {
+        if (shift > 21 || !recv_all(fd, &byte, 1)) {
+            return false;
+        }
+        *len |= (size_t)(byte & 0x7f) << shift;
+        shift += 7;
+        (*hdr_len)++;
+    } while (byte & 0x80);
+    return *len <= size && recv_all(fd, buf, *len);
+}
+
+/* Broker, one client at a time */
+
+static void *broker_thread(void *arg)
+{
+    static uint8_t buf[LOOPBACK_MSG_MAX];
+    int fd;
+    while ((fd = accept(s_broker_fd, NULL, NULL)) >= 0) {
+        uint8_t type;
+        size_t len, hdr_len;
+        while (mqtt_packet_read(fd, &type, buf, sizeof(buf), &len, &hdr_len)) {
+            uint64_t now = port_time_us();
+            if (type >> 4 == MQTT_CONNECT) {
+                const uint8_t connack[] = { MQTT_CONNACK << 4, 2, 0, 0 };
+                send_all(fd, connack, sizeof(connack));
+            } else if (type >> 4 == MQTT_PUBLISH && len >= 2) {
+                size_t off = 2 + ((buf[0] << 8) | buf[1]);
+                uint16_t id = 0;
+                if ((type >> 1) & 3) {
+                    id = (buf[off] << 8) | buf[off + 1];
+                    off += 2;
+                }
+                if (off > len) {
+                    break;
+                }
+                s_msg_cb(buf + off, len - off, hdr_len + len, now);
+                if (id) {
+                    const uint8_t puback[] = { MQTT_PUBACK << 4, 2, id >> 8, id & 0xff };
+                    send_all(fd, puback, sizeof(puback));
+                }
+            } else if (type >> 4 == MQTT_PINGREQ) {
+                const uint8_t pingresp[] = { MQTT_PINGRESP << 4, 0 };
+                send_all(fd, pingresp, sizeof(pingresp));
+            } else if (type >> 4 == MQTT_DISCONNECT) {
+                break;
+            }
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+/* MQTT client of the device */
+
+static struct {
+    int fd;
+    SemaphoreHandle_t lock;     /* serialises the writers, protects the outbox */
+    uint16_t next_id;
+    struct {
+        int msg_id;
+        uint8_t *pkt;
+    } outbox[MQTT_OUTBOX_MAX];
+} s_mqtt = { .fd = -1 };
+
+static void mqtt_outbox_release(int msg_id)
+{
+    xSemaphoreTake(s_mqtt.lock, portMAX_DELAY);
+    for (int i = 0; i < MQTT_OUTBOX_MAX; i++) {
+        if (s_mqtt.outbox[i].pkt && s_mqtt.outbox[i].msg_id == msg_id) {
+            free(s_mqtt.outbox[i].pkt);
+            s_mqtt.outbox[i].pkt = NULL;
+            break;
+        }
+    }
+    xSemaphoreGive(s_mqtt.lock);
+}
+
+static void mqtt_task(void *arg)
+{
+    uint8_t buf[16];
+    uint8_t type;
+    size_t len, hdr_len;
+    while (mqtt_packet_read(s_mqtt.fd, &type, buf, sizeof(buf), &len, &hdr_len)) {
+        if (type >> 4 == MQTT_CONNACK && len == 2 && buf[1] == 0) {
+            esp_event_post(RMAKER_COMMON_EVENT, RMAKER_MQTT_EVENT_CONNECTED, NULL, 0, portMAX_DELAY);
+        } else if (type >> 4 == MQTT_PUBACK && len == 2) {
+            int msg_id = (buf[0] << 8) | buf[1];
+            mqtt_outbox_release(msg_id);
+            esp_event_post(RMAKER_COMMON_EVENT, RMAKER_MQTT_EVENT_PUBLISHED, &msg_id, sizeof(msg_id), portMAX_DELAY);
+        }
+    }
+    esp_event_post(RMAKER_COMMON_EVENT, RMAKER_MQTT_EVENT_DISCONNECTED, NULL, 0, portMAX_DELAY);
+}
+
+static esp_err_t mqtt_init(esp_rmaker_mqtt_conn_params_t *conn_params)
+{
+    s_mqtt.lock = xSemaphoreCreateMutex();
+    return s_mqtt.lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static void mqtt_deinit(void)
+{
+    for (int i = 0; i < MQTT_OUTBOX_MAX; i++) {
+        free(s_mqtt.outbox[i].pkt);
+        s_mqtt.outbox[i].pkt = NULL;
+    }
+    vSemaphoreDelete(s_mqtt.lock);
+    s_mqtt.lock = NULL;
+}
+
+static esp_err_t mqtt_connect(void)
+{
+    const char client_id[] = MQTT_CLIENT_ID;
+    uint8_t connect[14 + sizeof(client_id)] = {
+        MQTT_CONNECT << 4, 12 + sizeof(client_id) - 1,
+        0, 4, 'M', 'Q', 'T', 'T', 4, 0x02 /* clean session */, 0, 120 /* keep alive */,
+        0, sizeof(client_id) - 1,
+    };
+    memcpy(&connect[14], client_id, sizeof(client_id) - 1);
+    s_mqtt.fd = connect_to(s_broker_port);
+    if (s_mqtt.fd < 0) {
+        ESP_LOGE(TAG, "Failed to connect to the broker");
+        return ESP_FAIL;
+    }
+    if (!send_all(s_mqtt.fd, connect, sizeof(connect) - 1) ||
+            xTaskCreate(mqtt_task, "mqtt_task", 6144, NULL, 5, NULL) != pdPASS) {
+        close(s_mqtt.fd);
+        s_mqtt.fd = -1;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t mqtt_disconnect(void)
+{
+    const uint8_t disconnect[] = { MQTT_DISCONNECT << 4, 0 };
+    if (s_mqtt.fd < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    send_all(s_mqtt.fd, disconnect, sizeof(disconnect));
+    /* MQTT task exits when the broker closes the connection */
+    shutdown(s_mqtt.fd, SHUT_WR);
+    return ESP_OK;
+}
+
+static esp_err_t mqtt_publish(const char *topic, void *data, size_t data_len, uint8_t qos, int *msg_id)
+{
+    size_t topic_len = strlen(topic);
+    size_t rem_len = 2 + topic_len + (qos ? 2 : 0) + data_len;
+    uint8_t *pkt = malloc(5 + rem_len);
+    int slot = -1;
+    if (!pkt) {
+        return ESP_ERR_NO_MEM;
+    }
+    xSemaphoreTake(s_mqtt.lock, portMAX_DELAY);
+    if (qos) {
+        for (slot = 0; slot < MQTT_OUTBOX_MAX && s_mqtt.outbox[slot].pkt; slot++);
+        if (slot == MQTT_OUTBOX_MAX) {
+            xSemaphoreGive(s_mqtt.lock);
+            free(pkt);
+            return ESP_FAIL;
+        }
+        if (++s_mqtt.next_id == 0) {
+            s_mqtt.next_id = 1;
+        }
+    }
+    size_t len = 0;
+    pkt[len++] = (MQTT_PUBLISH << 4) | (qos << 1);
+    len += mqtt_len_put(&pkt[len], rem_len);
+    pkt[len++] = topic_len >> 8;
+    pkt[len++] = topic_len & 0xff;
+    memcpy(&pkt[len], topic, topic_len);
+    len += topic_len;
+    if (qos) {
+        pkt[len++] = s_mqtt.next_id >> 8;
+        pkt[len++] = s_mqtt.next_id & 0xff;
+        /* kept in the outbox until acknowledged */
+        s_mqtt.outbox[slot].pkt = pkt;
+        s_mqtt.outbox[slot].msg_id = s_mqtt.next_id;
+    }
+    memcpy(&pkt[len], data, data_len);
+    len += data_len;
+    bool sent = send_all(s_mqtt.fd, pkt, len);
+    *msg_id = qos ? s_mqtt.next_id : 0;
+    xSemaphoreGive(s_mqtt.lock);
+    if (!qos) {
+        free(pkt);
+    }
+    return sent ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t mqtt_subscribe(const char *topic, esp_rmaker_mqtt_subscribe_cb_t cb, uint8_t qos, void *priv_data)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_mqtt_glue_setup(esp_rmaker_mqtt_config_t *mqtt_config)
+{
+    mqtt_config->init = mqtt_init;
+    mqtt_config->deinit = mqtt_deinit;
+    mqtt_config->connect = mqtt_connect;
+    mqtt_config->disconnect = mqtt_disconnect;
+    mqtt_config->publish = mqtt_publish;
+    mqtt_config->subscribe = mqtt_subscribe;
+    mqtt_config->setup_done = true;
+    return ESP_OK;
+}
+
+/* HTTP sink, one request per connection */
+
+static void *sink_thread(void *arg)
+{
+    static uint8_t buf[LOOPBACK_MSG_MAX];
+    int fd;
+    while ((fd = accept(s_sink_fd, NULL, NULL)) >= 0) {
+        const char *status = "400 Bad Request";
+        size_t len = 0;
+        char *end = NULL;
+        while (!end && len < sizeof(buf) - 1) {
+            ssize_t n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+            if (n <= 0) {
+                break;
+            }
+            len += n;
+            end = memmem(buf, len, "\r\n\r\n", 4);
+        }
+        if (end) {
+            size_t hdr_len = (uint8_t *)end + 4 - buf;
+            *end = '\0';
+            char *cl = strcasestr((char *)buf, "\r\nContent-Length:");
+            size_t body_len = cl ? strtoul(cl + 17, NULL, 10) : 0;
+            if (hdr_len + body_len <= sizeof(buf) &&
+                    (len >= hdr_len + body_len || recv_all(fd, buf + len, hdr_len + body_len - len))) {
+                s_msg_cb(buf + hdr_len, body_len, hdr_len + body_len, port_time_us());
+                status = "200 OK";
+            }
+        }
+        char resp[96];
+        int resp_len = snprintf(resp, sizeof(resp), "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+        send_all(fd, resp, resp_len);
+        close(fd);
+    }
+    return NULL;
+}
+
+/* esp_http_client of the device */
+
+struct esp_http_client {
+    char path[256];
+    char headers[HTTP_HEADERS_MAX];
+    size_t headers_len;
+    const char *post_data;
+    int post_len;
+    int fd;
+    int status;
+    int64_t content_length;
+    char *buf;      /* as the tx/rx buffer of esp_http_client */
+    size_t buf_size;
+};
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    esp_http_client_handle_t client = calloc(1, sizeof(*client));
+    if (!client) {
+        return NULL;
+    }
+    client->buf_size = config->buffer_size_tx > HTTP_CLIENT_BUF_SIZE ? config->buffer_size_tx : HTTP_CLIENT_BUF_SIZE;
+    client->buf = malloc(client->buf_size);
+    if (!client->buf) {
+        free(client);
+        return NULL;
+    }
+    const char *p = strstr(config->url, "://");
+    p = strchr(p ? p + 3 : config->url, '/');
+    strlcpy(client->path, p ? p : "/", sizeof(client->path));
+    client->fd = -1;
+    return client;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    int n = snprintf(client->headers + client->headers_len, sizeof(client->headers) - client->headers_len,
+                     "%s: %s\r\n", key, value);
+    if (n < 0 || client->headers_len + n >= sizeof(client->headers)) {
+        return ESP_ERR_NO_MEM;
+    }
+    client->headers_len += n;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len)
+{
+    client->post_data = data;
+    client->post_len = len;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    client->fd = connect_to(s_sink_port);
+    if (client->fd < 0) {
+        return ESP_FAIL;
+    }
+    int n = snprintf(client->buf, client->buf_size,
+                     "POST %s HTTP/1.1\r\nHost: 127.0.0.1\r\n%sContent-Length: %d\r\nConnection: close\r\n\r\n",
+                     client->path, client->headers, write_len);
+    if (n < 0 || n >= (int) client->buf_size || !send_all(client->fd, client->buf, n)) {
+        esp_http_client_close(client);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int esp_http_client_write(esp_http_client_handle_t client, const char *buffer, int len)
+{
+    return send_all(client->fd, buffer, len) ? len : -1;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    size_t len = 0;
+    char *end = NULL;
+    while (!end && len < client->buf_size - 1) {
+        ssize_t n = recv(client->fd, client->buf + len, client->buf_size - 1 - len, 0);
+        if (n <= 0) {
+            return ESP_FAIL;
+        }
+        len += n;
+        client->buf[len] = '\0';
+        end = strstr(client->buf, "\r\n\r\n");
+    }
+    if (!end || sscanf(client->buf, "HTTP/1.%*d %d", &client->status) != 1) {
+        return ESP_FAIL;
+    }
+    char *cl = strcasestr(client->buf, "\r\nContent-Length:");
+    client->content_length = cl ? strtoll(cl + 17, NULL, 10) : 0;
+    return client->content_length;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
+{
+    esp_err_t err = esp_http_client_open(client, client->post_len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (esp_http_client_write(client, client->post_data, client->post_len) < 0 ||
+            esp_http_client_fetch_headers(client) < 0) {
+        err = ESP_FAIL;
+    }
+    esp_http_client_close(client);
+    return err;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status;
+}
+
+/* Sink does not send a body */
+esp_err_t esp_http_client_flush_response(esp_http_client_handle_t client, int *len)
+{
+    if (len) {
+        *len = 0;
+    }
+    return ESP_OK;
+}
+
+bool esp_http_client_is_chunked_response(esp_http_client_handle_t client)
+{
+    return false;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    esp_http_client_close(client);
+    free(client->buf);
+    free(client);
+    return ESP_OK;
+}
+
+/* Broker and sink */
+
+esp_err_t loopback_start(loopback_msg_cb_t cb)
+{
+    s_msg_cb = cb;
+    s_broker_fd = listen_any(&s_broker_port);
+    s_sink_fd = listen_any(&s_sink_port);
+    if (s_broker_fd < 0 || s_sink_fd < 0 ||
+            pthread_create(&s_broker_thread, NULL, broker_thread, NULL) != 0) {
+        goto err;
+    }
+    if (pthread_create(&s_sink_thread, NULL, sink_thread, NULL) != 0) {
+        shutdown(s_broker_fd, SHUT_RDWR);
+        pthread_join(s_broker_thread, NULL);
+        goto err;
+    }
+    return ESP_OK;
+err:
+    close(s_broker_fd);
+    close(s_sink_fd);
+    s_broker_fd = s_sink_fd = -1;
+    return ESP_FAIL;
+}
+
+/* Connections must be closed by the clients, accept() fails once the sockets are shut down */
+void loopback_stop(void)
+{
+    shutdown(s_broker_fd, SHUT_RDWR);
+    shutdown(s_sink_fd, SHUT_RDWR);
+    pthread_join(s_broker_thread, NULL);
+    pthread_join(s_sink_thread, NULL);
+    close(s_broker_fd);
+    close(s_sink_fd);
+    s_broker_fd = s_sink_fd = -1;
+}
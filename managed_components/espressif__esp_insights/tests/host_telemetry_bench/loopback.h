@@ -0,0 +1,34 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Local stand-ins of the Insights cloud, see loopback.c */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+/**
+ * @brief Called from the thread of the broker or the sink for every received message
+ *
+ * @param payload   MQTT payload or HTTP request body, as handed to the transport
+ * @param len       length of the payload
+ * @param wire_len  bytes received for the message, including MQTT packet or HTTP request headers
+ * @param recv_us   time of arrival, port_time_us()
+ */
+typedef void (*loopback_msg_cb_t)(const uint8_t *payload, size_t len, size_t wire_len, uint64_t recv_us);
+
+/**
+ * @brief Start the MQTT broker and the HTTP sink on 127.0.0.1
+ *
+ * Must be called before esp_insights_init(), transport connects to them.
+ */
+esp_err_t loopback_start(loopback_msg_cb_t cb);
+
+/**
+ * @brief Stop the broker and the sink
+ */
+void loopback_stop(void);
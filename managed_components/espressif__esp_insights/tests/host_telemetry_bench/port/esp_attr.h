@@ -0,0 +1,11 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* esp_attr.h of the host port, RTC memory is plain memory */
+#pragma once
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
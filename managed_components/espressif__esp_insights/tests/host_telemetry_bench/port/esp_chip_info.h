@@ -0,0 +1,24 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* esp_chip_info.h of the host port */
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+    CHIP_ESP32 = 1,
+    CHIP_ESP32C3 = 5,
+} esp_chip_model_t;
+
+typedef struct {
+    esp_chip_model_t model;
+    uint32_t features;
+    uint16_t revision;
+    uint8_t cores;
+} esp_chip_info_t;
+
+void esp_chip_info(esp_chip_info_t *out_info);
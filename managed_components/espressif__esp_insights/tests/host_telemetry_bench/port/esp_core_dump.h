@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* esp_core_dump.h of the host port, there is no core dump */
+#pragma once
+
+#include <esp_err.h>
+
+esp_err_t esp_core_dump_image_erase(void);
@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* esp_crc.h of the host port */
+#pragma once
+
+#include <stdint.h>
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,18 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* esp_event.h of the host port, the default event loop runs in its own thread */
+#pragma once
+
+#include <esp_err.h>
+#include <esp_event_base.h>
+#include <freertos/FreeRTOS.h>
+
+esp_err_t esp_event_loop_create_default(void);
+esp_err_t esp_event_loop_delete_default(void);
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void *arg);
+esp_err_t esp_event_handler_unregister(esp_event_base_t base, int32_t id, esp_event_handler_t handler);
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void *data, size_t size, TickType_t ticks);
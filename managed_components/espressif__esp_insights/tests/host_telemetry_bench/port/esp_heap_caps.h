@@ -0,0 +1,10 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* esp_heap_caps.h of the host port */
+#pragma once
+
+#include <stdlib.h>
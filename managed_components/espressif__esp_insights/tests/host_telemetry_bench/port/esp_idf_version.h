@@ -0,0 +1,15 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* esp_idf_version.h of the host port */
+#pragma once
+
+#define ESP_IDF_VERSION_MAJOR   5
+#define ESP_IDF_VERSION_MINOR   1
+#define ESP_IDF_VERSION_PATCH   0
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) ((major << 16) | (minor << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(ESP_IDF_VERSION_MAJOR, ESP_IDF_VERSION_MINOR, ESP_IDF_VERSION_PATCH)
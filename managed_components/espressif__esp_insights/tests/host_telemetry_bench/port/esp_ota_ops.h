@@ -0,0 +1,11 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* esp_ota_ops.h of the host port */
+#pragma once
+
+#include <esp_app_desc.h>
+#include <esp_partition.h>
@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* esp_random.h of the host port */
+#pragma once
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
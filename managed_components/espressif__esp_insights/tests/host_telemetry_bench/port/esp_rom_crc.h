@@ -0,0 +1,12 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* esp_rom_crc.h of the host port */
+#pragma once
+
+#include <esp_crc.h>
+
+#define esp_rom_crc32_le(crc, buf, len) esp_crc32_le(crc, buf, len)
@@ -0,0 +1,41 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* FreeRTOS.h of the host port, see port.c */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sdkconfig.h>
+#include <esp_attr.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                 ((BaseType_t) 0)
+#define pdTRUE                  ((BaseType_t) 1)
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define portMAX_DELAY           ((TickType_t) 0xffffffffUL)
+#define configTICK_RATE_HZ      1000
+#define portTICK_PERIOD_MS      ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)       ((TickType_t) (ms) * configTICK_RATE_HZ / 1000)
+#define pdTICKS_TO_MS(ticks)    ((ticks) * 1000 / configTICK_RATE_HZ)
+
+/* Critical sections are a process wide recursive mutex */
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#define portENTER_CRITICAL(mux)         pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)          pthread_mutex_unlock(mux)
+
+#define portSET_INTERRUPT_MASK_FROM_ISR()       0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(state) ((void) (state))
+#define xPortGetCoreID()                        0
@@ -0,0 +1,18 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* task_snapshot.h of the host port, there are no task stacks to take */
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct {
+    void *pxTCB;
+    void *pxTopOfStack;
+    void *pxEndOfStack;
+} TaskSnapshot_t;
+
+UBaseType_t uxTaskGetSnapshotAll(TaskSnapshot_t *snapshots, UBaseType_t size, UBaseType_t *tcb_size);
@@ -0,0 +1,17 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Functions of newlib used by the components which glibc before 2.38 does not have.
+ * Included in every source from the Makefile, defined in port.c.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
@@ -0,0 +1,13 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* nvs_flash.h of the host port */
+#pragma once
+
+#include <nvs.h>
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
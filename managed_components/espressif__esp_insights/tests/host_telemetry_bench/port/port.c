@@ -0,0 +1,1011 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Host port of the parts of FreeRTOS and esp-idf used by Insights.
+ * Tasks are threads, timers run in a timer thread and the default event loop in an event thread,
+ * as they do on the device. Priorities and stack sizes are ignored.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/task_snapshot.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/timers.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_event.h>
+#include <esp_wifi.h>
+#include <esp_core_dump.h>
+#include <nvs_flash.h>
+#include <esp_crc.h>
+#include <esp_mac.h>
+#include <esp_system.h>
+#include <esp_random.h>
+#include <esp_app_desc.h>
+#include <esp_chip_info.h>
+#include <esp_diagnostics.h>
+#include <esp_rmaker_factory.h>
+#include "port.h"
+
+#define PORT_MAX_TASKS          16
+#define PORT_MAX_LOG_TAGS       8
+#define PORT_MAX_NVS_ENTRIES    32
+#define PORT_MAX_EVENT_HANDLERS 16
+#define PORT_EVENT_QUEUE_LEN    32
+
+/* Time */
+
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t s_start_ms;
+
+__attribute__((constructor)) static void port_start(void)
+{
+    s_start_ms = monotonic_ms();
+}
+
+uint64_t port_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Absolute CLOCK_REALTIME deadline for pthread timed waits */
+static struct timespec deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ns = ts.tv_nsec + (uint64_t)pdTICKS_TO_MS(ticks) * 1000000;
+    ts.tv_sec += ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    return ts;
+}
+
+/* Tasks */
+
+struct port_task {
+    pthread_t thread;
+    char name[CONFIG_FREERTOS_MAX_TASK_NAME_LEN];
+    TaskFunction_t fn;
+    void *param;
+    bool device;    /* counted in port_device_cpu_ns() */
+};
+
+static struct port_task *s_tasks[PORT_MAX_TASKS];
+static size_t s_task_cnt;
+static pthread_mutex_t s_task_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct port_task *s_self;
+
+static struct port_task *task_add(const char *name, bool device)
+{
+    struct port_task *task = calloc(1, sizeof(*task));
+    if (!task) {
+        return NULL;
+    }
+    strlcpy(task->name, name, sizeof(task->name));
+    task->device = device;
+    pthread_mutex_lock(&s_task_lock);
+    if (s_task_cnt == PORT_MAX_TASKS) {
+        pthread_mutex_unlock(&s_task_lock);
+        free(task);
+        return NULL;
+    }
+    s_tasks[s_task_cnt++] = task;
+    pthread_mutex_unlock(&s_task_lock);
+    return task;
+}
+
+static void task_remove(struct port_task *task)
+{
+    pthread_mutex_lock(&s_task_lock);
+    for (size_t i = 0; i < s_task_cnt; i++) {
+        if (s_tasks[i] == task) {
+            s_tasks[i] = s_tasks[--s_task_cnt];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_task_lock);
+    free(task);
+}
+
+static void *task_entry(void *arg)
+{
+    s_self = arg;
+    s_self->thread = pthread_self();
+    s_self->fn(s_self->param);
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+    struct port_task *task = task_add(name, true);
+    if (!task) {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->param = param;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, task_entry, task) != 0) {
+        task_remove(task);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if (handle && handle != s_self) {
+        /* Deleting other tasks is not used */
+        abort();
+    }
+    task_remove(s_self);
+    s_self = NULL;
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec = pdTICKS_TO_MS(ticks) / 1000,
+        .tv_nsec = (pdTICKS_TO_MS(ticks) % 1000) * 1000000,
+    };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return pdMS_TO_TICKS(monotonic_ms() - s_start_ms);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (!s_self) {
+        /* Thread not created by xTaskCreate(), give it a handle for the mutex holder and log batches */
+        static __thread struct port_task self = { .name = "thread" };
+        self.thread = pthread_self();
+        s_self = &self;
+    }
+    return s_self;
+}
+
+void port_thread_register(const char *name)
+{
+    s_self = task_add(name, true);
+    if (s_self) {
+        s_self->thread = pthread_self();
+    }
+}
+
+char *pcTaskGetName(TaskHandle_t handle)
+{
+    return handle ? handle->name : xTaskGetCurrentTaskHandle()->name;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    return s_task_cnt;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle)
+{
+    return 0;
+}
+
+eTaskState eTaskGetState(TaskHandle_t handle)
+{
+    return handle == s_self ? eRunning : eBlocked;
+}
+
+UBaseType_t uxTaskGetSnapshotAll(TaskSnapshot_t *snapshots, UBaseType_t size, UBaseType_t *tcb_size)
+{
+    return 0;
+}
+
+uint64_t port_device_cpu_ns(void)
+{
+    uint64_t total = 0;
+    pthread_mutex_lock(&s_task_lock);
+    for (size_t i = 0; i < s_task_cnt; i++) {
+        struct port_task *task = s_tasks[i];
+        clockid_t clock;
+        struct timespec ts;
+        if (!task->device || !task->thread || pthread_getcpuclockid(task->thread, &clock) != 0 ||
+                clock_gettime(clock, &ts) != 0) {
+            continue;
+        }
+        total += (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+    pthread_mutex_unlock(&s_task_lock);
+    return total;
+}
+
+/* Queues */
+
+struct port_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t item_size;
+    size_t length;
+    size_t head;
+    size_t count;
+    uint8_t items[];
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct port_queue *queue = calloc(1, sizeof(*queue) + length * item_size);
+    if (!queue) {
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    queue->item_size = item_size;
+    queue->length = length;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue);
+}
+
+/* Waits on cond while wait_full ? queue is full : queue is empty */
+static bool queue_wait(struct port_queue *queue, pthread_cond_t *cond, bool wait_full, TickType_t ticks)
+{
+    struct timespec ts = deadline(ticks);
+    while (wait_full ? queue->count == queue->length : queue->count == 0) {
+        if (ticks == 0) {
+            return false;
+        } else if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(cond, &queue->lock);
+        } else if (pthread_cond_timedwait(cond, &queue->lock, &ts) == ETIMEDOUT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (!queue_wait(queue, &queue->not_full, true, ticks)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    size_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (!queue_wait(queue, &queue->not_empty, false, ticks)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+/* Mutexes */
+
+struct port_mutex {
+    pthread_mutex_t lock;
+    TaskHandle_t holder;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    struct port_mutex *sem = calloc(1, sizeof(*sem));
+    if (sem) {
+        pthread_mutex_init(&sem->lock, NULL);
+    }
+    return sem;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    free(sem);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    int ret;
+    if (ticks == portMAX_DELAY) {
+        ret = pthread_mutex_lock(&sem->lock);
+    } else if (ticks == 0) {
+        ret = pthread_mutex_trylock(&sem->lock);
+    } else {
+        struct timespec ts = deadline(ticks);
+        ret = pthread_mutex_timedlock(&sem->lock, &ts);
+    }
+    if (ret != 0) {
+        return pdFALSE;
+    }
+    sem->holder = xTaskGetCurrentTaskHandle();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    sem->holder = NULL;
+    pthread_mutex_unlock(&sem->lock);
+    return pdTRUE;
+}
+
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t sem)
+{
+    return sem->holder;
+}
+
+/* Software timers, callbacks are called from the timer thread without holding s_timer_lock */
+
+struct port_timer {
+    struct port_timer *next;
+    TimerCallbackFunction_t cb;
+    void *id;
+    TickType_t period;
+    uint64_t expiry_ms;
+    bool auto_reload;
+    bool active;
+    bool deleted;
+};
+
+static struct port_timer *s_timers;
+static pthread_mutex_t s_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_timer_cond = PTHREAD_COND_INITIALIZER;
+static bool s_timer_task_started;
+
+static void timer_task(void *arg)
+{
+    pthread_mutex_lock(&s_timer_lock);
+    while (1) {
+        struct port_timer **pp = &s_timers, *next = NULL;
+        while (*pp) {
+            struct port_timer *t = *pp;
+            if (t->deleted) {
+                *pp = t->next;
+                free(t);
+                continue;
+            }
+            if (t->active && (!next || t->expiry_ms < next->expiry_ms)) {
+                next = t;
+            }
+            pp = &t->next;
+        }
+        uint64_t now = monotonic_ms();
+        if (!next) {
+            pthread_cond_wait(&s_timer_cond, &s_timer_lock);
+            continue;
+        }
+        if (next->expiry_ms > now) {
+            struct timespec ts = deadline(pdMS_TO_TICKS(next->expiry_ms - now));
+            pthread_cond_timedwait(&s_timer_cond, &s_timer_lock, &ts);
+            continue;
+        }
+        if (next->auto_reload) {
+            next->expiry_ms += pdTICKS_TO_MS(next->period);
+        } else {
+            next->active = false;
+        }
+        pthread_mutex_unlock(&s_timer_lock);
+        next->cb(next);
+        pthread_mutex_lock(&s_timer_lock);
+    }
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t cb)
+{
+    struct port_timer *timer = calloc(1, sizeof(*timer));
+    if (!timer) {
+        return NULL;
+    }
+    timer->cb = cb;
+    timer->id = id;
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    pthread_mutex_lock(&s_timer_lock);
+    if (!s_timer_task_started) {
+        s_timer_task_started = xTaskCreate(timer_task, "Tmr Svc", 2048, NULL, 1, NULL) == pdPASS;
+    }
+    timer->next = s_timers;
+    s_timers = timer;
+    pthread_mutex_unlock(&s_timer_lock);
+    return timer;
+}
+
+static BaseType_t timer_update(TimerHandle_t timer, bool active, TickType_t period, bool deleted)
+{
+    pthread_mutex_lock(&s_timer_lock);
+    if (period) {
+        timer->period = period;
+    }
+    timer->active = active;
+    timer->deleted = deleted;
+    timer->expiry_ms = monotonic_ms() + pdTICKS_TO_MS(timer->period);
+    pthread_cond_signal(&s_timer_cond);
+    pthread_mutex_unlock(&s_timer_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks)
+{
+    return timer_update(timer, true, 0, false);
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks)
+{
+    return timer_update(timer, true, 0, false);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks)
+{
+    return timer_update(timer, false, 0, false);
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks)
+{
+    return timer_update(timer, true, period, false);
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks)
+{
+    return timer_update(timer, false, 0, true);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    pthread_mutex_lock(&s_timer_lock);
+    bool active = timer->active;
+    pthread_mutex_unlock(&s_timer_lock);
+    return active ? pdTRUE : pdFALSE;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+/* Default event loop, data of the events is copied */
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    void *data;
+} event_t;
+
+static event_handler_t s_handlers[PORT_MAX_EVENT_HANDLERS];
+static size_t s_handler_cnt;
+static pthread_mutex_t s_handler_lock = PTHREAD_MUTEX_INITIALIZER;
+static QueueHandle_t s_event_queue;
+
+static void event_task(void *arg)
+{
+    event_t event;
+    while (xQueueReceive(s_event_queue, &event, portMAX_DELAY) == pdTRUE) {
+        if (!event.base) {
+            break;
+        }
+        event_handler_t handlers[PORT_MAX_EVENT_HANDLERS];
+        size_t cnt = 0;
+        pthread_mutex_lock(&s_handler_lock);
+        for (size_t i = 0; i < s_handler_cnt; i++) {
+            if (s_handlers[i].base == event.base &&
+                    (s_handlers[i].id == ESP_EVENT_ANY_ID || s_handlers[i].id == event.id)) {
+                handlers[cnt++] = s_handlers[i];
+            }
+        }
+        pthread_mutex_unlock(&s_handler_lock);
+        for (size_t i = 0; i < cnt; i++) {
+            handlers[i].handler(handlers[i].arg, event.base, event.id, event.data);
+        }
+        free(event.data);
+    }
+    vQueueDelete(s_event_queue);
+    s_event_queue = NULL;
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (s_event_queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_event_queue = xQueueCreate(PORT_EVENT_QUEUE_LEN, sizeof(event_t));
+    if (!s_event_queue) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(event_task, "sys_evt", 2304, NULL, 20, NULL) != pdPASS) {
+        vQueueDelete(s_event_queue);
+        s_event_queue = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/* Pending events are dispatched before the loop stops */
+esp_err_t esp_event_loop_delete_default(void)
+{
+    event_t stop = { 0 };
+    if (!s_event_queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xQueueSend(s_event_queue, &stop, portMAX_DELAY);
+    while (s_event_queue) {
+        vTaskDelay(1);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void *arg)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_handler_lock);
+    if (s_handler_cnt < PORT_MAX_EVENT_HANDLERS) {
+        s_handlers[s_handler_cnt++] = (event_handler_t) { base, id, handler, arg };
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_handler_lock);
+    return err;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t base, int32_t id, esp_event_handler_t handler)
+{
+    pthread_mutex_lock(&s_handler_lock);
+    for (size_t i = 0; i < s_handler_cnt; i++) {
+        if (s_handlers[i].base == base && s_handlers[i].id == id && s_handlers[i].handler == handler) {
+            s_handlers[i] = s_handlers[--s_handler_cnt];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_handler_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void *data, size_t size, TickType_t ticks)
+{
+    event_t event = { .base = base, .id = id };
+    if (!s_event_queue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (data && size) {
+        event.data = malloc(size);
+        if (!event.data) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(event.data, data, size);
+    }
+    if (xQueueSend(s_event_queue, &event, ticks) != pdTRUE) {
+        free(event.data);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+/* Logs: as with the wrapped esp_log_write() of the firmware, every log goes to the diagnostics
+ * log hook, console output is filtered by level.
+ */
+
+static struct {
+    const char *tag;
+    esp_log_level_t level;
+} s_log_levels[PORT_MAX_LOG_TAGS];
+static size_t s_log_level_cnt;
+static esp_log_level_t s_log_level = CONFIG_LOG_DEFAULT_LEVEL;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    if (strcmp(tag, "*") == 0) {
+        s_log_level = level;
+        return;
+    }
+    for (size_t i = 0; i < s_log_level_cnt; i++) {
+        if (strcmp(s_log_levels[i].tag, tag) == 0) {
+            s_log_levels[i].level = level;
+            return;
+        }
+    }
+    if (s_log_level_cnt < PORT_MAX_LOG_TAGS) {
+        s_log_levels[s_log_level_cnt].tag = tag;
+        s_log_levels[s_log_level_cnt++].level = level;
+    }
+}
+
+static esp_log_level_t log_level_get(const char *tag)
+{
+    for (size_t i = 0; i < s_log_level_cnt; i++) {
+        if (strcmp(s_log_levels[i].tag, tag) == 0) {
+            return s_log_levels[i].level;
+        }
+    }
+    return s_log_level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return monotonic_ms() - s_start_ms;
+}
+
+void esp_log_writev(esp_log_level_t level, const char *tag, const char *format, va_list args)
+{
+    va_list diag_args;
+    va_copy(diag_args, args);
+    esp_diag_log_write(level, tag, format, diag_args);
+    va_end(diag_args);
+    if (level <= log_level_get(tag)) {
+        vprintf(format, args);
+    }
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    esp_log_writev(level, tag, format, args);
+    va_end(args);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ERROR";
+}
+
+/* NVS, in memory */
+
+typedef struct {
+    char ns[16];
+    char key[16];
+    uint32_t value;
+} nvs_entry_t;
+
+static nvs_entry_t s_nvs[PORT_MAX_NVS_ENTRIES];
+static size_t s_nvs_cnt;
+static const char *s_nvs_ns[8];
+static size_t s_nvs_ns_cnt;
+static pthread_mutex_t s_nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t s_nvs_read_us;
+
+void port_nvs_read_us_set(uint32_t us)
+{
+    s_nvs_read_us = us;
+}
+
+/* Flash read of the device, on the CPU as the cache is disabled during it */
+static void nvs_read_wait(void)
+{
+    if (s_nvs_read_us) {
+        uint64_t end = port_time_us() + s_nvs_read_us;
+        while (port_time_us() < end);
+    }
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    pthread_mutex_lock(&s_nvs_lock);
+    s_nvs_cnt = 0;
+    pthread_mutex_unlock(&s_nvs_lock);
+    return ESP_OK;
+}
+
+/* Handle is the index of the namespace, namespaces are string literals */
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    esp_err_t err = ESP_OK;
+    size_t i;
+    nvs_read_wait();
+    pthread_mutex_lock(&s_nvs_lock);
+    for (i = 0; i < s_nvs_ns_cnt && strcmp(s_nvs_ns[i], name) != 0; i++);
+    if (i == s_nvs_ns_cnt) {
+        if (open_mode == NVS_READONLY) {
+            err = ESP_ERR_NVS_NOT_FOUND;
+        } else if (s_nvs_ns_cnt == sizeof(s_nvs_ns) / sizeof(s_nvs_ns[0])) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            s_nvs_ns[s_nvs_ns_cnt++] = name;
+        }
+    }
+    *out_handle = i;
+    pthread_mutex_unlock(&s_nvs_lock);
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+static nvs_entry_t *nvs_find(nvs_handle_t handle, const char *key, bool create)
+{
+    for (size_t i = 0; i < s_nvs_cnt; i++) {
+        if (strcmp(s_nvs[i].ns, s_nvs_ns[handle]) == 0 && strcmp(s_nvs[i].key, key) == 0) {
+            return &s_nvs[i];
+        }
+    }
+    if (!create || s_nvs_cnt == PORT_MAX_NVS_ENTRIES) {
+        return NULL;
+    }
+    nvs_entry_t *entry = &s_nvs[s_nvs_cnt++];
+    strlcpy(entry->ns, s_nvs_ns[handle], sizeof(entry->ns));
+    strlcpy(entry->key, key, sizeof(entry->key));
+    return entry;
+}
+
+static esp_err_t nvs_get(nvs_handle_t handle, const char *key, uint32_t *value)
+{
+    nvs_read_wait();
+    pthread_mutex_lock(&s_nvs_lock);
+    nvs_entry_t *entry = nvs_find(handle, key, false);
+    if (entry) {
+        *value = entry->value;
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return entry ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+static esp_err_t nvs_set(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    pthread_mutex_lock(&s_nvs_lock);
+    nvs_entry_t *entry = nvs_find(handle, key, true);
+    if (entry) {
+        entry->value = value;
+    }
+    pthread_mutex_unlock(&s_nvs_lock);
+    return entry ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    uint32_t value;
+    esp_err_t err = nvs_get(handle, key, &value);
+    if (err == ESP_OK) {
+        *out_value = value;
+    }
+    return err;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return nvs_set(handle, key, value);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    return nvs_get(handle, key, out_value);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return nvs_set(handle, key, value);
+}
+
+/* System */
+
+#if !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+uint32_t esp_random(void)
+{
+    return (uint32_t) random();
+}
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return ESP_RST_POWERON;
+}
+
+static const esp_app_desc_t s_app_desc = {
+    .version = "1.0",
+    .project_name = "telemetry_bench",
+    .idf_ver = "v5.1",
+    .app_elf_sha256 = {
+        0x5d, 0x1a, 0x0c, 0x43, 0x9e, 0x27, 0x81, 0xb6, 0x04, 0xf2, 0x6d, 0x3a, 0x18, 0xc7, 0x55, 0x90,
+        0x2b, 0xe4, 0x7f, 0x61, 0xa9, 0x0d, 0x33, 0xc8, 0x72, 0x1e, 0x96, 0x4b, 0xd0, 0x85, 0x2a, 0xf3,
+    },
+};
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    return &s_app_desc;
+}
+
+int esp_app_get_elf_sha256(char *dst, size_t size)
+{
+    size_t n;
+    for (n = 0; n + 1 < size && n / 2 < sizeof(s_app_desc.app_elf_sha256); n += 2) {
+        snprintf(dst + n, size - n, "%02x", s_app_desc.app_elf_sha256[n / 2]);
+    }
+    return n;
+}
+
+void esp_chip_info(esp_chip_info_t *out_info)
+{
+    *out_info = (esp_chip_info_t) { .model = CHIP_ESP32C3, .revision = 3, .cores = 1 };
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    const uint8_t sta_mac[6] = { 0x7c, 0xdf, 0xa1, 0x00, 0x00, 0x01 };
+    memcpy(mac, sta_mac, sizeof(sta_mac));
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    memset(ap_info, 0, sizeof(*ap_info));
+    ap_info->rssi = -50;
+    return ESP_OK;
+}
+
+esp_err_t esp_core_dump_image_erase(void)
+{
+    return ESP_OK;
+}
+
+/* Factory partition, the loopback transports do not use the credentials */
+
+esp_err_t esp_rmaker_factory_init(void)
+{
+    return ESP_OK;
+}
+
+void *esp_rmaker_factory_get(const char *key)
+{
+    if (strcmp(key, "node_id") == 0) {
+        return strdup("telemetrybench01");
+    } else if (strcmp(key, "mqtt_host") == 0) {
+        return strdup("127.0.0.1");
+    } else if (strcmp(key, "client_cert") == 0 || strcmp(key, "client_key") == 0) {
+        return strdup("-----BEGIN-----\n-----END-----\n");
+    }
+    return NULL;
+}
+
+const char mqtt_server_crt[] asm("_binary_mqtt_server_crt_start") = "-----BEGIN CERTIFICATE-----\n";
+const char https_server_crt[] asm("_binary_https_server_crt_start") = "-----BEGIN CERTIFICATE-----\n";
+const char https_server_crt_end[] asm("_binary_https_server_crt_end") = "";
+
+/* Heap accounting, glibc only. Live bytes are counted with malloc_usable_size() */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static atomic_size_t s_heap_used;
+static atomic_size_t s_heap_peak;
+
+static void heap_add(void *ptr)
+{
+    if (ptr) {
+        size_t used = atomic_fetch_add(&s_heap_used, malloc_usable_size(ptr)) + malloc_usable_size(ptr);
+        size_t peak = atomic_load(&s_heap_peak);
+        while (used > peak && !atomic_compare_exchange_weak(&s_heap_peak, &peak, used));
+    }
+}
+
+static void heap_sub(void *ptr)
+{
+    if (ptr) {
+        atomic_fetch_sub(&s_heap_used, malloc_usable_size(ptr));
+    }
+}
+
+void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *ptr = __libc_calloc(n, size);
+    heap_add(ptr);
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    heap_sub(ptr);
+    void *new_ptr = __libc_realloc(ptr, size);
+    heap_add(new_ptr ? new_ptr : (size ? ptr : NULL));
+    return new_ptr;
+}
+
+void free(void *ptr)
+{
+    heap_sub(ptr);
+    __libc_free(ptr);
+}
+
+size_t port_heap_used(void)
+{
+    return atomic_load(&s_heap_used);
+}
+
+size_t port_heap_peak(void)
+{
+    return atomic_load(&s_heap_peak);
+}
+
+void port_heap_peak_reset(void)
+{
+    atomic_store(&s_heap_peak, atomic_load(&s_heap_used));
+}
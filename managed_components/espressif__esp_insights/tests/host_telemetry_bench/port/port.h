@@ -0,0 +1,30 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Measurements of the host port, used by the benchmark */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Microseconds of realtime clock, same clock as esp_diag_timestamp_get() */
+uint64_t port_time_us(void);
+
+/* CPU time in ns of the tasks created with xTaskCreate() and of the threads registered with
+ * port_thread_register(), i.e. of everything which would run on the device
+ */
+uint64_t port_device_cpu_ns(void);
+
+/* Counts the CPU time of the calling thread in port_device_cpu_ns() */
+void port_thread_register(const char *name);
+
+/* Cost of the NVS flash reads of the device: nvs_open() and every nvs_get_*() busy wait this long */
+void port_nvs_read_us_set(uint32_t us);
+
+/* Heap in use and its high-water mark, in bytes */
+size_t port_heap_used(void);
+size_t port_heap_peak(void);
+void port_heap_peak_reset(void);
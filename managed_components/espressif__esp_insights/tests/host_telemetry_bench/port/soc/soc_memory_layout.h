@@ -0,0 +1,16 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* soc_memory_layout.h of the host port */
+#pragma once
+
+#include <stdbool.h>
+
+/* String literals of the host build are in .rodata */
+static inline bool esp_ptr_in_drom(const void *p)
+{
+    return p != NULL;
+}
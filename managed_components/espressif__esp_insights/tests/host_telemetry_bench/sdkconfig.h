@@ -0,0 +1,56 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Configuration of the host build, defaults of the components unless noted.
+ * Options set from the Makefile are not defined here.
+ */
+#pragma once
+
+#define CONFIG_ESP_INSIGHTS_ENABLED                     1
+#define CONFIG_ESP_INSIGHTS_STREAM_CHUNK_SIZE           256
+#define CONFIG_ESP_INSIGHTS_DATA_MSG_WINDOW             4
+#define CONFIG_ESP_INSIGHTS_MSG_MAX_SIZE                2048
+#define CONFIG_ESP_INSIGHTS_META_VERSION_10             1
+#define CONFIG_ESP_INSIGHTS_CBOR_FAST_PATH              1
+#define CONFIG_ESP_INSIGHTS_TRANSPORT_HTTPS_HOST        "http://127.0.0.1"
+#define CONFIG_ESP_INSIGHTS_COMPRESSION_WINDOW_BITS     9
+#define CONFIG_ESP_INSIGHTS_COMPRESSION_LOOKAHEAD_BITS  4
+/* Seconds, the benchmark runs for a minute or so */
+#ifndef CONFIG_ESP_INSIGHTS_CLOUD_POST_MIN_INTERVAL_SEC
+#define CONFIG_ESP_INSIGHTS_CLOUD_POST_MIN_INTERVAL_SEC 1
+#endif
+#ifndef CONFIG_ESP_INSIGHTS_CLOUD_POST_MAX_INTERVAL_SEC
+#define CONFIG_ESP_INSIGHTS_CLOUD_POST_MAX_INTERVAL_SEC 4
+#endif
+#define CONFIG_ESP_INSIGHTS_ADAPTIVE_TARGET_FILL_PERCENT 50
+#define CONFIG_ESP_INSIGHTS_ADAPTIVE_BATCH_PERCENT      50
+
+#define CONFIG_DIAG_LOG_MSG_ARG_FORMAT_TLV              1
+#define CONFIG_DIAG_LOG_DROP_WIFI_LOGS                  1
+#define CONFIG_DIAG_LOG_MSG_ARG_MAX_SIZE                64
+#define CONFIG_DIAG_LOG_COMPACT_RECORDS                 1
+#define CONFIG_DIAG_LOG_STR_TABLE_SIZE                  32
+#define CONFIG_DIAG_LOG_BATCH_MAX_COUNT                 4
+#define CONFIG_DIAG_ENABLE_METRICS                      1
+#define CONFIG_DIAG_METRICS_MAX_COUNT                   20
+#define CONFIG_DIAG_METRICS_BATCH_MAX_COUNT             6
+#define CONFIG_DIAG_ENABLE_VARIABLES                    1
+#define CONFIG_DIAG_VARIABLES_MAX_COUNT                 20
+/* Log hook is called directly, the host build does not wrap esp_log_write() */
+#define CONFIG_DIAG_USE_EXTERNAL_LOG_WRAP               1
+
+#define CONFIG_DIAG_DATA_STORE_RTC                      1
+#define CONFIG_DIAG_DATA_STORE_REPORTING_WATERMARK_PERCENT 80
+#define CONFIG_RTC_STORE_DATA_SIZE                      6144
+#define CONFIG_RTC_STORE_CRITICAL_DATA_SIZE             4096
+
+#define CONFIG_ESP_RMAKER_WORK_QUEUE_TASK_STACK         4096
+#define CONFIG_ESP_RMAKER_WORK_QUEUE_TASK_PRIORITY      5
+#define CONFIG_FREERTOS_MAX_TASK_NAME_LEN               16
+#define CONFIG_FREERTOS_UNICORE                         1
+/* Skips the Xtensa backtrace of the task snapshot */
+#define CONFIG_IDF_TARGET_ARCH_RISCV                    1
+#define CONFIG_LOG_DEFAULT_LEVEL                        3
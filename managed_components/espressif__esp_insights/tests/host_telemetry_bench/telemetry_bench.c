@@ -0,0 +1,332 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* End to end benchmark of the Insights pipeline on the host.
+ *
+ * Logs, events, metrics and variables are reported at a fixed rate and go through the log hook,
+ * the data store, the periodic handler, the encoder and the transport to the loopback broker or
+ * sink, which decodes every data message and measures the latency of every record from the
+ * timestamp recorded on the device.
+ *
+ * Usage: telemetry_bench [duration_sec] [reports_per_sec]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_event.h>
+#include <esp_insights.h>
+#include <esp_diagnostics.h>
+#include <esp_diagnostics_metrics.h>
+#include <esp_diagnostics_variables.h>
+#include <cbor.h>
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+#include <heatshrink_decoder.h>
+#include "esp_insights_compress.h"
+#endif
+#include "port.h"
+#include "loopback.h"
+
+#define DEFAULT_DURATION_SEC    30
+#define DEFAULT_REPORTS_PER_SEC 50
+#define LATENCY_SAMPLES_MAX     (1 << 20)
+#define MSG_TLV_HDR_SIZE        3
+#define MSG_TYPE_DATA           0x02
+#define MSG_BUF_SIZE            (UINT16_MAX + 1024)
+#define CBOR_TAG_TA_UINT32_LE   70
+/* Data messages sent by the last report need a period or two to arrive */
+#define DRAIN_SEC               (CONFIG_ESP_INSIGHTS_CLOUD_POST_MAX_INTERVAL_SEC * 2 + 1)
+
+static const char *TAG = "bench";
+
+/* Written only from the thread of the broker or the sink */
+static struct {
+    uint32_t msgs;
+    uint32_t data_msgs;
+    uint32_t bad_msgs;
+    uint64_t payload_bytes;
+    uint64_t wire_bytes;
+    uint32_t latency_us[LATENCY_SAMPLES_MAX];
+    size_t latency_cnt;
+    uint8_t msg[MSG_BUF_SIZE];
+    uint32_t offsets[MSG_BUF_SIZE / sizeof(uint32_t)];
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+    heatshrink_decoder *hsd;
+#endif
+} s_sink;
+
+static void latency_add(uint64_t ts, uint64_t recv_us)
+{
+    if (s_sink.latency_cnt < LATENCY_SAMPLES_MAX) {
+        s_sink.latency_us[s_sink.latency_cnt++] = recv_us > ts ? recv_us - ts : 0;
+    }
+}
+
+/* Adds the samples of the "t" typed array, offsets from "t0" */
+static CborError latency_add_offsets(CborValue *it, uint64_t t0, uint64_t recv_us)
+{
+    CborTag tag;
+    size_t len = sizeof(s_sink.offsets);
+    if (cbor_value_get_tag(it, &tag) != CborNoError || tag != CBOR_TAG_TA_UINT32_LE) {
+        return CborErrorIllegalType;
+    }
+    cbor_value_advance_fixed(it);
+    if (!cbor_value_is_byte_string(it) ||
+            cbor_value_copy_byte_string(it, (uint8_t *) s_sink.offsets, &len, it) != CborNoError) {
+        return CborErrorIllegalType;
+    }
+    for (size_t i = 0; i < len / sizeof(uint32_t); i++) {
+        latency_add(t0 + s_sink.offsets[i], recv_us);
+    }
+    return CborNoError;
+}
+
+/* Records are the maps in arrays, i.e. the log entries and the metrics and variables data points.
+ * Their "ts" or "t" is the time of the record on the device.
+ */
+static CborError walk(CborValue *it, bool record, uint64_t recv_us)
+{
+    CborError err = CborNoError;
+    if (cbor_value_is_tag(it)) {
+        cbor_value_advance_fixed(it);
+    }
+    if (!cbor_value_is_container(it)) {
+        return cbor_value_advance(it);
+    }
+    bool is_map = cbor_value_is_map(it);
+    uint64_t t0 = 0;
+    CborValue inner;
+    if ((err = cbor_value_enter_container(it, &inner)) != CborNoError) {
+        return err;
+    }
+    while (!cbor_value_at_end(&inner) && err == CborNoError) {
+        if (!is_map) {
+            err = walk(&inner, true, recv_us);
+            continue;
+        }
+        bool ts = false, t = false, is_t0 = false;
+        if (cbor_value_is_text_string(&inner)) {
+            bool boot = false;
+            cbor_value_text_string_equals(&inner, "ts", &ts);
+            cbor_value_text_string_equals(&inner, "t", &t);
+            cbor_value_text_string_equals(&inner, "t0", &is_t0);
+            cbor_value_text_string_equals(&inner, "boot", &boot);
+            if (boot) {
+                /* boot time is not a record */
+                cbor_value_advance(&inner);
+                err = cbor_value_advance(&inner);
+                continue;
+            }
+        }
+        if ((err = cbor_value_advance(&inner)) != CborNoError) {
+            break;
+        }
+        uint64_t val;
+        if (record && (ts || t || is_t0) && cbor_value_is_unsigned_integer(&inner)) {
+            cbor_value_get_uint64(&inner, &val);
+            if (is_t0) {
+                t0 = val;
+            } else {
+                latency_add(val, recv_us);
+            }
+            err = cbor_value_advance_fixed(&inner);
+        } else if (record && t && cbor_value_is_tag(&inner)) {
+            err = latency_add_offsets(&inner, t0, recv_us);
+        } else {
+            err = walk(&inner, false, recv_us);
+        }
+    }
+    return err == CborNoError ? cbor_value_leave_container(it, &inner) : err;
+}
+
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+static size_t msg_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_size)
+{
+    size_t sunk = ESP_INSIGHTS_COMPRESS_HDR_SIZE, out_len = 0, cnt;
+    heatshrink_decoder_reset(s_sink.hsd);
+    while (sunk < in_len) {
+        heatshrink_decoder_sink(s_sink.hsd, (uint8_t *) in + sunk, in_len - sunk, &cnt);
+        sunk += cnt;
+        HSD_poll_res res;
+        do {
+            res = heatshrink_decoder_poll(s_sink.hsd, out + out_len, out_size - out_len, &cnt);
+            out_len += cnt;
+        } while (res == HSDR_POLL_MORE && out_len < out_size);
+    }
+    heatshrink_decoder_finish(s_sink.hsd);
+    return out_len;
+}
+#endif
+
+static void msg_recv(const uint8_t *payload, size_t len, size_t wire_len, uint64_t recv_us)
+{
+    s_sink.msgs++;
+    s_sink.payload_bytes += len;
+    s_sink.wire_bytes += wire_len;
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+    if (len >= ESP_INSIGHTS_COMPRESS_HDR_SIZE && payload[0] == ESP_INSIGHTS_COMPRESS_MARKER) {
+        len = msg_decompress(payload, len, s_sink.msg, sizeof(s_sink.msg));
+        payload = s_sink.msg;
+    }
+#endif
+    if (len < MSG_TLV_HDR_SIZE || payload[0] != MSG_TYPE_DATA) {
+        return;
+    }
+    s_sink.data_msgs++;
+    CborParser parser;
+    CborValue it;
+    if (cbor_parser_init(payload + MSG_TLV_HDR_SIZE, len - MSG_TLV_HDR_SIZE, 0, &parser, &it) != CborNoError ||
+            walk(&it, false, recv_us) != CborNoError) {
+        s_sink.bad_msgs++;
+    }
+}
+
+static void metrics_register(void)
+{
+    esp_diag_metrics_register(TAG, "rssi", "Wi-Fi RSSI", "bench.wifi", ESP_DIAG_DATA_TYPE_INT);
+    esp_diag_metrics_register(TAG, "heap", "Free heap", "bench.heap", ESP_DIAG_DATA_TYPE_UINT);
+    esp_diag_metrics_register(TAG, "temp", "Temperature", "bench.sensor", ESP_DIAG_DATA_TYPE_FLOAT);
+    esp_diag_variable_register(TAG, "state", "State", "bench.app", ESP_DIAG_DATA_TYPE_UINT);
+    esp_diag_variable_register(TAG, "conn", "Connected", "bench.app", ESP_DIAG_DATA_TYPE_BOOL);
+}
+
+/* Mix of a device which reports a few metrics often and logs now and then.
+ * Metadata 1.0 is the default (CONFIG_ESP_INSIGHTS_META_VERSION_10), hence the _add_ APIs.
+ *
+ * Returns the count of records reported.
+ */
+static uint32_t record_report(uint32_t i)
+{
+    switch (i % 10) {
+    case 0:
+        ESP_LOGE(TAG, "Sensor read failed, err %d on channel %u", -(int)(i % 7), (unsigned)(i % 4));
+        return 1;
+    case 3:
+    case 7:
+        ESP_LOGW(TAG, "Retrying request %" PRIu32 ", backoff %u ms", i, (unsigned)(i % 5) * 100);
+        return 1;
+    case 5:
+        ESP_DIAG_EVENT(TAG, "Button pressed %" PRIu32 " times", i / 10);
+        return 1;
+    case 9:
+        esp_diag_variable_add_uint("state", i % 3);
+        esp_diag_variable_add_bool("conn", (i / 10) % 2);
+        return 2;
+    default:
+        esp_diag_metrics_add_int("rssi", -40 - (int)(i % 30));
+        esp_diag_metrics_add_uint("heap", 120000 - (i % 1000) * 8);
+        esp_diag_metrics_add_float("temp", 21.5f + (float)(i % 10) / 10);
+        return 3;
+    }
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t duration_sec = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_DURATION_SEC;
+    uint32_t rate = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_REPORTS_PER_SEC;
+    if (duration_sec == 0 || rate == 0 || rate > 1000) {
+        printf("Usage: %s [duration_sec] [reports_per_sec (1-1000)]\n", argv[0]);
+        return 1;
+    }
+
+    port_thread_register("main");
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+    s_sink.hsd = heatshrink_decoder_alloc(256, ESP_INSIGHTS_COMPRESS_WINDOW_BITS, ESP_INSIGHTS_COMPRESS_LOOKAHEAD_BITS);
+#endif
+    if (esp_event_loop_create_default() != ESP_OK || loopback_start(msg_recv) != ESP_OK) {
+        printf("Failed to start the event loop or the loopback\n");
+        return 1;
+    }
+    /* Logs of the benchmark are reported, but not printed */
+    esp_log_level_set(TAG, ESP_LOG_NONE);
+
+    size_t heap_base = port_heap_used();
+    port_heap_peak_reset();
+
+    esp_insights_config_t config = {
+        .log_type = ESP_DIAG_LOG_TYPE_ERROR | ESP_DIAG_LOG_TYPE_WARNING | ESP_DIAG_LOG_TYPE_EVENT,
+        .auth_key = "bench",
+    };
+    esp_err_t err = esp_insights_init(&config);
+    if (err != ESP_OK) {
+        printf("esp_insights_init failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    metrics_register();
+    /* connection and the first messages (boot info, metadata) are not a part of the measurement */
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_ESP_INSIGHTS_CLOUD_POST_MAX_INTERVAL_SEC * 1000));
+
+    uint32_t msgs_base = s_sink.msgs;
+    uint64_t payload_base = s_sink.payload_bytes, wire_base = s_sink.wire_bytes;
+    uint64_t cpu_base = port_device_cpu_ns();
+    uint64_t start = port_time_us();
+    s_sink.latency_cnt = 0;
+
+    uint32_t reports = duration_sec * rate, records = 0;
+    for (uint32_t i = 0; i < reports; i++) {
+        records += record_report(i);
+        uint64_t next = start + (uint64_t)(i + 1) * 1000000 / rate;
+        uint64_t now = port_time_us();
+        if (next > now) {
+            usleep(next - now);
+        }
+    }
+    vTaskDelay(pdMS_TO_TICKS(DRAIN_SEC * 1000));
+
+    uint64_t elapsed_us = port_time_us() - start;
+    uint64_t cpu_ns = port_device_cpu_ns() - cpu_base;
+    size_t heap_peak = port_heap_peak() - heap_base;
+    uint32_t msgs = s_sink.msgs - msgs_base;
+    uint64_t payload = s_sink.payload_bytes - payload_base, wire = s_sink.wire_bytes - wire_base;
+    size_t cnt = s_sink.latency_cnt;
+    qsort(s_sink.latency_us, cnt, sizeof(s_sink.latency_us[0]), cmp_u32);
+
+    printf("transport %s, compression %s, typed arrays %s\n",
+#if CONFIG_ESP_INSIGHTS_TRANSPORT_MQTT
+           "mqtt",
+#else
+           "https",
+#endif
+#if CONFIG_ESP_INSIGHTS_COMPRESSION
+           "on",
+#else
+           "off",
+#endif
+#if CONFIG_ESP_INSIGHTS_METRICS_TYPED_ARRAYS
+           "on"
+#else
+           "off"
+#endif
+          );
+    printf("%" PRIu32 " s at %" PRIu32 " reports/s, %" PRIu32 " messages (%" PRIu32 " not decoded)\n",
+           duration_sec, rate, msgs, s_sink.bad_msgs);
+    printf("records           %" PRIu32 " reported, %zu received\n", records, cnt);
+    printf("payload           %.1f bytes/s\n", payload * 1e6 / elapsed_us);
+    printf("on the wire       %.1f bytes/s\n", wire * 1e6 / elapsed_us);
+    printf("device CPU        %.1f ns/byte of payload, %.2f %% of one core\n",
+           payload ? (double) cpu_ns / payload : 0, cpu_ns / 10.0 / elapsed_us);
+    printf("heap high-water   %zu bytes (+ %d bytes of RTC store)\n", heap_peak, CONFIG_RTC_STORE_DATA_SIZE);
+    if (cnt) {
+        printf("latency           p50 %.3f s, p99 %.3f s, max %.3f s\n",
+               s_sink.latency_us[cnt / 2] / 1e6, s_sink.latency_us[cnt * 99 / 100] / 1e6,
+               s_sink.latency_us[cnt - 1] / 1e6);
+    }
+
+    esp_insights_deinit();
+    return (cnt && s_sink.bad_msgs == 0) ? 0 : 1;
+}